@@ -198,7 +198,7 @@ void sbbs_t::ansi_getlines()
 	if(sys_status&SS_USERON && useron.misc&ANSI && !useron.rows /* Auto-detect rows */
 		&& online==ON_REMOTE) {									/* Remote */
 		SYNC;
-		putcom("\x1b[s\x1b[255B\x1b[255C\x1b[6n\x1b[u");
+		putcom_iac("\x1b[s\x1b[255B\x1b[255C\x1b[6n\x1b[u");
 		inkey(K_ANSI_CPR,TIMEOUT_ANSI_GETXY*1000); 
 	}
 }
@@ -210,7 +210,7 @@ bool sbbs_t::ansi_getxy(int* x, int* y)
     *x=0;
     *y=0;
 
-	putcom("\x1b[6n");	/* Request cusor position */
+	putcom_iac("\x1b[6n");	/* Request cusor position */
 
     time_t start=time(NULL);
     sys_status&=~SS_ABORT;
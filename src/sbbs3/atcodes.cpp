@@ -53,6 +53,7 @@ int sbbs_t::show_atcode(const char *instr)
 	char	str[128],str2[128],*tp,*sp,*p;
     int     len;
 	int		disp_len;
+	int		batch;
 	bool	padded_left=false;
 	bool	padded_right=false;
 	const char *cp;
@@ -79,7 +80,10 @@ int sbbs_t::show_atcode(const char *instr)
 		*p=0;
 	}
 
+	/* @-codes may run modules or external programs, which write to outbuf */
+	batch=outcom_suspend();
 	cp=atcode(sp,str2,sizeof(str2));
+	outcom_resume(batch);
 	if(cp==NULL)
 		return(0);
 
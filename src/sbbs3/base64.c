@@ -43,123 +43,233 @@
 static const char * base64alphabet = 
  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/=";
 
-int b64_decode(char *target, size_t tlen, const char *source, size_t slen)
+/* Reverse look-up table: 6-bit value of each base64 alphabet character */
+#define XX	0xff	/* Invalid */
+#define PD	0xfe	/* Pad ('=') */
+#define SP	0xfd	/* White-space (e.g. MIME line breaks) */
+
+static const uchar base64values[256] = {
+	XX,XX,XX,XX,XX,XX,XX,XX,XX,SP,SP,XX,XX,SP,XX,XX,
+	XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,
+	SP,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,62,XX,XX,XX,63,
+	52,53,54,55,56,57,58,59,60,61,XX,XX,XX,PD,XX,XX,
+	XX, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9,10,11,12,13,14,
+	15,16,17,18,19,20,21,22,23,24,25,XX,XX,XX,XX,XX,
+	XX,26,27,28,29,30,31,32,33,34,35,36,37,38,39,40,
+	41,42,43,44,45,46,47,48,49,50,51,XX,XX,XX,XX,XX,
+	XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,
+	XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,
+	XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,
+	XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,
+	XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,
+	XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,
+	XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,
+	XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,XX,
+};
+
+void b64_init(b64_state_t* st)
 {
-	const char	*inp;
-	char	*outp;
-	char	*outend;
-	const char	*inend;
-	int		bits=0;
-	int		working=0;
-	char *	i;
+	st->working=0;
+	st->bits=0;
+	st->pad=0;
+}
 
-	if(slen==0)
-		slen=strlen(source);
-	outp=target;
-	inp=source;
-	outend=target+tlen;
-	inend=source+slen;
-	for(;outp<outend && inp<inend;inp++) {
-		working<<=6;
-		i=strchr(base64alphabet,(char)*inp);
-		if(i==NULL) {
-			return(-1);
+/****************************************************************************/
+/* Decoding																	*/
+/****************************************************************************/
+
+/* When strict, white-space is invalid (rather than ignored) */
+static int decode(b64_state_t* st, char *target, size_t tlen, const char *source, size_t slen, int strict)
+{
+	const uchar	*inp=(const uchar*)source;
+	const uchar	*inend=inp+slen;
+	uchar	*outp=(uchar*)target;
+	uchar	*outend=outp+tlen;
+	unsigned a,b,c,d;
+
+	while(inp<inend && !st->pad) {
+		/* Whole quanta: 4 characters in, 3 bytes out */
+		if(st->bits==0) {
+			while(inend-inp>=4 && outend-outp>=3) {
+				a=base64values[inp[0]];
+				b=base64values[inp[1]];
+				c=base64values[inp[2]];
+				d=base64values[inp[3]];
+				if((a|b|c|d)&0x80)	/* pad, white-space or invalid */
+					break;
+				a=(a<<18)|(b<<12)|(c<<6)|d;
+				outp[0]=(uchar)(a>>16);
+				outp[1]=(uchar)(a>>8);
+				outp[2]=(uchar)a;
+				st->working=d;
+				inp+=4;
+				outp+=3;
+			}
+			if(inp>=inend)
+				break;
 		}
-		if(*i=='=')  { /* pad char */
-			if((working&0xFF) != 0)
+		/* One character at a time */
+		a=base64values[*(inp++)];
+		if(a==PD) {
+			if(((st->working<<6)&0xff) != 0)
 				return(-1);
+			st->pad=1;
 			break;
 		}
-		bits+=6;
-		working |= (i-base64alphabet);
-		if(bits>=8) {
-			*(outp++)=(char)((working&(0xFF<<(bits-8)))>>(bits-8));
-			bits-=8;
+		if(a==SP && !strict)
+			continue;
+		if(a&0x80)
+			return(-1);
+		st->working=(st->working<<6)|a;
+		st->bits+=6;
+		if(st->bits>=8) {
+			if(outp>=outend)
+				return(-1);
+			st->bits-=8;
+			*(outp++)=(uchar)(st->working>>st->bits);
 		}
 	}
-	if(outp == outend)  {
-		*(--outp)=0;
+	return(outp-(uchar*)target);
+}
+
+/* Decodes source, ignoring white-space and anything following a pad char	*/
+/* Encoded quanta may be split across calls (e.g. MIME-encoded lines)		*/
+/* target must hold at least B64_DECODED_MAXLEN(slen) bytes					*/
+/* Returns number of bytes decoded (not NUL-terminated) or -1 on error		*/
+int b64_decode_update(b64_state_t* st, char *target, size_t tlen, const char *source, size_t slen)
+{
+	return(decode(st,target,tlen,source,slen,/* strict: */0));
+}
+
+/* Returns 0 if the decoded input was complete, or -1 if it was truncated */
+int b64_decode_final(b64_state_t* st)
+{
+	if(!st->pad && st->bits>=6)	/* a lone 6 bits can't make a byte */
+		return(-1);
+	return(0);
+}
+
+int b64_decode(char *target, size_t tlen, const char *source, size_t slen)
+{
+	int			len;
+	b64_state_t	st;
+
+	if(tlen<1)
+		return(-1);
+	if(slen==0)
+		slen=strlen(source);
+	b64_init(&st);
+	/* Leave room for the NUL terminator */
+	if((len=decode(&st,target,tlen-1,source,slen,/* strict: */1))<0) {
+		target[tlen-1]=0;
 		return(-1);
 	}
-	*outp=0;
-	return(outp-target);
+	target[len]=0;
+	return(len);
 }
 
-static int add_char(char *pos, char ch, int done, char *end)
+/****************************************************************************/
+/* Encoding																	*/
+/****************************************************************************/
+
+static char* encode_quanta(char* outp, const uchar* inp, size_t quanta)
 {
-	if(pos>=end)  {
-		return(1);
+	while(quanta--) {
+		outp[0]=base64alphabet[inp[0]>>2];
+		outp[1]=base64alphabet[((inp[0]&0x03)<<4)|(inp[1]>>4)];
+		outp[2]=base64alphabet[((inp[1]&0x0f)<<2)|(inp[2]>>6)];
+		outp[3]=base64alphabet[inp[2]&0x3f];
+		inp+=3;
+		outp+=4;
 	}
-	if(done)
-		*pos=base64alphabet[64];
-	else
-		*pos=base64alphabet[(int)ch];
-	return(0);
+	return(outp);
+}
+
+/* Encodes source, holding up to 2 bytes (an incomplete quantum) for the	*/
+/* next call (or b64_encode_final)											*/
+/* Returns number of chars encoded (not NUL-terminated) or -1 if tlen is	*/
+/* insufficient (less than B64_ENCODED_LEN(slen))								*/
+int b64_encode_update(b64_state_t* st, char *target, size_t tlen, const char *source, size_t slen)
+{
+	const uchar	*inp=(const uchar*)source;
+	const uchar	*inend=inp+slen;
+	char		*outp=target;
+	uchar		quantum[3];
+	size_t		quanta;
+
+	if((st->bits/8+slen)/3*4 > tlen)
+		return(-1);
+
+	/* Complete a quantum held from the previous call */
+	while(st->bits && inp<inend) {
+		st->working=(st->working<<8)|*(inp++);
+		st->bits+=8;
+		if(st->bits==24) {
+			quantum[0]=(uchar)(st->working>>16);
+			quantum[1]=(uchar)(st->working>>8);
+			quantum[2]=(uchar)st->working;
+			outp=encode_quanta(outp,quantum,1);
+			st->working=0;
+			st->bits=0;
+		}
+	}
+
+	quanta=(inend-inp)/3;
+	outp=encode_quanta(outp,inp,quanta);
+	inp+=quanta*3;
+
+	/* Hold the remainder */
+	while(inp<inend) {
+		st->working=(st->working<<8)|*(inp++);
+		st->bits+=8;
+	}
+	return(outp-target);
+}
+
+/* Encodes (and pads) any incomplete quantum: writes 0 or 4 chars */
+int b64_encode_final(b64_state_t* st, char *target, size_t tlen)
+{
+	uchar	quantum[3]={0,0,0};
+
+	if(st->bits==0)
+		return(0);
+	if(tlen<4)
+		return(-1);
+	quantum[0]=(uchar)(st->working>>(st->bits-8));
+	if(st->bits==16)
+		quantum[1]=(uchar)st->working;
+	encode_quanta(target,quantum,1);
+	target[3]=base64alphabet[64];
+	if(st->bits==8)
+		target[2]=base64alphabet[64];
+	b64_init(st);
+	return(4);
 }
 
 int b64_encode(char *target, size_t tlen, const char *source, size_t slen)  {
-	const char	*inp;
-	char	*outp;
-	char	*outend;
-	const char	*inend;
-	char	*tmpbuf=NULL;
-	int		done=0;
-	char	enc;
-	int		buf;
-	
+	char*		tmpbuf=NULL;
+	int			len;
+	b64_state_t	st;
+
 	if(slen==0)
 		slen=strlen(source);
-	inp=source;
+	if(B64_ENCODED_LEN(slen) > tlen)
+		return(-1);
 	if(source==target)  {
-		tmpbuf=(char *)malloc(tlen);
-		if(tmpbuf==NULL)
+		if((tmpbuf=(char *)malloc(slen))==NULL)
 			return(-1);
-		outp=tmpbuf;
-	}
-	else
-		outp=target;
-
-	outend=outp+tlen;
-	inend=inp+slen;
-	for(;(inp < inend) && !done;)  {
-		enc=*(inp++);
-		buf=(enc & 0x03)<<4;
-		enc=(enc&0xFC)>>2;
-		if(add_char(outp++, enc, done, outend)) {
-			FREE_AND_NULL(tmpbuf);
-			return(-1);
-		}
-		enc=buf|((*inp & 0xF0) >> 4);
-		if(add_char(outp++, enc, done, outend)) {
-			FREE_AND_NULL(tmpbuf);
-			return(-1);
-		}
-		if(inp==inend)
-			done=1;
-		buf=(*(inp++)<<2)&0x3C;
-		enc=buf|((*inp & 0xC0)>>6);
-		if(add_char(outp++, enc, done, outend)) {
-			FREE_AND_NULL(tmpbuf);
-			return(-1);
-		}
-		if(inp==inend)
-			done=1;
-		enc=((int)*(inp++))&0x3F;
-		if(add_char(outp++, enc, done, outend)) {
-			FREE_AND_NULL(tmpbuf);
-			return(-1);
-		}
-		if(inp==inend)
-			done=1;
-	}
-	if(outp<outend)
-		*outp=0;
-	if(target==source) {
-		memcpy(target,tmpbuf,tlen);
-		free(tmpbuf);
+		memcpy(tmpbuf,source,slen);
+		source=tmpbuf;
 	}
 
-	return(outp-target);
+	b64_init(&st);
+	len=b64_encode_update(&st,target,tlen,source,slen);
+	len+=b64_encode_final(&st,target+len,tlen-len);
+	if((size_t)len<tlen)
+		target[len]=0;
+	FREE_AND_NULL(tmpbuf);
+
+	return(len);
 }
 
 #ifdef BASE64_TEST
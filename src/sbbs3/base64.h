@@ -35,6 +35,21 @@
  * Note: If this box doesn't appear square, then you need to fix your tabs.	*
  ****************************************************************************/
 
+#ifndef _BASE64_H_
+#define _BASE64_H_
+
+#include <stddef.h>		/* size_t */
+
+/* Streaming (incremental) encoder/decoder state */
+typedef struct {
+	unsigned	working;	/* Bits not yet output */
+	int			bits;		/* Number of bits in working */
+	int			pad;		/* Decoding: pad char ('=') received */
+} b64_state_t;
+
+#define B64_ENCODED_LEN(n)		((((n)+2)/3)*4)	/* Not including NUL terminator */
+#define B64_DECODED_MAXLEN(n)	(((n)/4)*3+3)	/* Including bits held from previous update */
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -42,6 +57,14 @@ extern "C" {
 int b64_encode(char *target, size_t tlen, const char *source, size_t slen);
 int b64_decode(char *target, size_t tlen, const char *source, size_t slen);
 
+void b64_init(b64_state_t*);
+int b64_encode_update(b64_state_t*, char *target, size_t tlen, const char *source, size_t slen);
+int b64_encode_final(b64_state_t*, char *target, size_t tlen);
+int b64_decode_update(b64_state_t*, char *target, size_t tlen, const char *source, size_t slen);
+int b64_decode_final(b64_state_t*);
+
 #ifdef __cplusplus
 }
 #endif
+
+#endif	/* Don't add anything after this line */
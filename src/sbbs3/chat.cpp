@@ -918,8 +918,8 @@ void sbbs_t::privchat(bool local)
 
 											/* Wait for other node */
 											/* to acknowledge and reset */
+		getnodedat(n,&node,0);
 		while(online && !(sys_status&SS_ABORT)) {
-			getnodedat(n,&node,0);
 			if(!(node.misc&NODE_RPCHT))
 				break;
 			getnodedat(cfg.node_num,&thisnode,0);
@@ -928,7 +928,7 @@ void sbbs_t::privchat(bool local)
 			checkline();
 			gettimeleft();
 			SYNC;
-			SLEEP(500); 
+			waitnodedat(&cfg,n,&node,500);	/* returns early when node changes */
 		}
 	}
 
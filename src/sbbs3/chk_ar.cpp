@@ -86,6 +86,34 @@ bool sbbs_t::ar_exp(const uchar **ptrptr, user_t* user, client_t* client)
 		}
 
 		artype=(**ptrptr);
+		switch(artype) {	/* Results that can change without useron changing */
+			case AR_BPS:
+			case AR_QUIET:
+			case AR_DAY:
+			case AR_TIME:
+			case AR_RANDOM:
+			case AR_EXPIRE:
+			case AR_LASTON:
+			case AR_AGE:
+			case AR_TLEFT:
+			case AR_TUSED:
+			case AR_MAIN_CMDS:
+			case AR_FILE_CMDS:
+			case AR_GROUP:
+			case AR_SUB:
+			case AR_SUBCODE:
+			case AR_LIB:
+			case AR_DIR:
+			case AR_DIRCODE:
+				ar_dynamic=true;
+				break;
+			case AR_PROT:
+			case AR_HOST:
+			case AR_IP:
+				if(client==NULL)
+					ar_dynamic=true;
+				break;
+		}
 		switch(artype) {
 			case AR_ANSI:				/* No arguments */
 			case AR_RIP:
@@ -644,14 +672,179 @@ bool sbbs_t::ar_exp(const uchar **ptrptr, user_t* user, client_t* client)
 	return(result);
 }
 
+/****************************************************************************/
+/* The results of ARS evaluated for useron that depend only on useron (and	*/
+/* the client/session) are cached by ARS (contents), so the same access		*/
+/* checks, repeated for every sub-board and directory, are only evaluated	*/
+/* once. The cache is flushed whenever those useron fields change.			*/
+/****************************************************************************/
+
+/* Returns the length of a compiled ARS (as generated by arstr), including	*/
+/* the AR_NULL terminator, or 0 if it is unrecognized or too long to cache	*/
+static size_t ar_len(const uchar* ar)
+{
+	size_t	len=0;
+
+	while(len<AR_CACHE_MAXLEN) {
+		switch(ar[len++]) {
+			case AR_NULL:
+				return(len);
+			case AR_OR:					/* No arguments */
+			case AR_NOT:
+			case AR_EQUAL:
+			case AR_BEGNEST:
+			case AR_ENDNEST:
+			case AR_ANSI:
+			case AR_RIP:
+			case AR_WIP:
+			case AR_LOCAL:
+			case AR_EXPERT:
+			case AR_SYSOP:
+			case AR_GUEST:
+			case AR_QNODE:
+			case AR_QUIET:
+			case AR_OS2:
+			case AR_DOS:
+			case AR_WIN32:
+			case AR_UNIX:
+			case AR_LINUX:
+			case AR_ACTIVE:
+			case AR_INACTIVE:
+			case AR_DELETED:
+				break;
+			case AR_LEVEL:				/* Byte arguments */
+			case AR_AGE:
+			case AR_NODE:
+			case AR_TLEFT:
+			case AR_TUSED:
+			case AR_PCR:
+			case AR_UDR:
+			case AR_UDFR:
+			case AR_DAY:
+			case AR_FLAG1:
+			case AR_FLAG2:
+			case AR_FLAG3:
+			case AR_FLAG4:
+			case AR_EXEMPT:
+			case AR_REST:
+			case AR_SEX:
+				len++;
+				break;
+			case AR_BPS:				/* Short (16-bit) arguments */
+			case AR_USER:
+			case AR_TIME:
+			case AR_EXPIRE:
+			case AR_CREDIT:
+			case AR_GROUP:
+			case AR_SUB:
+			case AR_LIB:
+			case AR_DIR:
+			case AR_MAIN_CMDS:
+			case AR_FILE_CMDS:
+			case AR_RANDOM:
+			case AR_LASTON:
+			case AR_LOGONS:
+			case AR_ULS:
+			case AR_ULK:
+			case AR_ULM:
+			case AR_DLS:
+			case AR_DLK:
+			case AR_DLM:
+				len+=2;
+				break;
+			case AR_SUBCODE:			/* String arguments */
+			case AR_DIRCODE:
+			case AR_SHELL:
+			case AR_PROT:
+			case AR_HOST:
+			case AR_IP:
+				while(len<AR_CACHE_MAXLEN && ar[len])
+					len++;
+				len++;
+				break;
+			default:
+				return(0);
+		}
+	}
+	return(0);
+}
+
+void sbbs_t::ar_cache_flush(void)
+{
+	memset(ar_cache,0,sizeof(ar_cache));
+	memcpy(&ar_cache_user,&useron,sizeof(ar_cache_user));
+	ar_cache_status=sys_status&SS_TMPSYSOP;
+}
+
+static bool ar_cache_valid(user_t* user, user_t* cached)
+{
+	return(user->number==cached->number
+		&& user->level==cached->level
+		&& user->flags1==cached->flags1
+		&& user->flags2==cached->flags2
+		&& user->flags3==cached->flags3
+		&& user->flags4==cached->flags4
+		&& user->exempt==cached->exempt
+		&& user->rest==cached->rest
+		&& user->misc==cached->misc
+		&& user->sex==cached->sex
+		&& user->shell==cached->shell
+		&& user->cdt==cached->cdt
+		&& user->freecdt==cached->freecdt
+		&& user->uls==cached->uls
+		&& user->ulb==cached->ulb
+		&& user->dls==cached->dls
+		&& user->dlb==cached->dlb
+		&& user->logons==cached->logons
+		&& user->posts==cached->posts);
+}
+
 bool sbbs_t::chk_ar(const uchar *ar, user_t* user, client_t* client)
 {
 	const uchar *p;
+	bool		result;
+	char*		str;
+	long		val;
+	ar_cache_t*	ent;
+	size_t		len;
+	size_t		i;
+	ulong		hash;
 
 	if(ar==NULL)
 		return(true);
 	p=ar;
-	return(ar_exp(&p,user,client));
+	if(user!=&useron || (len=ar_len(ar))==0)
+		return(ar_exp(&p,user,client));
+
+	if(!ar_cache_valid(&useron,&ar_cache_user)
+		|| (sys_status&SS_TMPSYSOP)!=ar_cache_status)
+		ar_cache_flush();
+	hash=(ulong)client;
+	for(i=0;i<len;i++)
+		hash=(hash*31)+ar[i];
+	ent=&ar_cache[(hash^(hash>>8))&(AR_CACHE_SIZE-1)];
+	if(ent->len==len && ent->client==client && memcmp(ent->ar,ar,len)==0) {
+		if(ent->noaccess) {
+			noaccess_str=ent->noaccess_str;
+			noaccess_val=ent->noaccess_val;
+		}
+		return(ent->result);
+	}
+
+	str=noaccess_str;
+	val=noaccess_val;
+	ar_dynamic=false;
+	result=ar_exp(&p,user,client);
+	if(!ar_dynamic) {
+		memcpy(ent->ar,ar,len);
+		ent->len=len;
+		ent->client=client;
+		ent->result=result;
+		ent->noaccess=(noaccess_str!=str || noaccess_val!=val);
+		ent->noaccess_str=noaccess_str;
+		ent->noaccess_val=noaccess_val;
+	}
+	return(result);
 }
 
 
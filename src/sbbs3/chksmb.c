@@ -276,6 +276,12 @@ int main(int argc, char **argv)
 	acthdrblocks=actdatblocks=0;
 	dfieldlength=dfieldoffset=0;
 
+	if(!(smb.status.attr&SMB_EMAIL) && chkhash
+		&& (i=smb_indexhashes(&smb,/* rebuild: */TRUE))!=SMB_SUCCESS) {
+		printf("smb_indexhashes returned %d: %s\n",i,smb.last_error);
+		errors++;
+	}
+
 	for(l=smb.status.header_offset;l<length;l+=size) {
 		size=SHD_BLOCK_LEN;
 		fprintf(stderr,"\r%2lu%%  ",(long)(100.0/((float)length/l)));
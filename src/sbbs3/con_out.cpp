@@ -55,6 +55,7 @@ int sbbs_t::bputs(const char *str)
 	if(online==ON_LOCAL && console&CON_L_ECHO) 	/* script running as event */
 		return(eprintf(LOG_INFO,"%s",str));
 
+	outcom_begin();
 	while(str[l] && online) {
 		if(str[l]==CTRL_A && str[l+1]!=0) {
 			l++;
@@ -84,6 +85,7 @@ int sbbs_t::bputs(const char *str)
 		}
 		outchar(str[l++]); 
 	}
+	outcom_end();
 	return(l);
 }
 
@@ -96,19 +98,20 @@ int sbbs_t::bputs(const char *str)
 int sbbs_t::rputs(const char *str, size_t len)
 {
     size_t	l;
+	size_t	lb;
 
 	if(console&CON_ECHO_OFF)
 		return 0;
+	if(!online)
+		return 0;
 	if(len==0)
 		len=strlen(str);
-	for(l=0;l<len && online;l++) {
-		if(str[l]==(char)TELNET_IAC && !(telnet_mode&TELNET_MODE_OFF))
-			outcom(TELNET_IAC);	/* Must escape Telnet IAC char (255) */
-		if(outcom(str[l])!=0)
-			break;
-		if(lbuflen<LINE_BUFSIZE)
-			lbuf[lbuflen++]=str[l]; 
-	}
+	l=putcom_iac(str,len);
+	lb=l;
+	if(lbuflen+lb > LINE_BUFSIZE)
+		lb=LINE_BUFSIZE-lbuflen;
+	memcpy(lbuf+lbuflen,str,lb);
+	lbuflen+=lb;
 	return(l);
 }
 
@@ -179,8 +182,6 @@ long sbbs_t::term_supports(long cmp_flags)
 /****************************************************************************/
 void sbbs_t::outchar(char ch)
 {
-	int		i;
-
 	if(console&CON_ECHO_OFF)
 		return;
 	if(ch==ESC)
@@ -214,29 +215,10 @@ void sbbs_t::outchar(char ch)
 			ch=text[YN][3];
 			if(text[YN][2]==0 || ch==0) ch='X';
 		}
-		if(ch==FF && term_supports(ANSI)) {
-			putcom("\x1b[2J\x1b[H");	/* clear screen, home cursor */
-		}
-		else {
-			if(ch==(char)TELNET_IAC && !(telnet_mode&TELNET_MODE_OFF))
-				outcom(TELNET_IAC);	/* Must escape Telnet IAC char (255) */
-			i=0;
-			while(outcom(ch)&TXBOF && i<1440) { /* 3 minute pause delay */
-				if(!online)
-					break;
-				i++;
-				if(sys_status&SS_SYSPAGE)
-					sbbs_beep(i,80);
-				else
-					mswait(80); 
-			}
-			if(i==1440) {							/* timeout - beep flush outbuf */
-				i=rioctl(TXBC);
-				lprintf(LOG_NOTICE,"timeout(outchar) %04X %04X\r\n",i,rioctl(IOFO));
-				outcom(BEL);
-				rioctl(IOCS|PAUSE); 
-			} 
-		} 
+		if(ch==FF && term_supports(ANSI))
+			putcom_iac("\x1b[2J\x1b[H",7);	/* clear screen, home cursor */
+		else
+			putcom_iac(&ch,1);	/* batched, waits (up to 3 minutes) for room */
 	}
 	if(!outchar_esc) {
 		if((uchar)ch>=' ')
@@ -472,12 +454,15 @@ void sbbs_t::ctrl_a(char x)
 			bputs(unixtodstr(&cfg,(time32_t)now,tmp1));
 			break;
 		case ',':   /* Delay 1/10 sec */
+			outcom_flush();
 			mswait(100);
 			break;
 		case ';':   /* Delay 1/2 sec */
+			outcom_flush();
 			mswait(500);
 			break;
 		case '.':   /* Delay 2 secs */
+			outcom_flush();
 			mswait(2000);
 			break;
 		case 'S':   /* Synchronize */
@@ -38,6 +38,7 @@
 #include "sbbs.h"
 #include "cmdshell.h"
 #include "js_request.h"
+#include "js_cache.h"
 
 char ** sbbs_t::getstrvar(csi_t *bin, int32_t name)
 {
@@ -646,7 +647,7 @@ long sbbs_t::js_execfile(const char *cmd, const char* startup_dir, JSObject* sco
 
 		JS_ClearPendingException(js_cx);
 
-		js_script=JS_CompileFile(js_cx, js_scope, path);
+		js_script=js_get_compiled_script(js_cx, js_scope, path);
 	}
 
 	if(js_scope==NULL || js_script==NULL) {
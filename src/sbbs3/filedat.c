@@ -37,6 +37,8 @@
 
 #include "sbbs.h"
 
+static void parsefiledat(scfg_t* cfg, file_t* f, char* buf);
+
 /****************************************************************************/
 /* Gets filedata from dircode.DAT file										*/
 /* Need fields .name ,.dir and .offset to get other info    				*/
@@ -67,6 +69,17 @@ BOOL DLLCALL getfiledat(scfg_t* cfg, file_t* f)
 		return(FALSE); 
 	}
 	close(file);
+	parsefiledat(cfg,f,buf);
+	return(TRUE);
+}
+
+/****************************************************************************/
+/* Fills file_t fields from a dircode.DAT file record (buf)					*/
+/****************************************************************************/
+static void parsefiledat(scfg_t* cfg, file_t* f, char* buf)
+{
+	char str[MAX_PATH+1];
+
 	getrec(buf,F_ALTPATH,2,str);
 	f->altpath=hptoi(str);
 	getrec(buf,F_CDT,LEN_FCDT,str);
@@ -101,7 +114,6 @@ BOOL DLLCALL getfiledat(scfg_t* cfg, file_t* f)
 		f->misc=buf[F_MISC]-' ';
 	else
 		f->misc=0;
-	return(TRUE);
 }
 
 /****************************************************************************/
@@ -374,6 +386,127 @@ BOOL DLLCALL getfileixb(scfg_t* cfg, file_t* f)
 	return(TRUE);
 }
 
+/****************************************************************************/
+/* Directory file index: the dircode.IXB and .DAT files of a directory,		*/
+/* read once, with the index records hashed by file name, so that looking	*/
+/* up every file in a directory listing doesn't re-read the files for each.	*/
+/****************************************************************************/
+static ulong fileidx_hash(const uchar* name)
+{
+	ulong	h=0;
+	int		i;
+
+	for(i=0;i<11;i++)
+		h=(h*31)+toupper(name[i]);
+	return(h);
+}
+
+static BOOL fileidx_read(const char* path, uchar** buf, long* length)
+{
+	int		file;
+
+	*buf=NULL;
+	*length=0;
+	if((file=sopen(path,O_RDONLY|O_BINARY,SH_DENYWR))==-1)
+		return(FALSE);
+	*length=(long)filelength(file);
+	if(*length<=0) {
+		close(file);
+		*length=0;
+		return(TRUE);
+	}
+	if((*buf=(uchar *)malloc(*length))==NULL) {
+		close(file);
+		return(FALSE);
+	}
+	if(lread(file,*buf,*length)!=*length) {
+		close(file);
+		FREE_AND_NULL(*buf);
+		return(FALSE);
+	}
+	close(file);
+	return(TRUE);
+}
+
+BOOL DLLCALL loadfileidx(scfg_t* cfg, uint dirnum, fileidx_t* idx)
+{
+	char	path[MAX_PATH+1];
+	ulong	i,slot;
+	long	datlen;
+
+	memset(idx,0,sizeof(fileidx_t));
+	idx->dir=dirnum;
+	SAFEPRINTF2(path,"%s%s.ixb",cfg->dir[dirnum]->data_dir,cfg->dir[dirnum]->code);
+	if(!fileidx_read(path,&idx->ixb,&idx->length) || idx->length%F_IXBSIZE) {
+		freefileidx(idx);
+		return(FALSE);
+	}
+	SAFEPRINTF2(path,"%s%s.dat",cfg->dir[dirnum]->data_dir,cfg->dir[dirnum]->code);
+	if(!fileidx_read(path,(uchar**)&idx->dat,&datlen) || datlen%F_LEN) {
+		freefileidx(idx);
+		return(FALSE);
+	}
+	idx->datlen=datlen;
+	for(idx->slots=64;idx->slots<(ulong)(idx->length/F_IXBSIZE)*2;idx->slots<<=1)
+		;
+	if((idx->table=(long*)calloc(idx->slots,sizeof(long)))==NULL) {
+		freefileidx(idx);
+		return(FALSE);
+	}
+	for(i=0;i<(ulong)idx->length;i+=F_IXBSIZE) {
+		for(slot=fileidx_hash(idx->ixb+i)&(idx->slots-1);idx->table[slot];slot=(slot+1)&(idx->slots-1))
+			;
+		idx->table[slot]=i+1;
+	}
+	return(TRUE);
+}
+
+/****************************************************************************/
+/* Same as getfileixb() followed by getfiledat(), using a loaded index		*/
+/****************************************************************************/
+BOOL DLLCALL getfileidx(scfg_t* cfg, fileidx_t* idx, file_t* f)
+{
+	char	fname[13];
+	uchar*	p;
+	ulong	slot;
+	long	l;
+	int		i;
+
+	if(idx->table==NULL)
+		return(FALSE);
+	SAFECOPY(fname,f->name);
+	for(i=8;i<12;i++)	/* Turn FILENAME.EXT into FILENAMEEXT */
+		fname[i]=fname[i+1];
+	for(slot=fileidx_hash((uchar*)fname)&(idx->slots-1);(l=idx->table[slot])!=0;slot=(slot+1)&(idx->slots-1)) {
+		p=idx->ixb+(l-1);
+		for(i=0;i<11;i++)
+			if(toupper((uchar)fname[i])!=toupper(p[i]))
+				break;
+		if(i==11)
+			break;
+	}
+	if(l==0)
+		return(FALSE);
+	p+=11;
+	f->datoffset=p[0]|((long)p[1]<<8)|((long)p[2]<<16);
+	f->dateuled=p[3]|((long)p[4]<<8)|((long)p[5]<<16)|((long)p[6]<<24);
+	f->datedled=p[7]|((long)p[8]<<8)|((long)p[9]<<16)|((long)p[10]<<24);
+	if(f->datoffset<0 || f->datoffset+F_LEN>idx->datlen)
+		return(FALSE);
+	parsefiledat(cfg,f,idx->dat+f->datoffset);
+	return(TRUE);
+}
+
+void DLLCALL freefileidx(fileidx_t* idx)
+{
+	FREE_AND_NULL(idx->ixb);
+	FREE_AND_NULL(idx->dat);
+	FREE_AND_NULL(idx->table);
+	idx->length=0;
+	idx->datlen=0;
+	idx->slots=0;
+}
+
 /****************************************************************************/
 /* Updates the datedled and dateuled index record fields for a file			*/
 /****************************************************************************/
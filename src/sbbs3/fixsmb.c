@@ -103,8 +103,10 @@ int fixsmb(char* sub)
 	char*		p;
 	char*		text;
 	char		c;
+	char		path[MAX_PATH+1];
 	int 		i,w;
 	ulong		l,length,size,n;
+	BOOL		fts;
 	smbmsg_t	msg;
 
 	memset(&smb,0,sizeof(smb));
@@ -162,6 +164,20 @@ int fixsmb(char* sub)
 	rewind(smb.sid_fp);
 	chsize(fileno(smb.sid_fp),0L);			/* Truncate the index */
 
+	/* Records are by message number, so rebuild the full-text index too */
+	SAFEPRINTF(path,"%s.sft",smb.file);
+	if((fts=fexist(path))==TRUE) {
+		printf("Rebuilding full-text search index\n");
+		if((i=smb_fts_create(&smb))!=SMB_SUCCESS)
+			printf("smb_fts_create returned %d: %s\n",i,smb.last_error);
+	}
+
+	if(!(smb.status.attr&(SMB_EMAIL|SMB_NOHASH))) {
+		printf("Rebuilding hash index\n");
+		if((i=smb_indexhashes(&smb,/* rebuild: */TRUE))!=SMB_SUCCESS)
+			printf("smb_indexhashes returned %d: %s\n",i,smb.last_error);
+	}
+
 
 	if(!(smb.status.attr&SMB_HYPERALLOC)) {
 		length=filelength(fileno(smb.sdt_fp));
@@ -227,6 +243,8 @@ int fixsmb(char* sub)
 				printf("\nsmb_putmsg returned %d: %s\n",i,smb.last_error);
 				continue; 
 			}
+			if(fts && (i=smb_fts_addmsg(&smb,&msg))!=SMB_SUCCESS)
+				printf("\nsmb_fts_addmsg returned %d: %s\n",i,smb.last_error);
 			n++; 
 		}
 
@@ -53,6 +53,7 @@
 #include "telnet.h"
 #include "js_rtpool.h"
 #include "js_request.h"
+#include "js_cache.h"
 
 /* Constants */
 
@@ -269,6 +270,7 @@ static int sockprintf(SOCKET sock, char *fmt, ...)
 	int		len;
 	int		maxlen;
 	int		result;
+	int		wr=0;
 	va_list argptr;
 	char	sbuf[1024];
 	fd_set	socket_set;
@@ -306,8 +308,8 @@ static int sockprintf(SOCKET sock, char *fmt, ...)
 				,sock, ERROR_VALUE);
 		return(0);
 	}
-	while((result=sendsocket(sock,sbuf,len))!=len) {
-		if(result==SOCKET_ERROR) {
+	while(wr<len) {
+		if((result=sendsocket(sock,sbuf+wr,len-wr))==SOCKET_ERROR) {
 			if(ERROR_VALUE==EWOULDBLOCK) {
 				YIELD();
 				continue;
@@ -320,7 +322,7 @@ static int sockprintf(SOCKET sock, char *fmt, ...)
 				lprintf(LOG_WARNING,"%04d !ERROR %d sending",sock,ERROR_VALUE);
 			return(0);
 		}
-		lprintf(LOG_WARNING,"%04d !ERROR: short send: %u instead of %u",sock,result,len);
+		wr+=result;	/* short sends are continued, not repeated */
 	}
 	return(len);
 }
@@ -647,6 +649,7 @@ BOOL js_generate_index(JSContext* js_cx, JSObject* parent,
 	FILE*		alias_fp;
 	uint		i;
 	file_t		f;
+	fileidx_t	idx;
 	glob_t		g;
 	jsval		val;
 	jsval		rval;
@@ -956,6 +959,7 @@ BOOL js_generate_index(JSContext* js_cx, JSObject* parent,
 		} else if(chk_ar(&scfg,scfg.dir[dir]->ar,user,client)){
 			SAFEPRINTF(path,"%s*",scfg.dir[dir]->path);
 			rc=JS_SUSPENDREQUEST(js_cx);
+			loadfileidx(&scfg,dir,&idx);
 			glob(path,0,NULL,&g);
 			for(i=0;i<(int)g.gl_pathc;i++) {
 				if(isdir(g.gl_pathv[i]))
@@ -967,9 +971,8 @@ BOOL js_generate_index(JSContext* js_cx, JSObject* parent,
 	#endif
 				padfname(getfname(str),f.name);
 				f.dir=dir;
-				if(getfileixb(&scfg,&f)) {
-					f.size=0; /* flength(g.gl_pathv[i]); */
-					getfiledat(&scfg,&f);
+				f.size=0; /* flength(g.gl_pathv[i]); */
+				if(getfileidx(&scfg,&idx,&f)) {
 					if(f.misc&FM_EXTDESC) {
 						extdesc[0]=0;
 						getextdesc(&scfg, dir, f.datoffset, extdesc);
@@ -1000,6 +1003,7 @@ BOOL js_generate_index(JSContext* js_cx, JSObject* parent,
 				}
 			}
 			globfree(&g);
+			freefileidx(&idx);
 			JS_RESUMEREQUEST(js_cx, rc);
 		}
 
@@ -1007,7 +1011,7 @@ BOOL js_generate_index(JSContext* js_cx, JSObject* parent,
 		/* RUN SCRIPT */
 		JS_ClearPendingException(js_cx);
 
-		if((js_script=JS_CompileFile(js_cx, parent, spath))==NULL) {
+		if((js_script=js_get_compiled_script(js_cx, parent, spath))==NULL) {
 			lprintf(LOG_ERR,"%04d !JavaScript FAILED to compile script (%s)",sock,spath);
 			break;
 		}
@@ -1105,10 +1109,10 @@ void recverror(SOCKET socket, int rd, int line)
 			,socket, rd, line);
 }
 
-int sockreadline(SOCKET socket, char* buf, int len, time_t* lastactive)
+int sockreadline(SOCKET socket, sockbuf_t* rdbuf, char* buf, int len, time_t* lastactive)
 {
-	char	ch;
-	int		i,rd=0;
+	int		i;
+	size_t	rd=0;
 	fd_set	socket_set;
 	struct timeval	tv;
 
@@ -1119,15 +1123,18 @@ int sockreadline(SOCKET socket, char* buf, int len, time_t* lastactive)
 		return(0);
 	}
 	
-	while(rd<len-1) {
+	while(rd<(size_t)len-1) {
 
-		tv.tv_sec=startup->max_inactivity;
-		tv.tv_usec=0;
+		if(sockbuf_pending(rdbuf)==0) {
+			tv.tv_sec=startup->max_inactivity;
+			tv.tv_usec=0;
 
-		FD_ZERO(&socket_set);
-		FD_SET(socket,&socket_set);
+			FD_ZERO(&socket_set);
+			FD_SET(socket,&socket_set);
 
-		i=select(socket+1,&socket_set,NULL,NULL,&tv);
+			i=select(socket+1,&socket_set,NULL,NULL,&tv);
+		} else
+			i=1;
 
 		if(server_socket==INVALID_SOCKET || terminate_server) {
 			sockprintf(socket,"421 Server downed, aborting.");
@@ -1147,21 +1154,22 @@ int sockreadline(SOCKET socket, char* buf, int len, time_t* lastactive)
 			recverror(socket,i,__LINE__);
 			return(i);
 		}
+		if(sockbuf_pending(rdbuf)==0) {
 #ifdef SOCKET_DEBUG_RECV_CHAR
-		socket_debug[socket]|=SOCKET_DEBUG_RECV_CHAR;
+			socket_debug[socket]|=SOCKET_DEBUG_RECV_CHAR;
 #endif
-		i=recv(socket, &ch, 1, 0);
+			i=sockbuf_recv(rdbuf, socket);
 #ifdef SOCKET_DEBUG_RECV_CHAR
-		socket_debug[socket]&=~SOCKET_DEBUG_RECV_CHAR;
+			socket_debug[socket]&=~SOCKET_DEBUG_RECV_CHAR;
 #endif
-		if(i<1) {
-			recverror(socket,i,__LINE__);
-			return(i);
+			if(i<1) {
+				recverror(socket,i,__LINE__);
+				return(i);
+			}
 		}
-		if(ch=='\n' /* && rd>=1 */) { /* Mar-9-2003: terminate on sole LF */
+		/* Mar-9-2003: terminate on sole LF */
+		if(sockbuf_getline(rdbuf, buf, &rd, len-1))
 			break;
-		}	
-		buf[rd++]=ch;
 	}
 	if(rd>0 && buf[rd-1]=='\r')
 		buf[rd-1]=0;
@@ -2293,6 +2301,7 @@ static void ctrl_thread(void* arg)
 	FILE*		fp;
 	FILE*		alias_fp;
 	SOCKET		sock;
+	sockbuf_t	rdbuf;
 	SOCKET		tmp_sock;
 	SOCKET		pasv_sock=INVALID_SOCKET;
 	SOCKET		data_sock=INVALID_SOCKET;
@@ -2308,6 +2317,7 @@ static void ctrl_thread(void* arg)
 	time_t		lastactive;
 	time_t		file_date;
 	file_t		f;
+	fileidx_t	idx;
 	glob_t		g;
 	node_t		node;
 	client_t	client;
@@ -2329,6 +2339,7 @@ static void ctrl_thread(void* arg)
 	lastactive=time(NULL);
 
 	sock=ftp.socket;
+	sockbuf_init(&rdbuf);
 	data_addr=ftp.client_addr;
 	/* Default data port is ctrl port-1 */
 	data_addr.sin_port=ntohs(data_addr.sin_port)-1;
@@ -2448,7 +2459,7 @@ static void ctrl_thread(void* arg)
 #ifdef SOCKET_DEBUG_READLINE
 		socket_debug[sock]|=SOCKET_DEBUG_READLINE;
 #endif
-		rd = sockreadline(sock, buf, sizeof(buf), &lastactive);
+		rd = sockreadline(sock, &rdbuf, buf, sizeof(buf), &lastactive);
 #ifdef SOCKET_DEBUG_READLINE
 		socket_debug[sock]&=~SOCKET_DEBUG_READLINE;
 #endif
@@ -3523,6 +3534,7 @@ static void ctrl_thread(void* arg)
 					,sock,user.alias,scfg.lib[lib]->sname,scfg.dir[dir]->code_suffix,mode);
 
 				SAFEPRINTF2(path,"%s%s",scfg.dir[dir]->path,filespec);
+				loadfileidx(&scfg,dir,&idx);
 				glob(path,0,NULL,&g);
 				for(i=0;i<(int)g.gl_pathc;i++) {
 					if(isdir(g.gl_pathv[i]))
@@ -3534,12 +3546,12 @@ static void ctrl_thread(void* arg)
 #endif
 					padfname(getfname(str),f.name);
 					f.dir=dir;
-					if((filedat=getfileixb(&scfg,&f))==FALSE
+					f.size=1;	/* don't have getfileidx() read the disk */
+					if((filedat=getfileidx(&scfg,&idx,&f))==FALSE
 						&& !(startup->options&FTP_OPT_DIR_FILES))
 						continue;
 					if(detail) {
 						f.size=flength(g.gl_pathv[i]);
-						getfiledat(&scfg,&f);
 						t=fdate(g.gl_pathv[i]);
 						if(localtime_r(&t,&tm)==NULL)
 							memset(&tm,0,sizeof(tm));
@@ -3568,6 +3580,7 @@ static void ctrl_thread(void* arg)
 						fprintf(fp,"%s\r\n",getfname(g.gl_pathv[i]));
 				}
 				globfree(&g);
+				freefileidx(&idx);
 			} else 
 				lprintf(LOG_INFO,"%04d %s listing: %s/%s directory in %s mode (empty - no access)"
 					,sock,user.alias,scfg.lib[lib]->sname,scfg.dir[dir]->code_suffix,mode);
@@ -3796,6 +3809,7 @@ static void ctrl_thread(void* arg)
 						}
 					} else if(chk_ar(&scfg,scfg.dir[dir]->ar,&user,&client)){
 						sprintf(cmd,"%s*",scfg.dir[dir]->path);
+						loadfileidx(&scfg,dir,&idx);
 						glob(cmd,0,NULL,&g);
 						for(i=0;i<(int)g.gl_pathc;i++) {
 							if(isdir(g.gl_pathv[i]))
@@ -3807,14 +3821,13 @@ static void ctrl_thread(void* arg)
 	#endif
 							padfname(getfname(str),f.name);
 							f.dir=dir;
-							if(getfileixb(&scfg,&f)) {
-								f.size=flength(g.gl_pathv[i]);
-								getfiledat(&scfg,&f);
+							f.size=1;	/* don't have getfileidx() read the disk */
+							if(getfileidx(&scfg,&idx,&f))
 								fprintf(fp,"%-*s %s\r\n",INDEX_FNAME_LEN
 									,getfname(g.gl_pathv[i]),f.desc);
-							}
 						}
 						globfree(&g);
+						freefileidx(&idx);
 					}
 					fclose(fp);
 				}
@@ -4800,6 +4813,8 @@ void DLLCALL ftp_server(void* arg)
 
 		while(server_socket!=INVALID_SOCKET && !terminate_server) {
 
+			js_cache_expire();	/* free compiled scripts that have gone unused */
+
 			if(thread_count.value <= 1) {
 				if(!(startup->options&FTP_OPT_NO_RECYCLE)) {
 					if((p=semfile_list_check(&initialized,recycle_semfiles))!=NULL) {
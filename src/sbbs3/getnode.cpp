@@ -59,6 +59,8 @@ int sbbs_t::getnodedat(uint number, node_t *node, bool lockit)
 
 	if(node!=&thisnode)
 		memset(node,0,sizeof(node_t));
+	if(!lockit && readnodedat(&cfg,number,node))	/* shared mapping */
+		return(0);
 	sprintf(str,"%snode.dab",cfg.ctrl_dir);
 	if(nodefile==-1) {
 		if((nodefile=nopen(str,O_RDWR|O_DENYNONE))==-1) {
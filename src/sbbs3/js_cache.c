@@ -0,0 +1,277 @@
+/* js_cache.c */
+
+/* Synchronet JavaScript compiled-script cache */
+
+/****************************************************************************
+ * @format.tab-size 4		(Plain Text/Source Code File Header)			*
+ * @format.use-tabs true	(see http://www.synchro.net/ptsc_hdr.html)		*
+ *																			*
+ * Copyright 2013 Rob Swindell - http://www.synchro.net/copyright.html		*
+ *																			*
+ * This program is free software; you can redistribute it and/or			*
+ * modify it under the terms of the GNU General Public License				*
+ * as published by the Free Software Foundation; either version 2			*
+ * of the License, or (at your option) any later version.					*
+ * See the GNU General Public License for more details: gpl.txt or			*
+ * http://www.fsf.org/copyleft/gpl.html										*
+ *																			*
+ * Anonymous FTP access to the most recent released source is available at	*
+ * ftp://vert.synchro.net, ftp://cvs.synchro.net and ftp://ftp.synchro.net	*
+ *																			*
+ * Anonymous CVS access to the development source and modification history	*
+ * is available at cvs.synchro.net:/cvsroot/sbbs, example:					*
+ * cvs -d :pserver:anonymous@cvs.synchro.net:/cvsroot/sbbs login			*
+ *     (just hit return, no password is necessary)							*
+ * cvs -d :pserver:anonymous@cvs.synchro.net:/cvsroot/sbbs checkout src		*
+ *																			*
+ * For Synchronet coding style and modification guidelines, see				*
+ * http://www.synchro.net/source.html										*
+ *																			*
+ * You are encouraged to submit any modifications (preferably in Unix diff	*
+ * format) via e-mail to mods@synchro.net									*
+ *																			*
+ * Note: If this box doesn't appear square, then you need to fix your tabs.	*
+ ****************************************************************************/
+
+#include "sbbs.h"
+#include "js_cache.h"
+#include <jsxdrapi.h>
+
+static struct cache_data*	cache[JS_CACHE_MAX_SCRIPTS];
+static ulong				cached;
+static js_cache_stats_t		counters;
+static time_t				expired;	/* last js_cache_expire() */
+static pthread_mutex_t		cache_mutex;
+static pthread_once_t		cache_once=PTHREAD_ONCE_INIT;
+
+static void cache_mutex_init(void)
+{
+	pthread_mutex_init(&cache_mutex, NULL);
+}
+
+static void cache_init(void)
+{
+	pthread_once(&cache_once, cache_mutex_init);
+}
+
+#if JS_HAS_XDR
+
+/* All of the following must be called with cache_mutex locked */
+
+static long cache_find(const char* filename)
+{
+	ulong	i;
+
+	for(i=0; i<cached; i++) {
+		if(strcmp(cache[i]->filename, filename)==0)
+			return(i);
+	}
+	return(-1);
+}
+
+static void cache_remove(ulong i)
+{
+	struct cache_data* entry=cache[i];
+
+	counters.bytes-=entry->len;
+	free(entry->data);
+	free(entry->filename);
+	free(entry);
+	cache[i]=cache[--cached];
+	cache[cached]=NULL;
+}
+
+/* Expires entries not ran in JS_CACHE_MAX_AGE and, to make room for another, */
+/* the entry with the greatest weight=(age in seconds)/(number of times ran) */
+static void cache_expire(time_t now, BOOL make_room)
+{
+	ulong	i;
+	long	victim=-1;
+	double	weight;
+	double	heaviest=-1;
+
+	for(i=0; i<cached; ) {
+		if(now-cache[i]->lastrun > JS_CACHE_MAX_AGE) {
+			cache_remove(i);
+			continue;
+		}
+		weight=(double)(now-cache[i]->lastrun)/cache[i]->runcount;
+		if(weight>heaviest) {
+			heaviest=weight;
+			victim=i;
+		}
+		i++;
+	}
+	if(make_room && cached>=JS_CACHE_MAX_SCRIPTS && victim>=0)
+		cache_remove(victim);
+}
+
+static JSObject* xdr_decode(JSContext* cx, void* data, uint32 len)
+{
+	JSXDRState*	xdr;
+	JSObject*	script=NULL;
+
+	if((xdr=JS_XDRNewMem(cx, JSXDR_DECODE))==NULL)
+		return(NULL);
+	JS_XDRMemSetData(xdr, data, len);
+	if(!JS_XDRScriptObject(xdr, &script))
+		script=NULL;
+	JS_XDRMemSetData(xdr, NULL, 0);	/* data belongs to the caller */
+	JS_XDRDestroy(xdr);
+	return(script);
+}
+
+static void* xdr_encode(JSContext* cx, JSObject* script, uint32* len)
+{
+	JSXDRState*	xdr;
+	void*		p;
+	void*		data=NULL;
+
+	if((xdr=JS_XDRNewMem(cx, JSXDR_ENCODE))==NULL)
+		return(NULL);
+	if(JS_XDRScriptObject(xdr, &script)
+		&& (p=JS_XDRMemGetData(xdr, len))!=NULL
+		&& (data=malloc(*len))!=NULL)
+		memcpy(data, p, *len);
+	JS_XDRDestroy(xdr);
+	return(data);
+}
+
+static void cache_add(const char* filename, struct stat* st, time_t now, void* data, uint32 len)
+{
+	struct cache_data* entry;
+
+	if(cache_find(filename)>=0) {	/* Another thread beat us to it */
+		free(data);
+		return;
+	}
+	cache_expire(now, TRUE);
+	if((entry=(struct cache_data*)calloc(1, sizeof(*entry)))==NULL
+		|| (entry->filename=strdup(filename))==NULL) {
+		free(entry);
+		free(data);
+		return;
+	}
+	entry->mtime=st->st_mtime;
+	entry->ctime=st->st_ctime;
+	entry->size=st->st_size;
+	entry->runcount=1;
+	entry->lastrun=now;
+	entry->laststat=now;
+	entry->data=data;
+	entry->len=len;
+	cache[cached++]=entry;
+	counters.bytes+=len;
+}
+
+#endif	/* JS_HAS_XDR */
+
+JSObject* DLLCALL js_get_compiled_script(JSContext *cx, JSObject *obj, const char *filename)
+{
+	JSObject*	script;
+	long double	start;
+	long double	elapsed;
+#if JS_HAS_XDR
+	struct stat	st;
+	struct cache_data* entry;
+	time_t		now=time(NULL);
+	long		i;
+	void*		data=NULL;
+	uint32		len=0;
+
+	cache_init();
+
+	pthread_mutex_lock(&cache_mutex);
+	if((i=cache_find(filename))>=0) {
+		entry=cache[i];
+		if(now-entry->laststat >= JS_CACHE_STALE_TIMEOUT) {
+			if(stat(filename, &st)!=0
+				|| st.st_mtime!=entry->mtime
+				|| st.st_ctime!=entry->ctime
+				|| st.st_size!=entry->size) {
+				cache_remove(i);
+				entry=NULL;
+			} else
+				entry->laststat=now;
+		}
+		/* Decode from a copy so the entry may be expired while we're using it */
+		if(entry!=NULL && (data=malloc(entry->len))!=NULL) {
+			memcpy(data, entry->data, entry->len);
+			len=entry->len;
+			entry->runcount++;
+			entry->lastrun=now;
+		}
+	}
+	pthread_mutex_unlock(&cache_mutex);
+
+	if(data!=NULL) {
+		script=xdr_decode(cx, data, len);
+		free(data);
+		if(script!=NULL) {
+			pthread_mutex_lock(&cache_mutex);
+			counters.hits++;
+			pthread_mutex_unlock(&cache_mutex);
+			return(script);
+		}
+		JS_ClearPendingException(cx);
+		pthread_mutex_lock(&cache_mutex);
+		if((i=cache_find(filename))>=0)
+			cache_remove(i);
+		pthread_mutex_unlock(&cache_mutex);
+	}
+
+	if(stat(filename, &st)!=0)
+		return(JS_CompileFile(cx, obj, filename));
+#else
+	cache_init();
+#endif
+
+	start=xp_timer();
+	script=JS_CompileFile(cx, obj, filename);
+	elapsed=xp_timer()-start;
+
+	pthread_mutex_lock(&cache_mutex);
+	counters.misses++;
+	counters.compile_time+=(double)elapsed;
+	pthread_mutex_unlock(&cache_mutex);
+
+#if JS_HAS_XDR
+	if(script==NULL)
+		return(NULL);
+
+	if((data=xdr_encode(cx, script, &len))==NULL) {
+		JS_ClearPendingException(cx);
+		return(script);
+	}
+
+	pthread_mutex_lock(&cache_mutex);
+	cache_add(filename, &st, now, data, len);
+	pthread_mutex_unlock(&cache_mutex);
+#endif
+
+	return(script);
+}
+
+void DLLCALL js_cache_expire(void)
+{
+#if JS_HAS_XDR
+	time_t	now=time(NULL);
+
+	cache_init();
+	pthread_mutex_lock(&cache_mutex);
+	if(now-expired >= JS_CACHE_EXPIRE_INTERVAL) {
+		cache_expire(now, FALSE);
+		expired=now;
+	}
+	pthread_mutex_unlock(&cache_mutex);
+#endif
+}
+
+void DLLCALL js_cache_stats(js_cache_stats_t *stats)
+{
+	cache_init();
+	pthread_mutex_lock(&cache_mutex);
+	*stats=counters;
+	stats->scripts=cached;
+	pthread_mutex_unlock(&cache_mutex);
+}
@@ -1,36 +1,73 @@
+/* js_cache.h */
+
+/* Synchronet JavaScript compiled-script cache */
+
 #ifndef _JS_CACHE_H_
 #define _JS_CACHE_H_
 
-#include "link_list.h"
-#include "jscntxt.h"
-#include "jsscript.h"
+#ifdef __unix__
+	#define XP_UNIX
+#else
+	#define XP_PC
+	#define XP_WIN
+#endif
+#include <jsapi.h>
+#include <gen_defs.h>		/* ulong */
+#include <time.h>			/* time_t */
+#include <sys/types.h>		/* off_t */
 
-/* JS Compile Cache Stuff */
-struct context_cache {
-	JSContext	*cx;
-	link_list_t	cache;
-};
+#ifdef DLLEXPORT
+#undef DLLEXPORT
+#endif
+#ifdef DLLCALL
+#undef DLLCALL
+#endif
+#ifdef _WIN32
+	#ifdef SBBS_EXPORTS
+		#define DLLEXPORT	__declspec(dllexport)
+	#else
+		#define DLLEXPORT	__declspec(dllimport)
+	#endif
+	#ifdef __BORLANDC__
+		#define DLLCALL __stdcall
+	#else
+		#define DLLCALL
+	#endif
+#else	/* !_WIN32 */
+	#define DLLEXPORT
+	#define DLLCALL
+#endif
+
+/*
+ * Compiled script objects belong to the compartment of the context that
+ * compiled them and every server session/node has its own context (and
+ * global object), so the cache holds the XDR-encoded bytecode instead and
+ * each caller decodes a fresh script object into its own context.
+ */
+
+#define JS_CACHE_MAX_SCRIPTS	256			/* Max number of scripts to hold in cache */
+#define JS_CACHE_MAX_AGE		(24*60*60)	/* Max age in seconds since lastrun */
+#define JS_CACHE_STALE_TIMEOUT	1			/* Minimum time between calls to stat() */
+#define JS_CACHE_EXPIRE_INTERVAL	60		/* Minimum time between expirations by age */
 
 struct cache_data {
-	char	filename[MAX_PATH+1];
+	char*	filename;
 	time_t	mtime,ctime;		/* st_mtime/st_ctime from last stat() call */
 	off_t	size;				/* File size when loaded */
 	ulong	runcount;			/* Number of times this script has been used */
 	time_t	lastrun;			/* Time script was last ran */
 	time_t	laststat;			/* Time of last call to stat() */
-	JSObject	*script;
-	int		running;			/* Count of currently running scripts */
-	int		expired;			/* TRUE if last stat() makes this as stale and
-								 * running was non-zero */
+	void*	data;				/* XDR-encoded script */
+	uint32	len;				/* Length of data, in bytes */
 };
 
 typedef struct {
-	DWORD   size;				/* sizeof(js_cache_startup_t) */
-	time_t	max_age;			/* Max age in seconds for lastrun */
-	ulong	max_scripts;		/* Max number of scripts to hold in cache */
-	time_t	stale_timeout;		/* Minimum time between calls to stat() */
-	ulong	expire_period;		/* Time between servicing the exipry cache... milliseconds */
-} js_cache_startup_t;
+	ulong	scripts;			/* Number of scripts currently cached */
+	ulong	bytes;				/* Total size of cached (encoded) scripts */
+	ulong	hits;				/* Scripts loaded from the cache */
+	ulong	misses;				/* Scripts compiled from source */
+	double	compile_time;		/* Total seconds spent compiling (misses) */
+} js_cache_stats_t;
 
 #ifdef __cplusplus
 extern "C" {
@@ -40,36 +77,23 @@ extern "C" {
  * Gets the compiled script from the cache if available and
  * laststat is less than stale time or a new stat() matches
  * the mtime, ctime, and size.
- * Compiles it and adds to the cache if not.
- * Increments running value.
- */
-JSObject *js_get_compiled_script(JSContext *cx, char *filename);
-
-/*
- * Starts the caching thread.  The caching thread periodically
- * checks the caches for entries to be expired.  They are expired
- * by weigth where weight=(age in seconds)/(number of times ran)
- * does NOT check the laststat nor does it do a stat().
- * It also does not expire an entry for which running is non-zero.
+ * Compiles it (with JS_CompileFile) and adds to the cache if not.
+ * Returns a new script object for cx, or NULL on compile failure.
  */
-void js_cache_thread(void *args);
+DLLEXPORT JSObject* DLLCALL js_get_compiled_script(JSContext *cx, JSObject *obj, const char *filename);
 
 /*
- * Decrements the running value, increments runcount, and updates
- * lastrun
+ * Frees the scripts that haven't been ran in JS_CACHE_MAX_AGE
+ * Called periodically by the servers, returns immediately if
+ * called again within JS_CACHE_EXPIRE_INTERVAL.
  */
-void js_script_done(struct cached_data *entry);
+DLLEXPORT void DLLCALL js_cache_expire(void);
 
 /*
- * Sets the expired member for any existing cached copies of filename
- * Required for self-modifying scripts.
+ * Copies the current cache counters into stats
  */
-void js_cache_expire(char *filename);
+DLLEXPORT void DLLCALL js_cache_stats(js_cache_stats_t *stats);
 
-/*
- * Creates a new cached runtime and context
- */
-JSContext *js_get_cached_context(size_t maxbytes, size_t stacksize);
 #ifdef __cplusplus
 }
 #endif
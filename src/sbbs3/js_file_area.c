@@ -97,378 +97,584 @@ static char* dir_prop_desc[] = {
 #endif
 
 
-JSObject* DLLCALL js_CreateFileAreaObject(JSContext* cx, JSObject* parent, scfg_t* cfg
-										  ,user_t* user, client_t* client, char* html_index_file)
+/*
+ * The file_area object tree is created on demand (via resolve hooks):
+ * libraries when file_area.lib, file_area.dir or file_area.lib_list is first
+ * referenced (or enumerated) and the directories of a library when the
+ * library's dir_list or one of its directories (by internal code) is first
+ * referenced. Access is evaluated against a copy of the user and client
+ * taken when the object was created, same as if the whole tree had been
+ * created then.
+ */
+struct file_area_private;
+
+typedef struct {
+	struct file_area_private* area;
+	uint		libnum;
+	int			index;			/* index into lib_list[] (or -1) */
+	BOOL		dirs_created;
+	BOOL		dir_list_created;
+	BOOL		offline_dir_created;
+} file_lib_private_t;
+
+typedef struct file_area_private {
+	ulong		refs;			/* area, dir[] and lib[] objects referencing this */
+	scfg_t*		cfg;
+	user_t*		user;			/* NULL or &user_buf */
+	client_t*	client;			/* NULL or &client_buf */
+	user_t		user_buf;
+	client_t	client_buf;
+	char		html_index_file[MAX_PATH+1];
+	DWORD		generation;		/* of cfg when created */
+	uint		total_libs;
+	uint		total_dirs;
+	BOOL		libs_created;
+	file_lib_private_t* lib;
+	int*		dir_index;		/* index into lib's dir_list[] (or -1) */
+} file_area_private_t;
+
+static void file_area_release(file_area_private_t* p)
+{
+	if(p==NULL || --p->refs)
+		return;
+	FREE_AND_NULL(p->lib);
+	FREE_AND_NULL(p->dir_index);
+	free(p);
+}
+
+/* Returns FALSE if the configuration has been reloaded since the object was created */
+static BOOL file_area_valid(file_area_private_t* p)
+{
+	return(p->generation==p->cfg->generation);
+}
+
+static JSBool js_file_area_get_name(JSContext* cx, jsid id, char** name)
+{
+	jsval idval;
+
+	*name=NULL;
+	if(id == JSID_VOID || id == JSID_EMPTY)
+		return(JS_TRUE);
+
+	JS_IdToValue(cx, id, &idval);
+	if(JSVAL_IS_STRING(idval)) {
+		JSSTRING_TO_MSTRING(cx, JSVAL_TO_STRING(idval), *name, NULL);
+		HANDLE_PENDING(cx);
+	} else if(JSVAL_IS_INT(idval)) {
+		if((*name=(char*)malloc(16))!=NULL)
+			sprintf(*name,"%d",JSVAL_TO_INT(idval));
+	}
+	return(JS_TRUE);
+}
+
+static void js_file_area_finalize(JSContext *cx, JSObject *obj)
+{
+	file_area_release((file_area_private_t*)JS_GetPrivate(cx,obj));
+	JS_SetPrivate(cx, obj, NULL);
+}
+
+static void js_file_lib_finalize(JSContext *cx, JSObject *obj)
+{
+	file_lib_private_t* lib;
+
+	if((lib=(file_lib_private_t*)JS_GetPrivate(cx,obj))==NULL)
+		return;
+	file_area_release(lib->area);
+	JS_SetPrivate(cx, obj, NULL);
+}
+
+/* Creates the directory objects of a library as properties of file_area.dir */
+static JSBool js_create_file_dirs(JSContext* cx, JSObject* alldirs, file_area_private_t* p, uint libnum)
 {
 	char		vpath[MAX_PATH+1];
-	JSObject*	areaobj;
-	JSObject*	alllibs;
-	JSObject*	alldirs;
-	JSObject*	libobj;
+	scfg_t*		cfg=p->cfg;
+	user_t*		user=p->user;
+	client_t*	client=p->client;
 	JSObject*	dirobj;
-	JSObject*	lib_list;
-	JSObject*	dir_list;
 	JSString*	js_str;
 	jsval		val;
-	jsuint		lib_index;
-	jsuint		dir_index;
-	uint		l,d;
+	int			dir_index=0;
+	uint		d;
 	BOOL		is_op;
 
-	/* Return existing object if it's already been created */
-	if(JS_GetProperty(cx,parent,"file_area",&val) && val!=JSVAL_VOID)
-		areaobj = JSVAL_TO_OBJECT(val);
-	else
-		areaobj = JS_DefineObject(cx, parent, "file_area", NULL
-								, NULL, JSPROP_ENUMERATE|JSPROP_READONLY);
-	if(areaobj==NULL)
-		return(NULL);
+	if(!file_area_valid(p) || libnum>=p->total_libs || p->lib[libnum].dirs_created)
+		return(JS_TRUE);
+	p->lib[libnum].dirs_created=TRUE;
 
-	/* file_area.properties */
-	val=UINT_TO_JSVAL(cfg->min_dspace);
-	if(!JS_SetProperty(cx, areaobj, "min_diskspace", &val)) 
-		return(NULL);
+	for(d=0;d<cfg->total_dirs;d++) {
+		if(cfg->dir[d]->lib!=libnum)
+			continue;
 
-	val=UINT_TO_JSVAL(cfg->file_misc);
-	if(!JS_SetProperty(cx, areaobj, "settings", &val)) 
-		return(NULL);
+		if((dirobj=JS_NewObject(cx, NULL, NULL, alldirs))==NULL)
+			return(JS_FALSE);
 
-	/* file_area.lib[] */
-	if((alllibs=JS_NewObject(cx, NULL, NULL, areaobj))==NULL)
-		return(NULL);
+		p->dir_index[d]=-1;
+		if(user==NULL || chk_ar(cfg,cfg->dir[d]->ar,user,client))
+			p->dir_index[d]=dir_index++;
 
-	val=OBJECT_TO_JSVAL(alllibs);
-	if(!JS_SetProperty(cx, areaobj, "lib", &val))
-		return(NULL);
+		/* Add as property (associative array element) */
+		if(!JS_DefineProperty(cx, alldirs, cfg->dir[d]->code, OBJECT_TO_JSVAL(dirobj)
+			,NULL,NULL,JSPROP_READONLY|JSPROP_ENUMERATE))
+			return(JS_FALSE);
 
-	/* file_area.dir[] */
-	if((alldirs=JS_NewObject(cx, NULL, NULL, areaobj))==NULL)
-		return(NULL);
+		val=INT_TO_JSVAL(p->dir_index[d]);
+		if(!JS_SetProperty(cx, dirobj, "index", &val))
+			return(JS_FALSE);
 
-	val=OBJECT_TO_JSVAL(alldirs);
-	if(!JS_SetProperty(cx, areaobj, "dir", &val))
-		return(NULL);
+		val=INT_TO_JSVAL(d);
+		if(!JS_SetProperty(cx, dirobj, "number", &val))
+			return(JS_FALSE);
+
+		val=INT_TO_JSVAL(p->lib[libnum].index);
+		if(!JS_SetProperty(cx, dirobj, "lib_index", &val))
+			return(JS_FALSE);
+
+		val=INT_TO_JSVAL(cfg->dir[d]->lib);
+		if(!JS_SetProperty(cx, dirobj, "lib_number", &val))
+			return(JS_FALSE);
 
-	if(html_index_file==NULL)
-		html_index_file="";
+		if((js_str=JS_NewStringCopyZ(cx, cfg->lib[cfg->dir[d]->lib]->sname))==NULL)
+			return(JS_FALSE);
+		val=STRING_TO_JSVAL(js_str);
+		if(!JS_SetProperty(cx, dirobj, "lib_name", &val))
+			return(JS_FALSE);
+
+		if((js_str=JS_NewStringCopyZ(cx, cfg->dir[d]->code))==NULL)
+			return(JS_FALSE);
+		val=STRING_TO_JSVAL(js_str);
+		if(!JS_SetProperty(cx, dirobj, "code", &val))
+			return(JS_FALSE);
+
+		if((js_str=JS_NewStringCopyZ(cx, cfg->dir[d]->sname))==NULL)
+			return(JS_FALSE);
+		val=STRING_TO_JSVAL(js_str);
+		if(!JS_SetProperty(cx, dirobj, "name", &val))
+			return(JS_FALSE);
+
+		if((js_str=JS_NewStringCopyZ(cx, cfg->dir[d]->lname))==NULL)
+			return(JS_FALSE);
+		val=STRING_TO_JSVAL(js_str);
+		if(!JS_SetProperty(cx, dirobj, "description", &val))
+			return(JS_FALSE);
+
+		if((js_str=JS_NewStringCopyZ(cx, cfg->dir[d]->path))==NULL)
+			return(JS_FALSE);
+		val=STRING_TO_JSVAL(js_str);
+		if(!JS_SetProperty(cx, dirobj, "path", &val))
+			return(JS_FALSE);
+
+		if((js_str=JS_NewStringCopyZ(cx, cfg->dir[d]->arstr))==NULL)
+			return(JS_FALSE);
+		if(!JS_DefineProperty(cx, dirobj, "ars", STRING_TO_JSVAL(js_str)
+			,NULL,NULL,JSPROP_ENUMERATE|JSPROP_READONLY))
+			return(JS_FALSE);
+
+		if((js_str=JS_NewStringCopyZ(cx, cfg->dir[d]->ul_arstr))==NULL)
+			return(JS_FALSE);
+		if(!JS_DefineProperty(cx, dirobj, "upload_ars", STRING_TO_JSVAL(js_str)
+			,NULL,NULL,JSPROP_ENUMERATE|JSPROP_READONLY))
+			return(JS_FALSE);
+
+		if((js_str=JS_NewStringCopyZ(cx, cfg->dir[d]->dl_arstr))==NULL)
+			return(JS_FALSE);
+		if(!JS_DefineProperty(cx, dirobj, "download_ars", STRING_TO_JSVAL(js_str)
+			,NULL,NULL,JSPROP_ENUMERATE|JSPROP_READONLY))
+			return(JS_FALSE);
+
+		if((js_str=JS_NewStringCopyZ(cx, cfg->dir[d]->ex_arstr))==NULL)
+			return(JS_FALSE);
+		if(!JS_DefineProperty(cx, dirobj, "exempt_ars", STRING_TO_JSVAL(js_str)
+			,NULL,NULL,JSPROP_ENUMERATE|JSPROP_READONLY))	/* exception here: Oct-15-2006 */
+			return(JS_FALSE);								/* ChangeScope->calloc() */
+
+		if((js_str=JS_NewStringCopyZ(cx, cfg->dir[d]->op_arstr))==NULL)
+			return(JS_FALSE);
+		if(!JS_DefineProperty(cx, dirobj, "operator_ars", STRING_TO_JSVAL(js_str)
+			,NULL,NULL,JSPROP_ENUMERATE|JSPROP_READONLY))
+			return(JS_FALSE);
+
+		if((js_str=JS_NewStringCopyZ(cx, cfg->dir[d]->exts))==NULL)
+			return(JS_FALSE);
+		val=STRING_TO_JSVAL(js_str);
+		if(!JS_SetProperty(cx, dirobj, "extensions", &val))
+			return(JS_FALSE);
+
+		if((js_str=JS_NewStringCopyZ(cx, cfg->dir[d]->upload_sem))==NULL)
+			return(JS_FALSE);
+		val=STRING_TO_JSVAL(js_str);
+		if(!JS_SetProperty(cx, dirobj, "upload_sem", &val))
+			return(JS_FALSE);
+
+		if((js_str=JS_NewStringCopyZ(cx, cfg->dir[d]->data_dir))==NULL)
+			return(JS_FALSE);
+		val=STRING_TO_JSVAL(js_str);
+		if(!JS_SetProperty(cx, dirobj, "data_dir", &val))
+			return(JS_FALSE);
+
+		val=UINT_TO_JSVAL(cfg->dir[d]->misc);
+		if(!JS_SetProperty(cx, dirobj, "settings", &val))
+			return(JS_FALSE);
+
+		val=INT_TO_JSVAL(cfg->dir[d]->seqdev);
+		if(!JS_SetProperty(cx, dirobj, "seqdev", &val))
+			return(JS_FALSE);
+
+		val=INT_TO_JSVAL(cfg->dir[d]->sort);
+		if(!JS_SetProperty(cx, dirobj, "sort", &val))
+			return(JS_FALSE);
+
+		val=INT_TO_JSVAL(cfg->dir[d]->maxfiles);
+		if(!JS_SetProperty(cx, dirobj, "max_files", &val))
+			return(JS_FALSE);
+
+		val=INT_TO_JSVAL(cfg->dir[d]->maxage);
+		if(!JS_SetProperty(cx, dirobj, "max_age", &val))
+			return(JS_FALSE);
+
+		val=INT_TO_JSVAL(cfg->dir[d]->up_pct);
+		if(!JS_SetProperty(cx, dirobj, "upload_credit_pct", &val))
+			return(JS_FALSE);
+
+		val=INT_TO_JSVAL(cfg->dir[d]->dn_pct);
+		if(!JS_SetProperty(cx, dirobj, "download_credit_pct", &val))
+			return(JS_FALSE);
+
+		sprintf(vpath,"/%s/%s/%s"
+			,cfg->lib[libnum]->sname
+			,cfg->dir[d]->code_suffix
+			,p->html_index_file);
+		if((js_str=JS_NewStringCopyZ(cx, vpath))==NULL)
+			return(JS_FALSE);
+		val=STRING_TO_JSVAL(js_str);
+		if(!JS_SetProperty(cx, dirobj, "link", &val))
+			return(JS_FALSE);
+
+		if(user!=NULL 
+			&& (user->level>=SYSOP_LEVEL 
+				|| (cfg->dir[d]->op_ar[0]!=0 
+					&& chk_ar(cfg,cfg->dir[d]->op_ar,user,client))))
+			is_op=TRUE;
+		else
+			is_op=FALSE;
+
+		if(user==NULL 
+			|| ((is_op || user->exempt&FLAG('U') || chk_ar(cfg,cfg->dir[d]->ul_ar,user,client)) && !(user->rest&FLAG('U'))))
+			val=JSVAL_TRUE;
+		else
+			val=JSVAL_FALSE;
+		if(!JS_SetProperty(cx, dirobj, "can_upload", &val))
+			return(JS_FALSE);
+
+		if(user==NULL 
+			|| (chk_ar(cfg,cfg->dir[d]->dl_ar,user,client) && !(user->rest&FLAG('D'))))
+			val=JSVAL_TRUE;
+		else
+			val=JSVAL_FALSE;
+		if(!JS_SetProperty(cx, dirobj, "can_download", &val))
+			return(JS_FALSE);
+
+		if(is_download_free(cfg,d,user,client))
+			val=JSVAL_TRUE;
+		else
+			val=JSVAL_FALSE;
+		if(!JS_SetProperty(cx, dirobj, "is_exempt", &val))
+			return(JS_FALSE);
+
+		if(is_op)
+			val=JSVAL_TRUE;
+		else
+			val=JSVAL_FALSE;
+		if(!JS_SetProperty(cx, dirobj, "is_operator", &val))
+			return(JS_FALSE);
+
+		val=BOOLEAN_TO_JSVAL(d==cfg->lib[libnum]->offline_dir);
+		if(!JS_SetProperty(cx, dirobj, "is_offline", &val))
+			return(JS_FALSE);
+
+		val=BOOLEAN_TO_JSVAL(d==cfg->upload_dir);
+		if(!JS_SetProperty(cx, dirobj, "is_upload", &val))
+			return(JS_FALSE);
+
+		val=BOOLEAN_TO_JSVAL(d==cfg->sysop_dir);
+		if(!JS_SetProperty(cx, dirobj, "is_sysop", &val))
+			return(JS_FALSE);
 
 #ifdef BUILD_JSDOCS
-	js_DescribeSyncObject(cx,areaobj,"File Transfer Areas",310);
+		js_CreateArrayOfStrings(cx, dirobj, "_property_desc_list", dir_prop_desc, JSPROP_READONLY);
+		js_DescribeSyncObject(cx,dirobj,"File Transfer Directories  (current user has access to)",310);
 #endif
+	}
+
+	return(JS_TRUE);
+}
+
+/* Defines obj.name as a reference to file_area.dir[code] (e.g. file_area.user_dir) */
+static JSBool js_link_file_dir(JSContext* cx, JSObject* obj, const char* name
+							   ,JSObject* alldirs, file_area_private_t* p, uint dirnum)
+{
+	jsval	val;
+
+	if(!file_area_valid(p) || dirnum>=p->total_dirs)
+		return(JS_TRUE);
+
+	if(!js_create_file_dirs(cx, alldirs, p, p->cfg->dir[dirnum]->lib))
+		return(JS_FALSE);
+
+	if(!JS_GetProperty(cx, alldirs, p->cfg->dir[dirnum]->code, &val))
+		return(JS_FALSE);
+
+	if(!JS_DefineProperty(cx, obj, name, val, NULL, NULL, JSPROP_READONLY))
+		return(JS_FALSE);
+
+	return(JS_TRUE);
+}
+
+/* file_area.dir[] */
+static JSBool js_file_dirs_resolve(JSContext *cx, JSObject *obj, jsid id)
+{
+	char*		name;
+	file_area_private_t* p;
+	JSBool		ret=JS_TRUE;
+	uint		d;
+
+	if((p=(file_area_private_t*)JS_GetPrivate(cx,obj))==NULL || !file_area_valid(p))
+		return(JS_TRUE);
+
+	if(!js_file_area_get_name(cx, id, &name))
+		return(JS_FALSE);
+
+	if(name==NULL) {
+		for(d=0;d<p->total_libs && ret;d++)
+			ret=js_create_file_dirs(cx, obj, p, d);
+		return(ret);
+	}
+
+	for(d=0;d<p->total_dirs;d++) {
+		if(strcmp(p->cfg->dir[d]->code,name)==0) {
+			ret=js_create_file_dirs(cx, obj, p, p->cfg->dir[d]->lib);
+			break;
+		}
+	}
+	free(name);
+	return(ret);
+}
+
+static JSBool js_file_dirs_enumerate(JSContext *cx, JSObject *obj)
+{
+	return(js_file_dirs_resolve(cx, obj, JSID_VOID));
+}
+
+static JSClass js_file_dirs_class = {
+     "FileDirs"				/* name			*/
+    ,JSCLASS_HAS_PRIVATE	/* flags		*/
+	,JS_PropertyStub		/* addProperty	*/
+	,JS_PropertyStub		/* delProperty	*/
+	,JS_PropertyStub		/* getProperty	*/
+	,JS_StrictPropertyStub	/* setProperty	*/
+	,js_file_dirs_enumerate	/* enumerate	*/
+	,js_file_dirs_resolve	/* resolve		*/
+	,JS_ConvertStub			/* convert		*/
+	,js_file_area_finalize	/* finalize		*/
+};
+
+/* file_area.lib[].dir_list[] and file_area.lib[].offline_dir */
+static JSBool js_file_lib_resolve(JSContext *cx, JSObject *obj, jsid id)
+{
+	char*		name;
+	file_lib_private_t* lib;
+	file_area_private_t* p;
+	JSObject*	alldirs;
+	JSObject*	dir_list;
+	jsval		val;
+	uint		d;
+	JSBool		ret=JS_TRUE;
+	BOOL		match=TRUE;
+
+	if((lib=(file_lib_private_t*)JS_GetPrivate(cx,obj))==NULL)
+		return(JS_TRUE);
+	p=lib->area;
+
+	if((alldirs=JS_GetParent(cx,obj))==NULL)
+		return(JS_TRUE);
+
+	if(!js_file_area_get_name(cx, id, &name))
+		return(JS_FALSE);
+
+	if(name!=NULL && strcmp(name,"offline_dir")==0) {
+		free(name);
+		if(lib->offline_dir_created)
+			return(JS_TRUE);
+		lib->offline_dir_created=TRUE;
+		if(file_area_valid(p) && p->cfg->lib[lib->libnum]->offline_dir<p->total_dirs
+			&& p->cfg->dir[p->cfg->lib[lib->libnum]->offline_dir]->lib==lib->libnum)
+			ret=js_link_file_dir(cx, obj, "offline_dir", alldirs, p, p->cfg->lib[lib->libnum]->offline_dir);
+		return(ret);
+	}
+
+	if(name!=NULL) {
+		match=(strcmp(name,"dir_list")==0);
+		free(name);
+	}
+	if(!match)
+		return(JS_TRUE);
+	if(lib->dir_list_created)
+		return(JS_TRUE);
+	lib->dir_list_created=TRUE;
+
+	if(!js_create_file_dirs(cx, alldirs, p, lib->libnum))
+		return(JS_FALSE);
+
+	if((dir_list=JS_NewArrayObject(cx, 0, NULL))==NULL) 
+		return(JS_FALSE);
+
+	if(!JS_DefineProperty(cx, obj, "dir_list", OBJECT_TO_JSVAL(dir_list)
+		,NULL,NULL,JSPROP_ENUMERATE))
+		return(JS_FALSE);
+
+	if(!file_area_valid(p))
+		return(JS_TRUE);
+
+	for(d=0;d<p->total_dirs;d++) {
+		if(p->cfg->dir[d]->lib!=lib->libnum || p->dir_index[d]<0)
+			continue;
+		if(!JS_GetProperty(cx, alldirs, p->cfg->dir[d]->code, &val))
+			return(JS_FALSE);
+		if(!JS_SetElement(cx, dir_list, p->dir_index[d], &val))
+			return(JS_FALSE);
+	}
+
+	return(JS_TRUE);
+}
+
+static JSBool js_file_lib_enumerate(JSContext *cx, JSObject *obj)
+{
+	return(js_file_lib_resolve(cx, obj, JSID_VOID));
+}
+
+static JSClass js_file_lib_class = {
+     "FileLib"				/* name			*/
+    ,JSCLASS_HAS_PRIVATE	/* flags		*/
+	,JS_PropertyStub		/* addProperty	*/
+	,JS_PropertyStub		/* delProperty	*/
+	,JS_PropertyStub		/* getProperty	*/
+	,JS_StrictPropertyStub	/* setProperty	*/
+	,js_file_lib_enumerate	/* enumerate	*/
+	,js_file_lib_resolve	/* resolve		*/
+	,JS_ConvertStub			/* convert		*/
+	,js_file_lib_finalize	/* finalize		*/
+};
+
+/* file_area.lib[], file_area.dir[] and file_area.lib_list[] */
+static JSBool js_create_file_libs(JSContext* cx, JSObject* areaobj, file_area_private_t* p)
+{
+	char		vpath[MAX_PATH+1];
+	scfg_t*		cfg=p->cfg;
+	JSObject*	alllibs;
+	JSObject*	alldirs;
+	JSObject*	libobj;
+	JSObject*	lib_list;
+	JSString*	js_str;
+	jsval		val;
+	jsuint		lib_index;
+	uint		l;
+
+	p->libs_created=TRUE;
+	if(!file_area_valid(p))
+		return(JS_TRUE);
+
+	/* file_area.lib[] */
+	if((alllibs=JS_NewObject(cx, NULL, NULL, areaobj))==NULL)
+		return(JS_FALSE);
+
+	if(!JS_DefineProperty(cx, areaobj, "lib", OBJECT_TO_JSVAL(alllibs)
+		,NULL,NULL,JSPROP_ENUMERATE))
+		return(JS_FALSE);
+
+	/* file_area.dir[] */
+	if((alldirs=JS_NewObject(cx, &js_file_dirs_class, NULL, areaobj))==NULL)
+		return(JS_FALSE);
+	JS_SetPrivate(cx, alldirs, p);
+	p->refs++;
+
+	if(!JS_DefineProperty(cx, areaobj, "dir", OBJECT_TO_JSVAL(alldirs)
+		,NULL,NULL,JSPROP_ENUMERATE))
+		return(JS_FALSE);
 
 	/* file_area.lib_list[] */
 	if((lib_list=JS_NewArrayObject(cx, 0, NULL))==NULL) 
-		return(NULL);
+		return(JS_FALSE);
 
-	val=OBJECT_TO_JSVAL(lib_list);
-	if(!JS_SetProperty(cx, areaobj, "lib_list", &val)) 
-		return(NULL);
+	if(!JS_DefineProperty(cx, areaobj, "lib_list", OBJECT_TO_JSVAL(lib_list)
+		,NULL,NULL,JSPROP_ENUMERATE))
+		return(JS_FALSE);
 
 	for(l=0;l<cfg->total_libs;l++) {
 
-		if((libobj=JS_NewObject(cx, NULL, NULL, NULL))==NULL)
-			return(NULL);
+		/* Parent is file_area.dir, where the library's directories are created */
+		if((libobj=JS_NewObject(cx, &js_file_lib_class, NULL, alldirs))==NULL)
+			return(JS_FALSE);
+		p->lib[l].area=p;
+		p->lib[l].libnum=l;
+		JS_SetPrivate(cx, libobj, &p->lib[l]);
+		p->refs++;
 
 		val=OBJECT_TO_JSVAL(libobj);
 		lib_index=-1;
-		if(user==NULL || chk_ar(cfg,cfg->lib[l]->ar,user,client)) {
+		if(p->user==NULL || chk_ar(cfg,cfg->lib[l]->ar,p->user,p->client)) {
 
 			if(!JS_GetArrayLength(cx, lib_list, &lib_index))
-				return(NULL);
+				return(JS_FALSE);
 
 			if(!JS_SetElement(cx, lib_list, lib_index, &val))
-				return(NULL);
+				return(JS_FALSE);
 		}
+		p->lib[l].index=lib_index;
 
 		/* Add as property (associative array element) */
 		if(!JS_DefineProperty(cx, alllibs, cfg->lib[l]->sname, val
 			,NULL,NULL,JSPROP_READONLY|JSPROP_ENUMERATE))
-			return(NULL);
+			return(JS_FALSE);
 
 		val=INT_TO_JSVAL(lib_index);
 		if(!JS_SetProperty(cx, libobj, "index", &val))
-			return(NULL);
+			return(JS_FALSE);
 
 		val=INT_TO_JSVAL(l);
 		if(!JS_SetProperty(cx, libobj, "number", &val))
-			return(NULL);
+			return(JS_FALSE);
 
 		if((js_str=JS_NewStringCopyZ(cx, cfg->lib[l]->sname))==NULL)
-			return(NULL);
+			return(JS_FALSE);
 		val=STRING_TO_JSVAL(js_str);
 		if(!JS_SetProperty(cx, libobj, "name", &val))
-			return(NULL);
+			return(JS_FALSE);
 
 		if((js_str=JS_NewStringCopyZ(cx, cfg->lib[l]->lname))==NULL)
-			return(NULL);
+			return(JS_FALSE);
 		val=STRING_TO_JSVAL(js_str);
 		if(!JS_SetProperty(cx, libobj, "description", &val))
-			return(NULL);
+			return(JS_FALSE);
 
 		if((js_str=JS_NewStringCopyZ(cx, cfg->lib[l]->arstr))==NULL)
-			return(NULL);
+			return(JS_FALSE);
 		val=STRING_TO_JSVAL(js_str);
 		if(!JS_SetProperty(cx, libobj, "ars", &val))
-			return(NULL);
+			return(JS_FALSE);
 
-		sprintf(vpath,"/%s/%s",cfg->lib[l]->sname,html_index_file);
+		sprintf(vpath,"/%s/%s",cfg->lib[l]->sname,p->html_index_file);
 		if((js_str=JS_NewStringCopyZ(cx, vpath))==NULL)
-			return(NULL);
+			return(JS_FALSE);
 		val=STRING_TO_JSVAL(js_str);
 		if(!JS_SetProperty(cx, libobj, "link", &val))
-			return(NULL);
+			return(JS_FALSE);
 
 #ifdef BUILD_JSDOCS
 		js_DescribeSyncObject(cx,libobj,"File Transfer Libraries (current user has access to)",310);
-#endif
-
-		/* dir_list[] */
-		if((dir_list=JS_NewArrayObject(cx, 0, NULL))==NULL) 
-			return(NULL);
-
-		val=OBJECT_TO_JSVAL(dir_list);
-		if(!JS_SetProperty(cx, libobj, "dir_list", &val)) 
-			return(NULL);
-
-		for(d=0;d<cfg->total_dirs;d++) {
-			if(cfg->dir[d]->lib!=l)
-				continue;
-
-			if((dirobj=JS_NewObject(cx, NULL, NULL, NULL))==NULL)
-				return(NULL);
-
-			val=OBJECT_TO_JSVAL(dirobj);
-			dir_index=-1;
-			if(user==NULL || chk_ar(cfg,cfg->dir[d]->ar,user,client)) {
-
-				if(!JS_GetArrayLength(cx, dir_list, &dir_index))
-					return(NULL);								
-
-				if(!JS_SetElement(cx, dir_list, dir_index, &val))
-					return(NULL);
-			}
-
-			/* Add as property (associative array element) */
-			if(!JS_DefineProperty(cx, alldirs, cfg->dir[d]->code, val
-				,NULL,NULL,JSPROP_READONLY|JSPROP_ENUMERATE))
-				return(NULL);
-
-			if(d==cfg->user_dir 
-				&& !JS_DefineProperty(cx, areaobj, "user_dir", val
-					,NULL,NULL,JSPROP_READONLY))
-				return(NULL);
-
-			if(d==cfg->sysop_dir 
-				&& !JS_DefineProperty(cx, areaobj, "sysop_dir", val
-					,NULL,NULL,JSPROP_READONLY))
-				return(NULL);
-
-			if(d==cfg->upload_dir 
-				&& !JS_DefineProperty(cx, areaobj, "upload_dir", val
-					,NULL,NULL,JSPROP_READONLY))
-				return(NULL);
-
-			if(d==cfg->lib[l]->offline_dir
-				&& !JS_DefineProperty(cx, libobj, "offline_dir", val
-					,NULL,NULL,JSPROP_READONLY))
-				return(NULL);
-
-			val=INT_TO_JSVAL(dir_index);
-			if(!JS_SetProperty(cx, dirobj, "index", &val))
-				return(NULL);
-
-			val=INT_TO_JSVAL(d);
-			if(!JS_SetProperty(cx, dirobj, "number", &val))
-				return(NULL);
-
-			val=INT_TO_JSVAL(lib_index);
-			if(!JS_SetProperty(cx, dirobj, "lib_index", &val))
-				return(NULL);
-
-			val=INT_TO_JSVAL(cfg->dir[d]->lib);
-			if(!JS_SetProperty(cx, dirobj, "lib_number", &val))
-				return(NULL);
-
-			if((js_str=JS_NewStringCopyZ(cx, cfg->lib[cfg->dir[d]->lib]->sname))==NULL)
-				return(NULL);
-			val=STRING_TO_JSVAL(js_str);
-			if(!JS_SetProperty(cx, dirobj, "lib_name", &val))
-				return(NULL);
-
-			if((js_str=JS_NewStringCopyZ(cx, cfg->dir[d]->code))==NULL)
-				return(NULL);
-			val=STRING_TO_JSVAL(js_str);
-			if(!JS_SetProperty(cx, dirobj, "code", &val))
-				return(NULL);
-
-			if((js_str=JS_NewStringCopyZ(cx, cfg->dir[d]->sname))==NULL)
-				return(NULL);
-			val=STRING_TO_JSVAL(js_str);
-			if(!JS_SetProperty(cx, dirobj, "name", &val))
-				return(NULL);
-
-			if((js_str=JS_NewStringCopyZ(cx, cfg->dir[d]->lname))==NULL)
-				return(NULL);
-			val=STRING_TO_JSVAL(js_str);
-			if(!JS_SetProperty(cx, dirobj, "description", &val))
-				return(NULL);
-
-			if((js_str=JS_NewStringCopyZ(cx, cfg->dir[d]->path))==NULL)
-				return(NULL);
-			val=STRING_TO_JSVAL(js_str);
-			if(!JS_SetProperty(cx, dirobj, "path", &val))
-				return(NULL);
-
-			if((js_str=JS_NewStringCopyZ(cx, cfg->dir[d]->arstr))==NULL)
-				return(NULL);
-			if(!JS_DefineProperty(cx, dirobj, "ars", STRING_TO_JSVAL(js_str)
-				,NULL,NULL,JSPROP_ENUMERATE|JSPROP_READONLY))
-				return(NULL);
-
-			if((js_str=JS_NewStringCopyZ(cx, cfg->dir[d]->ul_arstr))==NULL)
-				return(NULL);
-			if(!JS_DefineProperty(cx, dirobj, "upload_ars", STRING_TO_JSVAL(js_str)
-				,NULL,NULL,JSPROP_ENUMERATE|JSPROP_READONLY))
-				return(NULL);
-
-			if((js_str=JS_NewStringCopyZ(cx, cfg->dir[d]->dl_arstr))==NULL)
-				return(NULL);
-			if(!JS_DefineProperty(cx, dirobj, "download_ars", STRING_TO_JSVAL(js_str)
-				,NULL,NULL,JSPROP_ENUMERATE|JSPROP_READONLY))
-				return(NULL);
-
-			if((js_str=JS_NewStringCopyZ(cx, cfg->dir[d]->ex_arstr))==NULL)
-				return(NULL);
-			if(!JS_DefineProperty(cx, dirobj, "exempt_ars", STRING_TO_JSVAL(js_str)
-				,NULL,NULL,JSPROP_ENUMERATE|JSPROP_READONLY))	/* exception here: Oct-15-2006 */
-				return(NULL);									/* ChangeScope->calloc() */
-
-			if((js_str=JS_NewStringCopyZ(cx, cfg->dir[d]->op_arstr))==NULL)
-				return(NULL);
-			if(!JS_DefineProperty(cx, dirobj, "operator_ars", STRING_TO_JSVAL(js_str)
-				,NULL,NULL,JSPROP_ENUMERATE|JSPROP_READONLY))
-				return(NULL);
-
-			if((js_str=JS_NewStringCopyZ(cx, cfg->dir[d]->exts))==NULL)
-				return(NULL);
-			val=STRING_TO_JSVAL(js_str);
-			if(!JS_SetProperty(cx, dirobj, "extensions", &val))
-				return(NULL);
-
-			if((js_str=JS_NewStringCopyZ(cx, cfg->dir[d]->upload_sem))==NULL)
-				return(NULL);
-			val=STRING_TO_JSVAL(js_str);
-			if(!JS_SetProperty(cx, dirobj, "upload_sem", &val))
-				return(NULL);
-
-			if((js_str=JS_NewStringCopyZ(cx, cfg->dir[d]->data_dir))==NULL)
-				return(NULL);
-			val=STRING_TO_JSVAL(js_str);
-			if(!JS_SetProperty(cx, dirobj, "data_dir", &val))
-				return(NULL);
-
-			val=UINT_TO_JSVAL(cfg->dir[d]->misc);
-			if(!JS_SetProperty(cx, dirobj, "settings", &val))
-				return(NULL);
-
-			val=INT_TO_JSVAL(cfg->dir[d]->seqdev);
-			if(!JS_SetProperty(cx, dirobj, "seqdev", &val))
-				return(NULL);
-
-			val=INT_TO_JSVAL(cfg->dir[d]->sort);
-			if(!JS_SetProperty(cx, dirobj, "sort", &val))
-				return(NULL);
-
-			val=INT_TO_JSVAL(cfg->dir[d]->maxfiles);
-			if(!JS_SetProperty(cx, dirobj, "max_files", &val))
-				return(NULL);
-
-			val=INT_TO_JSVAL(cfg->dir[d]->maxage);
-			if(!JS_SetProperty(cx, dirobj, "max_age", &val))
-				return(NULL);
-
-			val=INT_TO_JSVAL(cfg->dir[d]->up_pct);
-			if(!JS_SetProperty(cx, dirobj, "upload_credit_pct", &val))
-				return(NULL);
-
-			val=INT_TO_JSVAL(cfg->dir[d]->dn_pct);
-			if(!JS_SetProperty(cx, dirobj, "download_credit_pct", &val))
-				return(NULL);
-
-			sprintf(vpath,"/%s/%s/%s"
-				,cfg->lib[l]->sname
-				,cfg->dir[d]->code_suffix
-				,html_index_file);
-			if((js_str=JS_NewStringCopyZ(cx, vpath))==NULL)
-				return(NULL);
-			val=STRING_TO_JSVAL(js_str);
-			if(!JS_SetProperty(cx, dirobj, "link", &val))
-				return(NULL);
-
-			if(user!=NULL 
-				&& (user->level>=SYSOP_LEVEL 
-					|| (cfg->dir[d]->op_ar[0]!=0 
-						&& chk_ar(cfg,cfg->dir[d]->op_ar,user,client))))
-				is_op=TRUE;
-			else
-				is_op=FALSE;
-
-			if(user==NULL 
-				|| ((is_op || user->exempt&FLAG('U') || chk_ar(cfg,cfg->dir[d]->ul_ar,user,client)) && !(user->rest&FLAG('U'))))
-				val=JSVAL_TRUE;
-			else
-				val=JSVAL_FALSE;
-			if(!JS_SetProperty(cx, dirobj, "can_upload", &val))
-				return(NULL);
-
-			if(user==NULL 
-				|| (chk_ar(cfg,cfg->dir[d]->dl_ar,user,client) && !(user->rest&FLAG('D'))))
-				val=JSVAL_TRUE;
-			else
-				val=JSVAL_FALSE;
-			if(!JS_SetProperty(cx, dirobj, "can_download", &val))
-				return(NULL);
-
-			if(is_download_free(cfg,d,user,client))
-				val=JSVAL_TRUE;
-			else
-				val=JSVAL_FALSE;
-			if(!JS_SetProperty(cx, dirobj, "is_exempt", &val))
-				return(NULL);
-
-			if(is_op)
-				val=JSVAL_TRUE;
-			else
-				val=JSVAL_FALSE;
-			if(!JS_SetProperty(cx, dirobj, "is_operator", &val))
-				return(NULL);
-
-			val=BOOLEAN_TO_JSVAL(d==cfg->lib[l]->offline_dir);
-			if(!JS_SetProperty(cx, dirobj, "is_offline", &val))
-				return(NULL);
-
-			val=BOOLEAN_TO_JSVAL(d==cfg->upload_dir);
-			if(!JS_SetProperty(cx, dirobj, "is_upload", &val))
-				return(NULL);
-
-			val=BOOLEAN_TO_JSVAL(d==cfg->sysop_dir);
-			if(!JS_SetProperty(cx, dirobj, "is_sysop", &val))
-				return(NULL);
-
-#ifdef BUILD_JSDOCS
-			js_CreateArrayOfStrings(cx, dirobj, "_property_desc_list", dir_prop_desc, JSPROP_READONLY);
-			js_DescribeSyncObject(cx,dirobj,"File Transfer Directories  (current user has access to)",310);
-#endif
-		}
-
-#ifdef BUILD_JSDOCS
 		js_CreateArrayOfStrings(cx, libobj, "_property_desc_list", lib_prop_desc, JSPROP_READONLY);
 #endif
 	}
 
 #ifdef BUILD_JSDOCS
-	js_CreateArrayOfStrings(cx, areaobj, "_property_desc_list", file_area_prop_desc, JSPROP_READONLY);
-
 	js_DescribeSyncObject(cx,alllibs,"Associative array of all libraries (use name as index)",312);
 	JS_DefineProperty(cx,alllibs,"_dont_document",JSVAL_TRUE,NULL,NULL,JSPROP_READONLY);
 
@@ -476,6 +682,133 @@ JSObject* DLLCALL js_CreateFileAreaObject(JSContext* cx, JSObject* parent, scfg_
 	JS_DefineProperty(cx,alldirs,"_dont_document",JSVAL_TRUE,NULL,NULL,JSPROP_READONLY);
 #endif
 
+	return(JS_TRUE);
+}
+
+static JSBool js_file_area_resolve(JSContext *cx, JSObject *obj, jsid id)
+{
+	char*		name;
+	file_area_private_t* p;
+	JSBool		ret=JS_TRUE;
+	jsval		val;
+	uint		dirnum;
+
+	if((p=(file_area_private_t*)JS_GetPrivate(cx,obj))==NULL)
+		return(JS_TRUE);
+
+	if(!js_file_area_get_name(cx, id, &name))
+		return(JS_FALSE);
+
+	if(name==NULL || strcmp(name,"lib")==0 || strcmp(name,"dir")==0 || strcmp(name,"lib_list")==0) {
+		if(!p->libs_created)
+			ret=js_create_file_libs(cx, obj, p);
+	}
+	else if(strcmp(name,"user_dir")==0 || strcmp(name,"sysop_dir")==0 || strcmp(name,"upload_dir")==0) {
+		if(strcmp(name,"user_dir")==0)
+			dirnum=p->cfg->user_dir;
+		else if(strcmp(name,"sysop_dir")==0)
+			dirnum=p->cfg->sysop_dir;
+		else
+			dirnum=p->cfg->upload_dir;
+		/* Resolves file_area.dir, if necessary */
+		if(JS_GetProperty(cx, obj, "dir", &val) && JSVAL_IS_OBJECT(val) && !JSVAL_IS_NULL(val))
+			ret=js_link_file_dir(cx, obj, name, JSVAL_TO_OBJECT(val), p, dirnum);
+	}
+	if(name)
+		free(name);
+
+	return(ret);
+}
+
+static JSBool js_file_area_enumerate(JSContext *cx, JSObject *obj)
+{
+	return(js_file_area_resolve(cx, obj, JSID_VOID));
+}
+
+static JSClass js_file_area_class = {
+     "FileArea"				/* name			*/
+    ,JSCLASS_HAS_PRIVATE	/* flags		*/
+	,JS_PropertyStub		/* addProperty	*/
+	,JS_PropertyStub		/* delProperty	*/
+	,JS_PropertyStub		/* getProperty	*/
+	,JS_StrictPropertyStub	/* setProperty	*/
+	,js_file_area_enumerate	/* enumerate	*/
+	,js_file_area_resolve	/* resolve		*/
+	,JS_ConvertStub			/* convert		*/
+	,js_file_area_finalize	/* finalize		*/
+};
+
+JSObject* DLLCALL js_CreateFileAreaObject(JSContext* cx, JSObject* parent, scfg_t* cfg
+										  ,user_t* user, client_t* client, char* html_index_file)
+{
+	JSObject*	areaobj=NULL;
+	file_area_private_t* p;
+	file_area_private_t* old;
+	jsval		val;
+
+	if((p=(file_area_private_t*)calloc(1,sizeof(file_area_private_t)))==NULL)
+		return(NULL);
+	p->refs=1;
+	p->cfg=cfg;
+	if(user!=NULL) {
+		p->user_buf=*user;
+		p->user=&p->user_buf;
+	}
+	if(client!=NULL) {
+		p->client_buf=*client;
+		p->client=&p->client_buf;
+	}
+	if(html_index_file!=NULL)
+		SAFECOPY(p->html_index_file,html_index_file);
+	p->generation=cfg->generation;
+	p->total_libs=cfg->total_libs;
+	p->total_dirs=cfg->total_dirs;
+	if((p->lib=(file_lib_private_t*)calloc(cfg->total_libs+1,sizeof(file_lib_private_t)))==NULL
+		|| (p->dir_index=(int*)calloc(cfg->total_dirs+1,sizeof(int)))==NULL) {
+		file_area_release(p);
+		return(NULL);
+	}
+
+	/* Return existing object if it's already been created */
+	if(JS_GetProperty(cx,parent,"file_area",&val) && JSVAL_IS_OBJECT(val) && !JSVAL_IS_NULL(val)
+		&& (old=(file_area_private_t*)JS_GetInstancePrivate(cx,JSVAL_TO_OBJECT(val),&js_file_area_class,NULL))!=NULL) {
+		areaobj = JSVAL_TO_OBJECT(val);
+		JS_SetPrivate(cx, areaobj, p);
+		file_area_release(old);
+		/* Re-created on next reference */
+		JS_DeleteProperty(cx, areaobj, "lib");
+		JS_DeleteProperty(cx, areaobj, "dir");
+		JS_DeleteProperty(cx, areaobj, "lib_list");
+		JS_DeleteProperty(cx, areaobj, "user_dir");
+		JS_DeleteProperty(cx, areaobj, "sysop_dir");
+		JS_DeleteProperty(cx, areaobj, "upload_dir");
+	}
+	else {
+		areaobj = JS_DefineObject(cx, parent, "file_area", &js_file_area_class
+									, NULL, JSPROP_ENUMERATE|JSPROP_READONLY);
+		if(areaobj!=NULL)
+			JS_SetPrivate(cx, areaobj, p);
+	}
+
+	if(areaobj==NULL) {
+		file_area_release(p);
+		return(NULL);
+	}
+
+	/* file_area.properties */
+	val=UINT_TO_JSVAL(cfg->min_dspace);
+	if(!JS_SetProperty(cx, areaobj, "min_diskspace", &val)) 
+		return(NULL);
+
+	val=UINT_TO_JSVAL(cfg->file_misc);
+	if(!JS_SetProperty(cx, areaobj, "settings", &val)) 
+		return(NULL);
+
+#ifdef BUILD_JSDOCS
+	js_DescribeSyncObject(cx,areaobj,"File Transfer Areas",310);
+	js_CreateArrayOfStrings(cx, areaobj, "_property_desc_list", file_area_prop_desc, JSPROP_READONLY);
+#endif
+
 	return(areaobj);
 }
 
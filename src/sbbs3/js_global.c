@@ -42,6 +42,7 @@
 #include "ini_file.h"
 #include "js_rtpool.h"
 #include "js_request.h"
+#include "js_cache.h"
 #include "wordwrap.h"
 
 /* SpiderMonkey: */
@@ -587,7 +588,7 @@ js_load(JSContext *cx, uintN argc, jsval *arglist)
 
 	JS_ClearPendingException(exec_cx);
 
-	if((script=JS_CompileFile(exec_cx, exec_obj, path))==NULL) {
+	if((script=js_get_compiled_script(exec_cx, exec_obj, path))==NULL) {
 		if(background) {
 			JS_ENDREQUEST(bg->cx);
 			JS_RemoveObjectRoot(bg->cx, &bg->obj);
@@ -3397,6 +3398,8 @@ js_socket_select(JSContext *cx, uintN argc, jsval *arglist)
 	jsuint		i;
     jsuint      limit;
 	SOCKET*		index;
+	BOOL*		buffered;	/* Socket objects with received data not yet read */
+	BOOL		any_buffered=FALSE;
 	jsval		val;
 	int			len=0;
 	jsrefcount	rc;
@@ -3424,6 +3427,10 @@ js_socket_select(JSContext *cx, uintN argc, jsval *arglist)
 
 	if((index=(SOCKET *)malloc(sizeof(SOCKET)*limit))==NULL)
 		return(JS_FALSE);
+	if((buffered=(BOOL *)malloc(sizeof(BOOL)*limit))==NULL) {
+		free(index);
+		return(JS_FALSE);
+	}
 
 	FD_ZERO(&socket_set);
 	if(poll_for_write)
@@ -3436,18 +3443,30 @@ js_socket_select(JSContext *cx, uintN argc, jsval *arglist)
 			break;
 		sock=js_socket(cx,val);
 		index[i]=sock;
+		buffered[i]=FALSE;
 		if(sock!=INVALID_SOCKET) {
 			FD_SET(sock,&socket_set);
 			if(sock>maxsock)
 				maxsock=sock;
+			if(!poll_for_write && js_socket_pending(cx,val))
+				any_buffered=buffered[i]=TRUE;
 		}
     }
+	for(;i<limit;i++) {	/* JS_GetElement() failure */
+		index[i]=INVALID_SOCKET;
+		buffered[i]=FALSE;
+	}
+
+	/* Already-received data is ready to be read now: don't wait for more */
+	if(any_buffered)
+		tv.tv_sec=tv.tv_usec=0;
 
 	rc=JS_SUSPENDREQUEST(cx);
 	if(select(maxsock+1,rd_set,wr_set,NULL,&tv) >= 0) {
 
 		for(i=0;i<limit;i++) {
-			if(index[i]!=INVALID_SOCKET && FD_ISSET(index[i],&socket_set)) {
+			if(index[i]!=INVALID_SOCKET
+				&& (buffered[i] || FD_ISSET(index[i],&socket_set))) {
 				val=INT_TO_JSVAL(i);
 				JS_RESUMEREQUEST(cx, rc);
    				if(!JS_SetElement(cx, rarray, len++, &val)) {
@@ -3461,6 +3480,7 @@ js_socket_select(JSContext *cx, uintN argc, jsval *arglist)
 		JS_SET_RVAL(cx, arglist, OBJECT_TO_JSVAL(rarray));
 	}
 	free(index);
+	free(buffered);
 	JS_RESUMEREQUEST(cx, rc);
 
     return(JS_TRUE);
@@ -37,6 +37,7 @@
 
 #include "sbbs.h"
 #include "js_request.h"
+#include "js_cache.h"
 
 /* SpiderMonkey: */
 #include <jsdbgapi.h>
@@ -57,6 +58,10 @@ enum {
 	,PROP_MAXBYTES
 #endif
 	,PROP_GLOBAL
+	,PROP_CACHE_SCRIPTS
+	,PROP_CACHE_HITS
+	,PROP_CACHE_MISSES
+	,PROP_CACHE_COMPILE_TIME
 };
 
 static JSBool js_get(JSContext *cx, JSObject *obj, jsid id, jsval *vp)
@@ -64,6 +69,7 @@ static JSBool js_get(JSContext *cx, JSObject *obj, jsid id, jsval *vp)
 	jsval idval;
     jsint			tiny;
 	js_callback_t*	cb;
+	js_cache_stats_t cache;
 
 	if((cb=(js_callback_t*)JS_GetPrivate(cx,obj))==NULL)
 		return(JS_FALSE);
@@ -116,6 +122,22 @@ static JSBool js_get(JSContext *cx, JSObject *obj, jsid id, jsval *vp)
 		case PROP_GLOBAL:
 			*vp = OBJECT_TO_JSVAL(JS_GetGlobalObject(cx));	
 			break;
+		case PROP_CACHE_SCRIPTS:
+			js_cache_stats(&cache);
+			*vp=DOUBLE_TO_JSVAL((double)cache.scripts);
+			break;
+		case PROP_CACHE_HITS:
+			js_cache_stats(&cache);
+			*vp=DOUBLE_TO_JSVAL((double)cache.hits);
+			break;
+		case PROP_CACHE_MISSES:
+			js_cache_stats(&cache);
+			*vp=DOUBLE_TO_JSVAL((double)cache.misses);
+			break;
+		case PROP_CACHE_COMPILE_TIME:
+			js_cache_stats(&cache);
+			*vp=DOUBLE_TO_JSVAL(cache.compile_time);
+			break;
 	}
 
 	return(JS_TRUE);
@@ -190,6 +212,10 @@ static jsSyncPropertySpec js_properties[] = {
 	{	"max_bytes",		PROP_MAXBYTES,		JSPROP_ENUMERATE,	311 },
 #endif
 	{	"global",			PROP_GLOBAL,		PROP_FLAGS,			314 },
+	{	"cache_scripts",	PROP_CACHE_SCRIPTS,	PROP_FLAGS,			316 },
+	{	"cache_hits",		PROP_CACHE_HITS,	PROP_FLAGS,			316 },
+	{	"cache_misses",		PROP_CACHE_MISSES,	PROP_FLAGS,			316 },
+	{	"cache_compile_time",PROP_CACHE_COMPILE_TIME,PROP_FLAGS,	316 },
 	{0}
 };
 
@@ -210,6 +236,10 @@ static char* prop_desc[] = {
 	,"maximum number of bytes available for heap"
 #endif
 	,"global (top level) object - <small>READ ONLY</small>"
+	,"number of compiled scripts currently held in the (process-wide) script cache - <small>READ ONLY</small>"
+	,"number of scripts loaded from the script cache without compiling - <small>READ ONLY</small>"
+	,"number of scripts compiled from source (not found in, or stale in, the script cache) - <small>READ ONLY</small>"
+	,"total number of seconds spent compiling scripts from source - <small>READ ONLY</small>"
 	/* New properties go here... */
 	,"load() search path array.<br>For relative load paths (e.g. not beginning with '/' or '\'), "
 		"the path is assumed to be a sub-directory of the (configurable) mods or exec directories "
@@ -330,247 +330,514 @@ static JSClass js_sub_class = {
 	,JS_FinalizeStub		/* finalize		*/
 };
 
-JSObject* DLLCALL js_CreateMsgAreaObject(JSContext* cx, JSObject* parent, scfg_t* cfg
-										  ,user_t* user, client_t* client, subscan_t* subscan)
+/*
+ * The msg_area object tree is created on demand (via resolve hooks):
+ * groups when msg_area.grp, msg_area.sub or msg_area.grp_list is first
+ * referenced (or enumerated) and the sub-boards of a group when the group's
+ * sub_list or one of its sub-boards (by internal code) is first referenced.
+ * Access is evaluated against a copy of the user and client taken when the
+ * object was created, same as if the whole tree had been created then.
+ */
+struct msg_area_private;
+
+typedef struct {
+	struct msg_area_private* area;
+	uint		grpnum;
+	int			index;			/* index into grp_list[] (or -1) */
+	BOOL		subs_created;
+	BOOL		sub_list_created;
+} msg_grp_private_t;
+
+typedef struct msg_area_private {
+	ulong		refs;			/* area, sub[] and grp[] objects referencing this */
+	scfg_t*		cfg;
+	user_t*		user;			/* NULL or &user_buf */
+	client_t*	client;			/* NULL or &client_buf */
+	user_t		user_buf;
+	client_t	client_buf;
+	subscan_t*	subscan;
+	DWORD		generation;		/* of cfg when created */
+	uint		total_grps;
+	uint		total_subs;
+	BOOL		grps_created;
+	msg_grp_private_t* grp;
+	int*		sub_index;		/* index into grp's sub_list[] (or -1) */
+} msg_area_private_t;
+
+static void msg_area_release(msg_area_private_t* p)
 {
-	JSObject*	areaobj;
-	JSObject*	allgrps;
-	JSObject*	allsubs;
-	JSObject*	grpobj_proto;
-	JSObject*	grpobj;
-	JSObject*	subobj_proto;
+	if(p==NULL || --p->refs)
+		return;
+	FREE_AND_NULL(p->grp);
+	FREE_AND_NULL(p->sub_index);
+	free(p);
+}
+
+/* Returns FALSE if the configuration has been reloaded since the object was created */
+static BOOL msg_area_valid(msg_area_private_t* p)
+{
+	return(p->generation==p->cfg->generation);
+}
+
+static JSBool js_msg_area_get_name(JSContext* cx, jsid id, char** name)
+{
+	jsval idval;
+
+	*name=NULL;
+	if(id == JSID_VOID || id == JSID_EMPTY)
+		return(JS_TRUE);
+
+	JS_IdToValue(cx, id, &idval);
+	if(JSVAL_IS_STRING(idval)) {
+		JSSTRING_TO_MSTRING(cx, JSVAL_TO_STRING(idval), *name, NULL);
+		HANDLE_PENDING(cx);
+	} else if(JSVAL_IS_INT(idval)) {
+		if((*name=(char*)malloc(16))!=NULL)
+			sprintf(*name,"%d",JSVAL_TO_INT(idval));
+	}
+	return(JS_TRUE);
+}
+
+static void js_msg_area_finalize(JSContext *cx, JSObject *obj)
+{
+	msg_area_release((msg_area_private_t*)JS_GetPrivate(cx,obj));
+	JS_SetPrivate(cx, obj, NULL);
+}
+
+static void js_msg_grp_finalize(JSContext *cx, JSObject *obj)
+{
+	msg_grp_private_t* grp;
+
+	if((grp=(msg_grp_private_t*)JS_GetPrivate(cx,obj))==NULL)
+		return;
+	msg_area_release(grp->area);
+	JS_SetPrivate(cx, obj, NULL);
+}
+
+/* Creates the sub-board objects of a group as properties of msg_area.sub */
+static JSBool js_create_msg_subs(JSContext* cx, JSObject* allsubs, msg_area_private_t* p, uint grpnum)
+{
+	scfg_t*		cfg=p->cfg;
+	user_t*		user=p->user;
+	client_t*	client=p->client;
 	JSObject*	subobj;
-	JSObject*	grp_list;
-	JSObject*	sub_list;
-	JSString*	js_str;
 	jsval		val;
-	jsuint		grp_index;
-	jsuint		sub_index;
-	uint		l,d;
+	int			sub_index=0;
+	uint		d;
 
-	/* Return existing object if it's already been created */
-	if(JS_GetProperty(cx,parent,"msg_area",&val) && val!=JSVAL_VOID)
-		areaobj = JSVAL_TO_OBJECT(val);
-	else
-		areaobj = JS_DefineObject(cx, parent, "msg_area", NULL
-									, NULL, JSPROP_ENUMERATE|JSPROP_READONLY);
+	if(!msg_area_valid(p) || grpnum>=p->total_grps || p->grp[grpnum].subs_created)
+		return(JS_TRUE);
+	p->grp[grpnum].subs_created=TRUE;
 
-	if(areaobj==NULL)
-		return(NULL);
+	for(d=0;d<cfg->total_subs;d++) {
+		if(cfg->sub[d]->grp!=grpnum)
+			continue;
+
+		if((subobj=JS_NewObject(cx, &js_sub_class, NULL, allsubs))==NULL)
+			return(JS_FALSE);
+
+		if(p->subscan!=NULL)
+			JS_SetPrivate(cx,subobj,&p->subscan[d]);
+
+		p->sub_index[d]=-1;
+		if(user==NULL || can_user_access_sub(cfg,d,user,client))
+			p->sub_index[d]=sub_index++;
+
+		/* Add as property (associative array element) */
+		if(!JS_DefineProperty(cx, allsubs, cfg->sub[d]->code, OBJECT_TO_JSVAL(subobj)
+			,NULL,NULL,JSPROP_READONLY|JSPROP_ENUMERATE))
+			return(JS_FALSE);
+
+		val=INT_TO_JSVAL(p->sub_index[d]);
+		if(!JS_SetProperty(cx, subobj, "index", &val))
+			return(JS_FALSE);
+
+		val=INT_TO_JSVAL(p->grp[grpnum].index);
+		if(!JS_SetProperty(cx, subobj, "grp_index", &val))
+			return(JS_FALSE);
+
+		if(!js_CreateMsgAreaProperties(cx, cfg, subobj, d))
+			return(JS_FALSE);
+	
+		if(user==NULL)
+			val=BOOLEAN_TO_JSVAL(JS_TRUE);
+		else
+			val=BOOLEAN_TO_JSVAL(can_user_read_sub(cfg,d,user,client));
+		if(!JS_SetProperty(cx, subobj, "can_read", &val))
+			return(JS_FALSE);
+
+		if(user==NULL)
+			val=BOOLEAN_TO_JSVAL(JS_TRUE);
+		else
+			val=BOOLEAN_TO_JSVAL(can_user_post(cfg,d,user,client,/* reason: */NULL));
+		if(!JS_SetProperty(cx, subobj, "can_post", &val))
+			return(JS_FALSE);
+
+		if(user==NULL)
+			val=BOOLEAN_TO_JSVAL(JS_TRUE);
+		else
+			val=BOOLEAN_TO_JSVAL(is_user_subop(cfg,d,user,client));
+		if(!JS_SetProperty(cx, subobj, "is_operator", &val))
+			return(JS_FALSE);
+
+		if(cfg->sub[d]->mod_ar[0]!=0 && user!=NULL 
+			&& chk_ar(cfg,cfg->sub[d]->mod_ar,user,client))
+			val=BOOLEAN_TO_JSVAL(JS_TRUE);
+		else
+			val=BOOLEAN_TO_JSVAL(JS_FALSE);
+		if(!JS_SetProperty(cx, subobj, "is_moderated", &val))
+			return(JS_FALSE);
+
+		if(!JS_DefineProperties(cx, subobj, js_sub_properties))
+			return(JS_FALSE);
 
 #ifdef BUILD_JSDOCS
-	js_DescribeSyncObject(cx,areaobj,"Message Areas",310);
+		js_DescribeSyncObject(cx,subobj,"Message Sub-boards (current user has access to)</h2>"
+			"(all properties are <small>READ ONLY</small> except for "
+			"<i>scan_ptr</i>, <i>scan_cfg</i>, and <i>last_read</i>)"
+			,310);
 #endif
+	}
 
-	/* msg_area.properties */
-	if(!JS_NewNumberValue(cx,cfg->msg_misc,&val))
-		return(NULL);
-	if(!JS_SetProperty(cx, areaobj, "settings", &val)) 
-		return(NULL);
+	return(JS_TRUE);
+}
+
+/* msg_area.sub[] */
+static JSBool js_msg_subs_resolve(JSContext *cx, JSObject *obj, jsid id)
+{
+	char*		name;
+	msg_area_private_t* p;
+	JSBool		ret=JS_TRUE;
+	uint		d;
+
+	if((p=(msg_area_private_t*)JS_GetPrivate(cx,obj))==NULL || !msg_area_valid(p))
+		return(JS_TRUE);
+
+	if(!js_msg_area_get_name(cx, id, &name))
+		return(JS_FALSE);
+
+	if(name==NULL) {
+		for(d=0;d<p->total_grps && ret;d++)
+			ret=js_create_msg_subs(cx, obj, p, d);
+		return(ret);
+	}
+
+	for(d=0;d<p->total_subs;d++) {
+		if(strcmp(p->cfg->sub[d]->code,name)==0) {
+			ret=js_create_msg_subs(cx, obj, p, p->cfg->sub[d]->grp);
+			break;
+		}
+	}
+	free(name);
+	return(ret);
+}
+
+static JSBool js_msg_subs_enumerate(JSContext *cx, JSObject *obj)
+{
+	return(js_msg_subs_resolve(cx, obj, JSID_VOID));
+}
+
+static JSClass js_msg_subs_class = {
+     "MsgSubs"				/* name			*/
+    ,JSCLASS_HAS_PRIVATE	/* flags		*/
+	,JS_PropertyStub		/* addProperty	*/
+	,JS_PropertyStub		/* delProperty	*/
+	,JS_PropertyStub		/* getProperty	*/
+	,JS_StrictPropertyStub	/* setProperty	*/
+	,js_msg_subs_enumerate	/* enumerate	*/
+	,js_msg_subs_resolve	/* resolve		*/
+	,JS_ConvertStub			/* convert		*/
+	,js_msg_area_finalize	/* finalize		*/
+};
+
+/* msg_area.grp[].sub_list[] */
+static JSBool js_msg_grp_resolve(JSContext *cx, JSObject *obj, jsid id)
+{
+	char*		name;
+	msg_grp_private_t* grp;
+	msg_area_private_t* p;
+	JSObject*	allsubs;
+	JSObject*	sub_list;
+	jsval		val;
+	uint		d;
+	BOOL		match=TRUE;
+
+	if((grp=(msg_grp_private_t*)JS_GetPrivate(cx,obj))==NULL || grp->sub_list_created)
+		return(JS_TRUE);
+	p=grp->area;
+
+	if(!js_msg_area_get_name(cx, id, &name))
+		return(JS_FALSE);
+	if(name!=NULL) {
+		match=(strcmp(name,"sub_list")==0);
+		free(name);
+	}
+	if(!match)
+		return(JS_TRUE);
+	grp->sub_list_created=TRUE;
+
+	if((allsubs=JS_GetParent(cx,obj))==NULL)
+		return(JS_TRUE);
+	if(!js_create_msg_subs(cx, allsubs, p, grp->grpnum))
+		return(JS_FALSE);
+
+	if((sub_list=JS_NewArrayObject(cx, 0, NULL))==NULL) 
+		return(JS_FALSE);
+
+	if(!JS_DefineProperty(cx, obj, "sub_list", OBJECT_TO_JSVAL(sub_list)
+		,NULL,NULL,JSPROP_ENUMERATE))
+		return(JS_FALSE);
+
+	if(!msg_area_valid(p))
+		return(JS_TRUE);
+
+	for(d=0;d<p->total_subs;d++) {
+		if(p->cfg->sub[d]->grp!=grp->grpnum || p->sub_index[d]<0)
+			continue;
+		if(!JS_GetProperty(cx, allsubs, p->cfg->sub[d]->code, &val))
+			return(JS_FALSE);
+		if(!JS_SetElement(cx, sub_list, p->sub_index[d], &val))
+			return(JS_FALSE);
+	}
+
+	return(JS_TRUE);
+}
+
+static JSBool js_msg_grp_enumerate(JSContext *cx, JSObject *obj)
+{
+	return(js_msg_grp_resolve(cx, obj, JSID_VOID));
+}
+
+static JSClass js_msg_grp_class = {
+     "MsgGrp"				/* name			*/
+    ,JSCLASS_HAS_PRIVATE	/* flags		*/
+	,JS_PropertyStub		/* addProperty	*/
+	,JS_PropertyStub		/* delProperty	*/
+	,JS_PropertyStub		/* getProperty	*/
+	,JS_StrictPropertyStub	/* setProperty	*/
+	,js_msg_grp_enumerate	/* enumerate	*/
+	,js_msg_grp_resolve		/* resolve		*/
+	,JS_ConvertStub			/* convert		*/
+	,js_msg_grp_finalize	/* finalize		*/
+};
+
+/* msg_area.grp[], msg_area.sub[] and msg_area.grp_list[] */
+static JSBool js_create_msg_grps(JSContext* cx, JSObject* areaobj, msg_area_private_t* p)
+{
+	scfg_t*		cfg=p->cfg;
+	JSObject*	allgrps;
+	JSObject*	allsubs;
+	JSObject*	grpobj;
+	JSObject*	grp_list;
+	JSString*	js_str;
+	jsval		val;
+	jsuint		grp_index;
+	uint		l;
+
+	p->grps_created=TRUE;
+	if(!msg_area_valid(p))
+		return(JS_TRUE);
 
 	/* msg_area.grp[] */
 	if((allgrps=JS_NewObject(cx, NULL, NULL, areaobj))==NULL)
-		return(NULL);
+		return(JS_FALSE);
 
-	val=OBJECT_TO_JSVAL(allgrps);
-	if(!JS_SetProperty(cx, areaobj, "grp", &val))
-		return(NULL);
+	if(!JS_DefineProperty(cx, areaobj, "grp", OBJECT_TO_JSVAL(allgrps)
+		,NULL,NULL,JSPROP_ENUMERATE))
+		return(JS_FALSE);
 
 	/* msg_area.sub[] */
-	if((allsubs=JS_NewObject(cx, NULL, NULL, areaobj))==NULL)
-		return(NULL);
+	if((allsubs=JS_NewObject(cx, &js_msg_subs_class, NULL, areaobj))==NULL)
+		return(JS_FALSE);
+	JS_SetPrivate(cx, allsubs, p);
+	p->refs++;
 
-	val=OBJECT_TO_JSVAL(allsubs);
-	if(!JS_SetProperty(cx, areaobj, "sub", &val))
-		return(NULL);
+	if(!JS_DefineProperty(cx, areaobj, "sub", OBJECT_TO_JSVAL(allsubs)
+		,NULL,NULL,JSPROP_ENUMERATE))
+		return(JS_FALSE);
 
 	/* msg_area.grp_list[] */
 	if((grp_list=JS_NewArrayObject(cx, 0, NULL))==NULL) 
-		return(NULL);
+		return(JS_FALSE);
 
-	val=OBJECT_TO_JSVAL(grp_list);
-	if(!JS_SetProperty(cx, areaobj, "grp_list", &val)) 
-		return(NULL);
+	if(!JS_DefineProperty(cx, areaobj, "grp_list", OBJECT_TO_JSVAL(grp_list)
+		,NULL,NULL,JSPROP_ENUMERATE))
+		return(JS_FALSE);
 
-	if((grpobj_proto=JS_NewObject(cx, NULL, NULL, areaobj))==NULL)
-		return(NULL);
-	if((subobj_proto=JS_NewObject(cx, NULL, NULL, areaobj))==NULL)
-		return(NULL);
 	for(l=0;l<cfg->total_grps;l++) {
 
-		if((grpobj=JS_NewObject(cx, NULL, grpobj_proto, NULL))==NULL)
-			return(NULL);
+		/* Parent is msg_area.sub, where the group's sub-boards are created */
+		if((grpobj=JS_NewObject(cx, &js_msg_grp_class, NULL, allsubs))==NULL)
+			return(JS_FALSE);
+		p->grp[l].area=p;
+		p->grp[l].grpnum=l;
+		JS_SetPrivate(cx, grpobj, &p->grp[l]);
+		p->refs++;
 
 		val=OBJECT_TO_JSVAL(grpobj);
 		grp_index=-1;
-		if(user==NULL || chk_ar(cfg,cfg->grp[l]->ar,user,client)) {
+		if(p->user==NULL || chk_ar(cfg,cfg->grp[l]->ar,p->user,p->client)) {
 
 			if(!JS_GetArrayLength(cx, grp_list, &grp_index))
-				return(NULL);
+				return(JS_FALSE);
 
 			if(!JS_SetElement(cx, grp_list, grp_index, &val))
-				return(NULL);
+				return(JS_FALSE);
 		}
+		p->grp[l].index=grp_index;
 
 		/* Add as property (associative array element) */
 		if(!JS_DefineProperty(cx, allgrps, cfg->grp[l]->sname, val
 			,NULL,NULL,JSPROP_READONLY|JSPROP_ENUMERATE))
-			return(NULL);
+			return(JS_FALSE);
 
 		val=INT_TO_JSVAL(grp_index);
 		if(!JS_SetProperty(cx, grpobj, "index", &val))
-			return(NULL);
+			return(JS_FALSE);
 
 		val=INT_TO_JSVAL(l);
 		if(!JS_SetProperty(cx, grpobj, "number", &val))
-			return(NULL);
+			return(JS_FALSE);
 
 		if((js_str=JS_NewStringCopyZ(cx, cfg->grp[l]->sname))==NULL)
-			return(NULL);
+			return(JS_FALSE);
 		val=STRING_TO_JSVAL(js_str);
 		if(!JS_SetProperty(cx, grpobj, "name", &val))
-			return(NULL);
+			return(JS_FALSE);
 
 		if((js_str=JS_NewStringCopyZ(cx, cfg->grp[l]->lname))==NULL)
-			return(NULL);
+			return(JS_FALSE);
 		val=STRING_TO_JSVAL(js_str);
 		if(!JS_SetProperty(cx, grpobj, "description", &val))
-			return(NULL);
+			return(JS_FALSE);
 
 		if((js_str=JS_NewStringCopyZ(cx, cfg->grp[l]->arstr))==NULL)
-			return(NULL);
+			return(JS_FALSE);
 		if(!JS_DefineProperty(cx, grpobj, "ars", STRING_TO_JSVAL(js_str)
 			,NULL,NULL,JSPROP_ENUMERATE|JSPROP_READONLY))
-			return(NULL);
+			return(JS_FALSE);
 
 #ifdef BUILD_JSDOCS
 		js_DescribeSyncObject(cx,grpobj,"Message Groups (current user has access to)",310);
+		js_CreateArrayOfStrings(cx, grpobj, "_property_desc_list", msg_grp_prop_desc, JSPROP_READONLY);
 #endif
-
-		/* sub_list[] */
-		if((sub_list=JS_NewArrayObject(cx, 0, NULL))==NULL) 
-			return(NULL);
-
-		val=OBJECT_TO_JSVAL(sub_list);
-		if(!JS_SetProperty(cx, grpobj, "sub_list", &val)) 
-			return(NULL);
-
-		for(d=0;d<cfg->total_subs;d++) {
-			if(cfg->sub[d]->grp!=l)
-				continue;
-
-			if((subobj=JS_NewObject(cx, &js_sub_class, subobj_proto, NULL))==NULL)
-				return(NULL);
-/** Crash ^^^ Here in JSexec/ircd upon recycle/reload of script:
-
- 	mozjs185-1.0.dll!62e4a968() 	
- 	[Frames below may be incorrect and/or missing, no symbols loaded for mozjs185-1.0.dll]	
- 	mozjs185-1.0.dll!62eda4b2() 	
- 	mozjs185-1.0.dll!62e9cd4e() 	
- 	mozjs185-1.0.dll!62ea3cf0() 	
- 	mozjs185-1.0.dll!62e4e39e() 	
- 	mozjs185-1.0.dll!62edd884() 	
- 	mozjs185-1.0.dll!62e8010f() 	
- 	mozjs185-1.0.dll!62e5b0c9() 	
- 	mozjs185-1.0.dll!62e4b1ee() 	
->	sbbs.dll!js_CreateMsgAreaObject(JSContext * cx=0x07b33ce8, JSObject * parent=0x0a37f028, scfg_t * cfg=0x004a2b20, user_t * user=0x00000000, client_t * client=0x00000000, subscan_t * subscan=0x00000000)  Line 459 + 0x17 bytes	C
- 	sbbs.dll!js_CreateUserObjects(JSContext * cx=0x07b33ce8, JSObject * parent=0x0a37f028, scfg_t * cfg=0x004a2b20, user_t * user=0x00000000, client_t * client=0x00000000, char * html_index_file=0x00000000, subscan_t * subscan=0x00000000)  Line 1431 + 0x1d bytes	C
- 	sbbs.dll!js_CreateCommonObjects(JSContext * js_cx=0x07b33ce8, scfg_t * cfg=0x004a2b20, scfg_t * node_cfg=0x004a2b20, jsSyncMethodSpec * methods=0x00000000, __int64 uptime=0, char * host_name=0x101bdaa6, char * socklib_desc=0x101bdaa6, js_branch_t * branch=0x019c8f30, js_startup_t * js_startup=0x0012f7cc, client_t * client=0x00000000, unsigned int client_socket=4294967295, js_server_props_t * props=0x00000000)  Line 3858 + 0x1b bytes	C
- 	sbbs.dll!js_load(JSContext * cx=0x02e36300, unsigned int argc=3, unsigned __int64 * arglist=0x01d700d0)  Line 282 + 0x44 bytes	C
- 	mozjs185-1.0.dll!62e91dfd() 	
- 	jsexec.exe!__lock_fhandle(int fh=1240564)  Line 467	C
- 	7ffdf000()	
- 	ffff0007()	
- 	mozjs185-1.0.dll!62fe9c60() 	
-
-*/
-
-			if(subscan!=NULL)
-				JS_SetPrivate(cx,subobj,&subscan[d]);
-
-			val=OBJECT_TO_JSVAL(subobj);
-			sub_index=-1;
-			if(user==NULL || can_user_access_sub(cfg,d,user,client)) {
-
-				if(!JS_GetArrayLength(cx, sub_list, &sub_index))
-					return(NULL);							
-
-				if(!JS_SetElement(cx, sub_list, sub_index, &val))
-					return(NULL);
-			}
-
-			/* Add as property (associative array element) */
-			if(!JS_DefineProperty(cx, allsubs, cfg->sub[d]->code, val
-				,NULL,NULL,JSPROP_READONLY|JSPROP_ENUMERATE))
-				return(NULL);
-
-			val=INT_TO_JSVAL(sub_index);
-			if(!JS_SetProperty(cx, subobj, "index", &val))
-				return(NULL);
-
-			val=INT_TO_JSVAL(grp_index);
-			if(!JS_SetProperty(cx, subobj, "grp_index", &val))
-				return(NULL);
-
-			if(!js_CreateMsgAreaProperties(cx, cfg, subobj, d))
-				return(NULL);
-		
-			if(user==NULL)
-				val=BOOLEAN_TO_JSVAL(JS_TRUE);
-			else
-				val=BOOLEAN_TO_JSVAL(can_user_read_sub(cfg,d,user,client));
-			if(!JS_SetProperty(cx, subobj, "can_read", &val))
-				return(NULL);
-
-			if(user==NULL)
-				val=BOOLEAN_TO_JSVAL(JS_TRUE);
-			else
-				val=BOOLEAN_TO_JSVAL(can_user_post(cfg,d,user,client,/* reason: */NULL));
-			if(!JS_SetProperty(cx, subobj, "can_post", &val))
-				return(NULL);
-
-			if(user==NULL)
-				val=BOOLEAN_TO_JSVAL(JS_TRUE);
-			else
-				val=BOOLEAN_TO_JSVAL(is_user_subop(cfg,d,user,client));
-			if(!JS_SetProperty(cx, subobj, "is_operator", &val))
-				return(NULL);
-
-			if(cfg->sub[d]->mod_ar[0]!=0 && user!=NULL 
-				&& chk_ar(cfg,cfg->sub[d]->mod_ar,user,client))
-				val=BOOLEAN_TO_JSVAL(JS_TRUE);
-			else
-				val=BOOLEAN_TO_JSVAL(JS_FALSE);
-			if(!JS_SetProperty(cx, subobj, "is_moderated", &val))
-				return(NULL);
-
-			if(!JS_DefineProperties(cx, subobj, js_sub_properties))
-				return(NULL);
+	}
 
 #ifdef BUILD_JSDOCS
-			js_DescribeSyncObject(cx,subobj,"Message Sub-boards (current user has access to)</h2>"
-				"(all properties are <small>READ ONLY</small> except for "
-				"<i>scan_ptr</i>, <i>scan_cfg</i>, and <i>last_read</i>)"
-				,310);
+	js_DescribeSyncObject(cx,allgrps,"Associative array of all groups (use name as index)",312);
+	JS_DefineProperty(cx,allgrps,"_dont_document",JSVAL_TRUE,NULL,NULL,JSPROP_READONLY);
+
+	js_DescribeSyncObject(cx,allsubs,"Associative array of all sub-boards (use internal code as index)",311);
+	JS_DefineProperty(cx,allsubs,"_dont_document",JSVAL_TRUE,NULL,NULL,JSPROP_READONLY);
 #endif
 
-		}
+	return(JS_TRUE);
+}
 
-#ifdef BUILD_JSDOCS
-		js_CreateArrayOfStrings(cx, grpobj, "_property_desc_list", msg_grp_prop_desc, JSPROP_READONLY);
-#endif
+static JSBool js_msg_area_resolve(JSContext *cx, JSObject *obj, jsid id)
+{
+	char*		name;
+	msg_area_private_t* p;
+	BOOL		match=TRUE;
+
+	if((p=(msg_area_private_t*)JS_GetPrivate(cx,obj))==NULL || p->grps_created)
+		return(JS_TRUE);
+
+	if(!js_msg_area_get_name(cx, id, &name))
+		return(JS_FALSE);
+	if(name!=NULL) {
+		match=(strcmp(name,"grp")==0 || strcmp(name,"sub")==0 || strcmp(name,"grp_list")==0);
+		free(name);
 	}
+	if(!match)
+		return(JS_TRUE);
 
-#ifdef BUILD_JSDOCS
-	js_CreateArrayOfStrings(cx, areaobj, "_property_desc_list", msg_area_prop_desc, JSPROP_READONLY);
+	return(js_create_msg_grps(cx, obj, p));
+}
 
-	js_DescribeSyncObject(cx,allgrps,"Associative array of all groups (use name as index)",312);
-	JS_DefineProperty(cx,allgrps,"_dont_document",JSVAL_TRUE,NULL,NULL,JSPROP_READONLY);
+static JSBool js_msg_area_enumerate(JSContext *cx, JSObject *obj)
+{
+	return(js_msg_area_resolve(cx, obj, JSID_VOID));
+}
+
+static JSClass js_msg_area_class = {
+     "MsgArea"				/* name			*/
+    ,JSCLASS_HAS_PRIVATE	/* flags		*/
+	,JS_PropertyStub		/* addProperty	*/
+	,JS_PropertyStub		/* delProperty	*/
+	,JS_PropertyStub		/* getProperty	*/
+	,JS_StrictPropertyStub	/* setProperty	*/
+	,js_msg_area_enumerate	/* enumerate	*/
+	,js_msg_area_resolve	/* resolve		*/
+	,JS_ConvertStub			/* convert		*/
+	,js_msg_area_finalize	/* finalize		*/
+};
+
+JSObject* DLLCALL js_CreateMsgAreaObject(JSContext* cx, JSObject* parent, scfg_t* cfg
+										  ,user_t* user, client_t* client, subscan_t* subscan)
+{
+	JSObject*	areaobj=NULL;
+	msg_area_private_t* p;
+	msg_area_private_t* old;
+	jsval		val;
+
+	if((p=(msg_area_private_t*)calloc(1,sizeof(msg_area_private_t)))==NULL)
+		return(NULL);
+	p->refs=1;
+	p->cfg=cfg;
+	if(user!=NULL) {
+		p->user_buf=*user;
+		p->user=&p->user_buf;
+	}
+	if(client!=NULL) {
+		p->client_buf=*client;
+		p->client=&p->client_buf;
+	}
+	p->subscan=subscan;
+	p->generation=cfg->generation;
+	p->total_grps=cfg->total_grps;
+	p->total_subs=cfg->total_subs;
+	if((p->grp=(msg_grp_private_t*)calloc(cfg->total_grps+1,sizeof(msg_grp_private_t)))==NULL
+		|| (p->sub_index=(int*)calloc(cfg->total_subs+1,sizeof(int)))==NULL) {
+		msg_area_release(p);
+		return(NULL);
+	}
+
+	/* Return existing object if it's already been created */
+	if(JS_GetProperty(cx,parent,"msg_area",&val) && JSVAL_IS_OBJECT(val) && !JSVAL_IS_NULL(val)
+		&& (old=(msg_area_private_t*)JS_GetInstancePrivate(cx,JSVAL_TO_OBJECT(val),&js_msg_area_class,NULL))!=NULL) {
+		areaobj = JSVAL_TO_OBJECT(val);
+		JS_SetPrivate(cx, areaobj, p);
+		msg_area_release(old);
+		/* Re-created on next reference */
+		JS_DeleteProperty(cx, areaobj, "grp");
+		JS_DeleteProperty(cx, areaobj, "sub");
+		JS_DeleteProperty(cx, areaobj, "grp_list");
+	}
+	else {
+		areaobj = JS_DefineObject(cx, parent, "msg_area", &js_msg_area_class
+									, NULL, JSPROP_ENUMERATE|JSPROP_READONLY);
+		if(areaobj!=NULL)
+			JS_SetPrivate(cx, areaobj, p);
+	}
+
+	if(areaobj==NULL) {
+		msg_area_release(p);
+		return(NULL);
+	}
+
+#ifdef BUILD_JSDOCS
+	js_DescribeSyncObject(cx,areaobj,"Message Areas",310);
 #endif
 
+	/* msg_area.properties */
+	if(!JS_NewNumberValue(cx,cfg->msg_misc,&val))
+		return(NULL);
+	if(!JS_SetProperty(cx, areaobj, "settings", &val)) 
+		return(NULL);
+
 #ifdef BUILD_JSDOCS
-	js_DescribeSyncObject(cx,allsubs,"Associative array of all sub-boards (use internal code as index)",311);
-	JS_DefineProperty(cx,allsubs,"_dont_document",JSVAL_TRUE,NULL,NULL,JSPROP_READONLY);
+	js_CreateArrayOfStrings(cx, areaobj, "_property_desc_list", msg_area_prop_desc, JSPROP_READONLY);
 #endif
 
 	return(areaobj);
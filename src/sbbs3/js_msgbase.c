@@ -1499,6 +1499,7 @@ js_put_msg_header(JSContext *cx, uintN argc, jsval *arglist)
 	private_t*	p;
 	jsrefcount	rc;
 	char*		cstr;
+	char*		old_subj=NULL;
 	JSBool		ret=JS_TRUE;
 
 	JS_SET_RVAL(cx, arglist, JSVAL_FALSE);
@@ -1570,6 +1571,8 @@ js_put_msg_header(JSContext *cx, uintN argc, jsval *arglist)
 		if((p->status=smb_getmsghdr(&(p->smb), &msg))!=SMB_SUCCESS)
 			break;
 
+		if(msg.subj!=NULL)
+			old_subj=strdup(msg.subj);
 		smb_freemsghdrmem(&msg);	/* prevent duplicate header fields */
 
 		JS_RESUMEREQUEST(cx, rc);
@@ -1587,12 +1590,72 @@ js_put_msg_header(JSContext *cx, uintN argc, jsval *arglist)
 	} while(0);
 
 	smb_unlockmsghdr(&(p->smb),&msg); 
+	/* The subject is in the full-text search index too */
+	if(p->status==SMB_SUCCESS && ret
+		&& (old_subj==NULL || msg.subj==NULL || strcmp(old_subj,msg.subj)!=0))
+		smb_fts_addmsg(&(p->smb),&msg);
+	FREE_AND_NULL(old_subj);
 	smb_freemsgmem(&msg);
 	JS_RESUMEREQUEST(cx, rc);
 
 	return(ret);
 }
 
+static JSBool
+js_search_msg_text(JSContext *cx, uintN argc, jsval *arglist)
+{
+	JSObject *obj=JS_THIS_OBJECT(cx, arglist);
+	jsval *argv=JS_ARGV(cx, arglist);
+	char*		text=NULL;
+	jsint		items=0;
+	jsval		val;
+	idxrec_t	idx;
+	smbfts_t	fts;
+	JSObject*	array;
+	private_t*	p;
+	jsrefcount	rc;
+
+	JS_SET_RVAL(cx, arglist, JSVAL_NULL);
+
+	if((p=(private_t*)JS_GetPrivate(cx,obj))==NULL) {
+		JS_ReportError(cx,getprivate_failure,WHERE);
+		return(JS_FALSE);
+	}
+
+	if(!SMB_IS_OPEN(&(p->smb)) || argc<1)
+		return(JS_TRUE);
+
+	JSVALUE_TO_MSTRING(cx, argv[0], text, NULL);
+	HANDLE_PENDING(cx);
+	if(text==NULL)
+		return(JS_TRUE);
+
+	if((array=JS_NewArrayObject(cx,0,NULL))==NULL) {
+		free(text);
+		return(JS_FALSE);
+	}
+
+	rc=JS_SUSPENDREQUEST(cx);
+	strupr(text);
+	smb_fts_search(&(p->smb),text,&fts);	/* no index? all are candidates */
+	free(text);
+	JS_RESUMEREQUEST(cx, rc);
+
+	fseek(p->smb.sid_fp,0,SEEK_SET);
+	while(fread(&idx,sizeof(idx),1,p->smb.sid_fp)==1) {
+		if(!smb_fts_candidate(&fts,idx.number))
+			continue;
+		val=UINT_TO_JSVAL(idx.number);
+		if(!JS_SetElement(cx,array,items++,&val))
+			break;
+	}
+	smb_fts_free(&fts);
+
+	JS_SET_RVAL(cx, arglist, OBJECT_TO_JSVAL(array));
+
+	return(JS_TRUE);
+}
+
 static JSBool
 js_remove_msg(JSContext *cx, uintN argc, jsval *arglist)
 {
@@ -2298,6 +2361,12 @@ static jsSyncMethodSpec js_msgbase_functions[] = {
 	"</table>")
 	,311
 	},
+	{"search_msg_text",	js_search_msg_text,	1, JSTYPE_ARRAY,	JSDOCSTR("text")
+	,JSDOCSTR("returns an array of the numbers of messages that may contain the specified (case-insensitive) text, "
+	"as determined by the message base's full-text search index (if there is one, otherwise all message numbers are returned). "
+	"The text of each message returned must still be searched to confirm a match")
+	,316
+	},
 	{"remove_msg",		js_remove_msg,		2, JSTYPE_BOOLEAN,	JSDOCSTR("[by_offset=<tt>false</tt>,] number_or_id")
 	,JSDOCSTR("mark message for deletion")
 	,311
@@ -57,6 +57,7 @@ typedef struct
 	SOCKADDR_IN	remote_addr;
 	CRYPT_SESSION	session;
 	char	*hostname;
+	sockbuf_t	rdbuf;	/* received (and decrypted) but not yet consumed, see recvline() */
 } private_t;
 
 static const char* getprivate_failure = "line %d %s JS_GetPrivate failed";
@@ -109,8 +110,20 @@ static void do_CryptFlush(const CRYPT_CONTEXT session)
 static ptrdiff_t js_socket_recv(private_t *p, void *buf, size_t len, int flags, int timeout)
 {
 	ptrdiff_t	total=0;
+	ptrdiff_t	rd;
 	int	copied,ret;
-	
+
+	if(sockbuf_pending(&p->rdbuf)) {
+		total=sockbuf_read(&p->rdbuf, buf, len, (flags&MSG_PEEK) ? TRUE:FALSE);
+		if(total>=len || (flags&MSG_PEEK) || (p->session==-1 && !p->nonblocking))
+			return total;
+		/* Blocking TLS reads return the full length requested, */
+		/* nonblocking reads add whatever else is available */
+		rd=js_socket_recv(p, ((uint8_t *)buf) + total, len-total, flags, timeout);
+		if(rd>0)
+			total+=rd;
+		return total;
+	}
 	if(p->session==-1)
 		return(recv(p->sock, buf, len, flags));
 	if(p->nonblocking) {
@@ -137,6 +150,43 @@ static ptrdiff_t js_socket_recv(private_t *p, void *buf, size_t len, int flags,
 	return total;	// Shouldn't happen...
 }
 
+/* Reads exactly len bytes (unless the connection is closed, times out, or	*/
+/* would block), as a short read may consume buffered bytes				*/
+static ptrdiff_t js_socket_recv_all(private_t *p, void *buf, size_t len, int timeout)
+{
+	ptrdiff_t	total=0;
+	ptrdiff_t	rd;
+
+	while(total<len) {
+		if((rd=js_socket_recv(p, ((uint8_t *)buf) + total, len-total, 0, timeout))<=0)
+			break;
+		total+=rd;
+	}
+	return total;
+}
+
+/* Appends whatever data is available to the (empty) read buffer */
+static ptrdiff_t js_socket_fill(private_t *p, int timeout)
+{
+	char*		space;
+	size_t		avail;
+	ptrdiff_t	rd;
+	int			copied;
+
+	if(p->session==-1)
+		return(sockbuf_recv(&p->rdbuf, p->sock));
+	space=sockbuf_space(&p->rdbuf, &avail);
+	/* Wait for the first byte, then take any more that cryptlib has already decrypted */
+	if((rd=js_socket_recv(p, space, 1, 0, timeout))==1) {
+		if(avail>1
+			&& cryptSetAttribute(p->session, CRYPT_OPTION_NET_READTIMEOUT, 0)==CRYPT_OK
+			&& cryptPopData(p->session, space+1, avail-1, &copied)==CRYPT_OK)
+			rd+=copied;
+		p->rdbuf.len+=rd;
+	}
+	return(rd);
+}
+
 static ptrdiff_t js_socket_sendsocket(private_t *p, const void *msg, size_t len, int flush)
 {
 	ptrdiff_t total=0;
@@ -304,6 +354,7 @@ js_close(JSContext *cx, uintN argc, jsval *arglist)
 
 	p->sock = INVALID_SOCKET; 
 	p->is_connected = FALSE;
+	sockbuf_init(&p->rdbuf);
 	JS_RESUMEREQUEST(cx, rc);
 
 	return(JS_TRUE);
@@ -1025,7 +1076,7 @@ js_peek(JSContext *cx, uintN argc, jsval *arglist)
 		return(JS_FALSE);
 	}
 	rc=JS_SUSPENDREQUEST(cx);
-	if(p->session==-1)
+	if(p->session==-1 || sockbuf_pending(&p->rdbuf))
 		len = js_socket_recv(p,buf,len,MSG_PEEK,120);
 	else
 		len=0;
@@ -1085,9 +1136,8 @@ js_recvline(JSContext *cx, uintN argc, jsval *arglist)
 {
 	JSObject *obj=JS_THIS_OBJECT(cx, arglist);
 	jsval *argv=JS_ARGV(cx, arglist);
-	char		ch;
 	char*		buf;
-	int			i;
+	size_t		i;
 	int32		len=512;
 	time_t		start;
 	int32		timeout=30;	/* seconds */
@@ -1115,7 +1165,12 @@ js_recvline(JSContext *cx, uintN argc, jsval *arglist)
 
 	start=time(NULL);
 	rc=JS_SUSPENDREQUEST(cx);
-	for(i=0;i<len;) {
+	for(i=0;(int32)i<len;) {
+
+		if(sockbuf_getline(&p->rdbuf, buf, &i, len))
+			break;
+		if((int32)i>=len)
+			break;
 
 		if(p->session==-1) {
 			switch(js_sock_read_check(p,start,timeout,i)) {
@@ -1132,7 +1187,7 @@ js_recvline(JSContext *cx, uintN argc, jsval *arglist)
 			}
 		}
 
-		if(js_socket_recv(p, &ch, 1, 0, timeout)!=1) {
+		if(js_socket_fill(p, timeout)<1) {
 			if(p->session==-1) {
 				p->last_error=ERROR_VALUE;
 				break;
@@ -1152,11 +1207,7 @@ js_recvline(JSContext *cx, uintN argc, jsval *arglist)
 				}
 			}
 		}
-
-		if(ch=='\n' /* && i>=1 */) /* Mar-9-2003: terminate on sole LF */
-			break;
-
-		buf[i++]=ch;
+		/* Mar-9-2003: terminate on sole LF (see sockbuf_getline) */
 	}
 	if(i>0 && buf[i-1]=='\r')
 		buf[i-1]=0;
@@ -1172,7 +1223,7 @@ js_recvline(JSContext *cx, uintN argc, jsval *arglist)
 	JS_SET_RVAL(cx, arglist, STRING_TO_JSVAL(str));
 	rc=JS_SUSPENDREQUEST(cx);
 	dbprintf(FALSE, p, "received %u bytes (recvline) lasterror=%d"
-		,i,ERROR_VALUE);
+		,(unsigned)i,ERROR_VALUE);
 	JS_RESUMEREQUEST(cx, rc);
 		
 	return(JS_TRUE);
@@ -1204,18 +1255,18 @@ js_recvbin(JSContext *cx, uintN argc, jsval *arglist)
 	rc=JS_SUSPENDREQUEST(cx);
 	switch(size) {
 		case sizeof(BYTE):
-			if((rd=js_socket_recv(p,&b,size,0,120))==size)
+			if((rd=js_socket_recv_all(p,&b,size,120))==size)
 				JS_SET_RVAL(cx, arglist, INT_TO_JSVAL(b));
 			break;
 		case sizeof(WORD):
-			if((rd=js_socket_recv(p,(BYTE*)&w,size,0,120))==size) {
+			if((rd=js_socket_recv_all(p,(BYTE*)&w,size,120))==size) {
 				if(p->network_byte_order)
 					w=ntohs(w);
 				JS_SET_RVAL(cx, arglist, INT_TO_JSVAL(w));
 			}
 			break;
 		case sizeof(DWORD):
-			if((rd=js_socket_recv(p,(BYTE*)&l,size,0,120))==size) {
+			if((rd=js_socket_recv_all(p,(BYTE*)&l,size,120))==size) {
 				if(p->network_byte_order)
 					l=ntohl(l);
 				JS_SET_RVAL(cx, arglist, UINT_TO_JSVAL(l));
@@ -1405,6 +1456,11 @@ js_poll(JSContext *cx, uintN argc, jsval *arglist)
 			js_timeval(cx,argv[argn],&tv);
 	}
 
+	if(!poll_for_write && sockbuf_pending(&p->rdbuf)) {
+		JS_SET_RVAL(cx, arglist, INT_TO_JSVAL(1));
+		return(JS_TRUE);
+	}
+
 	rc=JS_SUSPENDREQUEST(cx);
 	FD_ZERO(&socket_set);
 	FD_SET(p->sock,&socket_set);
@@ -1502,6 +1558,7 @@ static JSBool js_socket_set(JSContext *cx, JSObject *obj, jsid id, JSBool strict
 				p->session=-1;
 			}
 			JS_ValueToInt32(cx,*vp,(int32*)&(p->sock));
+			sockbuf_init(&p->rdbuf);	/* discard data received from the old descriptor */
 			p->is_connected=TRUE;
 			break;
 		case SOCK_PROP_LAST_ERROR:
@@ -1610,16 +1667,19 @@ static JSBool js_socket_get(JSContext *cx, JSObject *obj, jsid id, jsval *vp)
 			*vp = BOOLEAN_TO_JSVAL(wr);
 			break;
 		case SOCK_PROP_DATA_WAITING:
-			socket_check(p->sock,&rd,NULL,0);
+			if(sockbuf_pending(&p->rdbuf))
+				rd=TRUE;
+			else
+				socket_check(p->sock,&rd,NULL,0);
 			*vp = BOOLEAN_TO_JSVAL(rd);
 			break;
 		case SOCK_PROP_NREAD:
 			cnt=0;
 			if(ioctlsocket(p->sock, FIONREAD, &cnt)==0) {
-				*vp=DOUBLE_TO_JSVAL((double)cnt);
+				*vp=DOUBLE_TO_JSVAL((double)cnt+sockbuf_pending(&p->rdbuf));
 			}
 			else
-				*vp = JSVAL_ZERO;
+				*vp = DOUBLE_TO_JSVAL((double)sockbuf_pending(&p->rdbuf));
 			break;
 		case SOCK_PROP_DEBUG:
 			*vp = INT_TO_JSVAL(p->debug);
@@ -1950,6 +2010,20 @@ JSObject* DLLCALL js_CreateSocketClass(JSContext* cx, JSObject* parent)
 	return(sockobj);
 }
 
+/* Returns the number of bytes received and buffered, but not yet read, by a Socket object */
+size_t DLLCALL js_socket_pending(JSContext *cx, jsval val)
+{
+	JSObject*	obj;
+	private_t*	p;
+
+	if(!JSVAL_IS_OBJECT(val) || (obj=JSVAL_TO_OBJECT(val))==NULL
+		|| JS_GetClass(cx,obj)!=&js_socket_class)
+		return(0);
+	if((p=(private_t*)JS_GetPrivate(cx,obj))==NULL)
+		return(0);
+	return(sockbuf_pending(&p->rdbuf));
+}
+
 JSObject* DLLCALL js_CreateSocketObject(JSContext* cx, JSObject* parent, char *name, SOCKET sock)
 {
 	JSObject*	obj;
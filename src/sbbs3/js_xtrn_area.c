@@ -183,200 +183,397 @@ BOOL DLLCALL js_CreateXtrnProgProperties(JSContext* cx, JSObject* obj, xtrn_t* x
 }
 
 
-JSObject* DLLCALL js_CreateXtrnAreaObject(JSContext* cx, JSObject* parent, scfg_t* cfg
-										  ,user_t* user, client_t* client)
+/*
+ * The xtrn_area object tree is created on demand (via resolve hooks):
+ * sections, events and editors when xtrn_area.sec, xtrn_area.prog,
+ * xtrn_area.sec_list, xtrn_area.event or xtrn_area.editor is first
+ * referenced (or enumerated) and the programs of a section when the
+ * section's prog_list or one of its programs (by internal code) is first
+ * referenced. Access is evaluated against a copy of the user and client
+ * taken when the object was created, same as if the whole tree had been
+ * created then.
+ */
+struct xtrn_area_private;
+
+typedef struct {
+	struct xtrn_area_private* area;
+	uint		secnum;
+	int			index;			/* index into sec_list[] (or -1) */
+	BOOL		progs_created;
+	BOOL		prog_list_created;
+} xtrn_sec_private_t;
+
+typedef struct xtrn_area_private {
+	ulong		refs;			/* area, prog[] and sec[] objects referencing this */
+	scfg_t*		cfg;
+	user_t*		user;			/* NULL or &user_buf */
+	client_t*	client;			/* NULL or &client_buf */
+	user_t		user_buf;
+	client_t	client_buf;
+	DWORD		generation;		/* of cfg when created */
+	uint		total_xtrnsecs;
+	uint		total_xtrns;
+	BOOL		secs_created;
+	xtrn_sec_private_t* sec;
+	int*		prog_index;		/* index into sec's prog_list[] (or -1) */
+} xtrn_area_private_t;
+
+static void xtrn_area_release(xtrn_area_private_t* p)
+{
+	if(p==NULL || --p->refs)
+		return;
+	FREE_AND_NULL(p->sec);
+	FREE_AND_NULL(p->prog_index);
+	free(p);
+}
+
+/* Returns FALSE if the configuration has been reloaded since the object was created */
+static BOOL xtrn_area_valid(xtrn_area_private_t* p)
+{
+	return(p->generation==p->cfg->generation);
+}
+
+static JSBool js_xtrn_area_get_name(JSContext* cx, jsid id, char** name)
+{
+	jsval idval;
+
+	*name=NULL;
+	if(id == JSID_VOID || id == JSID_EMPTY)
+		return(JS_TRUE);
+
+	JS_IdToValue(cx, id, &idval);
+	if(JSVAL_IS_STRING(idval)) {
+		JSSTRING_TO_MSTRING(cx, JSVAL_TO_STRING(idval), *name, NULL);
+		HANDLE_PENDING(cx);
+	} else if(JSVAL_IS_INT(idval)) {
+		if((*name=(char*)malloc(16))!=NULL)
+			sprintf(*name,"%d",JSVAL_TO_INT(idval));
+	}
+	return(JS_TRUE);
+}
+
+static void js_xtrn_area_finalize(JSContext *cx, JSObject *obj)
+{
+	xtrn_area_release((xtrn_area_private_t*)JS_GetPrivate(cx,obj));
+	JS_SetPrivate(cx, obj, NULL);
+}
+
+static void js_xtrn_sec_finalize(JSContext *cx, JSObject *obj)
+{
+	xtrn_sec_private_t* sec;
+
+	if((sec=(xtrn_sec_private_t*)JS_GetPrivate(cx,obj))==NULL)
+		return;
+	xtrn_area_release(sec->area);
+	JS_SetPrivate(cx, obj, NULL);
+}
+
+/* Creates the program objects of a section as properties of xtrn_area.prog */
+static JSBool js_create_xtrn_progs(JSContext* cx, JSObject* allprog, xtrn_area_private_t* p, uint secnum)
+{
+	scfg_t*		cfg=p->cfg;
+	user_t*		user=p->user;
+	client_t*	client=p->client;
+	JSObject*	progobj;
+	jsval		val;
+	int			prog_index=0;
+	uint		d;
+
+	if(!xtrn_area_valid(p) || secnum>=p->total_xtrnsecs || p->sec[secnum].progs_created)
+		return(JS_TRUE);
+	p->sec[secnum].progs_created=TRUE;
+
+	for(d=0;d<cfg->total_xtrns;d++) {
+		if(cfg->xtrn[d]->sec!=secnum)
+			continue;
+
+		if((progobj=JS_NewObject(cx, NULL, NULL, allprog))==NULL)
+			return(JS_FALSE);
+
+		p->prog_index[d]=-1;
+		if((user==NULL || chk_ar(cfg,cfg->xtrn[d]->ar,user,client))
+			&& !(cfg->xtrn[d]->event && cfg->xtrn[d]->misc&EVENTONLY))
+			p->prog_index[d]=prog_index++;
+
+		/* Add as property (associative array element) */
+		if(!JS_DefineProperty(cx, allprog, cfg->xtrn[d]->code, OBJECT_TO_JSVAL(progobj)
+			,NULL,NULL,JSPROP_READONLY|JSPROP_ENUMERATE))
+			return(JS_FALSE);
+
+		val=INT_TO_JSVAL(p->prog_index[d]);
+		if(!JS_SetProperty(cx, progobj, "index", &val))
+			return(JS_FALSE);
+
+		val=INT_TO_JSVAL(d);
+		if(!JS_SetProperty(cx, progobj, "number", &val))
+			return(JS_FALSE);
+
+		val=INT_TO_JSVAL(p->sec[secnum].index);
+		if(!JS_SetProperty(cx, progobj, "sec_index", &val))
+			return(JS_FALSE);
+
+		val=INT_TO_JSVAL(secnum);
+		if(!JS_SetProperty(cx, progobj, "sec_number", &val))
+			return(JS_FALSE);
+
+		val=STRING_TO_JSVAL(JS_NewStringCopyZ(cx,cfg->xtrnsec[secnum]->code));
+		if(!JS_SetProperty(cx, progobj, "sec_code", &val))
+			return(JS_FALSE);
+
+		if(!js_CreateXtrnProgProperties(cx, progobj, cfg->xtrn[d]))
+			return(JS_FALSE);
+
+		if(user==NULL || chk_ar(cfg,cfg->xtrn[d]->ar,user,client))
+			val=JSVAL_TRUE;
+		else
+			val=JSVAL_FALSE;
+		if(!JS_SetProperty(cx, progobj, "can_access", &val))
+			return(JS_FALSE);
+
+		if(user==NULL || chk_ar(cfg,cfg->xtrn[d]->run_ar,user,client))
+			val=JSVAL_TRUE;
+		else
+			val=JSVAL_FALSE;
+		if(!JS_SetProperty(cx, progobj, "can_run", &val))
+			return(JS_FALSE);
+
+#ifdef BUILD_JSDOCS
+		js_DescribeSyncObject(cx,progobj,"Online External Programs (doors) (current user has access to)",310);
+#endif
+	}
+
+	return(JS_TRUE);
+}
+
+/* xtrn_area.prog[] */
+static JSBool js_xtrn_progs_resolve(JSContext *cx, JSObject *obj, jsid id)
+{
+	char*		name;
+	xtrn_area_private_t* p;
+	JSBool		ret=JS_TRUE;
+	uint		d;
+
+	if((p=(xtrn_area_private_t*)JS_GetPrivate(cx,obj))==NULL || !xtrn_area_valid(p))
+		return(JS_TRUE);
+
+	if(!js_xtrn_area_get_name(cx, id, &name))
+		return(JS_FALSE);
+
+	if(name==NULL) {
+		for(d=0;d<p->total_xtrnsecs && ret;d++)
+			ret=js_create_xtrn_progs(cx, obj, p, d);
+		return(ret);
+	}
+
+	for(d=0;d<p->total_xtrns;d++) {
+		if(strcmp(p->cfg->xtrn[d]->code,name)==0) {
+			ret=js_create_xtrn_progs(cx, obj, p, p->cfg->xtrn[d]->sec);
+			break;
+		}
+	}
+	free(name);
+	return(ret);
+}
+
+static JSBool js_xtrn_progs_enumerate(JSContext *cx, JSObject *obj)
+{
+	return(js_xtrn_progs_resolve(cx, obj, JSID_VOID));
+}
+
+static JSClass js_xtrn_progs_class = {
+     "XtrnProgs"			/* name			*/
+    ,JSCLASS_HAS_PRIVATE	/* flags		*/
+	,JS_PropertyStub		/* addProperty	*/
+	,JS_PropertyStub		/* delProperty	*/
+	,JS_PropertyStub		/* getProperty	*/
+	,JS_StrictPropertyStub	/* setProperty	*/
+	,js_xtrn_progs_enumerate	/* enumerate	*/
+	,js_xtrn_progs_resolve	/* resolve		*/
+	,JS_ConvertStub			/* convert		*/
+	,js_xtrn_area_finalize	/* finalize		*/
+};
+
+/* xtrn_area.sec[].prog_list[] */
+static JSBool js_xtrn_sec_resolve(JSContext *cx, JSObject *obj, jsid id)
+{
+	char*		name;
+	xtrn_sec_private_t* sec;
+	xtrn_area_private_t* p;
+	JSObject*	allprog;
+	JSObject*	prog_list;
+	jsval		val;
+	uint		d;
+	BOOL		match=TRUE;
+
+	if((sec=(xtrn_sec_private_t*)JS_GetPrivate(cx,obj))==NULL || sec->prog_list_created)
+		return(JS_TRUE);
+	p=sec->area;
+
+	if(!js_xtrn_area_get_name(cx, id, &name))
+		return(JS_FALSE);
+	if(name!=NULL) {
+		match=(strcmp(name,"prog_list")==0);
+		free(name);
+	}
+	if(!match)
+		return(JS_TRUE);
+	sec->prog_list_created=TRUE;
+
+	if((allprog=JS_GetParent(cx,obj))==NULL)
+		return(JS_TRUE);
+	if(!js_create_xtrn_progs(cx, allprog, p, sec->secnum))
+		return(JS_FALSE);
+
+	if((prog_list=JS_NewArrayObject(cx, 0, NULL))==NULL) 
+		return(JS_FALSE);
+
+	if(!JS_DefineProperty(cx, obj, "prog_list", OBJECT_TO_JSVAL(prog_list)
+		,NULL,NULL,JSPROP_ENUMERATE))
+		return(JS_FALSE);
+
+	if(!xtrn_area_valid(p))
+		return(JS_TRUE);
+
+	for(d=0;d<p->total_xtrns;d++) {
+		if(p->cfg->xtrn[d]->sec!=sec->secnum || p->prog_index[d]<0)
+			continue;
+		if(!JS_GetProperty(cx, allprog, p->cfg->xtrn[d]->code, &val))
+			return(JS_FALSE);
+		if(!JS_SetElement(cx, prog_list, p->prog_index[d], &val))
+			return(JS_FALSE);
+	}
+
+	return(JS_TRUE);
+}
+
+static JSBool js_xtrn_sec_enumerate(JSContext *cx, JSObject *obj)
+{
+	return(js_xtrn_sec_resolve(cx, obj, JSID_VOID));
+}
+
+static JSClass js_xtrn_sec_class = {
+     "XtrnSec"				/* name			*/
+    ,JSCLASS_HAS_PRIVATE	/* flags		*/
+	,JS_PropertyStub		/* addProperty	*/
+	,JS_PropertyStub		/* delProperty	*/
+	,JS_PropertyStub		/* getProperty	*/
+	,JS_StrictPropertyStub	/* setProperty	*/
+	,js_xtrn_sec_enumerate	/* enumerate	*/
+	,js_xtrn_sec_resolve	/* resolve		*/
+	,JS_ConvertStub			/* convert		*/
+	,js_xtrn_sec_finalize	/* finalize		*/
+};
+
+/* xtrn_area.sec[], xtrn_area.prog[], xtrn_area.sec_list[], xtrn_area.event[] and xtrn_area.editor[] */
+static JSBool js_create_xtrn_secs(JSContext* cx, JSObject* areaobj, xtrn_area_private_t* p)
 {
-	JSObject*	areaobj;
+	scfg_t*		cfg=p->cfg;
+	user_t*		user=p->user;
+	client_t*	client=p->client;
 	JSObject*	allsec;
 	JSObject*	allprog;
 	JSObject*	secobj;
-	JSObject*	progobj;
 	JSObject*	eventobj;
 	JSObject*	event_array;
 	JSObject*	xeditobj;
 	JSObject*	xedit_array;
 	JSObject*	sec_list;
-	JSObject*	prog_list;
 	JSString*	js_str;
 	jsval		val;
 	jsuint		sec_index;
-	jsuint		prog_index;
-	uint		l,d;
+	uint		l;
 
-	/* Return existing object if it's already been created */
-	if(JS_GetProperty(cx,parent,"xtrn_area",&val) && val!=JSVAL_VOID)
-		areaobj = JSVAL_TO_OBJECT(val);
-	else
-		areaobj = JS_DefineObject(cx, parent, "xtrn_area", NULL
-									, NULL, JSPROP_ENUMERATE|JSPROP_READONLY);
-
-	if(areaobj==NULL)
-		return(NULL);
-
-#ifdef BUILD_JSDOCS
-	js_DescribeSyncObject(cx,areaobj,"External Program Areas",310);
-#endif
+	p->secs_created=TRUE;
+	if(!xtrn_area_valid(p))
+		return(JS_TRUE);
 
 	/* xtrn_area.sec[] */
 	if((allsec=JS_NewObject(cx,NULL,NULL,areaobj))==NULL)
-		return(NULL);
+		return(JS_FALSE);
 
-	val=OBJECT_TO_JSVAL(allsec);
-	if(!JS_SetProperty(cx, areaobj, "sec", &val))
-		return(NULL);
+	if(!JS_DefineProperty(cx, areaobj, "sec", OBJECT_TO_JSVAL(allsec)
+		,NULL,NULL,JSPROP_ENUMERATE))
+		return(JS_FALSE);
 
 	/* xtrn_area.prog[] */
-	if((allprog=JS_NewObject(cx,NULL,NULL,areaobj))==NULL)
-		return(NULL);
+	if((allprog=JS_NewObject(cx,&js_xtrn_progs_class,NULL,areaobj))==NULL)
+		return(JS_FALSE);
+	JS_SetPrivate(cx, allprog, p);
+	p->refs++;
 
-	val=OBJECT_TO_JSVAL(allprog);
-	if(!JS_SetProperty(cx, areaobj, "prog", &val))
-		return(NULL);
+	if(!JS_DefineProperty(cx, areaobj, "prog", OBJECT_TO_JSVAL(allprog)
+		,NULL,NULL,JSPROP_ENUMERATE))
+		return(JS_FALSE);
 
 	/* xtrn_area.sec_list[] */
 	if((sec_list=JS_NewArrayObject(cx, 0, NULL))==NULL) 
-		return(NULL);
+		return(JS_FALSE);
 
-	val=OBJECT_TO_JSVAL(sec_list);
-	if(!JS_SetProperty(cx, areaobj, "sec_list", &val)) 
-		return(NULL);
+	if(!JS_DefineProperty(cx, areaobj, "sec_list", OBJECT_TO_JSVAL(sec_list)
+		,NULL,NULL,JSPROP_ENUMERATE))
+		return(JS_FALSE);
 
 	for(l=0;l<cfg->total_xtrnsecs;l++) {
 
-		if((secobj=JS_NewObject(cx, NULL, NULL, NULL))==NULL)
-			return(NULL);
+		/* Parent is xtrn_area.prog, where the section's programs are created */
+		if((secobj=JS_NewObject(cx, &js_xtrn_sec_class, NULL, allprog))==NULL)
+			return(JS_FALSE);
+		p->sec[l].area=p;
+		p->sec[l].secnum=l;
+		JS_SetPrivate(cx, secobj, &p->sec[l]);
+		p->refs++;
 
+		val=OBJECT_TO_JSVAL(secobj);
 		sec_index=-1;
 		if(user==NULL || chk_ar(cfg,cfg->xtrnsec[l]->ar,user,client)) {
 
 			if(!JS_GetArrayLength(cx, sec_list, &sec_index))
-				return(NULL);
+				return(JS_FALSE);
 
-			val=OBJECT_TO_JSVAL(secobj);
 			if(!JS_SetElement(cx, sec_list, sec_index, &val))
-				return(NULL);
+				return(JS_FALSE);
 		}
+		p->sec[l].index=sec_index;
 
 		/* Add as property (associative array element) */
 		if(!JS_DefineProperty(cx, allsec, cfg->xtrnsec[l]->code, val
 			,NULL,NULL,JSPROP_READONLY|JSPROP_ENUMERATE))
-			return(NULL);
+			return(JS_FALSE);
 
 		val=INT_TO_JSVAL(sec_index);
 		if(!JS_SetProperty(cx, secobj, "index", &val))
-			return(NULL);
+			return(JS_FALSE);
 
 		val=INT_TO_JSVAL(l);
 		if(!JS_SetProperty(cx, secobj, "number", &val))
-			return(NULL);
+			return(JS_FALSE);
 
 		if((js_str=JS_NewStringCopyZ(cx, cfg->xtrnsec[l]->code))==NULL)
-			return(NULL);
+			return(JS_FALSE);
 		val=STRING_TO_JSVAL(js_str);
 		if(!JS_SetProperty(cx, secobj, "code", &val))
-			return(NULL);
+			return(JS_FALSE);
 
 		if((js_str=JS_NewStringCopyZ(cx, cfg->xtrnsec[l]->name))==NULL)
-			return(NULL);
+			return(JS_FALSE);
 		val=STRING_TO_JSVAL(js_str);
 		if(!JS_SetProperty(cx, secobj, "name", &val))
-			return(NULL);
+			return(JS_FALSE);
 
 		if((js_str=JS_NewStringCopyZ(cx, cfg->xtrnsec[l]->arstr))==NULL)
-			return(NULL);
+			return(JS_FALSE);
 		val=STRING_TO_JSVAL(js_str);
 		if(!JS_SetProperty(cx, secobj, "ars", &val))
-			return(NULL);
+			return(JS_FALSE);
 
-		if(user==NULL || chk_ar(cfg,cfg->xtrnsec[l]->ar,user,client))
-			val=JSVAL_TRUE;
-		else
-			val=JSVAL_FALSE;
+		val=BOOLEAN_TO_JSVAL(sec_index!=(jsuint)-1);
 		if(!JS_SetProperty(cx, secobj, "can_access", &val))
-			return(NULL);
-
-		/* prog_list[] */
-		if((prog_list=JS_NewArrayObject(cx, 0, NULL))==NULL) 
-			return(NULL);
-
-		val=OBJECT_TO_JSVAL(prog_list);
-		if(!JS_SetProperty(cx, secobj, "prog_list", &val)) 
-			return(NULL);
+			return(JS_FALSE);
 
 #ifdef BUILD_JSDOCS
 		js_DescribeSyncObject(cx,secobj,"Online Program (door) Sections (current user has access to)",310);
-#endif
-
-		for(d=0;d<cfg->total_xtrns;d++) {
-			if(cfg->xtrn[d]->sec!=l)
-				continue;
-
-			if((progobj=JS_NewObject(cx, NULL, NULL, NULL))==NULL)
-				return(NULL);
-
-			prog_index=-1;
-			if((user==NULL || chk_ar(cfg,cfg->xtrn[d]->ar,user,client))
-				&& !(cfg->xtrn[d]->event && cfg->xtrn[d]->misc&EVENTONLY)) {
-
-				if(!JS_GetArrayLength(cx, prog_list, &prog_index))
-					return(NULL);							
-
-				val=OBJECT_TO_JSVAL(progobj);
-				if(!JS_SetElement(cx, prog_list, prog_index, &val))
-					return(NULL);
-			}
-
-			/* Add as property (associative array element) */
-			if(!JS_DefineProperty(cx, allprog, cfg->xtrn[d]->code, val
-				,NULL,NULL,JSPROP_READONLY|JSPROP_ENUMERATE))
-				return(NULL);
-
-			val=INT_TO_JSVAL(prog_index);
-			if(!JS_SetProperty(cx, progobj, "index", &val))
-				return(NULL);
-
-			val=INT_TO_JSVAL(d);
-			if(!JS_SetProperty(cx, progobj, "number", &val))
-				return(NULL);
-
-			val=INT_TO_JSVAL(sec_index);
-			if(!JS_SetProperty(cx, progobj, "sec_index", &val))
-				return(NULL);
-
-			val=INT_TO_JSVAL(l);
-			if(!JS_SetProperty(cx, progobj, "sec_number", &val))
-				return(NULL);
-
-			val=STRING_TO_JSVAL(JS_NewStringCopyZ(cx,cfg->xtrnsec[l]->code));
-			if(!JS_SetProperty(cx, progobj, "sec_code", &val))
-				return(NULL);
-
-			if(!js_CreateXtrnProgProperties(cx, progobj, cfg->xtrn[d]))
-				return(NULL);
-
-			if(user==NULL || chk_ar(cfg,cfg->xtrn[d]->ar,user,client))
-				val=JSVAL_TRUE;
-			else
-				val=JSVAL_FALSE;
-			if(!JS_SetProperty(cx, progobj, "can_access", &val))
-				return(NULL);
-
-			if(user==NULL || chk_ar(cfg,cfg->xtrn[d]->run_ar,user,client))
-				val=JSVAL_TRUE;
-			else
-				val=JSVAL_FALSE;
-			if(!JS_SetProperty(cx, progobj, "can_run", &val))
-				return(NULL);
-
-#ifdef BUILD_JSDOCS
-			js_DescribeSyncObject(cx,progobj,"Online External Programs (doors) (current user has access to)",310);
-#endif
-		}
-
-#ifdef BUILD_JSDOCS
 		js_CreateArrayOfStrings(cx, secobj, "_property_desc_list", xtrn_sec_prop_desc, JSPROP_READONLY);
 #endif
-
 	}
 
 #ifdef BUILD_JSDOCS
@@ -390,64 +587,64 @@ JSObject* DLLCALL js_CreateXtrnAreaObject(JSContext* cx, JSObject* parent, scfg_
 
 	/* Create event property */
 	if((event_array=JS_NewObject(cx,NULL,NULL,areaobj))==NULL)
-		return(NULL);
+		return(JS_FALSE);
 
-	val=OBJECT_TO_JSVAL(event_array);
-	if(!JS_SetProperty(cx, areaobj, "event", &val))
-		return(NULL);
+	if(!JS_DefineProperty(cx, areaobj, "event", OBJECT_TO_JSVAL(event_array)
+		,NULL,NULL,JSPROP_ENUMERATE))
+		return(JS_FALSE);
 
 	for(l=0;l<cfg->total_events;l++) {
 
 		if((eventobj=JS_NewObject(cx, NULL, NULL, NULL))==NULL)
-			return(NULL);
+			return(JS_FALSE);
 
 		if(!JS_DefineProperty(cx, event_array, cfg->event[l]->code, OBJECT_TO_JSVAL(eventobj)
 			,NULL,NULL,JSPROP_READONLY|JSPROP_ENUMERATE))
-			return(NULL);
+			return(JS_FALSE);
 
 		if((js_str=JS_NewStringCopyZ(cx, cfg->event[l]->cmd))==NULL)
-			return(NULL);
+			return(JS_FALSE);
 		if(!JS_DefineProperty(cx, eventobj, "cmd", STRING_TO_JSVAL(js_str)
 			,NULL,NULL,JSPROP_ENUMERATE|JSPROP_READONLY))
-			return(NULL);
+			return(JS_FALSE);
 
 		if((js_str=JS_NewStringCopyZ(cx, cfg->event[l]->dir))==NULL)
-			return(NULL);
+			return(JS_FALSE);
 		if(!JS_DefineProperty(cx, eventobj, "startup_dir", STRING_TO_JSVAL(js_str)
 			,NULL,NULL,JSPROP_ENUMERATE|JSPROP_READONLY))
-			return(NULL);
+			return(JS_FALSE);
 
 		if(!JS_DefineProperty(cx, eventobj, "node_num", INT_TO_JSVAL(cfg->event[l]->node)
 			,NULL,NULL,JSPROP_ENUMERATE|JSPROP_READONLY))
-			return(NULL);
+			return(JS_FALSE);
 
 		if(!JS_DefineProperty(cx, eventobj, "time", INT_TO_JSVAL(cfg->event[l]->time)
 			,NULL,NULL,JSPROP_ENUMERATE|JSPROP_READONLY))
-			return(NULL);
+			return(JS_FALSE);
 
 		if(!JS_DefineProperty(cx, eventobj, "freq", INT_TO_JSVAL(cfg->event[l]->freq)
 			,NULL,NULL,JSPROP_ENUMERATE|JSPROP_READONLY))
-			return(NULL);
+			return(JS_FALSE);
 
 		if(!JS_DefineProperty(cx, eventobj, "days", INT_TO_JSVAL(cfg->event[l]->days)
 			,NULL,NULL,JSPROP_ENUMERATE|JSPROP_READONLY))
-			return(NULL);
+			return(JS_FALSE);
 
 		if(!JS_DefineProperty(cx, eventobj, "mdays", INT_TO_JSVAL(cfg->event[l]->mdays)
 			,NULL,NULL,JSPROP_ENUMERATE|JSPROP_READONLY))
-			return(NULL);
+			return(JS_FALSE);
 
 		if(!JS_DefineProperty(cx, eventobj, "months", INT_TO_JSVAL(cfg->event[l]->months)
 			,NULL,NULL,JSPROP_ENUMERATE|JSPROP_READONLY))
-			return(NULL);
+			return(JS_FALSE);
 
 		if(!JS_DefineProperty(cx, eventobj, "last_run", INT_TO_JSVAL(cfg->event[l]->last)
 			,NULL,NULL,JSPROP_ENUMERATE|JSPROP_READONLY))
-			return(NULL);
+			return(JS_FALSE);
 
 		if(!JS_DefineProperty(cx, eventobj, "settings", INT_TO_JSVAL(cfg->event[l]->misc)
 			,NULL,NULL,JSPROP_ENUMERATE|JSPROP_READONLY))
-			return(NULL);
+			return(JS_FALSE);
 
 #ifdef BUILD_JSDOCS
 		js_CreateArrayOfStrings(cx, eventobj, "_property_desc_list", event_prop_desc, JSPROP_READONLY);
@@ -461,11 +658,11 @@ JSObject* DLLCALL js_CreateXtrnAreaObject(JSContext* cx, JSObject* parent, scfg_
 
 	/* Create editor property */
 	if((xedit_array=JS_NewObject(cx,NULL,NULL,areaobj))==NULL)
-		return(NULL);
+		return(JS_FALSE);
 
-	val=OBJECT_TO_JSVAL(xedit_array);
-	if(!JS_SetProperty(cx, areaobj, "editor", &val))
-		return(NULL);
+	if(!JS_DefineProperty(cx, areaobj, "editor", OBJECT_TO_JSVAL(xedit_array)
+		,NULL,NULL,JSPROP_ENUMERATE))
+		return(JS_FALSE);
 
 	for(l=0;l<cfg->total_xedits;l++) {
 
@@ -473,37 +670,37 @@ JSObject* DLLCALL js_CreateXtrnAreaObject(JSContext* cx, JSObject* parent, scfg_
 			continue;
 
 		if((xeditobj=JS_NewObject(cx, NULL, NULL, NULL))==NULL)
-			return(NULL);
+			return(JS_FALSE);
 
 		if(!JS_DefineProperty(cx, xedit_array, cfg->xedit[l]->code, OBJECT_TO_JSVAL(xeditobj)
 			,NULL,NULL,JSPROP_READONLY|JSPROP_ENUMERATE))
-			return(NULL);
+			return(JS_FALSE);
 
 		if((js_str=JS_NewStringCopyZ(cx, cfg->xedit[l]->name))==NULL)
-			return(NULL);
+			return(JS_FALSE);
 		if(!JS_DefineProperty(cx, xeditobj, "name", STRING_TO_JSVAL(js_str)
 			,NULL,NULL,JSPROP_ENUMERATE|JSPROP_READONLY))
-			return(NULL);
+			return(JS_FALSE);
 
 		if((js_str=JS_NewStringCopyZ(cx, cfg->xedit[l]->rcmd))==NULL)
-			return(NULL);
+			return(JS_FALSE);
 		if(!JS_DefineProperty(cx, xeditobj, "cmd", STRING_TO_JSVAL(js_str)
 			,NULL,NULL,JSPROP_ENUMERATE|JSPROP_READONLY))
-			return(NULL);
+			return(JS_FALSE);
 
 		if((js_str=JS_NewStringCopyZ(cx, cfg->xedit[l]->arstr))==NULL)
-			return(NULL);
+			return(JS_FALSE);
 		if(!JS_DefineProperty(cx, xeditobj, "ars", STRING_TO_JSVAL(js_str)
 			,NULL,NULL,JSPROP_ENUMERATE|JSPROP_READONLY))
-			return(NULL);
+			return(JS_FALSE);
 
 		if(!JS_DefineProperty(cx, xeditobj, "settings", INT_TO_JSVAL(cfg->xedit[l]->misc)
 			,NULL,NULL,JSPROP_ENUMERATE|JSPROP_READONLY))
-			return(NULL);
+			return(JS_FALSE);
 
 		if(!JS_DefineProperty(cx, xeditobj, "type", INT_TO_JSVAL(cfg->xedit[l]->type)
 			,NULL,NULL,JSPROP_ENUMERATE|JSPROP_READONLY))
-			return(NULL);
+			return(JS_FALSE);
 
 #ifdef BUILD_JSDOCS
 		js_CreateArrayOfStrings(cx, xeditobj, "_property_desc_list", xedit_prop_desc, JSPROP_READONLY);
@@ -515,6 +712,107 @@ JSObject* DLLCALL js_CreateXtrnAreaObject(JSContext* cx, JSObject* parent, scfg_
 	JS_DefineProperty(cx,xedit_array,"_assoc_array",JSVAL_TRUE,NULL,NULL,JSPROP_READONLY);
 #endif
 
+	return(JS_TRUE);
+}
+
+static JSBool js_xtrn_area_resolve(JSContext *cx, JSObject *obj, jsid id)
+{
+	char*		name;
+	xtrn_area_private_t* p;
+	BOOL		match=TRUE;
+
+	if((p=(xtrn_area_private_t*)JS_GetPrivate(cx,obj))==NULL || p->secs_created)
+		return(JS_TRUE);
+
+	if(!js_xtrn_area_get_name(cx, id, &name))
+		return(JS_FALSE);
+	if(name!=NULL) {
+		match=(strcmp(name,"sec")==0 || strcmp(name,"prog")==0 || strcmp(name,"sec_list")==0
+			|| strcmp(name,"event")==0 || strcmp(name,"editor")==0);
+		free(name);
+	}
+	if(!match)
+		return(JS_TRUE);
+
+	return(js_create_xtrn_secs(cx, obj, p));
+}
+
+static JSBool js_xtrn_area_enumerate(JSContext *cx, JSObject *obj)
+{
+	return(js_xtrn_area_resolve(cx, obj, JSID_VOID));
+}
+
+static JSClass js_xtrn_area_class = {
+     "XtrnArea"				/* name			*/
+    ,JSCLASS_HAS_PRIVATE	/* flags		*/
+	,JS_PropertyStub		/* addProperty	*/
+	,JS_PropertyStub		/* delProperty	*/
+	,JS_PropertyStub		/* getProperty	*/
+	,JS_StrictPropertyStub	/* setProperty	*/
+	,js_xtrn_area_enumerate	/* enumerate	*/
+	,js_xtrn_area_resolve	/* resolve		*/
+	,JS_ConvertStub			/* convert		*/
+	,js_xtrn_area_finalize	/* finalize		*/
+};
+
+JSObject* DLLCALL js_CreateXtrnAreaObject(JSContext* cx, JSObject* parent, scfg_t* cfg
+										  ,user_t* user, client_t* client)
+{
+	JSObject*	areaobj=NULL;
+	xtrn_area_private_t* p;
+	xtrn_area_private_t* old;
+	jsval		val;
+
+	if((p=(xtrn_area_private_t*)calloc(1,sizeof(xtrn_area_private_t)))==NULL)
+		return(NULL);
+	p->refs=1;
+	p->cfg=cfg;
+	if(user!=NULL) {
+		p->user_buf=*user;
+		p->user=&p->user_buf;
+	}
+	if(client!=NULL) {
+		p->client_buf=*client;
+		p->client=&p->client_buf;
+	}
+	p->generation=cfg->generation;
+	p->total_xtrnsecs=cfg->total_xtrnsecs;
+	p->total_xtrns=cfg->total_xtrns;
+	if((p->sec=(xtrn_sec_private_t*)calloc(cfg->total_xtrnsecs+1,sizeof(xtrn_sec_private_t)))==NULL
+		|| (p->prog_index=(int*)calloc(cfg->total_xtrns+1,sizeof(int)))==NULL) {
+		xtrn_area_release(p);
+		return(NULL);
+	}
+
+	/* Return existing object if it's already been created */
+	if(JS_GetProperty(cx,parent,"xtrn_area",&val) && JSVAL_IS_OBJECT(val) && !JSVAL_IS_NULL(val)
+		&& (old=(xtrn_area_private_t*)JS_GetInstancePrivate(cx,JSVAL_TO_OBJECT(val),&js_xtrn_area_class,NULL))!=NULL) {
+		areaobj = JSVAL_TO_OBJECT(val);
+		JS_SetPrivate(cx, areaobj, p);
+		xtrn_area_release(old);
+		/* Re-created on next reference */
+		JS_DeleteProperty(cx, areaobj, "sec");
+		JS_DeleteProperty(cx, areaobj, "prog");
+		JS_DeleteProperty(cx, areaobj, "sec_list");
+		JS_DeleteProperty(cx, areaobj, "event");
+		JS_DeleteProperty(cx, areaobj, "editor");
+	}
+	else {
+		areaobj = JS_DefineObject(cx, parent, "xtrn_area", &js_xtrn_area_class
+									, NULL, JSPROP_ENUMERATE|JSPROP_READONLY);
+		if(areaobj!=NULL)
+			JS_SetPrivate(cx, areaobj, p);
+	}
+
+	if(areaobj==NULL) {
+		xtrn_area_release(p);
+		return(NULL);
+	}
+
+#ifdef BUILD_JSDOCS
+	js_DescribeSyncObject(cx,areaobj,"External Program Areas",310);
+#endif
+
 	return(areaobj);
 }
 
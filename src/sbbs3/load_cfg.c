@@ -43,6 +43,9 @@ static void free_attr_cfg(scfg_t* cfg);
 
 int 	lprintf(int level, const char *fmt, ...);	/* log output */
 
+/* Process-wide, so a zeroed and reloaded scfg_t still gets a new generation */
+static DWORD	cfg_generation;
+
 /****************************************************************************/
 /* Initializes system and node configuration information and data variables */
 /****************************************************************************/
@@ -64,6 +67,7 @@ BOOL DLLCALL load_cfg(scfg_t* cfg, char* text[], BOOL prep, char* error)
 	free_cfg(cfg);	/* free allocated config parameters */
 
 	cfg->prepped=FALSE;	/* reset prepped flag */
+	cfg->generation=++cfg_generation;
 
 	if(cfg->node_num<1)
 		cfg->node_num=1;
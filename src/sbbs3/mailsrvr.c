@@ -58,6 +58,7 @@
 #include "xpendian.h"
 #include "js_rtpool.h"
 #include "js_request.h"
+#include "js_cache.h"
 
 /* Constants */
 static const char*	server_name="Synchronet Mail Server";
@@ -65,7 +66,10 @@ static const char*	server_name="Synchronet Mail Server";
 #define NO_FORWARD		"local:"
 
 int dns_getmx(char* name, char* mx, char* mx2
-			  ,DWORD intf, DWORD ip_addr, BOOL use_tcp, int timeout);
+			  ,DWORD intf, DWORD ip_addr, BOOL use_tcp, int timeout, DWORD* ttl);
+int dns_getaddrs(char** name, size_t count, DWORD* addr, DWORD* ttl
+				 ,DWORD intf, DWORD ip_addr, int timeout);
+void get_dns_server(char* dns_server, size_t len);
 
 static char* pop_err	=	"-ERR";
 static char* ok_rsp		=	"250 OK";
@@ -82,9 +86,24 @@ static char* badrsp_err	=	"%s replied with:\r\n\"%s\"\r\n"
 #define TIMEOUT_THREAD_WAIT		60		/* Seconds */
 #define DNSBL_THROTTLE_VALUE	1000	/* Milliseconds */
 #define SPAM_HASH_SUBJECT_MIN_LEN	10	/* characters */
+#define DNSBL_MAX_LISTS			32		/* Max dns_blacklist.cfg entries queried at once */
+#define DNSBL_QUERY_TIMEOUT		10		/* Seconds, for all of the lists in a batch */
+#define DNS_CACHE_MAX_ENTRIES	4096
+#define DNS_CACHE_BUCKETS		1024	/* Hash table size */
+#define DNS_CACHE_BUCKET_SIZE	(DNS_CACHE_MAX_ENTRIES/DNS_CACHE_BUCKETS)
+#define DNS_CACHE_MIN_TTL		60		/* Seconds */
+#define DNS_CACHE_MAX_TTL		(60*60)	/* Seconds */
+#define DNS_CACHE_NEG_TTL		(5*60)	/* Seconds, for names not found */
 
 #define STATUS_WFC	"Listening"
 
+typedef struct {
+	char	name[256];		/* Query name (e.g. "4.3.2.1.dnsbl.example.org") */
+	ulong	addr;			/* Address found (network byte order), 0=none */
+	char	host[128];		/* Host name found (PTR look-ups), empty=none */
+	time_t	expires;
+} dns_cache_t;
+
 static mail_startup_t* startup=NULL;
 static scfg_t	scfg;
 static SOCKET	server_socket=INVALID_SOCKET;
@@ -92,11 +111,13 @@ static SOCKET	submission_socket=INVALID_SOCKET;
 static SOCKET	pop3_socket=INVALID_SOCKET;
 static protected_uint32_t active_clients;
 static protected_uint32_t thread_count;
-static volatile int		active_sendmail=0;
+static protected_uint32_t active_sendmail;
 static volatile BOOL	sendmail_running=FALSE;
 static volatile BOOL	terminate_server=FALSE;
 static volatile BOOL	terminate_sendmail=FALSE;
 static sem_t	sendmail_wakeup_sem;
+static dns_cache_t*	dns_cache=NULL;	/* [DNS_CACHE_BUCKETS][DNS_CACHE_BUCKET_SIZE] */
+static pthread_mutex_t	dns_cache_mutex;
 static char		revision[16];
 static volatile time_t	uptime;
 static str_list_t recycle_semfiles;
@@ -201,7 +222,7 @@ static BOOL winsock_startup(void)
 static void update_clients(void)
 {
 	if(startup!=NULL && startup->clients!=NULL)
-		startup->clients(startup->cbdata,active_clients.value+active_sendmail);
+		startup->clients(startup->cbdata,active_clients.value+active_sendmail.value);
 }
 
 static void client_on(SOCKET sock, client_t* client, BOOL update)
@@ -284,51 +305,38 @@ static void status(char* str)
 	    startup->status(startup->cbdata,str);
 }
 
-int sockprintf(SOCKET sock, char *fmt, ...)
+/* Sends all of buf, waiting for the socket to become writable as necessary */
+int sockwrite(SOCKET sock, const char* buf, int len)
 {
-	int		len;
-	int		maxlen;
+	int		wr=0;
 	int		result;
-	va_list argptr;
-	char	sbuf[1024];
 	fd_set	socket_set;
 	struct timeval tv;
 
-    va_start(argptr,fmt);
-    len=vsnprintf(sbuf,maxlen=sizeof(sbuf)-2,fmt,argptr);
-    va_end(argptr);
-
-	if(len<0 || len > maxlen) /* format error or output truncated */
-		len=maxlen;
-	if(startup->options&MAIL_OPT_DEBUG_TX)
-		lprintf(LOG_DEBUG,"%04d TX: %.*s", sock, len, sbuf);
-	memcpy(sbuf+len,"\r\n",2);
-	len+=2;
-
 	if(sock==INVALID_SOCKET) {
-		lprintf(LOG_WARNING,"!INVALID SOCKET in call to sockprintf");
+		lprintf(LOG_WARNING,"!INVALID SOCKET in call to sockwrite");
 		return(0);
 	}
 
-	/* Check socket for writability (using select) */
-	tv.tv_sec=300;
-	tv.tv_usec=0;
+	while(wr<len) {
+		/* Check socket for writability (using select) */
+		tv.tv_sec=300;
+		tv.tv_usec=0;
 
-	FD_ZERO(&socket_set);
-	FD_SET(sock,&socket_set);
+		FD_ZERO(&socket_set);
+		FD_SET(sock,&socket_set);
 
-	if((result=select(sock+1,NULL,&socket_set,NULL,&tv))<1) {
-		if(result==0)
-			lprintf(LOG_NOTICE,"%04d !TIMEOUT selecting socket for send"
-				,sock);
-		else
-			lprintf(LOG_NOTICE,"%04d !ERROR %d selecting socket for send"
-				,sock, ERROR_VALUE);
-		return(0);
-	}
+		if((result=select(sock+1,NULL,&socket_set,NULL,&tv))<1) {
+			if(result==0)
+				lprintf(LOG_NOTICE,"%04d !TIMEOUT selecting socket for send"
+					,sock);
+			else
+				lprintf(LOG_NOTICE,"%04d !ERROR %d selecting socket for send"
+					,sock, ERROR_VALUE);
+			return(0);
+		}
 
-	while((result=sendsocket(sock,sbuf,len))!=len) {
-		if(result==SOCKET_ERROR) {
+		if((result=sendsocket(sock,buf+wr,len-wr))==SOCKET_ERROR) {
 			if(ERROR_VALUE==EWOULDBLOCK) {
 				YIELD();
 				continue;
@@ -341,11 +349,52 @@ int sockprintf(SOCKET sock, char *fmt, ...)
 				lprintf(LOG_NOTICE,"%04d !ERROR %d sending on socket",sock,ERROR_VALUE);
 			return(0);
 		}
-		lprintf(LOG_WARNING,"%04d !ERROR: short send on socket: %d instead of %d",sock,result,len);
+		wr+=result;	/* short sends are continued */
 	}
 	return(len);
 }
 
+/* While corked, partial segments are held by the TCP stack (up to 200ms)	*/
+/* so that lines sent individually go out in full-sized segments			*/
+static void sockcork(SOCKET sock, BOOL cork)
+{
+#if defined(TCP_CORK) || defined(TCP_NOPUSH)
+	int		opt=cork;
+
+#if defined(TCP_CORK)
+	setsockopt(sock,IPPROTO_TCP,TCP_CORK,(char*)&opt,sizeof(opt));
+#else
+	setsockopt(sock,IPPROTO_TCP,TCP_NOPUSH,(char*)&opt,sizeof(opt));
+#endif
+#endif
+}
+
+int sockprintf(SOCKET sock, char *fmt, ...)
+{
+	int		len;
+	int		maxlen;
+	va_list argptr;
+	char	sbuf[1024];
+
+    va_start(argptr,fmt);
+    len=vsnprintf(sbuf,maxlen=sizeof(sbuf)-2,fmt,argptr);
+    va_end(argptr);
+
+	if(len<0 || len > maxlen) /* format error or output truncated */
+		len=maxlen;
+	if(startup->options&MAIL_OPT_DEBUG_TX)
+		lprintf(LOG_DEBUG,"%04d TX: %.*s", sock, len, sbuf);
+	memcpy(sbuf+len,"\r\n",2);
+	len+=2;
+
+	if(sock==INVALID_SOCKET) {
+		lprintf(LOG_WARNING,"!INVALID SOCKET in call to sockprintf");
+		return(0);
+	}
+
+	return(sockwrite(sock,sbuf,len));
+}
+
 static void sockerror(SOCKET socket, int rd, const char* action)
 {
 	if(rd==0) 
@@ -367,10 +416,10 @@ static void sockerror(SOCKET socket, int rd, const char* action)
 }
 
 
-static int sockreadline(SOCKET socket, char* buf, int len)
+static int sockreadline(SOCKET socket, sockbuf_t* rdbuf, char* buf, int len)
 {
-	char	ch;
-	int		i,rd=0;
+	int		i;
+	size_t	rd=0;
 	fd_set	socket_set;
 	struct	timeval	tv;
 	time_t	start;
@@ -384,41 +433,42 @@ static int sockreadline(SOCKET socket, char* buf, int len)
 		return(-1);
 	}
 	
-	while(rd<len-1) {
+	while(rd<(size_t)len-1) {
 
 		if(server_socket==INVALID_SOCKET || terminate_server) {
 			lprintf(LOG_WARNING,"%04d !ABORTING sockreadline",socket);
 			return(-1);
 		}
 
-		tv.tv_sec=startup->max_inactivity;
-		tv.tv_usec=0;
+		if(sockbuf_pending(rdbuf)==0) {
+			tv.tv_sec=startup->max_inactivity;
+			tv.tv_usec=0;
 
-		FD_ZERO(&socket_set);
-		FD_SET(socket,&socket_set);
+			FD_ZERO(&socket_set);
+			FD_SET(socket,&socket_set);
 
-		i=select(socket+1,&socket_set,NULL,NULL,&tv);
+			i=select(socket+1,&socket_set,NULL,NULL,&tv);
 
-		if(i<1) {
-			if(i==0) {
-				if(startup->max_inactivity && (time(NULL)-start)>startup->max_inactivity) {
-					lprintf(LOG_WARNING,"%04d !TIMEOUT in sockreadline (%u seconds):  INACTIVE SOCKET",socket,startup->max_inactivity);
-					return(-1);
+			if(i<1) {
+				if(i==0) {
+					if(startup->max_inactivity && (time(NULL)-start)>startup->max_inactivity) {
+						lprintf(LOG_WARNING,"%04d !TIMEOUT in sockreadline (%u seconds):  INACTIVE SOCKET",socket,startup->max_inactivity);
+						return(-1);
+					}
+					continue;
 				}
-				continue;
+				sockerror(socket,i,"select");
+				return(-1);
+			}
+			i=sockbuf_recv(rdbuf, socket);
+			if(i<1) {
+				sockerror(socket,i,"receive");
+				return(-1);
 			}
-			sockerror(socket,i,"select");
-			return(-1);
-		}
-		i=recv(socket, &ch, 1, 0);
-		if(i<1) {
-			sockerror(socket,i,"receive");
-			return(-1);
 		}
-		if(ch=='\n' /* && rd>=1 */ ) { /* Mar-9-2003: terminate on sole LF */
+		/* Mar-9-2003: terminate on sole LF */
+		if(sockbuf_getline(rdbuf, buf, &rd, len-1))
 			break;
-		}	
-		buf[rd++]=ch;
 	}
 	if(rd>0 && buf[rd-1]=='\r')
 		rd--;
@@ -427,12 +477,12 @@ static int sockreadline(SOCKET socket, char* buf, int len)
 	return(rd);
 }
 
-static BOOL sockgetrsp(SOCKET socket, char* rsp, char *buf, int len)
+static BOOL sockgetrsp(SOCKET socket, sockbuf_t* rdbuf, char* rsp, char *buf, int len)
 {
 	int rd;
 
 	while(1) {
-		rd = sockreadline(socket, buf, len);
+		rd = sockreadline(socket, rdbuf, buf, len);
 		if(rd<1) {
 			if(rd==0)
 				lprintf(LOG_WARNING,"%04d !RECEIVED BLANK RESPONSE, Expected '%s'", socket, rsp);
@@ -462,6 +512,65 @@ static BOOL sockgetrsp(SOCKET socket, char* rsp, char *buf, int len)
 */
 #define MAX_LINE_LEN	998		
 
+#define MSGBODY_BUFLEN	(16*1024)
+
+/* Sends message body text, CRLF-terminated and dot-stuffed, in large chunks */
+/* Returns the number of lines successfully sent */
+static ulong sockmsgbody(SOCKET socket, char* msgtxt, ulong maxlines)
+{
+	char		buf[MSGBODY_BUFLEN];
+	char*		np=msgtxt;
+	char*		eol;
+	size_t		pos=0;
+	size_t		len,tlen;
+	ulong		lines=0;
+	ulong		buffered=0;
+
+	while(1) {
+		/* Flush when the buffer can't hold another (max length, stuffed) line */
+		if(*np==0 || lines+buffered>=maxlines || pos+MAX_LINE_LEN+3>sizeof(buf)) {
+			if(pos && !sockwrite(socket,buf,pos))
+				break;
+			lines+=buffered;
+			buffered=0;
+			pos=0;
+			if(*np==0 || lines>=maxlines)
+				break;
+			/* release time-slice every buffer-full */
+			if(startup->lines_per_yield)
+				YIELD();
+		}
+
+		if((eol=strchr(np,'\n'))!=NULL)
+			len=eol-np;
+		else
+			len=strlen(np);
+		if(len>MAX_LINE_LEN)
+			len=MAX_LINE_LEN;
+
+		tlen=len;
+		while(tlen && *(np+(tlen-1))<=' ') /* Takes care of '\r' or spaces */
+			tlen--;
+
+		if(startup->options&MAIL_OPT_DEBUG_TX)
+			lprintf(LOG_DEBUG,"%04d TX: %s%.*s", socket, *np=='.' ? ".":"", (int)tlen, np);
+		if(*np=='.')
+			buf[pos++]='.';
+		memcpy(buf+pos,np,tlen);
+		pos+=tlen;
+		buf[pos++]='\r';
+		buf[pos++]='\n';
+		buffered++;
+
+		if(*(np+len)=='\r')
+			len++;
+		if(*(np+len)=='\n')
+			len++;
+		np+=len;
+	}
+	return(lines);
+}
+
 static ulong sockmimetext(SOCKET socket, smbmsg_t* msg, char* msgtxt, ulong maxlines
 						  ,str_list_t file_list, char* mime_boundary)
 {
@@ -476,7 +585,6 @@ static ulong sockmimetext(SOCKET socket, smbmsg_t* msg, char* msgtxt, ulong maxl
 	int			i;
 	int			s;
 	ulong		lines;
-	int			len,tlen;
 
 	/* HEADERS (in recommended order per RFC822 4.1) */
 
@@ -599,30 +707,8 @@ static ulong sockmimetext(SOCKET socket, smbmsg_t* msg, char* msgtxt, ulong maxl
 		return(0);
 
 	/* MESSAGE BODY */
-	lines=0;
-	np=msgtxt;
-	while(*np && lines<maxlines) {
-		len=0;
-		while(len<MAX_LINE_LEN && *(np+len)!=0 && *(np+len)!='\n')
-			len++;
-
-		tlen=len;
-		while(tlen && *(np+(tlen-1))<=' ') /* Takes care of '\r' or spaces */
-			tlen--;
+	lines=sockmsgbody(socket,msgtxt,maxlines);
 
-		if(!sockprintf(socket, "%s%.*s", *np=='.' ? ".":"", tlen, np))
-			break;
-		lines++;
-		if(*(np+len)=='\r')
-			len++;
-		if(*(np+len)=='\n')
-			len++;
-		np+=len;
-		/* release time-slices every x lines */
-		if(startup->lines_per_yield
-			&& !(lines%startup->lines_per_yield))	
-			YIELD();
-	}
 	if(file_list!=NULL) {
 		for(i=0;file_list[i];i++) { 
 			sockprintf(socket,"");
@@ -678,7 +764,9 @@ static ulong sockmsgtxt(SOCKET socket, smbmsg_t* msg, char* msgtxt, ulong maxlin
 		}
     }
 
+	sockcork(socket,TRUE);
 	retval = sockmimetext(socket,msg,msgtxt,maxlines,file_list,boundary);
+	sockcork(socket,FALSE);
 
 	strListFree(&file_list);
 
@@ -727,6 +815,111 @@ static u_long resolve_ip(char *inaddr)
 /* A successful login from the same host resets the counter.				*/
 /****************************************************************************/
 
+/****************************************************************************/
+/* DNS result cache (DNSBL and client host name look-ups), shared by all	*/
+/* sessions. Names not found are cached too (for DNS_CACHE_NEG_TTL).		*/
+/* Names are hashed (case-insensitively) to a bucket of						*/
+/* DNS_CACHE_BUCKET_SIZE entries; when a bucket is full, the entry that		*/
+/* expires first is replaced.												*/
+/****************************************************************************/
+static dns_cache_t* dns_cache_bucket(const char* name)
+{
+	char	lname[sizeof(dns_cache->name)];
+
+	SAFECOPY(lname,name);
+	strlwr(lname);
+	return(dns_cache+(crc32(lname,strlen(lname))%DNS_CACHE_BUCKETS)*DNS_CACHE_BUCKET_SIZE);
+}
+
+static BOOL dns_cache_get(const char* name, ulong* addr, char* host, size_t maxlen)
+{
+	int				i;
+	dns_cache_t*	entry;
+	time_t			now=time(NULL);
+	BOOL			found=FALSE;
+
+	if(dns_cache==NULL)
+		return(FALSE);
+
+	pthread_mutex_lock(&dns_cache_mutex);
+	entry=dns_cache_bucket(name);
+	for(i=0; i<DNS_CACHE_BUCKET_SIZE; i++, entry++) {
+		if(entry->name[0]==0 || now >= entry->expires)
+			continue;
+		if(stricmp(entry->name,name)==0) {
+			if(addr!=NULL)
+				*addr=entry->addr;
+			if(host!=NULL)
+				safe_snprintf(host,maxlen,"%s",entry->host);
+			found=TRUE;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&dns_cache_mutex);
+
+	return(found);
+}
+
+/* Replaces any existing entry for name */
+static void dns_cache_add(const char* name, ulong addr, const char* host, DWORD ttl)
+{
+	int				i;
+	dns_cache_t*	bucket;
+	dns_cache_t*	entry=NULL;
+
+	if(dns_cache==NULL)
+		return;
+
+	if(ttl<DNS_CACHE_MIN_TTL)
+		ttl=DNS_CACHE_MIN_TTL;
+	if(ttl>DNS_CACHE_MAX_TTL)
+		ttl=DNS_CACHE_MAX_TTL;
+
+	pthread_mutex_lock(&dns_cache_mutex);
+	bucket=dns_cache_bucket(name);
+	for(i=0; i<DNS_CACHE_BUCKET_SIZE; i++) {
+		if(bucket[i].name[0]==0 || stricmp(bucket[i].name,name)==0) {
+			entry=&bucket[i];
+			break;
+		}
+		if(entry==NULL || bucket[i].expires < entry->expires)	/* expires first */
+			entry=&bucket[i];
+	}
+	memset(entry,0,sizeof(*entry));
+	SAFECOPY(entry->name,name);
+	entry->addr=addr;
+	if(host!=NULL)
+		SAFECOPY(entry->host,host);
+	entry->expires=time(NULL)+ttl;
+	pthread_mutex_unlock(&dns_cache_mutex);
+}
+
+/* Returns FALSE if the address has no host name */
+static BOOL get_host_name(IN_ADDR addr, char* host_name, size_t maxlen)
+{
+	char		name[64];
+	ulong		ip=ntohl(addr.s_addr);
+	HOSTENT*	host;
+
+	SAFEPRINTF4(name,"%lu.%lu.%lu.%lu.in-addr.arpa"
+		,ip&0xff
+		,(ip>>8)&0xff
+		,(ip>>16)&0xff
+		,(ip>>24)&0xff);
+
+	if(!dns_cache_get(name,NULL,host_name,maxlen)) {
+		host=gethostbyaddr((char *)&addr,sizeof(addr),AF_INET);
+		if(host!=NULL && host->h_name!=NULL) {
+			safe_snprintf(host_name,maxlen,"%s",host->h_name);
+			dns_cache_add(name,0,host_name,DNS_CACHE_MAX_TTL);
+		} else {
+			*host_name=0;
+			dns_cache_add(name,0,NULL,DNS_CACHE_NEG_TTL);
+		}
+	}
+	return(*host_name!=0);
+}
+
 static void badlogin(SOCKET sock, const char* prot, const char* resp, char* user, char* passwd, char* host, SOCKADDR_IN* addr)
 {
 	char	reason[128];
@@ -771,7 +964,7 @@ static void pop3_thread(void* arg)
 	long		msgnum;
 	ulong		bytes;
 	SOCKET		socket;
-	HOSTENT*	host;
+	sockbuf_t	rdbuf;
 	smb_t		smb;
 	smbmsg_t	msg;
 	user_t		user;
@@ -785,6 +978,7 @@ static void pop3_thread(void* arg)
 	free(arg);
 
 	socket=pop3.socket;
+	sockbuf_init(&rdbuf);
 
 	if(startup->options&MAIL_OPT_DEBUG_POP3)
 		lprintf(LOG_DEBUG,"%04d POP3 session thread started", socket);
@@ -800,15 +994,8 @@ static void pop3_thread(void* arg)
 		lprintf(LOG_INFO,"%04d POP3 connection accepted from: %s port %u"
 			,socket, host_ip, ntohs(pop3.client_addr.sin_port));
 
-	if(startup->options&MAIL_OPT_NO_HOST_LOOKUP)
-		host=NULL;
-	else
-		host=gethostbyaddr((char *)&pop3.client_addr.sin_addr
-			,sizeof(pop3.client_addr.sin_addr),AF_INET);
-
-	if(host!=NULL && host->h_name!=NULL)
-		SAFECOPY(host_name,host->h_name);
-	else
+	if((startup->options&MAIL_OPT_NO_HOST_LOOKUP)
+		|| !get_host_name(pop3.client_addr.sin_addr,host_name,sizeof(host_name)))
 		strcpy(host_name,"<no name>");
 
 	if(!(startup->options&MAIL_OPT_NO_HOST_LOOKUP) && (startup->options&MAIL_OPT_DEBUG_POP3))
@@ -873,7 +1060,7 @@ static void pop3_thread(void* arg)
 
 		/* Requires USER command first */
 		for(i=3;i;i--) {
-			if(!sockgetrsp(socket,NULL,buf,sizeof(buf)))
+			if(!sockgetrsp(socket,&rdbuf,NULL,buf,sizeof(buf)))
 				break;
 			if(!strnicmp(buf,"USER ",5))
 				break;
@@ -897,7 +1084,7 @@ static void pop3_thread(void* arg)
 		SAFECOPY(username,p);
 		if(!apop) {
 			sockprintf(socket,"+OK");
-			if(!sockgetrsp(socket,"PASS ",buf,sizeof(buf))) {
+			if(!sockgetrsp(socket,&rdbuf,"PASS ",buf,sizeof(buf))) {
 				sockprintf(socket,"-ERR PASS command expected");
 				break;
 			}
@@ -1019,7 +1206,7 @@ static void pop3_thread(void* arg)
 		sockprintf(socket,"+OK %lu messages (%lu bytes)",msgs,bytes);
 
 		while(1) {	/* TRANSACTION STATE */
-			rd = sockreadline(socket, buf, sizeof(buf));
+			rd = sockreadline(socket, &rdbuf, buf, sizeof(buf));
 			if(rd<0) 
 				break;
 			truncsp(buf);
@@ -1369,42 +1556,38 @@ static void pop3_thread(void* arg)
 	mail_close_socket(socket);
 }
 
-static ulong rblchk(SOCKET sock, DWORD mail_addr_n, const char* rbl_addr)
+static ulong rblchk(SOCKET sock, const char* name)
 {
-	char		name[256];
-	DWORD		mail_addr;
 	HOSTENT*	host;
-	struct in_addr dnsbl_result;
-
-	mail_addr=ntohl(mail_addr_n);
-	safe_snprintf(name,sizeof(name),"%ld.%ld.%ld.%ld.%.128s"
-		,mail_addr&0xff
-		,(mail_addr>>8)&0xff
-		,(mail_addr>>16)&0xff
-		,(mail_addr>>24)&0xff
-		,rbl_addr
-		);
-
-	lprintf(LOG_DEBUG,"%04d SMTP DNSBL Query: %s",sock,name);
 
 	if((host=gethostbyname(name))==NULL)
 		return(0);
 
-	dnsbl_result.s_addr = *((ulong*)host->h_addr_list[0]);
-	lprintf(LOG_INFO,"%04d SMTP DNSBL Query: %s resolved to: %s"
-		,sock,name,inet_ntoa(dnsbl_result));
-
-	return(dnsbl_result.s_addr);
+	return(*((ulong*)host->h_addr_list[0]));
 }
 
 static ulong dns_blacklisted(SOCKET sock, IN_ADDR addr, char* host_name, char* list, char* dnsbl_ip)
 {
 	char	fname[MAX_PATH+1];
 	char	str[256];
+	char	dns_server[16];
+	char	desc[DNSBL_MAX_LISTS][101];
+	char	name[DNSBL_MAX_LISTS][256];
+	char*	query[DNSBL_MAX_LISTS];
 	char*	p;
 	char*	tp;
 	FILE*	fp;
+	ulong	mail_addr;
+	ulong	dns;
+	ulong	result[DNSBL_MAX_LISTS];
+	DWORD	query_result[DNSBL_MAX_LISTS];
+	DWORD	ttl[DNSBL_MAX_LISTS];
+	size_t	index[DNSBL_MAX_LISTS];
+	size_t	lists=0;
+	size_t	queries=0;
+	size_t	i;
 	ulong	found=0;
+	struct in_addr dnsbl_result;
 
 	SAFEPRINTF(fname,"%sdnsbl_exempt.cfg",scfg.ctrl_dir);
 	if(findstr(inet_ntoa(addr),fname))
@@ -1416,26 +1599,81 @@ static ulong dns_blacklisted(SOCKET sock, IN_ADDR addr, char* host_name, char* l
 	if((fp=fopen(fname,"r"))==NULL)
 		return(FALSE);
 
-	while(!feof(fp) && !found) {
-		if(fgets(str,sizeof(str),fp)==NULL)
-			break;
-		truncsp(str);
+	mail_addr=ntohl(addr.s_addr);
+	/* Query the lists in batches of (at most) DNSBL_MAX_LISTS */
+	while(!found && !feof(fp)) {
+		lists=queries=0;
+		while(lists<DNSBL_MAX_LISTS && fgets(str,sizeof(str),fp)!=NULL) {
+			truncsp(str);
 
-		p=str;
-		SKIP_WHITESPACE(p);
-		if(*p==';' || *p==0) /* comment or blank line */
-			continue;
+			p=str;
+			SKIP_WHITESPACE(p);
+			if(*p==';' || *p==0) /* comment or blank line */
+				continue;
 
-		sprintf(list,"%.100s",p);
+			sprintf(desc[lists],"%.100s",p);
+
+			/* terminate */
+			tp = p;
+			FIND_WHITESPACE(tp);
+			*tp=0;	
+
+			safe_snprintf(name[lists],sizeof(name[lists]),"%ld.%ld.%ld.%ld.%.128s"
+				,mail_addr&0xff
+				,(mail_addr>>8)&0xff
+				,(mail_addr>>16)&0xff
+				,(mail_addr>>24)&0xff
+				,p
+				);
+			if(dns_cache_get(name[lists],&result[lists],NULL,0))
+				lprintf(LOG_DEBUG,"%04d SMTP DNSBL Query: %s (cached)",sock,name[lists]);
+			else {
+				lprintf(LOG_DEBUG,"%04d SMTP DNSBL Query: %s",sock,name[lists]);
+				result[lists]=INADDR_NONE;
+				index[queries]=lists;
+				query[queries++]=name[lists];
+			}
+			lists++;
+		}
+		if(!lists)
+			break;
 
-		/* terminate */
-		tp = p;
-		FIND_WHITESPACE(tp);
-		*tp=0;	
+		/* Query all of the lists in this batch (that aren't cached) at once */
+		if(queries) {
+			get_dns_server(dns_server,sizeof(dns_server));
+			if((dns=resolve_ip(dns_server))!=INADDR_NONE
+				&& dns_getaddrs(query, queries, query_result, ttl, INADDR_ANY, dns
+					,DNSBL_QUERY_TIMEOUT) > 0) {
+				for(i=0;i<queries;i++) {
+					if(query_result[i]==INADDR_NONE)	/* no response */
+						continue;
+					result[index[i]]=query_result[i];
+					dns_cache_add(query[i], query_result[i], NULL
+						,query_result[i] ? ttl[i] : DNS_CACHE_NEG_TTL);
+				}
+			}
+			/* Fall back to the system resolver for any without a response */
+			for(i=0;i<queries;i++) {
+				if(result[index[i]]!=INADDR_NONE)
+					continue;
+				result[index[i]]=rblchk(sock, query[i]);
+				dns_cache_add(query[i], result[index[i]], NULL
+					,result[index[i]] ? DNS_CACHE_MAX_TTL : DNS_CACHE_NEG_TTL);
+			}
+		}
 
-		found = rblchk(sock, addr.s_addr, p);
+		for(i=0;i<lists && !found;i++) {
+			if(result[i]==0 || result[i]==INADDR_NONE)
+				continue;
+			found=result[i];
+			strcpy(list,desc[i]);
+			dnsbl_result.s_addr=found;
+			lprintf(LOG_INFO,"%04d SMTP DNSBL Query: %s resolved to: %s"
+				,sock,name[i],inet_ntoa(dnsbl_result));
+		}
 	}
 	fclose(fp);
+
 	if(found)
 		strcpy(dnsbl_ip, inet_ntoa(addr));
 
@@ -1892,7 +2130,7 @@ js_mailproc(SOCKET sock, client_t* client, user_t* user, struct mailproc* mailpr
 		} else {
 			lprintf(LOG_DEBUG,"%04d %s Executing: %s"
 				,sock, log_prefix, cmdline);
-			if((js_script=JS_CompileFile(*js_cx, js_scope, path)) != NULL)
+			if((js_script=js_get_compiled_script(*js_cx, js_scope, path)) != NULL)
 				js_PrepareToExecute(*js_cx, js_scope, path, /* startup_dir: */NULL);
 		}
 		if(js_script==NULL)
@@ -2118,6 +2356,8 @@ static void parse_mail_address(char* p
 	truncsp(name);
 }
 
+#define HEX_DIGIT_VAL(ch)	(isdigit(ch) ? (ch)-'0' : (toupper(ch)-'A')+10)
+
 /* Decode quoted-printable content-transfer-encoded text */
 /* Ignores (strips) unsupported ctrl chars and non-ASCII chars */
 /* Does not enforce 76 char line length limit */
@@ -2139,12 +2379,8 @@ static char* qp_decode(char* buf)
 			if(*p==0) 	/* soft link break */
 				break;
 			if(isxdigit(*p) && isxdigit(*(p+1))) {
-				char hex[3];
-				hex[0]=*p;
-				hex[1]=*(p+1);
-				hex[2]=0;
 				/* ToDo: what about encoded NULs and the like? */
-				*dest++=(uchar)strtoul(hex,NULL,16);
+				*dest++=(uchar)((HEX_DIGIT_VAL(*p)<<4)|HEX_DIGIT_VAL(*(p+1)));
 				p++;
 			} else {	/* bad encoding */
 				*dest++='=';
@@ -2289,7 +2525,7 @@ static void smtp_thread(void* arg)
 	char		session_id[MAX_PATH+1];
 	FILE*		spy=NULL;
 	SOCKET		socket;
-	HOSTENT*	host;
+	sockbuf_t	rdbuf;
 	int			smb_error;
 	smb_t		smb;
 	smb_t		spam;
@@ -2334,6 +2570,7 @@ static void smtp_thread(void* arg)
 			,ENCODING_BASE64
 			,ENCODING_QUOTED_PRINTABLE
 	} content_encoding = ENCODING_NONE;
+	b64_state_t	b64_state;			/* base64 quanta may span lines */
 
 	SetThreadName("SMTP");
 	thread_up(TRUE /* setuid */);
@@ -2341,6 +2578,7 @@ static void smtp_thread(void* arg)
 	free(arg);
 
 	socket=smtp.socket;
+	sockbuf_init(&rdbuf);
 
 	lprintf(LOG_DEBUG,"%04d SMTP Session thread started", socket);
 
@@ -2379,15 +2617,8 @@ static void smtp_thread(void* arg)
 	lprintf(LOG_INFO,"%04d SMTP Connection accepted on port %u from: %s port %u"
 		,socket, BE_INT16(server_addr.sin_port), host_ip, ntohs(smtp.client_addr.sin_port));
 
-	if(startup->options&MAIL_OPT_NO_HOST_LOOKUP)
-		host=NULL;
-	else
-		host=gethostbyaddr ((char *)&smtp.client_addr.sin_addr
-			,sizeof(smtp.client_addr.sin_addr),AF_INET);
-
-	if(host!=NULL && host->h_name!=NULL)
-		SAFECOPY(host_name,host->h_name);
-	else
+	if((startup->options&MAIL_OPT_NO_HOST_LOOKUP)
+		|| !get_host_name(smtp.client_addr.sin_addr,host_name,sizeof(host_name)))
 		strcpy(host_name,"<no name>");
 
 	if(!(startup->options&MAIL_OPT_NO_HOST_LOOKUP))
@@ -2524,7 +2755,7 @@ static void smtp_thread(void* arg)
 	sockprintf(socket,"220 %s Synchronet SMTP Server %s-%s Ready"
 		,startup->host_name,revision,PLATFORM_DESC);
 	while(1) {
-		rd = sockreadline(socket, buf, sizeof(buf));
+		rd = sockreadline(socket, &rdbuf, buf, sizeof(buf));
 		if(rd<0) 
 			break;
 		truncsp(buf);
@@ -2554,7 +2785,8 @@ static void smtp_thread(void* arg)
 				lprintf(LOG_INFO,"%04d SMTP End of message (body: %lu lines, %lu bytes, header: %lu lines, %lu bytes)"
 					, socket, lines, ftell(msgtxt)-hdr_len, hdr_lines, hdr_len);
 
-				if(!socket_check(socket, NULL, NULL, 0)) {
+				/* A pipelined command (e.g. QUIT) may have already been received */
+				if(!sockbuf_pending(&rdbuf) && !socket_check(socket, NULL, NULL, 0)) {
 					lprintf(LOG_WARNING,"%04d !SMTP sender disconnected (premature evacuation)", socket);
 					continue;
 				}
@@ -3186,6 +3418,7 @@ static void smtp_thread(void* arg)
 			if(buf[0]==0 && state==SMTP_STATE_DATA_HEADER) {	
 				state=SMTP_STATE_DATA_BODY;	/* Null line separates header and body */
 				lines=0;
+				b64_init(&b64_state);
 				if(msgtxt!=NULL) {
 					fprintf(msgtxt, "\r\n");
 					hdr_len=ftell(msgtxt);
@@ -3200,11 +3433,17 @@ static void smtp_thread(void* arg)
 						case ENCODING_BASE64:
 							{
 								char	decode_buf[sizeof(buf)];
+								int		len;
 
-								if(b64_decode(decode_buf, sizeof(decode_buf), p, strlen(p))<0)
+								if((len=b64_decode_update(&b64_state, decode_buf, sizeof(decode_buf)-1, p, strlen(p)))<0) {
 									fprintf(msgtxt,"\r\n!Base64 decode error: %s\r\n", p);
-								else
+									b64_init(&b64_state);
+								} else {
+									decode_buf[len]=0;
 									fputs(decode_buf, msgtxt);
+									if(b64_state.pad)	/* end of encoded data */
+										b64_init(&b64_state);
+								}
 							}
 							break;
 						case ENCODING_QUOTED_PRINTABLE:
@@ -3293,7 +3532,7 @@ static void smtp_thread(void* arg)
 			|| strnicmp(buf,"AUTH PLAIN",10)==0) {
 			if(auth_login) {
 				sockprintf(socket,"334 VXNlcm5hbWU6");	/* Base64-encoded "Username:" */
-				if((rd=sockreadline(socket, buf, sizeof(buf)))<1) {
+				if((rd=sockreadline(socket, &rdbuf, buf, sizeof(buf)))<1) {
 					sockprintf(socket,badarg_rsp);
 					continue;
 				}
@@ -3304,7 +3543,7 @@ static void smtp_thread(void* arg)
 					continue;
 				}
 				sockprintf(socket,"334 UGFzc3dvcmQ6");	/* Base64-encoded "Password:" */
-				if((rd=sockreadline(socket, buf, sizeof(buf)))<1) {
+				if((rd=sockreadline(socket, &rdbuf, buf, sizeof(buf)))<1) {
 					sockprintf(socket,badarg_rsp);
 					continue;
 				}
@@ -3397,7 +3636,7 @@ static void smtp_thread(void* arg)
 #endif
 			b64_encode(str,sizeof(str),challenge,0);
 			sockprintf(socket,"334 %s",str);
-			if((rd=sockreadline(socket, buf, sizeof(buf)))<1) {
+			if((rd=sockreadline(socket, &rdbuf, buf, sizeof(buf)))<1) {
 				sockprintf(socket,badarg_rsp);
 				continue;
 			}
@@ -4240,565 +4479,1096 @@ void get_dns_server(char* dns_server, size_t len)
 	}
 }
 
-#ifdef __BORLANDC__
-#pragma argsused
-#endif
-static void sendmail_thread(void* arg)
+/****************************************************************************/
+/* SendMail: the SendMail thread scans the mail base for outbound messages	*/
+/* and adds them to per-destination (domain or relay) queues as they become	*/
+/* due. Up to startup->sendmail_threads long-lived worker threads each		*/
+/* claim a queue that no other worker is delivering and send its messages	*/
+/* over a single SMTP connection (using RSET between messages), so a slow	*/
+/* destination only holds up its own queue.									*/
+/****************************************************************************/
+
+#define MX_CACHE_MIN_TTL	60				/* seconds */
+#define MX_CACHE_MAX_TTL	(24*60*60)		/* seconds */
+#define SENDMAIL_RETRY_MIN	(5*60)			/* seconds, doubled per delivery attempt */
+
+typedef struct {
+	char		domain[128];
+	char		mx[128];
+	char		mx2[128];
+	time_t		expires;
+} mx_cache_t;
+
+/* Outbound message, found by sendmail_scan() */
+typedef struct {
+	ulong		number;
+	char		dest[128];		/* Destination domain (and :port) */
+	time_t		next_try;		/* Time of next delivery attempt */
+	BOOL		done;			/* Sent, bounced, or no longer outbound */
+	BOOL		queued;			/* In a destination queue (or being delivered) */
+} sendmail_pending_t;
+
+typedef struct {
+	char		dest[128];		/* Destination domain (and :port), or relay queue number */
+	BOOL		busy;			/* Claimed by a worker */
+	uint32_t	msgs;
+	sendmail_pending_t** msg;	/* In mail base order */
+} sendmail_queue_t;
+
+/* Shared by the SendMail thread and the workers, protected by mutex */
+typedef struct {
+	sendmail_queue_t**	queue;
+	uint32_t			queues;
+	uint32_t			relay_next;	/* Next relay queue (round-robin) */
+	uint32_t			sent;		/* Messages attempted so far (for status) */
+	uint32_t			total;		/* Total messages queued */
+	pthread_mutex_t		mutex;
+	sem_t				work;		/* Posted when a queue is ready to be claimed */
+	sem_t				done;		/* Posted by each worker thread upon exit */
+	link_list_t			mx_cache;	/* Of mx_cache_t, shared by all workers */
+} sendmail_sched_t;
+
+typedef struct {
+	sendmail_sched_t*	sched;
+	smb_t		smb;
+	smbmsg_t	msg;
+	char*		msgtxt;
+	SOCKET		sock;			/* Current (re-usable) SMTP connection */
+	sockbuf_t	rdbuf;
+	char		server[128];	/* Host name of current connection */
+	char		dest[128];		/* Destination (see sendmail_dest) of current connection */
+	ulong		sent;			/* Messages sent over current connection */
+	link_list_t	failed_server_list;
+} sendmail_worker_t;
+
+static BOOL mx_cache_get(link_list_t* cache, const char* domain, char* mx, char* mx2)
+{
+	list_node_t*	node;
+	mx_cache_t*		entry;
+	BOOL			found=FALSE;
+
+	listLock(cache);
+	for(node=listFirstNode(cache); node!=NULL; node=listNextNode(node)) {
+		entry=(mx_cache_t*)node->data;
+		if(stricmp(entry->domain,domain)!=0)
+			continue;
+		if(time(NULL) < entry->expires) {
+			strcpy(mx,entry->mx);
+			strcpy(mx2,entry->mx2);
+			found=TRUE;
+		} else
+			listRemoveNode(cache,node,/* free_data: */TRUE);
+		break;
+	}
+	listUnlock(cache);
+	return(found);
+}
+
+static void mx_cache_add(link_list_t* cache, const char* domain, const char* mx, const char* mx2, DWORD ttl)
+{
+	mx_cache_t	entry;
+
+	if(ttl<MX_CACHE_MIN_TTL)
+		ttl=MX_CACHE_MIN_TTL;
+	if(ttl>MX_CACHE_MAX_TTL)
+		ttl=MX_CACHE_MAX_TTL;
+
+	memset(&entry,0,sizeof(entry));
+	SAFECOPY(entry.domain,domain);
+	SAFECOPY(entry.mx,mx);
+	SAFECOPY(entry.mx2,mx2);
+	entry.expires=time(NULL)+ttl;
+
+	listLock(cache);
+	if(!mx_cache_get(cache,domain,entry.mx,entry.mx2))	/* Another worker may have beat us to it */
+		listPushNodeData(cache,&entry,sizeof(entry));
+	listUnlock(cache);
+}
+
+/* Deferred messages are retried after SENDMAIL_RETRY_MIN seconds, doubling	*/
+/* with each failed delivery attempt, up to the rescan frequency			*/
+static time_t sendmail_retry_delay(ushort attempts)
+{
+	time_t	delay=SENDMAIL_RETRY_MIN;
+
+	while(attempts-- > 1 && delay < startup->rescan_frequency)
+		delay*=2;
+	if(delay > startup->rescan_frequency)
+		delay=startup->rescan_frequency;
+	return(delay);
+}
+
+static void sendmail_disconnect(sendmail_worker_t* worker, BOOL quit)
+{
+	char	buf[512];
+
+	if(worker->sock==INVALID_SOCKET)
+		return;
+	if(quit) {
+		sockprintf(worker->sock,"QUIT");
+		sockgetrsp(worker->sock,&worker->rdbuf,"221", buf, sizeof(buf));
+	}
+	mail_close_socket(worker->sock);
+	worker->sock=INVALID_SOCKET;
+	worker->sent=0;
+}
+
+/* Returns TRUE if mail for the domain is delivered to this mail server */
+static BOOL sendmail_local_domain(const char* domain)
+{
+	char	domain_list[MAX_PATH+1];
+
+	SAFEPRINTF(domain_list,"%sdomains.cfg",scfg.ctrl_dir);
+	return(stricmp(domain,scfg.sys_inetaddr)==0
+		|| stricmp(domain,startup->host_name)==0
+		|| findstr((char*)domain,domain_list));
+}
+
+/* Identifies the server that sendmail_connect() will connect to for the	*/
+/* domain: messages are only sent over a connection to the same destination	*/
+static void sendmail_dest(const char* domain, char* dest, size_t maxlen)
+{
+	if(sendmail_local_domain(domain))
+		safe_snprintf(dest,maxlen,"[local]");
+	else if(startup->options&MAIL_OPT_RELAY_TX)
+		safe_snprintf(dest,maxlen,"[relay]");
+	else
+		safe_snprintf(dest,maxlen,"%s",domain);
+}
+
+/* Opens an SMTP connection to the destination of worker->msg (to is the	*/
+/* domain portion of the destination address, and may be modified)			*/
+/* Returns FALSE on failure (after bouncing the message, if appropriate)	*/
+static BOOL sendmail_connect(sendmail_worker_t* worker, char* to)
 {
 	int			i,j;
-	char		to[128];
 	char		mx[128];
 	char		mx2[128];
 	char		err[1024];
 	char		buf[512];
 	char		str[128];
 	char		resp[512];
-	char		toaddr[256];
-	char		fromext[128];
-	char		fromaddr[256];
 	char		challenge[256];
 	char		secret[64];
 	char		md5_data[384];
 	uchar		digest[MD5_DIGEST_SIZE];
 	char		numeric_ip[16];
-	char		domain_list[MAX_PATH+1];
 	char		dns_server[16];
 	char*		server;
-	char*		msgtxt=NULL;
 	char*		p;
 	char*		tp;
-	ushort		port;
-	ulong		last_msg=0;
+	ushort		port=0;
 	ulong		ip_addr;
 	ulong		dns;
-	ulong		lines;
-	ulong		bytes;
+	DWORD		ttl;
 	BOOL		success;
-	BOOL		first_cycle=TRUE;
-	SOCKET		sock=INVALID_SOCKET;
+	BOOL		sending_locally=FALSE;
+	SOCKET		sock;
 	SOCKADDR_IN	addr;
 	SOCKADDR_IN	server_addr;
-	time_t		last_scan=0;
-	smb_t		smb;
-	smbmsg_t	msg;
-	mail_t*		mail;
-	uint32_t	msgs;
-	uint32_t	u;
 	size_t		len;
-	BOOL		sending_locally=FALSE;
-	link_list_t	failed_server_list;
-
-	SetThreadName("SendMail");
-	thread_up(TRUE /* setuid */);
-
-	sendmail_running=TRUE;
-	terminate_sendmail=FALSE;
+	smb_t*		smb=&worker->smb;
+	smbmsg_t*	msg=&worker->msg;
+
+	mx2[0]=0;
+
+	/* Check if this is a local email ToDo */
+	p=to;
+	if(sendmail_local_domain(p)) {
+		/* This is a local message... no need to send to remote */
+		port = startup->smtp_port;
+		if(startup->interface_addr==0)
+			server="127.0.0.1";
+		else {
+			SAFEPRINTF4(numeric_ip, "%u.%u.%u.%u"
+					, startup->interface_addr >> 24
+					, (startup->interface_addr >> 16) & 0xff
+					, (startup->interface_addr >> 8) & 0xff
+					, startup->interface_addr & 0xff);
+			server = numeric_ip;
+		}
+		sending_locally=TRUE;
+	}
+	else {
+		if(startup->options&MAIL_OPT_RELAY_TX) {
+			server=startup->relay_server;
+			port=startup->relay_port;
+		} else {
+			server=p;
+			tp=strrchr(p,':');	/* non-standard SMTP port */
+			if(tp!=NULL) {
+				*tp=0;
+				port=atoi(tp+1);
+			}
+			if(port==0) {	/* No port specified, use MX look-up */
+				if(mx_cache_get(&worker->sched->mx_cache,p,mx,mx2))
+					lprintf(LOG_DEBUG,"0000 SEND using cached MX records for %s",p);
+				else {
+					get_dns_server(dns_server,sizeof(dns_server));
+					if((dns=resolve_ip(dns_server))==INADDR_NONE) {
+						remove_msg_intransit(smb,msg);
+						lprintf(LOG_WARNING,"0000 !SEND INVALID DNS server address: %s"
+							,dns_server);
+						return(FALSE);
+					}
+					lprintf(LOG_DEBUG,"0000 SEND getting MX records for %s from %s",p,dns_server);
+					if((i=dns_getmx(p, mx, mx2, INADDR_ANY, dns
+						,startup->options&MAIL_OPT_USE_TCP_DNS ? TRUE : FALSE
+						,TIMEOUT_THREAD_WAIT/2, &ttl))!=0) {
+						remove_msg_intransit(smb,msg);
+						lprintf(LOG_WARNING,"0000 !SEND ERROR %d obtaining MX records for %s from %s"
+							,i,p,dns_server);
+						SAFEPRINTF2(err,"Error %d obtaining MX record for %s",i,p);
+						bounce(0, smb,msg,err, /* immediate: */FALSE);
+						return(FALSE);
+					}
+					mx_cache_add(&worker->sched->mx_cache,p,mx,mx2,ttl);
+				}
+				server=mx;
+			}
+		}
+	}
+	if(!port)
+		port=IPPORT_SMTP;
 
-	lprintf(LOG_INFO,"0000 SendMail thread started");
+	if((sock=mail_open_socket(SOCK_STREAM,"smtp|sendmail"))==INVALID_SOCKET) {
+		remove_msg_intransit(smb,msg);
+		lprintf(LOG_ERR,"0000 !SEND ERROR %d opening socket", ERROR_VALUE);
+		return(FALSE);
+	}
+	worker->sock=sock;
+	worker->sent=0;
+
+	if(startup->connect_timeout) {	/* Use non-blocking socket */
+		long nbio=1;
+		if((i=ioctlsocket(sock, FIONBIO, &nbio))!=0) {
+			remove_msg_intransit(smb,msg);
+			lprintf(LOG_ERR,"%04d !SEND ERROR %d (%d) disabling blocking on socket"
+				,sock, i, ERROR_VALUE);
+			return(FALSE);
+		}
+	}
 
-	memset(&msg,0,sizeof(msg));
-	memset(&smb,0,sizeof(smb));
+	memset(&addr,0,sizeof(addr));
+	addr.sin_addr.s_addr = htonl(startup->interface_addr);
+	addr.sin_family = AF_INET;
+
+	/* Not needed.  Port is zero
+	if(startup->seteuid!=NULL)
+		startup->seteuid(FALSE); */
+	i=bind(sock,(struct sockaddr *)&addr, sizeof(addr));
+	/* Not needed.  Port is zero
+	if(startup->seteuid!=NULL)
+		startup->seteuid(TRUE); */
+	if(i!=0) {
+		remove_msg_intransit(smb,msg);
+		lprintf(LOG_ERR,"%04d !SEND ERROR %d (%d) binding socket", sock, i, ERROR_VALUE);
+		return(FALSE);
+	}
 
-	listInit(&failed_server_list, /* flags: */0);
+	strcpy(err,"UNKNOWN ERROR");
+	success=FALSE;
+	for(j=0;j<2 && !success;j++) {
+		list_node_t*	node;
 
-	while(server_socket!=INVALID_SOCKET && !terminate_sendmail) {
+		if(j) {
+			if(startup->options&MAIL_OPT_RELAY_TX || !mx2[0])
+				break;
+			lprintf(LOG_DEBUG,"%04d SEND reverting to second MX: %s", sock, mx2);
+			server=mx2;	/* Give second mx record a try */
+		}
 
-		if(startup->options&MAIL_OPT_NO_SENDMAIL) {
-			sem_trywait_block(&sendmail_wakeup_sem,1000);
+		lprintf(LOG_DEBUG,"%04d SEND resolving SMTP hostname: %s", sock, server);
+		ip_addr=resolve_ip(server);
+		if(ip_addr==INADDR_NONE) {
+			SAFEPRINTF(err,"Failed to resolve SMTP hostname: %s",server);
+			lprintf(LOG_WARNING,"%04d !SEND failure resolving hostname: %s", sock, server);
 			continue;
 		}
 
-		if(active_sendmail!=0)
-			active_sendmail=0, update_clients();
-
-		listFreeNodes(&failed_server_list);
-
-		smb_close(&smb);
-
-		if(sock!=INVALID_SOCKET) {
-			mail_close_socket(sock);
-			sock=INVALID_SOCKET;
+		memset(&server_addr,0,sizeof(server_addr));
+		server_addr.sin_addr.s_addr = ip_addr;
+		server_addr.sin_family = AF_INET;
+		server_addr.sin_port = htons(port);
+
+		if((node=listFindNode(&worker->failed_server_list,&server_addr,sizeof(server_addr))) != NULL) {
+			lprintf(LOG_INFO,"%04d SEND skipping failed SMTP server: Error %d connecting to port %u on %s [%s]"
+			,sock
+			,node->tag
+			,ntohs(server_addr.sin_port)
+			,server,inet_ntoa(server_addr.sin_addr));
+			SAFEPRINTF2(err,"Error %d connecting to SMTP server: %s"
+				,node->tag, server);
+			continue;
 		}
 
-		if(msgtxt!=NULL) {
-			smb_freemsgtxt(msgtxt);
-			msgtxt=NULL;
+		if((server==mx || server==mx2)
+			&& ((ip_addr&0xff)==127 || ip_addr==0)) {
+			SAFEPRINTF2(err,"Bad IP address (%s) for MX server: %s"
+				,inet_ntoa(server_addr.sin_addr),server);
+			continue;
 		}
 
-		smb_freemsgmem(&msg);
-
-		/* Don't delay on first loop */
-		if(first_cycle)
-			first_cycle=FALSE;
-		else
-			sem_trywait_block(&sendmail_wakeup_sem,startup->sem_chk_freq*1000);
-
-		SAFEPRINTF(smb.file,"%smail",scfg.data_dir);
-		smb.retry_time=scfg.smb_retry_time;
-		smb.subnum=INVALID_SUB;
-		if((i=smb_open(&smb))!=SMB_SUCCESS) 
-			continue;
-		if((i=smb_locksmbhdr(&smb))!=SMB_SUCCESS)
-			continue;
-		i=smb_getstatus(&smb);
-		smb_unlocksmbhdr(&smb);
-		if(i!=0)
+		lprintf(LOG_INFO,"%04d SEND connecting to port %u on %s [%s]"
+			,sock
+			,ntohs(server_addr.sin_port)
+			,server,inet_ntoa(server_addr.sin_addr));
+		if((i=nonblocking_connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr), startup->connect_timeout))!=0) {
+			lprintf(LOG_WARNING,"%04d !SEND ERROR %d connecting to SMTP server: %s"
+				,sock
+				,i, server);
+			SAFEPRINTF2(err,"Error %d connecting to SMTP server: %s"
+				,i, server);
+			listAddNodeData(&worker->failed_server_list,&server_addr,sizeof(server_addr),i,NULL);
 			continue;
-		if(smb.status.last_msg==last_msg && time(NULL)-last_scan<startup->rescan_frequency)
-			continue;
-		lprintf(LOG_DEBUG, "0000 SEND last_msg=%u, smb.status.last_msg=%u, elapsed=%u"
-			,last_msg, smb.status.last_msg, time(NULL)-last_scan);
-		last_msg=smb.status.last_msg;
-		last_scan=time(NULL);
-		mail=loadmail(&smb,&msgs,/* to network */0,MAIL_YOUR,0);
-		for(u=0; u<msgs; u++) {
-			if(active_sendmail!=0)
-				active_sendmail=0, update_clients();
-
-			if(server_socket==INVALID_SOCKET || terminate_sendmail)	/* server stopped */
-				break;
-
-			if(sock!=INVALID_SOCKET) {
-				mail_close_socket(sock);
-				sock=INVALID_SOCKET;
-			}
+		}
+		success=TRUE;
+	}
+	if(!success) {	/* Failed to send, so bounce */
+		remove_msg_intransit(smb,msg);
+		bounce(sock, smb,msg,err,/* immediate: */FALSE);
+		return(FALSE);
+	}
 
-			if(msgtxt!=NULL) {
-				smb_freemsgtxt(msgtxt);
-				msgtxt=NULL;
-			}
+	SAFECOPY(worker->server,server);
+	lprintf(LOG_DEBUG,"%04d SEND connected to %s",sock,server);
+	sockbuf_init(&worker->rdbuf);
 
-			smb_freemsgmem(&msg);
+	/* HELO */
+	if(!sockgetrsp(sock,&worker->rdbuf,"220",buf,sizeof(buf))) {
+		remove_msg_intransit(smb,msg);
+		SAFEPRINTF3(err,badrsp_err,server,buf,"220");
+		bounce(sock, smb,msg,err,/* immediate: */buf[0]=='5');
+		return(FALSE);
+	}
+	if(startup->options&MAIL_OPT_RELAY_TX
+		&& (startup->options&MAIL_OPT_RELAY_AUTH_MASK)!=0)	/* Requires ESMTP */
+		sockprintf(sock,"EHLO %s",startup->host_name);
+	else
+		sockprintf(sock,"HELO %s",startup->host_name);
+	if(!sockgetrsp(sock,&worker->rdbuf,"250", buf, sizeof(buf))) {
+		remove_msg_intransit(smb,msg);
+		SAFEPRINTF3(err,badrsp_err,server,buf,"250");
+		bounce(sock, smb,msg,err,/* immediate: */buf[0]=='5');
+		return(FALSE);
+	}
 
-			msg.hdr.number=mail[u].number;
-			if((i=smb_getmsgidx(&smb,&msg))!=SMB_SUCCESS) {
-				lprintf(LOG_ERR,"0000 !SEND ERROR %d (%s) getting message index #%lu"
-					,i, smb.last_error, mail[u].number);
-				break;
+	/* AUTH */
+	if(startup->options&MAIL_OPT_RELAY_TX
+		&& (startup->options&MAIL_OPT_RELAY_AUTH_MASK)!=0 && !sending_locally) {
+
+		if((startup->options&MAIL_OPT_RELAY_AUTH_MASK)==MAIL_OPT_RELAY_AUTH_PLAIN) {
+			/* Build the buffer: <username>\0<user-id>\0<password */
+			len=safe_snprintf(buf,sizeof(buf),"%s%c%s%c%s"
+				,startup->relay_user
+				,0
+				,startup->relay_user
+				,0
+				,startup->relay_pass);
+			b64_encode(resp,sizeof(resp),buf,len);
+			sockprintf(sock,"AUTH PLAIN %s",resp);
+		} else {
+			switch(startup->options&MAIL_OPT_RELAY_AUTH_MASK) {
+				case MAIL_OPT_RELAY_AUTH_LOGIN:
+					p="LOGIN";
+					break;
+				case MAIL_OPT_RELAY_AUTH_CRAM_MD5:
+					p="CRAM-MD5";
+					break;
+				default:
+					p="<unknown>";
+					break;
 			}
-			if((i=smb_lockmsghdr(&smb,&msg))!=SMB_SUCCESS) {
-				lprintf(LOG_WARNING,"0000 !SEND ERROR %d (%s) locking message header #%lu"
-					,i, smb.last_error, msg.idx.number);
-				continue;
+			sockprintf(sock,"AUTH %s",p);
+			if(!sockgetrsp(sock,&worker->rdbuf,"334",buf,sizeof(buf))) {
+				SAFEPRINTF3(err,badrsp_err,server,buf,"334 Username/Challenge");
+				bounce(sock, smb,msg,err,/* immediate: */buf[0]=='5');
+				return(FALSE);
 			}
-			if((i=smb_getmsghdr(&smb,&msg))!=SMB_SUCCESS) {
-				smb_unlockmsghdr(&smb,&msg);
-				lprintf(LOG_ERR,"0000 !SEND ERROR %d (%s) reading message header #%lu"
-					,i, smb.last_error, msg.idx.number);
-				continue; 
+			switch(startup->options&MAIL_OPT_RELAY_AUTH_MASK) {
+				case MAIL_OPT_RELAY_AUTH_LOGIN:
+					b64_encode(p=resp,sizeof(resp),startup->relay_user,0);
+					break;
+				case MAIL_OPT_RELAY_AUTH_CRAM_MD5:
+					p=buf;
+					FIND_WHITESPACE(p);
+					SKIP_WHITESPACE(p);
+					b64_decode(challenge,sizeof(challenge),p,0);
+
+					/* Calculate response */
+					memset(secret,0,sizeof(secret));
+					SAFECOPY(secret,startup->relay_pass);
+					for(i=0;i<sizeof(secret);i++)
+						md5_data[i]=secret[i]^0x36;	/* ipad */
+					strcpy(md5_data+i,challenge);
+					MD5_calc(digest,md5_data,sizeof(secret)+strlen(challenge));
+					for(i=0;i<sizeof(secret);i++)
+						md5_data[i]=secret[i]^0x5c;	/* opad */
+					memcpy(md5_data+i,digest,sizeof(digest));
+					MD5_calc(digest,md5_data,sizeof(secret)+sizeof(digest));
+
+					safe_snprintf(buf,sizeof(buf),"%s %s",startup->relay_user,MD5_hex((BYTE*)str,digest));
+					b64_encode(p=resp,sizeof(resp),buf,0);
+					break;
+				default:
+					p="<unknown>";
+					break;
 			}
-			if(msg.hdr.attr&MSG_DELETE || msg.to_net.type!=NET_INTERNET || msg.to_net.addr==NULL) {
-				smb_unlockmsghdr(&smb,&msg);
-				continue;
+			sockprintf(sock,"%s",p);
+			if((startup->options&MAIL_OPT_RELAY_AUTH_MASK)!=MAIL_OPT_RELAY_AUTH_CRAM_MD5) {
+				if(!sockgetrsp(sock,&worker->rdbuf,"334",buf,sizeof(buf))) {
+					SAFEPRINTF3(err,badrsp_err,server,buf,"334 Password");
+					bounce(sock, smb,msg,err,/* immediate: */buf[0]=='5');
+					return(FALSE);
+				}
+				switch(startup->options&MAIL_OPT_RELAY_AUTH_MASK) {
+					case MAIL_OPT_RELAY_AUTH_LOGIN:
+						b64_encode(p=buf,sizeof(buf),startup->relay_pass,0);
+						break;
+					default:
+						p="<unknown>";
+						break;
+				}
+				sockprintf(sock,"%s",p);
 			}
+		}
+		if(!sockgetrsp(sock,&worker->rdbuf,"235",buf,sizeof(buf))) {
+			SAFEPRINTF3(err,badrsp_err,server,buf,"235");
+			bounce(sock, smb,msg,err,/* immediate: */buf[0]=='5');
+			return(FALSE);
+		}
+	}
+	return(TRUE);
+}
 
-			if(!(startup->options&MAIL_OPT_SEND_INTRANSIT) && msg.hdr.netattr&MSG_INTRANSIT) {
-				smb_unlockmsghdr(&smb,&msg);
-				lprintf(LOG_NOTICE,"0000 SEND Message #%lu from %s to %s - in transit"
-					,msg.hdr.number, msg.from, msg.to_net.addr);
-				continue;
-			}
-			msg.hdr.netattr|=MSG_INTRANSIT;	/* Prevent another sendmail thread from sending this msg */
-			smb_putmsghdr(&smb,&msg);
-			smb_unlockmsghdr(&smb,&msg);
+/* Delivers a pending message, re-using the worker's SMTP connection when	*/
+/* possible. Returns FALSE if the connection should not be re-used.			*/
+static BOOL sendmail_msg(sendmail_worker_t* worker, sendmail_pending_t* pending)
+{
+	int			i;
+	char		to[128];
+	char		err[1024];
+	char		buf[512];
+	char		str[128];
+	char		toaddr[256];
+	char		fromext[128];
+	char		fromaddr[256];
+	char		dest[128];
+	char*		server;
+	char*		p;
+	char*		tp;
+	ulong		lines;
+	ulong		bytes;
+	uint32_t	n;
+	SOCKET		sock;
+	smb_t*		smb=&worker->smb;
+	smbmsg_t*	msg=&worker->msg;
+	sendmail_sched_t* sched=worker->sched;
+
+	msg->hdr.number=pending->number;
+	if((i=smb_getmsgidx(smb,msg))!=SMB_SUCCESS) {
+		lprintf(LOG_ERR,"0000 !SEND ERROR %d (%s) getting message index #%lu"
+			,i, smb->last_error, pending->number);
+		pending->done=TRUE;
+		return(TRUE);
+	}
+	if((i=smb_lockmsghdr(smb,msg))!=SMB_SUCCESS) {
+		lprintf(LOG_WARNING,"0000 !SEND ERROR %d (%s) locking message header #%lu"
+			,i, smb->last_error, msg->idx.number);
+		return(TRUE);
+	}
+	if((i=smb_getmsghdr(smb,msg))!=SMB_SUCCESS) {
+		smb_unlockmsghdr(smb,msg);
+		lprintf(LOG_ERR,"0000 !SEND ERROR %d (%s) reading message header #%lu"
+			,i, smb->last_error, msg->idx.number);
+		return(TRUE);
+	}
+	if(msg->hdr.attr&MSG_DELETE || msg->to_net.type!=NET_INTERNET || msg->to_net.addr==NULL) {
+		smb_unlockmsghdr(smb,msg);
+		pending->done=TRUE;
+		return(TRUE);
+	}
+
+	if(!(startup->options&MAIL_OPT_SEND_INTRANSIT) && msg->hdr.netattr&MSG_INTRANSIT) {
+		smb_unlockmsghdr(smb,msg);
+		lprintf(LOG_NOTICE,"0000 SEND Message #%lu from %s to %s - in transit"
+			,msg->hdr.number, msg->from, msg->to_net.addr);
+		return(TRUE);
+	}
+	msg->hdr.netattr|=MSG_INTRANSIT;	/* Prevent another sendmail thread from sending this msg */
+	smb_putmsghdr(smb,msg);
+	smb_unlockmsghdr(smb,msg);
+
+	fromext[0]=0;
+	if(msg->from_ext)
+		SAFEPRINTF(fromext," #%s", msg->from_ext);
+	if(msg->from_net.type==NET_INTERNET && msg->reverse_path!=NULL)
+		SAFECOPY(fromaddr,msg->reverse_path);
+	else
+		usermailaddr(&scfg,fromaddr,msg->from);
+	truncstr(fromaddr," ");
 
-			active_sendmail=1, update_clients();
+	pthread_mutex_lock(&sched->mutex);
+	n=++sched->sent;
+	pthread_mutex_unlock(&sched->mutex);
 
-			fromext[0]=0;
-			if(msg.from_ext)
-				SAFEPRINTF(fromext," #%s", msg.from_ext);
-			if(msg.from_net.type==NET_INTERNET && msg.reverse_path!=NULL)
-				SAFECOPY(fromaddr,msg.reverse_path);
-			else 
-				usermailaddr(&scfg,fromaddr,msg.from);
-			truncstr(fromaddr," ");
-
-			lprintf(LOG_INFO,"0000 SEND Message #%lu (%u of %u) from %s%s %s to %s [%s]"
-				,msg.hdr.number, u+1, msgs, msg.from, fromext, fromaddr
-				,msg.to, msg.to_net.addr);
-			SAFEPRINTF2(str,"Sending (%u of %u)", u+1, msgs);
-			status(str);
+	lprintf(LOG_INFO,"%04d SEND Message #%lu (%u of %u) from %s%s %s to %s [%s]"
+		,worker->sock, msg->hdr.number, n, sched->total, msg->from, fromext, fromaddr
+		,msg->to, msg->to_net.addr);
+	SAFEPRINTF2(str,"Sending (%u of %u)", n, sched->total);
+	status(str);
 #ifdef _WIN32
-			if(startup->outbound_sound[0] && !(startup->options&MAIL_OPT_MUTE)) 
-				PlaySound(startup->outbound_sound, NULL, SND_ASYNC|SND_FILENAME);
+	if(startup->outbound_sound[0] && !(startup->options&MAIL_OPT_MUTE))
+		PlaySound(startup->outbound_sound, NULL, SND_ASYNC|SND_FILENAME);
 #endif
 
-			lprintf(LOG_DEBUG,"0000 SEND getting message text");
-			if((msgtxt=smb_getmsgtxt(&smb,&msg,GETMSGTXT_ALL))==NULL) {
-				remove_msg_intransit(&smb,&msg);
-				lprintf(LOG_ERR,"0000 !SEND ERROR (%s) retrieving message text",smb.last_error);
-				continue;
-			}
+	lprintf(LOG_DEBUG,"%04d SEND getting message text", worker->sock);
+	if((worker->msgtxt=smb_getmsgtxt(smb,msg,GETMSGTXT_ALL))==NULL) {
+		remove_msg_intransit(smb,msg);
+		lprintf(LOG_ERR,"%04d !SEND ERROR (%s) retrieving message text",worker->sock,smb->last_error);
+		return(TRUE);
+	}
 
-			remove_ctrl_a(msgtxt, msgtxt);
+	remove_ctrl_a(worker->msgtxt, worker->msgtxt);
 
-			port=0;
-			mx2[0]=0;
+	SAFECOPY(to,(char*)msg->to_net.addr);
+	truncstr(to,"> ");
 
-			sending_locally=FALSE;
-			/* Check if this is a local email ToDo */
-			SAFECOPY(to,(char*)msg.to_net.addr);
-			truncstr(to,"> ");
+	p=strrchr(to,'@');
+	if(p==NULL) {
+		remove_msg_intransit(smb,msg);
+		lprintf(LOG_WARNING,"%04d !SEND INVALID destination address: %s", worker->sock, to);
+		SAFEPRINTF(err,"Invalid destination address: %s", to);
+		bounce(worker->sock, smb,msg,err, /* immediate: */TRUE);
+		return(TRUE);
+	}
+	p++;
 
-			p=strrchr(to,'@');
-			if(p==NULL) {
-				remove_msg_intransit(&smb,&msg);
-				lprintf(LOG_WARNING,"0000 !SEND INVALID destination address: %s", to);
-				SAFEPRINTF(err,"Invalid destination address: %s", to);
-				bounce(0, &smb,&msg,err, /* immediate: */TRUE);
-				continue;
+	sendmail_dest(p,dest,sizeof(dest));
+	if(worker->sock!=INVALID_SOCKET && stricmp(worker->dest,dest)!=0) {
+		lprintf(LOG_DEBUG,"%04d SEND next message is for %s, disconnecting from %s"
+			,worker->sock, dest, worker->server);
+		sendmail_disconnect(worker, /* quit: */TRUE);
+	}
+	if(worker->sock!=INVALID_SOCKET) {	/* Re-use the connection */
+		if(startup->max_msgs_per_conn && worker->sent>=startup->max_msgs_per_conn)
+			sendmail_disconnect(worker, /* quit: */TRUE);
+		else {
+			sockprintf(worker->sock,"RSET");
+			if(!sockgetrsp(worker->sock,&worker->rdbuf,"250",buf,sizeof(buf))) {
+				lprintf(LOG_NOTICE,"%04d SEND RSET failed (%s), reconnecting to %s"
+					,worker->sock, buf, worker->server);
+				sendmail_disconnect(worker, /* quit: */FALSE);
 			}
+		}
+	}
+	if(worker->sock==INVALID_SOCKET) {
+		if(!sendmail_connect(worker,p))
+			return(FALSE);
+		SAFECOPY(worker->dest,dest);
+	}
+	sock=worker->sock;
+	server=worker->server;
+
+	/* MAIL */
+	if(fromaddr[0]=='<')
+		sockprintf(sock,"MAIL FROM: %s",fromaddr);
+	else
+		sockprintf(sock,"MAIL FROM: <%s>",fromaddr);
+	if(!sockgetrsp(sock,&worker->rdbuf,"250", buf, sizeof(buf))) {
+		remove_msg_intransit(smb,msg);
+		SAFEPRINTF3(err,badrsp_err,server,buf,"250");
+		bounce(sock, smb,msg,err,/* immediate: */buf[0]=='5');
+		return(FALSE);
+	}
+	/* RCPT */
+	if(msg->forward_path!=NULL) {
+		SAFECOPY(toaddr,msg->forward_path);
+	} else {
+		if((p=strrchr((char*)msg->to_net.addr,'<'))!=NULL)
 			p++;
-			SAFEPRINTF(domain_list,"%sdomains.cfg",scfg.ctrl_dir);
-			if(stricmp(p,scfg.sys_inetaddr)==0
-					|| stricmp(p,startup->host_name)==0
-					|| findstr(p,domain_list)) {
-				/* This is a local message... no need to send to remote */
-				port = startup->smtp_port;
-				if(startup->interface_addr==0)
-					server="127.0.0.1";
-				else {
-					SAFEPRINTF4(numeric_ip, "%u.%u.%u.%u"
-							, startup->interface_addr >> 24
-							, (startup->interface_addr >> 16) & 0xff
-							, (startup->interface_addr >> 8) & 0xff
-							, startup->interface_addr & 0xff);
-					server = numeric_ip;
-				}
-				sending_locally=TRUE;
-			}
-			else {
-				if(startup->options&MAIL_OPT_RELAY_TX) { 
-					server=startup->relay_server;
-					port=startup->relay_port;
-				} else {
-					server=p;
-					tp=strrchr(p,':');	/* non-standard SMTP port */
-					if(tp!=NULL) {
-						*tp=0;
-						port=atoi(tp+1);
-					}
-					if(port==0) {	/* No port specified, use MX look-up */
-						get_dns_server(dns_server,sizeof(dns_server));
-						if((dns=resolve_ip(dns_server))==INADDR_NONE) {
-							remove_msg_intransit(&smb,&msg);
-							lprintf(LOG_WARNING,"0000 !SEND INVALID DNS server address: %s"
-								,dns_server);
-							continue;
-						}
-						lprintf(LOG_DEBUG,"0000 SEND getting MX records for %s from %s",p,dns_server);
-						if((i=dns_getmx(p, mx, mx2, INADDR_ANY, dns
-							,startup->options&MAIL_OPT_USE_TCP_DNS ? TRUE : FALSE
-							,TIMEOUT_THREAD_WAIT/2))!=0) {
-							remove_msg_intransit(&smb,&msg);
-							lprintf(LOG_WARNING,"0000 !SEND ERROR %d obtaining MX records for %s from %s"
-								,i,p,dns_server);
-							SAFEPRINTF2(err,"Error %d obtaining MX record for %s",i,p);
-							bounce(0, &smb,&msg,err, /* immediate: */FALSE);
-							continue;
-						}
-						server=mx;
-					}
-				}
-			}
-			if(!port)
-				port=IPPORT_SMTP;
+		else
+			p=(char*)msg->to_net.addr;
+		SAFECOPY(toaddr,p);
+		truncstr(toaddr,"> ");
+		if((p=strrchr(toaddr,'@'))!=NULL && (tp=strrchr(toaddr,':'))!=NULL
+			&& tp > p)
+			*tp=0;	/* Remove ":port" designation from envelope */
+	}
+	sockprintf(sock,"RCPT TO: <%s>", toaddr);
+	if(!sockgetrsp(sock,&worker->rdbuf,"25", buf, sizeof(buf))) {
+		remove_msg_intransit(smb,msg);
+		SAFEPRINTF3(err,badrsp_err,server,buf,"25*");
+		bounce(sock, smb,msg,err,/* immediate: */buf[0]=='5');
+		return(FALSE);
+	}
+	/* DATA */
+	sockprintf(sock,"DATA");
+	if(!sockgetrsp(sock,&worker->rdbuf,"354", buf, sizeof(buf))) {
+		remove_msg_intransit(smb,msg);
+		SAFEPRINTF3(err,badrsp_err,server,buf,"354");
+		bounce(sock, smb,msg,err,/* immediate: */buf[0]=='5');
+		return(FALSE);
+	}
+	bytes=strlen(worker->msgtxt);
+	lprintf(LOG_DEBUG,"%04d SEND sending message text (%u bytes) begin"
+		,sock, bytes);
+	lines=sockmsgtxt(sock,msg,worker->msgtxt,-1);
+	lprintf(LOG_DEBUG,"%04d SEND send of message text (%u bytes, %u lines) complete, waiting for acknowledgement (250)"
+		,sock, bytes, lines);
+	if(!sockgetrsp(sock,&worker->rdbuf,"250", buf, sizeof(buf))) {
+		/* Wait doublely-long for the acknowledgement */
+		if(buf[0] || !sockgetrsp(sock,&worker->rdbuf,"250", buf, sizeof(buf))) {
+			remove_msg_intransit(smb,msg);
+			SAFEPRINTF3(err,badrsp_err,server,buf,"250");
+			bounce(sock, smb,msg,err,/* immediate: */buf[0]=='5');
+			return(FALSE);
+		}
+	}
+	lprintf(LOG_INFO,"%04d SEND message transfer complete (%u bytes, %lu lines)", sock, bytes, lines);
+	worker->sent++;
 
-			if((sock=mail_open_socket(SOCK_STREAM,"smtp|sendmail"))==INVALID_SOCKET) {
-				remove_msg_intransit(&smb,&msg);
-				lprintf(LOG_ERR,"0000 !SEND ERROR %d opening socket", ERROR_VALUE);
-				continue;
-			}
+	/* Now lets mark this message for deletion without corrupting the index */
+	msg->hdr.attr|=MSG_DELETE;
+	msg->hdr.netattr&=~MSG_INTRANSIT;
+	if((i=smb_updatemsg(smb,msg))!=SMB_SUCCESS)
+		lprintf(LOG_ERR,"%04d !SEND ERROR %d (%s) deleting message #%lu"
+			,sock, i, smb->last_error, msg->hdr.number);
+	if(msg->hdr.auxattr&MSG_FILEATTACH)
+		delfattach(&scfg,msg);
 
-			if(startup->connect_timeout) {	/* Use non-blocking socket */
-				long nbio=1;
-				if((i=ioctlsocket(sock, FIONBIO, &nbio))!=0) {
-					remove_msg_intransit(&smb,&msg);
-					lprintf(LOG_ERR,"%04d !SEND ERROR %d (%d) disabling blocking on socket"
-						,sock, i, ERROR_VALUE);
-					continue;
-				}
-			}
+	if(msg->from_agent==AGENT_PERSON && !(startup->options&MAIL_OPT_NO_AUTO_EXEMPT))
+		exempt_email_addr("SEND Auto-exempting",msg->from,fromext,fromaddr,toaddr);
 
-			memset(&addr,0,sizeof(addr));
-			addr.sin_addr.s_addr = htonl(startup->interface_addr);
-			addr.sin_family = AF_INET;
+	return(TRUE);
+}
 
-			/* Not needed.  Port is zero
-			if(startup->seteuid!=NULL)
-				startup->seteuid(FALSE); */
-			i=bind(sock,(struct sockaddr *)&addr, sizeof(addr));
-			/* Not needed.  Port is zero
-			if(startup->seteuid!=NULL)
-				startup->seteuid(TRUE); */
-			if(i!=0) {
-				remove_msg_intransit(&smb,&msg);
-				lprintf(LOG_ERR,"%04d !SEND ERROR %d (%d) binding socket", sock, i, ERROR_VALUE);
-				continue;
-			}
+/* Claims a queue with messages that no other worker is delivering */
+/* Must be called with sched->mutex locked */
+static sendmail_queue_t* sendmail_claim(sendmail_sched_t* sched)
+{
+	uint32_t	q;
 
-			strcpy(err,"UNKNOWN ERROR");
-			success=FALSE;
-			for(j=0;j<2 && !success;j++) {
-				list_node_t*	node;
+	for(q=0; q<sched->queues; q++) {
+		if(sched->queue[q]->busy || sched->queue[q]->msgs==0)
+			continue;
+		sched->queue[q]->busy=TRUE;
+		return(sched->queue[q]);
+	}
+	return(NULL);
+}
 
-				if(j) {
-					if(startup->options&MAIL_OPT_RELAY_TX || !mx2[0])
-						break;
-					lprintf(LOG_DEBUG,"%04d SEND reverting to second MX: %s", sock, mx2);
-					server=mx2;	/* Give second mx record a try */
-				}
-				
-				lprintf(LOG_DEBUG,"%04d SEND resolving SMTP hostname: %s", sock, server);
-				ip_addr=resolve_ip(server);
-				if(ip_addr==INADDR_NONE) {
-					SAFEPRINTF(err,"Failed to resolve SMTP hostname: %s",server);
-					lprintf(LOG_WARNING,"%04d !SEND failure resolving hostname: %s", sock, server);
-					continue;
-				}
+/* Delivers the messages of claimed queues as they are queued, until the	*/
+/* server (or SendMail) is stopped, or when not 'wait'ing, until there are	*/
+/* no more queues to claim													*/
+static void sendmail_worker(sendmail_sched_t* sched, BOOL wait)
+{
+	int					i;
+	sendmail_queue_t*	queue;
+	sendmail_pending_t*	pending;
+	sendmail_worker_t	worker;
+
+	memset(&worker,0,sizeof(worker));
+	worker.sched=sched;
+	worker.sock=INVALID_SOCKET;
+	listInit(&worker.failed_server_list, /* flags: */0);
+
+	SAFEPRINTF(worker.smb.file,"%smail",scfg.data_dir);
+	worker.smb.retry_time=scfg.smb_retry_time;
+	worker.smb.subnum=INVALID_SUB;
+	if((i=smb_open(&worker.smb))!=SMB_SUCCESS) {
+		lprintf(LOG_ERR,"0000 !SEND ERROR %d (%s) opening %s"
+			,i, worker.smb.last_error, worker.smb.file);
+		listFree(&worker.failed_server_list);
+		return;
+	}
 
-				memset(&server_addr,0,sizeof(server_addr));
-				server_addr.sin_addr.s_addr = ip_addr;
-				server_addr.sin_family = AF_INET;
-				server_addr.sin_port = htons(port);
-
-				if((node=listFindNode(&failed_server_list,&server_addr,sizeof(server_addr))) != NULL) {
-					lprintf(LOG_INFO,"%04d SEND skipping failed SMTP server: Error %d connecting to port %u on %s [%s]"
-					,sock
-					,node->tag
-					,ntohs(server_addr.sin_port)
-					,server,inet_ntoa(server_addr.sin_addr));
-					SAFEPRINTF2(err,"Error %d connecting to SMTP server: %s"
-						,node->tag, server);
-					continue;
-				}
+	while(server_socket!=INVALID_SOCKET && !terminate_sendmail) {
+		pthread_mutex_lock(&sched->mutex);
+		queue=sendmail_claim(sched);
+		pthread_mutex_unlock(&sched->mutex);
+		if(queue==NULL) {
+			if(!wait)
+				break;
+			sem_trywait_block(&sched->work,1000);
+			continue;
+		}
 
-				if((server==mx || server==mx2) 
-					&& ((ip_addr&0xff)==127 || ip_addr==0)) {
-					SAFEPRINTF2(err,"Bad IP address (%s) for MX server: %s"
-						,inet_ntoa(server_addr.sin_addr),server);
-					continue;
-				}
-				
-				lprintf(LOG_INFO,"%04d SEND connecting to port %u on %s [%s]"
-					,sock
-					,ntohs(server_addr.sin_port)
-					,server,inet_ntoa(server_addr.sin_addr));
-				if((i=nonblocking_connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr), startup->connect_timeout))!=0) {
-					lprintf(LOG_WARNING,"%04d !SEND ERROR %d connecting to SMTP server: %s"
-						,sock
-						,i, server);
-					SAFEPRINTF2(err,"Error %d connecting to SMTP server: %s"
-						,i, server);
-					listAddNodeData(&failed_server_list,&server_addr,sizeof(server_addr),i,NULL);
-					continue;
-				}
-				success=TRUE;
+		protected_uint32_adjust(&active_sendmail, 1);
+		update_clients();
+		while(server_socket!=INVALID_SOCKET && !terminate_sendmail) {
+			pthread_mutex_lock(&sched->mutex);
+			if(queue->msgs==0) {
+				pthread_mutex_unlock(&sched->mutex);
+				break;
 			}
-			if(!success) {	/* Failed to send, so bounce */
-				remove_msg_intransit(&smb,&msg);
-				bounce(sock, &smb,&msg,err,/* immediate: */FALSE);	
-				continue;
+			pending=queue->msg[0];
+			queue->msgs--;
+			memmove(queue->msg,queue->msg+1,sizeof(queue->msg[0])*queue->msgs);
+			pthread_mutex_unlock(&sched->mutex);
+
+			if(!sendmail_msg(&worker, pending))
+				sendmail_disconnect(&worker, /* quit: */FALSE);
+
+			pthread_mutex_lock(&sched->mutex);
+			if(worker.msg.hdr.attr&MSG_DELETE)	/* sent or bounced */
+				pending->done=TRUE;
+			else if(!pending->done)
+				pending->next_try=time(NULL)+sendmail_retry_delay(worker.msg.hdr.delivery_attempts);
+			pending->queued=FALSE;
+			pthread_mutex_unlock(&sched->mutex);
+
+			if(worker.msgtxt!=NULL) {
+				smb_freemsgtxt(worker.msgtxt);
+				worker.msgtxt=NULL;
 			}
+			smb_freemsgmem(&worker.msg);
+			memset(&worker.msg,0,sizeof(worker.msg));
+		}
+		sendmail_disconnect(&worker, /* quit: */TRUE);
 
-			lprintf(LOG_DEBUG,"%04d SEND connected to %s",sock,server);
+		pthread_mutex_lock(&sched->mutex);
+		queue->busy=FALSE;
+		pthread_mutex_unlock(&sched->mutex);
+		protected_uint32_adjust(&active_sendmail, -1);
+		update_clients();
+	}
 
-			/* HELO */
-			if(!sockgetrsp(sock,"220",buf,sizeof(buf))) {
-				remove_msg_intransit(&smb,&msg);
-				SAFEPRINTF3(err,badrsp_err,server,buf,"220");
-				bounce(sock, &smb,&msg,err,/* immediate: */buf[0]=='5');
-				continue;
-			}
-			if(startup->options&MAIL_OPT_RELAY_TX 
-				&& (startup->options&MAIL_OPT_RELAY_AUTH_MASK)!=0)	/* Requires ESMTP */
-				sockprintf(sock,"EHLO %s",startup->host_name);
-			else
-				sockprintf(sock,"HELO %s",startup->host_name);
-			if(!sockgetrsp(sock,"250", buf, sizeof(buf))) {
-				remove_msg_intransit(&smb,&msg);
-				SAFEPRINTF3(err,badrsp_err,server,buf,"250");
-				bounce(sock, &smb,&msg,err,/* immediate: */buf[0]=='5');
-				continue;
-			}
+	sendmail_disconnect(&worker, /* quit: */FALSE);
+	listFree(&worker.failed_server_list);
+	smb_close(&worker.smb);
+}
 
-			/* AUTH */
-			if(startup->options&MAIL_OPT_RELAY_TX 
-				&& (startup->options&MAIL_OPT_RELAY_AUTH_MASK)!=0 && !sending_locally) {
-
-				if((startup->options&MAIL_OPT_RELAY_AUTH_MASK)==MAIL_OPT_RELAY_AUTH_PLAIN) {
-					/* Build the buffer: <username>\0<user-id>\0<password */
-					len=safe_snprintf(buf,sizeof(buf),"%s%c%s%c%s"
-						,startup->relay_user
-						,0
-						,startup->relay_user
-						,0
-						,startup->relay_pass);
-					b64_encode(resp,sizeof(resp),buf,len);
-					sockprintf(sock,"AUTH PLAIN %s",resp);
-				} else {
-					switch(startup->options&MAIL_OPT_RELAY_AUTH_MASK) {
-						case MAIL_OPT_RELAY_AUTH_LOGIN:
-							p="LOGIN";
-							break;
-						case MAIL_OPT_RELAY_AUTH_CRAM_MD5:
-							p="CRAM-MD5";
-							break;
-						default:
-							p="<unknown>";
-							break;
-					}
-					sockprintf(sock,"AUTH %s",p);
-					if(!sockgetrsp(sock,"334",buf,sizeof(buf))) {
-						SAFEPRINTF3(err,badrsp_err,server,buf,"334 Username/Challenge");
-						bounce(sock, &smb,&msg,err,/* immediate: */buf[0]=='5');
-						continue;
-					}
-					switch(startup->options&MAIL_OPT_RELAY_AUTH_MASK) {
-						case MAIL_OPT_RELAY_AUTH_LOGIN:
-							b64_encode(p=resp,sizeof(resp),startup->relay_user,0);
-							break;
-						case MAIL_OPT_RELAY_AUTH_CRAM_MD5:
-							p=buf;
-							FIND_WHITESPACE(p);
-							SKIP_WHITESPACE(p);
-							b64_decode(challenge,sizeof(challenge),p,0);
-
-							/* Calculate response */
-							memset(secret,0,sizeof(secret));
-							SAFECOPY(secret,startup->relay_pass);
-							for(i=0;i<sizeof(secret);i++)
-								md5_data[i]=secret[i]^0x36;	/* ipad */
-							strcpy(md5_data+i,challenge);
-							MD5_calc(digest,md5_data,sizeof(secret)+strlen(challenge));
-							for(i=0;i<sizeof(secret);i++)
-								md5_data[i]=secret[i]^0x5c;	/* opad */
-							memcpy(md5_data+i,digest,sizeof(digest));
-							MD5_calc(digest,md5_data,sizeof(secret)+sizeof(digest));
-							
-							safe_snprintf(buf,sizeof(buf),"%s %s",startup->relay_user,MD5_hex((BYTE*)str,digest));
-							b64_encode(p=resp,sizeof(resp),buf,0);
-							break;
-						default:
-							p="<unknown>";
-							break;
-					}
-					sockprintf(sock,"%s",p);
-					if((startup->options&MAIL_OPT_RELAY_AUTH_MASK)!=MAIL_OPT_RELAY_AUTH_CRAM_MD5) {
-						if(!sockgetrsp(sock,"334",buf,sizeof(buf))) {
-							SAFEPRINTF3(err,badrsp_err,server,buf,"334 Password");
-							bounce(sock, &smb,&msg,err,/* immediate: */buf[0]=='5');
-							continue;
-						}
-						switch(startup->options&MAIL_OPT_RELAY_AUTH_MASK) {
-							case MAIL_OPT_RELAY_AUTH_LOGIN:
-								b64_encode(p=buf,sizeof(buf),startup->relay_pass,0);
-								break;
-							default:
-								p="<unknown>";
-								break;
-						}
-						sockprintf(sock,"%s",p);
-					}
-				}
-				if(!sockgetrsp(sock,"235",buf,sizeof(buf))) {
-					SAFEPRINTF3(err,badrsp_err,server,buf,"235");
-					bounce(sock, &smb,&msg,err,/* immediate: */buf[0]=='5');
-					continue;
-				}
-			}
+static void sendmail_worker_thread(void* arg)
+{
+	sendmail_sched_t* sched=(sendmail_sched_t*)arg;
+
+	SetThreadName("SendMail Worker");
+	thread_up(TRUE /* setuid */);
+
+	sendmail_worker(sched, /* wait: */TRUE);
+
+	thread_down();
+	sem_post(&sched->done);
+}
+
+/* Removes the pending messages that aren't queued (or being delivered), so	*/
+/* they will be found (and retried) by the next scan						*/
+static void sendmail_forget(sendmail_sched_t* sched, link_list_t* pending)
+{
+	list_node_t*	node;
+	list_node_t*	next;
+
+	pthread_mutex_lock(&sched->mutex);
+	for(node=listFirstNode(pending); node!=NULL; node=next) {
+		next=listNextNode(node);
+		if(!((sendmail_pending_t*)node->data)->queued)
+			listRemoveNode(pending,node,/* free_data: */TRUE);
+	}
+	pthread_mutex_unlock(&sched->mutex);
+}
+
+/* Returns TRUE if message 'number' is already in the pending list */
+static BOOL sendmail_pending(link_list_t* pending, ulong number)
+{
+	list_node_t*	node;
+
+	for(node=listFirstNode(pending); node!=NULL; node=listNextNode(node))
+		if(((sendmail_pending_t*)node->data)->number==number)
+			return(TRUE);
+	return(FALSE);
+}
+
+/****************************************************************************/
+/* Adds the outbound messages added to the mail base since the last scan	*/
+/* (index records 'scanned' on) to the pending list. Starts over (keeping	*/
+/* only the queued messages) if the index has changed under us (e.g. the	*/
+/* base was packed). Returns the number of messages added.					*/
+/****************************************************************************/
+static uint32_t sendmail_scan(sendmail_sched_t* sched, smb_t* smb, link_list_t* pending
+							  ,uint32_t* scanned, ulong* last_number)
+{
+	int			i;
+	char*		p;
+	idxrec_t	idx;
+	idxrec_t*	np;
+	idxrec_t*	outbound=NULL;
+	uint32_t	u;
+	uint32_t	count=0;
+	uint32_t	added=0;
+	smbmsg_t	msg;
+	sendmail_pending_t entry;
+
+	if(smb_locksmbhdr(smb)!=SMB_SUCCESS)
+		return(0);
+
+	/* Verify the last record we scanned is where we left it */
+	if(*scanned) {
+		if(fseek(smb->sid_fp,(*scanned-1)*sizeof(idx),SEEK_SET)!=0
+			|| smb_fread(smb,&idx,sizeof(idx),smb->sid_fp)!=sizeof(idx)
+			|| idx.number!=*last_number) {
+			lprintf(LOG_DEBUG,"0000 SEND mail base index changed, rescanning");
+			*scanned=0;
+			sendmail_forget(sched,pending);
+		}
+	}
+	if(fseek(smb->sid_fp,(*scanned)*sizeof(idx),SEEK_SET)!=0) {
+		smb_unlocksmbhdr(smb);
+		return(0);
+	}
+	while(smb_fread(smb,&idx,sizeof(idx),smb->sid_fp)==sizeof(idx)) {
+		(*scanned)++;
+		*last_number=idx.number;
+		if(idx.number==0 || idx.to!=0 || idx.attr&MSG_DELETE)	/* Not network mail */
+			continue;
+		if(sendmail_pending(pending,idx.number))
+			continue;
+		if((np=(idxrec_t*)realloc(outbound,sizeof(idxrec_t)*(count+1)))==NULL)
+			break;
+		outbound=np;
+		outbound[count++]=idx;
+	}
+	smb_unlocksmbhdr(smb);
+
+	/* Read the headers (for the destination) without the base locked */
+	memset(&msg,0,sizeof(msg));
+	for(u=0; u<count; u++) {
+		msg.idx=outbound[u];
+		if((i=smb_getmsghdr(smb,&msg))!=SMB_SUCCESS) {
+			lprintf(LOG_ERR,"0000 !SEND ERROR %d (%s) reading message header #%lu"
+				,i, smb->last_error, msg.idx.number);
+			continue;
+		}
+		if(msg.to_net.type==NET_INTERNET && msg.to_net.addr!=NULL) {
+			memset(&entry,0,sizeof(entry));
+			entry.number=msg.hdr.number;
+			SAFECOPY(entry.dest,(char*)msg.to_net.addr);
+			truncstr(entry.dest,"> ");
+			if((p=strrchr(entry.dest,'@'))!=NULL)
+				memmove(entry.dest,p+1,strlen(p+1)+1);
+			if(listPushNodeData(pending,&entry,sizeof(entry))!=NULL)
+				added++;
+		}
+		smb_freemsgmem(&msg);
+	}
+	FREE_AND_NULL(outbound);
+
+	return(added);
+}
+
+/* Adds the pending messages that are due to their destination's queue (or	*/
+/* round-robin when relaying, since every remote message goes to the same	*/
+/* server) and wakes the workers. Local messages are never mixed into the	*/
+/* relay queues. Returns the number of messages queued.						*/
+static uint32_t sendmail_queue(sendmail_sched_t* sched, link_list_t* pending)
+{
+	char				dest[128];
+	uint32_t			q;
+	uint32_t			relay_queues;
+	uint32_t			added=0;
+	uint32_t			ready=0;
+	BOOL				idle=TRUE;
+	time_t				now=time(NULL);
+	list_node_t*		node;
+	sendmail_pending_t*	entry;
+	sendmail_pending_t**	mp;
+	sendmail_queue_t**	qp;
+	sendmail_queue_t*	queue;
+
+	relay_queues=startup->sendmail_threads;
+	if(relay_queues<1)
+		relay_queues=1;
+
+	pthread_mutex_lock(&sched->mutex);
+	for(node=listFirstNode(pending); node!=NULL; node=listNextNode(node)) {
+		entry=(sendmail_pending_t*)node->data;
+		if(entry->done || entry->queued || entry->next_try > now)
+			continue;
+		if(startup->options&MAIL_OPT_RELAY_TX && !sendmail_local_domain(entry->dest))
+			SAFEPRINTF(dest,"%u",(sched->relay_next++)%relay_queues);
+		else
+			SAFECOPY(dest,entry->dest);
+
+		for(q=0; q<sched->queues; q++)
+			if(stricmp(sched->queue[q]->dest,dest)==0)
+				break;
+		if(q>=sched->queues) {
+			if((qp=realloc(sched->queue,sizeof(sendmail_queue_t*)*(sched->queues+1)))==NULL)
+				break;
+			sched->queue=qp;
+			if((queue=calloc(1,sizeof(sendmail_queue_t)))==NULL)
+				break;
+			SAFECOPY(queue->dest,dest);
+			sched->queue[sched->queues++]=queue;
+		}
+		queue=sched->queue[q];
+		if((mp=realloc(queue->msg,sizeof(sendmail_pending_t*)*(queue->msgs+1)))==NULL)
+			break;
+		queue->msg=mp;
+		queue->msg[queue->msgs++]=entry;
+		entry->queued=TRUE;
+		sched->total++;
+		added++;
+	}
 
-			/* MAIL */
-			if(fromaddr[0]=='<')
-				sockprintf(sock,"MAIL FROM: %s",fromaddr);
+	/* Free the queues that have been emptied (and released by the workers) */
+	for(q=0; q<sched->queues;) {
+		queue=sched->queue[q];
+		if(queue->busy || queue->msgs) {
+			if(queue->busy)
+				idle=FALSE;
 			else
-				sockprintf(sock,"MAIL FROM: <%s>",fromaddr);
-			if(!sockgetrsp(sock,"250", buf, sizeof(buf))) {
-				remove_msg_intransit(&smb,&msg);
-				SAFEPRINTF3(err,badrsp_err,server,buf,"250");
-				bounce(sock, &smb,&msg,err,/* immediate: */buf[0]=='5');
-				continue;
-			}
-			/* RCPT */
-			if(msg.forward_path!=NULL) {
-				SAFECOPY(toaddr,msg.forward_path);
-			} else {
-				if((p=strrchr((char*)msg.to_net.addr,'<'))!=NULL)
-					p++;
-				else
-					p=(char*)msg.to_net.addr;
-				SAFECOPY(toaddr,p);
-				truncstr(toaddr,"> ");
-				if((p=strrchr(toaddr,'@'))!=NULL && (tp=strrchr(toaddr,':'))!=NULL
-					&& tp > p)
-					*tp=0;	/* Remove ":port" designation from envelope */
-			}
-			sockprintf(sock,"RCPT TO: <%s>", toaddr);
-			if(!sockgetrsp(sock,"25", buf, sizeof(buf))) {
-				remove_msg_intransit(&smb,&msg);
-				SAFEPRINTF3(err,badrsp_err,server,buf,"25*");
-				bounce(sock, &smb,&msg,err,/* immediate: */buf[0]=='5');
-				continue;
-			}
-			/* DATA */
-			sockprintf(sock,"DATA");
-			if(!sockgetrsp(sock,"354", buf, sizeof(buf))) {
-				remove_msg_intransit(&smb,&msg);
-				SAFEPRINTF3(err,badrsp_err,server,buf,"354");
-				bounce(sock, &smb,&msg,err,/* immediate: */buf[0]=='5');
-				continue;
-			}
-			bytes=strlen(msgtxt);
-			lprintf(LOG_DEBUG,"%04d SEND sending message text (%u bytes) begin"
-				,sock, bytes);
-			lines=sockmsgtxt(sock,&msg,msgtxt,-1);
-			lprintf(LOG_DEBUG,"%04d SEND send of message text (%u bytes, %u lines) complete, waiting for acknowledgement (250)"
-				,sock, bytes, lines);
-			if(!sockgetrsp(sock,"250", buf, sizeof(buf))) {
-				/* Wait doublely-long for the acknowledgement */
-				if(buf[0] || !sockgetrsp(sock,"250", buf, sizeof(buf))) {
-					remove_msg_intransit(&smb,&msg);
-					SAFEPRINTF3(err,badrsp_err,server,buf,"250");
-					bounce(sock, &smb,&msg,err,/* immediate: */buf[0]=='5');
-					continue;
-				}
-			}
-			lprintf(LOG_INFO,"%04d SEND message transfer complete (%u bytes, %lu lines)", sock, bytes, lines);
-
-			/* Now lets mark this message for deletion without corrupting the index */
-			msg.hdr.attr|=MSG_DELETE;
-			msg.hdr.netattr&=~MSG_INTRANSIT;
-			if((i=smb_updatemsg(&smb,&msg))!=SMB_SUCCESS)
-				lprintf(LOG_ERR,"%04d !SEND ERROR %d (%s) deleting message #%lu"
-					,sock, i, smb.last_error, msg.hdr.number);
-			if(msg.hdr.auxattr&MSG_FILEATTACH)
-				delfattach(&scfg,&msg);
-
-			if(msg.from_agent==AGENT_PERSON && !(startup->options&MAIL_OPT_NO_AUTO_EXEMPT))
-				exempt_email_addr("SEND Auto-exempting",msg.from,fromext,fromaddr,toaddr);
-
-			/* QUIT */
-			sockprintf(sock,"QUIT");
-			sockgetrsp(sock,"221", buf, sizeof(buf));
-			mail_close_socket(sock);
-			sock=INVALID_SOCKET;
-		}				
+				ready++;
+			q++;
+			continue;
+		}
+		free(queue->msg);
+		free(queue);
+		sched->queues--;
+		memmove(sched->queue+q,sched->queue+q+1,sizeof(sched->queue[0])*(sched->queues-q));
+	}
+	if(idle && ready==0 && sched->total) {	/* All delivered */
+		sched->sent=0;
+		sched->total=0;
 		status(STATUS_WFC);
-		/* Free up resources here */
-		if(mail!=NULL)
-			freemail(mail);
 	}
-	if(sock!=INVALID_SOCKET)
-		mail_close_socket(sock);
+	pthread_mutex_unlock(&sched->mutex);
 
-	listFree(&failed_server_list);
+	while(ready--)
+		sem_post(&sched->work);
+
+	return(added);
+}
+
+static void sendmail_free_queue(sendmail_sched_t* sched)
+{
+	uint32_t	q;
+
+	for(q=0; q<sched->queues; q++) {
+		free(sched->queue[q]->msg);
+		free(sched->queue[q]);
+	}
+	FREE_AND_NULL(sched->queue);
+	sched->queues=0;
+	sched->sent=0;
+	sched->total=0;
+}
+
+/* Removes the messages that have been sent (or bounced) from the pending list */
+static void sendmail_purge(sendmail_sched_t* sched, link_list_t* pending)
+{
+	list_node_t*	node;
+	list_node_t*	next;
+	sendmail_pending_t*	entry;
+
+	pthread_mutex_lock(&sched->mutex);
+	for(node=listFirstNode(pending); node!=NULL; node=next) {
+		next=listNextNode(node);
+		entry=(sendmail_pending_t*)node->data;
+		if(entry->done && !entry->queued)
+			listRemoveNode(pending,node,/* free_data: */TRUE);
+	}
+	pthread_mutex_unlock(&sched->mutex);
+}
+
+#ifdef __BORLANDC__
+#pragma argsused
+#endif
+static void sendmail_thread(void* arg)
+{
+	int			i;
+	ulong		last_number=0;
+	uint32_t	scanned=0;
+	uint32_t	added;
+	uint32_t	queued;
+	BOOL		first_cycle=TRUE;
+	time_t		last_scan=0;
+	smb_t		smb;
+	uint32_t	workers=0;
+	uint32_t	w;
+	link_list_t	pending;
+	sendmail_sched_t sched;
+
+	SetThreadName("SendMail");
+	thread_up(TRUE /* setuid */);
+
+	sendmail_running=TRUE;
+	terminate_sendmail=FALSE;
+
+	lprintf(LOG_INFO,"0000 SendMail thread started");
+
+	memset(&smb,0,sizeof(smb));
+	memset(&sched,0,sizeof(sched));
+	pthread_mutex_init(&sched.mutex,NULL);
+	sem_init(&sched.work,0,0);
+	sem_init(&sched.done,0,0);
+	listInit(&sched.mx_cache, LINK_LIST_MUTEX);
+	listInit(&pending, /* flags: */0);
+
+	for(w=0; w<startup->sendmail_threads; w++) {
+		if(_beginthread(sendmail_worker_thread, 0, &sched)==-1) {
+			lprintf(LOG_ERR,"0000 !SEND ERROR %d starting delivery thread #%u"
+				,errno, w+1);
+			break;
+		}
+		workers++;
+	}
+	lprintf(LOG_DEBUG,"0000 SEND %u delivery threads started", workers);
+
+	while(server_socket!=INVALID_SOCKET && !terminate_sendmail) {
+
+		if(startup->options&MAIL_OPT_NO_SENDMAIL) {
+			sem_trywait_block(&sendmail_wakeup_sem,1000);
+			continue;
+		}
+
+		smb_close(&smb);
+
+		/* Don't delay on first loop */
+		if(first_cycle)
+			first_cycle=FALSE;
+		else
+			sem_trywait_block(&sendmail_wakeup_sem,startup->sem_chk_freq*1000);
+
+		SAFEPRINTF(smb.file,"%smail",scfg.data_dir);
+		smb.retry_time=scfg.smb_retry_time;
+		smb.subnum=INVALID_SUB;
+		if((i=smb_open(&smb))!=SMB_SUCCESS)
+			continue;
+
+		/* Re-read the whole index (and retry everything) now and then */
+		if(time(NULL)-last_scan>=startup->rescan_frequency) {
+			scanned=0;
+			sendmail_forget(&sched,&pending);
+			last_scan=time(NULL);
+		}
+		/* Always scan: the message count can't tell us whether messages were	*/
+		/* added (e.g. as many deleted and compacted away as were added), but	*/
+		/* sendmail_scan() only reads the records added since the last scan	*/
+		if((added=sendmail_scan(&sched,&smb,&pending,&scanned,&last_number))!=0)
+			lprintf(LOG_DEBUG,"0000 SEND scanned %u index records, %u new messages, %u pending"
+				,scanned, added, listCountNodes(&pending));
+		smb_close(&smb);
+
+		if((queued=sendmail_queue(&sched,&pending))!=0)
+			lprintf(LOG_DEBUG,"0000 SEND %u messages queued for delivery", queued);
+		if(workers==0)	/* No delivery threads, deliver from this thread */
+			sendmail_worker(&sched, /* wait: */FALSE);
+		sendmail_purge(&sched,&pending);
+	}
+
+	/* The workers stop when they see terminate_sendmail or the server stop */
+	for(w=0; w<workers; w++)
+		sem_wait(&sched.done);
 
-	smb_freemsgtxt(msgtxt);
-	smb_freemsgmem(&msg);
 	smb_close(&smb);
 
-	if(active_sendmail!=0)
-		active_sendmail=0, update_clients();
+	sendmail_free_queue(&sched);
+	listFree(&pending);
+	listFree(&sched.mx_cache);
+	sem_destroy(&sched.work);
+	sem_destroy(&sched.done);
+	pthread_mutex_destroy(&sched.mutex);
 
 	{
 		int32_t remain = thread_down();
@@ -4855,10 +5625,16 @@ static void cleanup(int code)
 		}
 	}
 
+	if(dns_cache!=NULL) {
+		FREE_AND_NULL(dns_cache);
+		pthread_mutex_destroy(&dns_cache_mutex);
+	}
+
 	if(active_clients.value)
 		lprintf(LOG_WARNING,"#### !Mail Server terminating with %ld active clients", active_clients.value);
 	else
 		protected_uint32_destroy(active_clients);
+	protected_uint32_destroy(active_sendmail);
 
 	update_clients();
 
@@ -4977,6 +5753,7 @@ void DLLCALL mail_server(void* arg)
 	if(startup->max_delivery_attempts==0)	startup->max_delivery_attempts=50;
 	if(startup->max_inactivity==0) 			startup->max_inactivity=120; /* seconds */
 	if(startup->sem_chk_freq==0)			startup->sem_chk_freq=2;
+	if(startup->sendmail_threads==0)		startup->sendmail_threads=1;
 
 #ifdef JAVASCRIPT
 	if(startup->js.max_bytes==0)			startup->js.max_bytes=JAVASCRIPT_MAX_BYTES;
@@ -5124,6 +5901,9 @@ void DLLCALL mail_server(void* arg)
 		lprintf(LOG_DEBUG,"Maximum inactivity: %u seconds",startup->max_inactivity);
 
 		protected_uint32_init(&active_clients, 0);
+		protected_uint32_init(&active_sendmail, 0);
+		pthread_mutex_init(&dns_cache_mutex,NULL);
+		dns_cache=(dns_cache_t*)calloc(DNS_CACHE_BUCKETS*DNS_CACHE_BUCKET_SIZE,sizeof(dns_cache_t));
 		update_clients();
 
 		/* open a socket and wait for a client */
@@ -5301,6 +6081,8 @@ void DLLCALL mail_server(void* arg)
 
 		while(server_socket!=INVALID_SOCKET && !terminate_server) {
 
+			js_cache_expire();	/* free compiled scripts that have gone unused */
+
 			if(active_clients.value==0) {
 				if(!(startup->options&MAIL_OPT_NO_RECYCLE)) {
 					if((p=semfile_list_check(&initialized,recycle_semfiles))!=NULL) {
@@ -115,6 +115,10 @@ typedef struct {
 	ulong	login_attempt_filter_threshold;
 	link_list_t* login_attempt_list;
 
+	/* Outbound (SendMail) delivery */
+	WORD	sendmail_threads;	/* Max concurrent outbound (SendMail) deliveries */
+	WORD	max_msgs_per_conn;	/* Max msgs sent per outbound SMTP connection (0=unlimited) */
+
 } mail_startup_t;
 
 /* startup options that requires re-initialization/recycle when changed */
@@ -235,5 +239,6 @@ DLLEXPORT const	char*	DLLCALL mail_ver(void);
 #endif
 
 int sockprintf(SOCKET sock, char *fmt, ...);
+int sockwrite(SOCKET sock, const char* buf, int len);
 
 #endif /* Don't add anything after this line */
@@ -42,6 +42,7 @@
 #include "js_rtpool.h"
 #include "js_request.h"
 #include "js_socket.h"
+#include "js_cache.h"
 
 #ifdef __unix__
 	#include <sys/un.h>
@@ -51,6 +52,13 @@
 	#endif
 #endif
 
+/* Service all node (non-SSH) client sockets from a single I/O thread */
+#if defined(__linux__) && !defined(NO_EPOLL)
+	#define USE_EPOLL
+	#include <sys/epoll.h>
+	#include <sys/eventfd.h>
+#endif
+
 //---------------------------------------------------------------------------
 
 #define TELNET_SERVER "Synchronet Terminal Server"
@@ -811,6 +819,7 @@ js_write_raw(JSContext *cx, uintN argc, jsval *arglist)
 		if(str==NULL)
 		    return(JS_FALSE);
 		rc=JS_SUSPENDREQUEST(cx);
+		sbbs->outcom_flush();
 		sbbs->putcom(str, len);
 		JS_RESUMEREQUEST(cx, rc);
 	}
@@ -1507,12 +1516,60 @@ bool sbbs_t::request_telnet_opt(uchar cmd, uchar opt, unsigned waitforack)
 	return true;
 }
 
+/****************************************************************************/
+/* Handles data received from a node's client (or local spy) socket:		*/
+/* Telnet command interpretation, first-level Ctrl-C checking and input		*/
+/* buffering.  'raw' data (e.g. from the local spy) is not Telnet-escaped	*/
+/****************************************************************************/
+static void node_input(sbbs_t* sbbs, BYTE* inbuf, int rd, bool raw)
+{
+   	BYTE		telbuf[4000];
+    BYTE		*wrbuf;
+	int			wr;
+	ulong		avail;
+
+    // telbuf and wr are modified to reflect telnet escaped data
+	wr=rd;
+	if(raw || sbbs->telnet_mode&TELNET_MODE_OFF)
+		wrbuf=inbuf;
+	else
+		wrbuf=telnet_interpret(sbbs, inbuf, rd, telbuf, wr);
+	if(wr > (int)sizeof(telbuf)) 
+		lprintf(LOG_ERR,"!TELBUF OVERFLOW (%d>%d)",wr,sizeof(telbuf));
+
+	/* First level Ctrl-C checking */
+	if(!(sbbs->cfg.ctrlkey_passthru&(1<<CTRL_C))
+		&& sbbs->rio_abortable 
+		&& !(sbbs->telnet_mode&TELNET_MODE_GATE)
+		&& sbbs->telnet_remote_option[TELNET_BINARY_TX]!=TELNET_WILL
+		&& memchr(wrbuf, CTRL_C, wr)) {	
+		if(RingBufFull(&sbbs->inbuf))
+    		lprintf(LOG_DEBUG,"Node %d Ctrl-C hit with %lu bytes in input buffer"
+				,sbbs->cfg.node_num,RingBufFull(&sbbs->inbuf));
+		if(RingBufFull(&sbbs->outbuf))
+    		lprintf(LOG_DEBUG,"Node %d Ctrl-C hit with %lu bytes in output buffer"
+				,sbbs->cfg.node_num,RingBufFull(&sbbs->outbuf));
+		sbbs->sys_status|=SS_ABORT;
+		RingBufReInit(&sbbs->inbuf);	/* Purge input buffer */
+    	RingBufReInit(&sbbs->outbuf);	/* Purge output buffer */
+		sem_post(&sbbs->inbuf.sem);
+		return;	// Ignore the entire buffer
+	}
+
+	avail=RingBufFree(&sbbs->inbuf);
+
+    if(avail<(ulong)wr)
+		lprintf(LOG_ERR,"!INPUT BUFFER FULL (%lu free)", avail);
+    else
+		RingBufWrite(&sbbs->inbuf, wrbuf, wr);
+//	if(wr>100)
+//		mswait(500);	// Throttle sender
+}
+
 void input_thread(void *arg)
 {
 	BYTE		inbuf[4000];
-   	BYTE		telbuf[sizeof(inbuf)];
-    BYTE		*wrbuf;
-    int			i,rd,wr,avail;
+    int			i,rd;
 	ulong		total_recv=0;
 	ulong		total_pkts=0;
 	fd_set		socket_set;
@@ -1718,47 +1775,11 @@ void input_thread(void *arg)
 		total_recv+=rd;
 		total_pkts++;
 
-        // telbuf and wr are modified to reflect telnet escaped data
-		wr=rd;
 #ifdef __unix__
-		if(sock!=sbbs->client_socket)
-			wrbuf=inbuf;
-		else
+		node_input(sbbs, inbuf, rd, /* raw: */sock!=sbbs->client_socket);
+#else
+		node_input(sbbs, inbuf, rd, /* raw: */false);
 #endif
-		if(sbbs->telnet_mode&TELNET_MODE_OFF)
-			wrbuf=inbuf;
-		else
-			wrbuf=telnet_interpret(sbbs, inbuf, rd, telbuf, wr);
-		if(wr > (int)sizeof(telbuf)) 
-			lprintf(LOG_ERR,"!TELBUF OVERFLOW (%d>%d)",wr,sizeof(telbuf));
-
-		/* First level Ctrl-C checking */
-		if(!(sbbs->cfg.ctrlkey_passthru&(1<<CTRL_C))
-			&& sbbs->rio_abortable 
-			&& !(sbbs->telnet_mode&TELNET_MODE_GATE)
-			&& sbbs->telnet_remote_option[TELNET_BINARY_TX]!=TELNET_WILL
-			&& memchr(wrbuf, CTRL_C, wr)) {	
-			if(RingBufFull(&sbbs->inbuf))
-    			lprintf(LOG_DEBUG,"Node %d Ctrl-C hit with %lu bytes in input buffer"
-					,sbbs->cfg.node_num,RingBufFull(&sbbs->inbuf));
-			if(RingBufFull(&sbbs->outbuf))
-    			lprintf(LOG_DEBUG,"Node %d Ctrl-C hit with %lu bytes in output buffer"
-					,sbbs->cfg.node_num,RingBufFull(&sbbs->outbuf));
-			sbbs->sys_status|=SS_ABORT;
-			RingBufReInit(&sbbs->inbuf);	/* Purge input buffer */
-    		RingBufReInit(&sbbs->outbuf);	/* Purge output buffer */
-			sem_post(&sbbs->inbuf.sem);
-			continue;	// Ignore the entire buffer
-		}
-
-		avail=RingBufFree(&sbbs->inbuf);
-
-        if(avail<wr)
-			lprintf(LOG_ERR,"!INPUT BUFFER FULL (%d free)", avail);
-        else
-			RingBufWrite(&sbbs->inbuf, wrbuf, wr);
-//		if(wr>100)
-//			mswait(500);	// Throttle sender
 	}
 	sbbs->online=FALSE;
 	sbbs->sys_status|=SS_ABORT;	/* as though Ctrl-C were hit */
@@ -1777,6 +1798,457 @@ void input_thread(void *arg)
 		,sbbs->cfg.node_num, total_recv, total_pkts);
 }
 
+/****************************************************************************/
+/* Auto-tunes the output highwater mark to the negotiated MSS for the		*/
+/* client socket (when possible) and returns the maximum send() size		*/
+/****************************************************************************/
+static ulong output_mss(sbbs_t* sbbs)
+{
+	ulong	mss=IO_THREAD_BUF_SIZE;
+#ifdef TCP_MAXSEG
+	int			i;
+	socklen_t	sl;
+
+	if(!sbbs->outbuf.highwater_mark) {
+		sl=sizeof(i);
+		if(!getsockopt(sbbs->client_socket, IPPROTO_TCP, TCP_MAXSEG, &i, &sl)) {
+			/* Check for sanity... */
+			if(i>100) {
+				sbbs->outbuf.highwater_mark=i;
+				lprintf(LOG_DEBUG,"Autotuning outbuf highwater mark to %d based on MSS",i);
+				mss=sbbs->outbuf.highwater_mark;
+				if(mss>IO_THREAD_BUF_SIZE) {
+					mss=IO_THREAD_BUF_SIZE;
+					lprintf(LOG_DEBUG,"MSS (%d) is higher than IO_THREAD_BUF_SIZE (%d)",i,IO_THREAD_BUF_SIZE);
+				}
+			}
+		}
+	}
+#endif
+	return(mss);
+}
+
+/* Copies data sent to a node's client to the node's spies (if any) */
+static void output_spy(sbbs_t* sbbs, BYTE* buf, int len)
+{
+	if(sbbs->cfg.node_num<1 || sbbs->sys_status&SS_FILEXFER)
+		return;
+	/* Spy on the user locally */
+	if(startup->node_spybuf!=NULL 
+		&& startup->node_spybuf[sbbs->cfg.node_num-1]!=NULL) {
+		RingBufWrite(startup->node_spybuf[sbbs->cfg.node_num-1],buf,len);
+		/* Signal spy output semaphore? */
+		if(startup->node_spysem!=NULL 
+			&& startup->node_spysem[sbbs->cfg.node_num-1]!=NULL)
+			sem_post(startup->node_spysem[sbbs->cfg.node_num-1]);
+	}
+	/* Spy on the user remotely */
+	if(spy_socket[sbbs->cfg.node_num-1]!=INVALID_SOCKET) 
+		sendsocket(spy_socket[sbbs->cfg.node_num-1],(char*)buf,len);
+#ifdef __unix__
+	if(uspy_socket[sbbs->cfg.node_num-1]!=INVALID_SOCKET)
+		sendsocket(uspy_socket[sbbs->cfg.node_num-1],(char*)buf,len);
+#endif
+}
+
+#ifdef USE_EPOLL
+/****************************************************************************/
+/* Node I/O reactor: one thread, using epoll, receives from the client (and	*/
+/* local spy) sockets of all Telnet and RLogin nodes and sends their output	*/
+/* buffers to their clients, in place of an input_thread and output_thread	*/
+/* per node.  SSH nodes (Cryptlib sessions) still get their own threads.	*/
+/* Writes to a node's (empty) output buffer wake the reactor via an eventfd	*/
+/* and output below the highwater mark is sent after the drain timeout,		*/
+/* same as output_thread().													*/
+/****************************************************************************/
+#define NODE_IO_POLL_INTERVAL	250		/* ms, for deferred and closing nodes */
+#define NODE_IO_WAKEUP_KEY		((uint64_t)-1)
+
+typedef struct {
+	sbbs_t*	sbbs;		/* NULL when not in use */
+	SOCKET	sock;		/* our own dup() of the client socket */
+	SOCKET	spy_sock;	/* local spy socket currently registered */
+	bool	deferred;	/* input_thread_mutex busy or inbuf full: retry later */
+	msclock_t retry;	/* when deferred input is to be retried */
+	bool	closing;	/* input ended, waiting for the client socket to be closed */
+	volatile int signaled;	/* output written since last checked, see node_io_notify() */
+	bool	blocked;	/* output waiting for the socket to be writable */
+	msclock_t drain;	/* when output below the highwater mark is to be sent (0=none) */
+	ulong	mss;
+	ulong	total_recv;
+	ulong	total_pkts;
+	ulong	total_sent;
+	ulong	total_sends;
+	ulong	short_sends;
+} node_io_t;
+
+static	node_io_t		node_io[MAX_NODES];
+static	pthread_mutex_t	node_io_mutex;
+static	int				node_io_epoll=-1;
+static	int				node_io_wakeup=-1;	/* eventfd */
+static	volatile bool	node_io_terminate=false;
+static	volatile bool	node_io_thread_running=false;
+
+#define NODE_IO_KEY(n, spy)		(((uint64_t)(n)<<1)|(spy))
+
+/* Called by the writers of a node's output buffer, from any thread */
+static void node_io_notify(void* arg)
+{
+	node_io_t*	nio=(node_io_t*)arg;
+
+	/* Only the first write since the reactor last checked needs to wake it */
+	if(__sync_bool_compare_and_swap(&nio->signaled, 0, 1))
+		eventfd_write(node_io_wakeup, 1);
+}
+
+static void node_io_arm(node_io_t* nio, SOCKET sock, bool spy, int op)
+{
+	struct epoll_event ev;
+
+	memset(&ev,0,sizeof(ev));
+	ev.events=EPOLLONESHOT;
+	if(spy || (!nio->deferred && !nio->closing))
+		ev.events|=EPOLLIN|EPOLLRDHUP;
+	if(!spy && nio->blocked)
+		ev.events|=EPOLLOUT;
+	ev.data.u64=NODE_IO_KEY(nio-node_io, spy);
+	if(epoll_ctl(node_io_epoll, op, sock, &ev)==0 || op!=EPOLL_CTL_ADD)
+		return;
+	/* A local spy socket remains registered after its node's session ends */
+	if(ERROR_VALUE==EEXIST && epoll_ctl(node_io_epoll, EPOLL_CTL_MOD, sock, &ev)==0)
+		return;
+	lprintf(LOG_ERR,"Node %d !ERROR %d adding socket %d to I/O reactor"
+		,nio->sbbs->cfg.node_num, ERROR_VALUE, sock);
+}
+
+/* Returns false if the node's I/O is not (or no longer) handled by us */
+static bool node_io_add(sbbs_t* sbbs)
+{
+	node_io_t*	nio;
+
+	if(node_io_epoll==-1 || sbbs->cfg.node_num<1 || sbbs->cfg.node_num>MAX_NODES)
+		return false;
+#ifdef USE_CRYPTLIB
+	if(sbbs->ssh_mode)			/* Cryptlib sessions need I/O threads */
+		return false;
+#endif
+	nio=&node_io[sbbs->cfg.node_num-1];
+
+	pthread_mutex_lock(&node_io_mutex);
+	if(nio->sbbs!=NULL) {		/* previous session still closing */
+		pthread_mutex_unlock(&node_io_mutex);
+		return false;
+	}
+	if((nio->sock=dup(sbbs->client_socket))==INVALID_SOCKET) {
+		pthread_mutex_unlock(&node_io_mutex);
+		return false;
+	}
+	nio->spy_sock=INVALID_SOCKET;
+	nio->deferred=false;
+	nio->closing=false;
+	nio->signaled=1;			/* check for output already buffered */
+	nio->blocked=false;
+	nio->drain=0;
+	nio->mss=output_mss(sbbs);
+	nio->total_recv=0;
+	nio->total_pkts=0;
+	nio->total_sent=0;
+	nio->total_sends=0;
+	nio->short_sends=0;
+	nio->sbbs=sbbs;
+
+	pthread_mutex_init(&sbbs->input_thread_mutex,NULL);
+    sbbs->input_thread_running = true;
+    sbbs->output_thread_running = true;
+	sbbs->console|=(CON_R_INPUT|CON_R_ECHO);
+	sbbs->outbuf.notify_arg=nio;
+	sbbs->outbuf.notify=node_io_notify;
+
+	node_io_arm(nio, nio->sock, /* spy: */false, EPOLL_CTL_ADD);
+	pthread_mutex_unlock(&node_io_mutex);
+	eventfd_write(node_io_wakeup, 1);
+	return true;
+}
+
+/* Called with node_io_mutex locked, same as the end of input_thread() */
+static void node_io_close(node_io_t* nio)
+{
+	sbbs_t*	sbbs=nio->sbbs;
+
+	nio->closing=true;
+	sbbs->online=FALSE;
+	sbbs->sys_status|=SS_ABORT;	/* as though Ctrl-C were hit */
+	if(node_socket[sbbs->cfg.node_num-1]==INVALID_SOCKET)	// Shutdown locally
+		sbbs->terminated = true;	// Signal JS to stop execution
+	/* Keep sending output until the client socket is closed (same as		*/
+	/* output_thread), so the socket stays registered for output only		*/
+	node_io_arm(nio, nio->sock, /* spy: */false, EPOLL_CTL_MOD);
+}
+
+/* Called with node_io_mutex locked, same as the ends of input_thread() and	*/
+/* output_thread()															*/
+static void node_io_remove(node_io_t* nio)
+{
+	sbbs_t*	sbbs=nio->sbbs;
+
+	if(nio->sock!=INVALID_SOCKET) {
+		/* The registration belongs to the open file, which client_socket	*/
+		/* may still refer to, so closing our dup alone wouldn't remove it.	*/
+		/* The spy socket is not ours to close (its events are ignored		*/
+		/* while we're unused)												*/
+		node_io_arm(nio, nio->sock, /* spy: */false, EPOLL_CTL_DEL);
+		closesocket(nio->sock);
+		nio->sock=INVALID_SOCKET;
+		sbbs->outbuf.notify=NULL;
+	}
+	/* Don't block the other nodes waiting on an external program */
+	if(pthread_mutex_destroy(&sbbs->input_thread_mutex)==EBUSY)
+		return;
+	while(pthread_mutex_destroy(&sbbs->ssh_mutex)==EBUSY)
+		mswait(1);
+
+	sbbs->spymsg("Disconnected");
+	lprintf(LOG_DEBUG,"Node %d I/O terminated (received %lu bytes in %lu blocks"
+		", sent %lu bytes in %lu blocks, %lu short)"
+		,sbbs->cfg.node_num, nio->total_recv, nio->total_pkts
+		,nio->total_sent, nio->total_sends, nio->short_sends);
+	nio->sbbs=NULL;
+    sbbs->input_thread_running = false;
+    sbbs->output_thread_running = false;	/* sbbs may be deleted now */
+}
+
+/* Returns false if the node's input has ended */
+static bool node_io_recv(node_io_t* nio, bool spy)
+{
+	BYTE		buf[4000];
+	sbbs_t*		sbbs=nio->sbbs;
+	SOCKET		sock=spy ? nio->spy_sock : nio->sock;
+	int			rd;
+
+	if(pthread_mutex_trylock(&sbbs->input_thread_mutex)!=0) {
+		nio->deferred=true;		/* socket in use by an external program */
+		nio->retry=msclock()+NODE_IO_POLL_INTERVAL;
+		return true;
+	}
+	if((rd=RingBufFree(&sbbs->inbuf))==0) {
+		pthread_mutex_unlock(&sbbs->input_thread_mutex);
+		if(!nio->deferred)
+			lprintf(LOG_WARNING,"Node %d !WARNING input buffer full", sbbs->cfg.node_num);
+		nio->deferred=true;
+		nio->retry=msclock()+NODE_IO_POLL_INTERVAL;
+		return true;
+	}
+	if(rd>(int)sizeof(buf))
+		rd=sizeof(buf);
+	rd=recv(sock, (char*)buf, rd, MSG_DONTWAIT);
+	pthread_mutex_unlock(&sbbs->input_thread_mutex);
+
+	if(rd==SOCKET_ERROR && ERROR_VALUE==EAGAIN)
+		return true;
+	if(spy) {
+		if(rd<1) {
+			if(rd==SOCKET_ERROR)
+				lprintf(LOG_ERR,"Node %d !ERROR %d on local spy socket %d receive"
+					, sbbs->cfg.node_num, ERROR_VALUE, sock);
+			else
+				lprintf(LOG_NOTICE,"Closing local spy socket: %d",sock);
+			if(uspy_socket[sbbs->cfg.node_num-1]==sock) {
+				node_io_arm(nio, sock, /* spy: */true, EPOLL_CTL_DEL);
+				close_socket(sock);
+				uspy_socket[sbbs->cfg.node_num-1]=INVALID_SOCKET;
+			}
+			nio->spy_sock=INVALID_SOCKET;
+			return true;
+		}
+		node_input(sbbs, buf, rd, /* raw: */true);
+		return true;
+	}
+	if(rd==SOCKET_ERROR) {
+		if(!sbbs->online)	// sbbs_t::hangup() called?
+			return false;
+		if(ERROR_VALUE==ECONNRESET)
+			lprintf(LOG_NOTICE,"Node %d connection reset by peer on receive", sbbs->cfg.node_num);
+		else if(ERROR_VALUE==ECONNABORTED)
+			lprintf(LOG_NOTICE,"Node %d connection aborted by peer on receive", sbbs->cfg.node_num);
+		else
+			lprintf(LOG_WARNING,"Node %d !ERROR %d receiving from socket %d"
+				,sbbs->cfg.node_num, ERROR_VALUE, sock);
+		return false;
+	}
+	if(rd==0) {
+		if(sbbs->online)
+			lprintf(LOG_NOTICE,"Node %d disconnected", sbbs->cfg.node_num);
+		return false;
+	}
+	nio->total_recv+=rd;
+	nio->total_pkts++;
+	node_input(sbbs, buf, rd, /* raw: */false);
+	return true;
+}
+
+/* Sends the node's buffered output, until it's empty, the socket would		*/
+/* block (nio->blocked) or the rest is waiting for the drain timeout		*/
+/* (nio->drain), same as output_thread()									*/
+static void node_io_send(node_io_t* nio)
+{
+	BYTE		buf[IO_THREAD_BUF_SIZE];
+	sbbs_t*		sbbs=nio->sbbs;
+	ulong		avail;
+	int			i;
+
+	while((avail=RingBufFull(&sbbs->outbuf))!=0) {
+		/* Wait for full buffer or drain timeout */
+		if(sbbs->outbuf.highwater_mark && avail<sbbs->outbuf.highwater_mark) {
+			if(nio->drain==0)
+				nio->drain=msclock()+startup->outbuf_drain_timeout;
+			if(msclock()<nio->drain)
+				return;
+		}
+		/* If we know the MSS, use it as the max send() size. */
+		if(avail>nio->mss)
+			avail=nio->mss;
+		/* Only consume (after the send) what was actually sent */
+		avail=RingBufPeek(&sbbs->outbuf, buf, avail);
+		i=send(nio->sock, (char*)buf, avail, MSG_DONTWAIT|MSG_NOSIGNAL);
+		if(i==SOCKET_ERROR) {
+			if(ERROR_VALUE==EAGAIN) {
+				nio->blocked=true;
+				return;
+			}
+            if(ERROR_VALUE==ECONNRESET) 
+				lprintf(LOG_NOTICE,"Node %d connection reset by peer on send", sbbs->cfg.node_num);
+            else if(ERROR_VALUE==ECONNABORTED || ERROR_VALUE==EPIPE) 
+				lprintf(LOG_NOTICE,"Node %d connection aborted by peer on send", sbbs->cfg.node_num);
+			else
+				lprintf(LOG_WARNING,"Node %d !ERROR %d sending on socket %d"
+                	,sbbs->cfg.node_num, ERROR_VALUE, nio->sock);
+			sbbs->online=FALSE;
+			i=avail;	// Pretend we sent it all
+		}
+		output_spy(sbbs, buf, i);
+		RingBufRead(&sbbs->outbuf, NULL, i);
+		nio->drain=0;
+		nio->total_sent+=i;
+		nio->total_sends++;
+		if(i!=(int)avail) {		/* the rest when the socket is writable */
+			nio->short_sends++;
+			nio->blocked=true;
+			return;
+		}
+	}
+	nio->drain=0;
+}
+
+void node_io_thread(void* arg)
+{
+	struct epoll_event	ev[64];
+	node_io_t*	nio;
+	int			i,n;
+	int			timeout=NODE_IO_POLL_INTERVAL;
+	bool		spy;
+	eventfd_t	count;
+	msclock_t	now;
+
+	SetThreadName("Node I/O");
+	thread_up(TRUE /* setuid */);
+	lprintf(LOG_DEBUG,"Node I/O reactor thread started");
+
+	while(!node_io_terminate) {
+		n=epoll_wait(node_io_epoll, ev, sizeof(ev)/sizeof(ev[0]), timeout);
+		if(n<0 && ERROR_VALUE!=EINTR) {
+			lprintf(LOG_ERR,"!ERROR %d waiting on node I/O reactor",ERROR_VALUE);
+			break;
+		}
+		pthread_mutex_lock(&node_io_mutex);
+		for(i=0;i<n;i++) {
+			if(ev[i].data.u64==NODE_IO_WAKEUP_KEY) {
+				eventfd_read(node_io_wakeup, &count);
+				continue;
+			}
+			nio=&node_io[ev[i].data.u64>>1];
+			spy=(ev[i].data.u64&1) ? true : false;
+			if(nio->sbbs==NULL)
+				continue;
+			if(spy) {
+				if(nio->spy_sock==INVALID_SOCKET)
+					continue;
+				node_io_recv(nio, /* spy: */true);
+				if(nio->spy_sock!=INVALID_SOCKET)
+					node_io_arm(nio, nio->spy_sock, /* spy: */true, EPOLL_CTL_MOD);
+				continue;
+			}
+			if(ev[i].events&EPOLLOUT) {
+				nio->blocked=false;
+				node_io_send(nio);
+			}
+			if((ev[i].events&~EPOLLOUT) && !nio->closing && !node_io_recv(nio, /* spy: */false)) {
+				node_io_close(nio);
+				continue;
+			}
+			/* Hang-ups and errors are always reported: don't spin on them */
+			if((ev[i].events&(EPOLLHUP|EPOLLERR)) && (nio->deferred || nio->closing))
+				continue;	/* re-armed when input is retried, or removed */
+			node_io_arm(nio, nio->sock, /* spy: */false, EPOLL_CTL_MOD);
+		}
+		/* Send output, check for disconnection, retry deferred input, and add spies */
+		timeout=NODE_IO_POLL_INTERVAL;
+		for(i=0;i<MAX_NODES;i++) {
+			nio=&node_io[i];
+			if(nio->sbbs==NULL)
+				continue;
+			if(nio->closing) {
+				if(nio->sock==INVALID_SOCKET
+					|| nio->sbbs->client_socket==INVALID_SOCKET
+					|| node_socket[i]==INVALID_SOCKET) {
+					node_io_remove(nio);
+					continue;
+				}
+			}
+			else if(!nio->sbbs->online || nio->sbbs->client_socket==INVALID_SOCKET
+				|| node_socket[i]==INVALID_SOCKET) {
+				node_io_close(nio);
+			}
+			if(!nio->blocked
+				&& (__sync_lock_test_and_set(&nio->signaled, 0) || nio->drain)) {
+				node_io_send(nio);
+				if(nio->blocked)
+					node_io_arm(nio, nio->sock, /* spy: */false, EPOLL_CTL_MOD);
+			}
+			if(nio->drain) {	/* wake up in time to send it */
+				now=msclock();
+				if(nio->drain<=now)
+					timeout=0;
+				else if(nio->drain-now<timeout)
+					timeout=(int)(nio->drain-now);
+			}
+			if(nio->closing)
+				continue;
+			/* The unread data would wake us immediately, so don't re-arm early */
+			if(nio->deferred && msclock()>=nio->retry) {
+				nio->deferred=false;
+				node_io_arm(nio, nio->sock, /* spy: */false, EPOLL_CTL_MOD);
+				if(nio->spy_sock!=INVALID_SOCKET)
+					node_io_arm(nio, nio->spy_sock, /* spy: */true, EPOLL_CTL_MOD);
+			}
+			if(uspy_socket[i]!=nio->spy_sock) {	/* old one was closed */
+				nio->spy_sock=uspy_socket[i];
+				if(nio->spy_sock!=INVALID_SOCKET)
+					node_io_arm(nio, nio->spy_sock, /* spy: */true, EPOLL_CTL_ADD);
+			}
+		}
+		pthread_mutex_unlock(&node_io_mutex);
+	}
+
+	close(node_io_wakeup);
+	node_io_wakeup=-1;
+	close(node_io_epoll);
+	node_io_epoll=-1;
+	node_io_thread_running=false;
+	thread_down();
+	lprintf(LOG_DEBUG,"Node I/O reactor thread terminated");
+}
+#endif	/* USE_EPOLL */
+
 #ifdef USE_CRYPTLIB
 /*
  * This thread copies anything received from the client to the passthru_socket
@@ -2006,7 +2478,7 @@ void output_thread(void* arg)
 	sbbs_t*		sbbs = (sbbs_t*) arg;
 	fd_set		socket_set;
 	struct timeval tv;
-	ulong		mss=IO_THREAD_BUF_SIZE;
+	ulong		mss;
 
 	SetThreadName("Node Output");
 	thread_up(TRUE /* setuid */);
@@ -2022,28 +2494,7 @@ void output_thread(void* arg)
     sbbs->output_thread_running = true;
 	sbbs->console|=CON_R_ECHO;
 
-#ifdef TCP_MAXSEG
-	/*
-	 * Auto-tune the highwater mark to be the negotiated MSS for the
-     * socket (when possible)
-	 */
-	if(!sbbs->outbuf.highwater_mark) {
-		socklen_t	sl;
-		sl=sizeof(i);
-		if(!getsockopt(sbbs->client_socket, IPPROTO_TCP, TCP_MAXSEG, &i, &sl)) {
-			/* Check for sanity... */
-			if(i>100) {
-				sbbs->outbuf.highwater_mark=i;
-				lprintf(LOG_DEBUG,"Autotuning outbuf highwater mark to %d based on MSS",i);
-				mss=sbbs->outbuf.highwater_mark;
-				if(mss>IO_THREAD_BUF_SIZE) {
-					mss=IO_THREAD_BUF_SIZE;
-					lprintf(LOG_DEBUG,"MSS (%d) is higher than IO_THREAD_BUF_SIZE (%d)",i,IO_THREAD_BUF_SIZE);
-				}
-			}
-		}
-	}
-#endif
+	mss=output_mss(sbbs);
 
 	/* Note: do not terminate when online==FALSE, that is expected for the terminal server output_thread */
 	while(sbbs->client_socket!=INVALID_SOCKET && !terminate_server) {
@@ -2165,24 +2616,7 @@ void output_thread(void* arg)
 			i=buftop-bufbot;	// Pretend we sent it all
 		}
 
-		if(sbbs->cfg.node_num>0 && !(sbbs->sys_status&SS_FILEXFER)) {
-			/* Spy on the user locally */
-			if(startup->node_spybuf!=NULL 
-				&& startup->node_spybuf[sbbs->cfg.node_num-1]!=NULL) {
-				RingBufWrite(startup->node_spybuf[sbbs->cfg.node_num-1],buf+bufbot,i);
-				/* Signal spy output semaphore? */
-				if(startup->node_spysem!=NULL 
-					&& startup->node_spysem[sbbs->cfg.node_num-1]!=NULL)
-					sem_post(startup->node_spysem[sbbs->cfg.node_num-1]);
-			}
-			/* Spy on the user remotely */
-			if(spy_socket[sbbs->cfg.node_num-1]!=INVALID_SOCKET) 
-				sendsocket(spy_socket[sbbs->cfg.node_num-1],(char*)buf+bufbot,i);
-#ifdef __unix__
-			if(uspy_socket[sbbs->cfg.node_num-1]!=INVALID_SOCKET)
-				sendsocket(uspy_socket[sbbs->cfg.node_num-1],(char*)buf+bufbot,i);
-#endif
-		}
+		output_spy(sbbs, buf+bufbot, i);
 
 		if(i!=(int)(buftop-bufbot)) {
 			lprintf(LOG_WARNING,"%s !Short socket send (%u instead of %u)"
@@ -2975,6 +3409,8 @@ sbbs_t::sbbs_t(ushort node_num, SOCKADDR_IN addr, const char* name, SOCKET sd,
 	timeleft = 60*10;	/* just incase this is being used for calling gettimeleft() */
 	uselect_total = 0;
 	lbuflen = 0;
+	outcom_buflen = 0;
+	outcom_batch = 0;
 	keybufbot=keybuftop=0;	/* initialize [unget]keybuf pointers */
 	SAFECOPY(connection,"Telnet");
 	node_connection=NODE_CONNECTION_TELNET;
@@ -3016,6 +3452,7 @@ sbbs_t::sbbs_t(ushort node_num, SOCKADDR_IN addr, const char* name, SOCKET sd,
 	ZERO_VAR(outbuf);
 	ZERO_VAR(smb);
 	ZERO_VAR(nodesync_user);
+	ar_cache_flush();
 
 	action=NODE_MAIN;
 	global_str_vars=0;
@@ -3073,10 +3510,12 @@ bool sbbs_t::init()
 	SOCKADDR_IN	addr;
 
 	RingBufInit(&inbuf, IO_THREAD_BUF_SIZE);
+	inbuf.mode=RINGBUF_SINGLE_CONSUMER;		/* node thread (other nodes may write) */
 	if(cfg.node_num>0)
 		node_inbuf[cfg.node_num-1]=&inbuf;
 
     RingBufInit(&outbuf, IO_THREAD_BUF_SIZE);
+	outbuf.mode=RINGBUF_SINGLE_CONSUMER;	/* output_thread (input_thread may write) */
 	outbuf.highwater_mark=startup->outbuf_highwater_mark;
 
 	if(cfg.node_num && client_socket!=INVALID_SOCKET) {
@@ -3671,6 +4110,9 @@ int sbbs_t::incom(unsigned long timeout)
 {
 	uchar	ch;
 
+	if(outcom_buflen)	/* don't wait for input with output still staged */
+		outcom_flush();
+
 #if 0	/* looping version */
 	while(!RingBufRead(&inbuf, &ch, 1))
 		if(sem_trywait_block(&inbuf.sem,timeout)!=0 || sys_status&SS_ABORT)
@@ -3688,6 +4130,12 @@ int sbbs_t::incom(unsigned long timeout)
 
 int sbbs_t::outcom(uchar ch)
 {
+	if(outcom_batch) {
+		if(outcom_buflen>=sizeof(outcom_buf) && outcom_flush()!=0)
+			return(TXBOF);
+		outcom_buf[outcom_buflen++]=ch;
+		return(0);
+	}
 	if(!RingBufFree(&outbuf))
 		return(TXBOF);
     if(!RingBufWrite(&outbuf, &ch, 1))
@@ -3695,18 +4143,92 @@ int sbbs_t::outcom(uchar ch)
 	return(0);
 }
 
+/****************************************************************************/
+/* Sends as much of 'str' as will currently fit in the output ring buffer	*/
+/* using a single RingBufWrite() call (one lock and semaphore post)			*/
+/* Not batched: safe to call from the input_thread							*/
+/****************************************************************************/
 int sbbs_t::putcom(const char *str, size_t len)
 {
-	size_t i;
+	DWORD	avail;
+
+	if(!len)
+		len=strlen(str);
+	if(!online)
+		return 0;
+	avail=RingBufFree(&outbuf);
+	if(len>avail)
+		len=avail;
+	return RingBufWrite(&outbuf, (const BYTE*)str, len);
+}
+
+/****************************************************************************/
+/* Sends 'str', escaping Telnet IAC chars, in a single pass into outcom_buf	*/
+/* If not batching output, the staged output is sent immediately			*/
+/* Returns the number of chars of 'str' consumed							*/
+/****************************************************************************/
+int sbbs_t::putcom_iac(const char *str, size_t len)
+{
+	size_t	i;
+	bool	escape = !(telnet_mode&TELNET_MODE_OFF);
 
 	if(!len)
 		len=strlen(str);
-    for(i=0;i<len && online;i++)
-        if(outcom(str[i])!=0)
+	for(i=0;i<len;i++) {
+		if(outcom_buflen+2 > sizeof(outcom_buf) && outcom_flush()!=0)
 			break;
+		if(str[i]==(char)TELNET_IAC && escape)
+			outcom_buf[outcom_buflen++]=TELNET_IAC;	/* Must escape Telnet IAC char (255) */
+		outcom_buf[outcom_buflen++]=str[i];
+	}
+	if(!outcom_batch)
+		outcom_flush();
 	return i;
 }
 
+/****************************************************************************/
+/* Moves the staged (batched) output into the output ring buffer, one		*/
+/* RingBufWrite() per contiguous chunk of free space, waiting up to 3		*/
+/* minutes for the output_thread to make room								*/
+/* Returns 0 on success or TXBOF if the output buffer remained full			*/
+/****************************************************************************/
+int sbbs_t::outcom_flush(void)
+{
+	size_t	sent=0;
+	DWORD	avail;
+	int		i=0;
+
+	while(sent<outcom_buflen) {
+		if((avail=RingBufFree(&outbuf))==0) {
+			if(!online || ++i>=1440) 	/* 3 minute pause delay */
+				break;
+			if(sys_status&SS_SYSPAGE)
+				sbbs_beep(i,80);
+			else
+				mswait(80);
+			continue;
+		}
+		if(avail>outcom_buflen-sent)
+			avail=outcom_buflen-sent;
+		sent+=RingBufWrite(&outbuf, outcom_buf+sent, avail);
+	}
+	if(sent<outcom_buflen) {
+		if(i==1440) {							/* timeout - beep flush outbuf */
+			lprintf(LOG_NOTICE,"Node %d timeout(outcom_flush) %04X %04X"
+				,cfg.node_num, RingBufFull(&outbuf), rioctl(IOFO));
+			outcom_buflen=0;
+			outcom(BEL);
+			rioctl(IOCS|PAUSE);
+			return(TXBOF);
+		}
+		memmove(outcom_buf, outcom_buf+sent, outcom_buflen-sent);
+		outcom_buflen-=sent;
+		return(TXBOF);
+	}
+	outcom_buflen=0;
+	return(0);
+}
+
 /* Legacy Remote I/O Control Interface */
 int sbbs_t::rioctl(ushort action)
 {
@@ -3729,7 +4251,7 @@ int sbbs_t::rioctl(ushort action)
 		case RXBS:		/* Get receive buffer size */
 			return(inbuf.size);
 		case TXBC:		/* Get transmit buffer count */
-			return(RingBufFull(&outbuf));
+			return(RingBufFull(&outbuf)+outcom_buflen);
 		case TXBS:		/* Get transmit buffer size */
 			return(outbuf.size);
 		case TXBF:		/* Get transmit buffer free space */
@@ -3748,10 +4270,12 @@ int sbbs_t::rioctl(ushort action)
 			RingBufReInit(&inbuf);
 			break;
 		case IOFO:		/* Flush output buffer */
+			outcom_buflen=0;
     		RingBufReInit(&outbuf);
 			break;
 		case IOFB:		/* Flush both buffers */
 			RingBufReInit(&inbuf);
+			outcom_buflen=0;
 			RingBufReInit(&outbuf);
 			break;
 		case LFN81:
@@ -4814,6 +5338,30 @@ NO_SSH:
 	}
 	_beginthread(output_thread, 0, sbbs);
 
+#ifdef USE_EPOLL
+	memset(node_io,0,sizeof(node_io));
+	node_io_terminate=false;
+	if((node_io_epoll=epoll_create(MAX_NODES))==-1
+		|| (node_io_wakeup=eventfd(0, EFD_NONBLOCK))==-1) {
+		lprintf(LOG_WARNING,"!ERROR %d creating node I/O reactor, using I/O threads"
+			,ERROR_VALUE);
+		if(node_io_epoll!=-1) {
+			close(node_io_epoll);
+			node_io_epoll=-1;
+		}
+	}
+	else {
+		struct epoll_event ev;
+		memset(&ev,0,sizeof(ev));
+		ev.events=EPOLLIN;
+		ev.data.u64=NODE_IO_WAKEUP_KEY;
+		epoll_ctl(node_io_epoll, EPOLL_CTL_ADD, node_io_wakeup, &ev);
+		pthread_mutex_init(&node_io_mutex,NULL);
+		node_io_thread_running=true;
+		_beginthread(node_io_thread, 0, NULL);
+	}
+#endif
+
 	if(!(startup->options&BBS_OPT_NO_EVENTS)) {
 		events = new sbbs_t(0, server_addr
 			,"BBS Events", INVALID_SOCKET, &scfg, text, NULL);
@@ -4934,6 +5482,8 @@ NO_SSH:
 
 	while(!terminate_server) {
 
+		js_cache_expire();	/* free compiled scripts that have gone unused */
+
 		if(node_threads_running.value==0) {	/* check for re-run flags and recycle/shutdown sem files */
 			if(!(startup->options&BBS_OPT_NO_RECYCLE)) {
 
@@ -5484,8 +6034,13 @@ NO_PASSTHRU:
 #endif
 
 	    protected_uint32_adjust(&node_threads_running, 1);
-		new_node->input_thread=(HANDLE)_beginthread(input_thread,0, new_node);
-		_beginthread(output_thread, 0, new_node);
+#ifdef USE_EPOLL
+		if(!node_io_add(new_node))
+#endif
+		{
+			new_node->input_thread=(HANDLE)_beginthread(input_thread,0, new_node);
+			_beginthread(output_thread, 0, new_node);
+		}
 		_beginthread(node_thread, 0, new_node);
 		served++;
 	}
@@ -5532,6 +6087,24 @@ NO_PASSTHRU:
 		}
 	}
 
+#ifdef USE_EPOLL
+	// Wait for node I/O reactor thread to terminate
+	node_io_terminate=true;
+	if(node_io_thread_running) {
+		start=time(NULL);
+		while(node_io_thread_running) {
+			if(time(NULL)-start>TIMEOUT_THREAD_WAIT) {
+				lprintf(LOG_ERR,"!TIMEOUT waiting for node I/O reactor thread to "
+            		"terminate");
+				break;
+			}
+			mswait(100);
+		}
+	}
+	if(!node_io_thread_running)
+		pthread_mutex_destroy(&node_io_mutex);
+#endif
+
 	// Wait for Events thread to terminate
 	if(events!=NULL && events->event_thread_running) {
 		lprintf(LOG_INFO,"Waiting for events thread to terminate...");
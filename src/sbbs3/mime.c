@@ -90,22 +90,39 @@ void mimetextpartheader(SOCKET socket, char* boundary)
     sockprintf(socket,"Content-Transfer-Encoding: 7bit");
 }
 
+#define BASE64_LINE_BYTES	57	/* Encodes to 76 chars (the max per RFC2045) */
+#define BASE64_BLOCK_LINES	64	/* Lines encoded and sent at a time */
+
 BOOL base64out(SOCKET socket, char* pathfile)
 {
     FILE *  fp;
-    char    in[57];
-    char    out[77];
+    char    in[BASE64_LINE_BYTES*BASE64_BLOCK_LINES];
+    char    out[(B64_ENCODED_LEN(BASE64_LINE_BYTES)+2)*BASE64_BLOCK_LINES];
+    char*   outp;
+    int     i;
+    int     len;
     int     bytesread;
+    b64_state_t st;
 
     if((fp=fopen(pathfile,"rb"))==NULL) 
         return(FALSE);
     while(1) {
         bytesread=fread(in,1,sizeof(in),fp);
-		if((b64_encode(out,sizeof(out),in,bytesread)==-1)
-				|| !sockprintf(socket,out))  {
-			fclose(fp);
-			return(FALSE);
-		}
+        outp=out;
+        for(i=0;i<bytesread;i+=BASE64_LINE_BYTES) {
+            len=bytesread-i;
+            if(len>BASE64_LINE_BYTES)
+                len=BASE64_LINE_BYTES;
+            b64_init(&st);
+            outp+=b64_encode_update(&st,outp,(out+sizeof(out))-outp,in+i,len);
+            outp+=b64_encode_final(&st,outp,(out+sizeof(out))-outp);
+            *(outp++)='\r';
+            *(outp++)='\n';
+        }
+        if(outp>out && !sockwrite(socket,out,outp-out)) {
+            fclose(fp);
+            return(FALSE);
+        }
         if(bytesread!=sizeof(in) || feof(fp))
             break;
     }
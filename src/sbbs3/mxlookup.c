@@ -42,11 +42,15 @@
 
 /* ANSI */
 #include <stdio.h>
+#include <stdlib.h>		/* calloc */
 #include <string.h>		/* strchr */
+#include <time.h>		/* time, clock */
+#include <ctype.h>		/* tolower */
 
 /* Synchronet-specific */
 #include "sockwrap.h"
 #include "gen_defs.h"
+#include "genwrap.h"		/* msclock */
 #include "smbdefs.h"		/* _PACK */
 
 #if defined(_WIN32) || defined(__BORLANDC__)
@@ -173,8 +177,9 @@ void dump(BYTE* buf, int len)
 }
 #endif
 
+/* If ttl is non-NULL, it is set to the lowest TTL (in seconds) of the MX records found (or 0) */
 int dns_getmx(char* name, char* mx, char* mx2
-			  ,DWORD intf, DWORD ip_addr, BOOL use_tcp, int timeout)
+			  ,DWORD intf, DWORD ip_addr, BOOL use_tcp, int timeout, DWORD* ttl)
 {
 	char*			p;
 	char*			tp;
@@ -199,6 +204,8 @@ int dns_getmx(char* name, char* mx, char* mx2
 
 	mx[0]=0;
 	mx2[0]=0;
+	if(ttl!=NULL)
+		*ttl=0;
 
 	if(use_tcp) 
 		sock = mail_open_socket(SOCK_STREAM,"dns");
@@ -363,6 +370,8 @@ int dns_getmx(char* name, char* mx, char* mx2
 				p+=2;
 				namelen=0;
 				p+=dns_name(hostname, &namelen, sizeof(hostname)-1, msg+offset, p);
+				if(ttl!=NULL && (*ttl==0 || ntohl(rr->ttl) < *ttl))
+					*ttl=ntohl(rr->ttl);
 				if(pref<=highpref) {
 					highpref=pref;
 					if(mx[0])
@@ -386,12 +395,278 @@ int dns_getmx(char* name, char* mx, char* mx2
 	return(0);
 }
 
+/* Encodes a (UDP) query message for one record type of name */
+static int dns_query_msg(BYTE* msg, size_t maxlen, const char* name, WORD id, WORD type)
+{
+	const char*		p;
+	const char*		tp;
+	size_t			namelen;
+	int				len;
+	dns_msghdr_t	msghdr;
+	dns_query_t		query;
+
+	if(sizeof(msghdr)-sizeof(msghdr.length)+strlen(name)+2+sizeof(query) > maxlen)
+		return(-1);
+
+	memset(&msghdr,0,sizeof(msghdr));
+	msghdr.id=htons(id);
+	msghdr.bitfields=htons(DNS_RD);
+	msghdr.qdcount=htons(1);
+	query.type=htons(type);
+	query.class=htons(DNS_IN);
+
+	len=sizeof(msghdr)-sizeof(msghdr.length);	/* No length field (UDP) */
+	memcpy(msg,((BYTE*)&msghdr)+sizeof(msghdr.length),len);
+	for(p=name;*p;p+=namelen) {
+		if(*p=='.')
+			p++;
+		tp=strchr(p,'.');
+		if(tp)
+			namelen=tp-p;
+		else
+			namelen=strlen(p);
+		if(namelen>63)	/* Max label length */
+			return(-1);
+		*(msg+len)=(BYTE)namelen;
+		len++;
+		memcpy(msg+len,p,namelen);
+		len+=namelen;
+	}
+	*(msg+len)=0;	/* terminator */
+	len++;
+	memcpy(msg+len,&query,sizeof(query));
+	len+=sizeof(query);
+
+	return(len);
+}
+
+/* Returns TRUE if the (UDP) response 'msg' is for the query of name and id */
+static BOOL dns_question_matches(BYTE* msg, int len, const char* name, WORD id, WORD type)
+{
+	BYTE			query[512];
+	int				qlen;
+	int				i;
+	dns_msghdr_t	msghdr;
+
+	if((qlen=dns_query_msg(query,sizeof(query),name,id,type))<1 || len<qlen)
+		return(FALSE);
+	memcpy(((BYTE*)&msghdr)+sizeof(msghdr.length),msg,sizeof(msghdr)-sizeof(msghdr.length));
+	if(ntohs(msghdr.qdcount)!=1)
+		return(FALSE);
+	/* Compare the question section (name, type and class), ignoring case */
+	for(i=sizeof(msghdr)-sizeof(msghdr.length);i<qlen;i++)
+		if(tolower(msg[i])!=tolower(query[i]))
+			return(FALSE);
+	return(TRUE);
+}
+
+/* Returns pointer past the (possibly compressed) name at p, or NULL */
+static BYTE* dns_skip_name(BYTE* p, BYTE* end)
+{
+	while(p<end) {
+		if(((*p)&0xC0)==0xC0)	/* Compressed name (pointer) */
+			return(p+2);
+		if(*p==0)
+			return(p+1);
+		p+=(*p)+1;
+	}
+	return(NULL);
+}
+
+#define DNS_RETRANSMIT_INTERVAL	2000	/* ms */
+
+/****************************************************************************/
+/* Looks-up the address (A) records of 'count' names concurrently: all of	*/
+/* the queries are sent (via UDP) before waiting (up to 'timeout' seconds	*/
+/* in total) for the responses, and the unanswered queries are resent		*/
+/* every DNS_RETRANSMIT_INTERVAL milliseconds.								*/
+/* addr[n] is set to the first address for name[n] (in network byte order),	*/
+/* 0 if the name doesn't exist (or has no address), or INADDR_NONE if no	*/
+/* usable response was received.											*/
+/* If ttl is non-NULL, ttl[n] is set to the TTL of the address record.		*/
+/* Returns the number of responses received, or an error value.				*/
+/****************************************************************************/
+int dns_getaddrs(char** name, size_t count, DWORD* addr, DWORD* ttl
+				 ,DWORD intf, DWORD ip_addr, int timeout)
+{
+	BYTE*			p;
+	BYTE*			end;
+	BYTE*			answered;
+	BYTE			msg[512];
+	WORD			id;
+	WORD			rcode;
+	WORD			rrs;
+	size_t			n;
+	size_t			responses=0;
+	int				len;
+	int				rd;
+	int				result;
+	msclock_t		start;
+	msclock_t		now;
+	msclock_t		deadline;
+	msclock_t		retransmit;
+	msclock_t		wait;
+	SOCKET			sock;
+	SOCKADDR_IN		sa={0};
+	dns_msghdr_t	msghdr;
+	dns_rr_t		rr;
+	struct timeval	tv;
+	fd_set			socket_set;
+
+	for(n=0;n<count;n++) {
+		addr[n]=INADDR_NONE;
+		if(ttl!=NULL)
+			ttl[n]=0;
+	}
+	if(count<1)
+		return(0);
+
+	if((answered=(BYTE*)calloc(count,sizeof(BYTE)))==NULL)
+		return(-1);
+
+	if((sock=mail_open_socket(SOCK_DGRAM,"dns"))==INVALID_SOCKET) {
+		free(answered);
+		return(ERROR_VALUE);
+	}
+
+	sa.sin_addr.s_addr = htonl(intf);
+	sa.sin_family = AF_INET;
+	sa.sin_port   = 0;
+
+	if(bind(sock,(struct sockaddr *)&sa, sizeof(sa))!=0) {
+		result=ERROR_VALUE;
+		mail_close_socket(sock);
+		free(answered);
+		return(result);
+	}
+
+	memset(&sa,0,sizeof(sa));
+	sa.sin_addr.s_addr = ip_addr;
+	sa.sin_family = AF_INET;
+	sa.sin_port   = htons(53);
+
+	if(connect(sock, (struct sockaddr *)&sa, sizeof(sa))!=0) {
+		result=ERROR_VALUE;
+		mail_close_socket(sock);
+		free(answered);
+		return(result);
+	}
+
+	/* The message ID identifies the name */
+	id=(WORD)(time(NULL)^(ulong)clock());
+	for(n=0;n<count;n++) {
+		if(dns_query_msg(msg,sizeof(msg),name[n],(WORD)(id+n),DNS_A)<1) {
+			addr[n]=0;	/* Invalid name */
+			answered[n]=TRUE;
+			responses++;
+		}
+	}
+
+	/* Send all of the queries, collect the responses in whatever order	*/
+	/* they arrive, and resend the unanswered queries (UDP datagrams may	*/
+	/* be lost) every DNS_RETRANSMIT_INTERVAL until the timeout				*/
+	start=msclock();
+	deadline=start+timeout*MSCLOCKS_PER_SEC;
+	retransmit=start;
+	while(responses<count && (now=msclock())<deadline) {
+		if(now>=retransmit) {
+			for(n=0;n<count;n++) {
+				if(answered[n])
+					continue;
+				len=dns_query_msg(msg,sizeof(msg),name[n],(WORD)(id+n),DNS_A);
+#if defined(MX_LOOKUP_TEST)
+				printf("Sending ");
+				dump(msg,len);
+#endif
+				if(send(sock,msg,len,0)!=len)
+					break;
+			}
+			if(n<count) {
+				if(retransmit==start) {	/* Nothing sent */
+					result=ERROR_VALUE;
+					mail_close_socket(sock);
+					free(answered);
+					return(result);
+				}
+				break;
+			}
+			retransmit=now+DNS_RETRANSMIT_INTERVAL*MSCLOCKS_PER_SEC/1000;
+		}
+		wait=(retransmit<deadline ? retransmit : deadline)-now;
+		tv.tv_sec=wait/MSCLOCKS_PER_SEC;
+		tv.tv_usec=(wait%MSCLOCKS_PER_SEC)*(1000000/MSCLOCKS_PER_SEC);
+
+		FD_ZERO(&socket_set);
+		FD_SET(sock,&socket_set);
+
+		if((result=select(sock+1,&socket_set,NULL,NULL,&tv))<0)
+			break;
+		if(result==0)	/* Time to retransmit (or give up) */
+			continue;
+
+		rd=recv(sock,msg,sizeof(msg),0);
+		if(rd==SOCKET_ERROR)
+			break;
+		if(rd<(int)(sizeof(msghdr)-sizeof(msghdr.length)))
+			continue;
+		memcpy(((BYTE*)&msghdr)+sizeof(msghdr.length),msg,sizeof(msghdr)-sizeof(msghdr.length));
+#if defined(MX_LOOKUP_TEST)
+		printf("Received ");
+		dump(msg,rd);
+#endif
+		n=(WORD)(ntohs(msghdr.id)-id);
+		if(n>=count || answered[n] || !(ntohs(msghdr.bitfields)&DNS_QR))
+			continue;
+		if(!dns_question_matches(msg,rd,name[n],ntohs(msghdr.id),DNS_A))
+			continue;	/* not a response to our query */
+		answered[n]=TRUE;
+		responses++;
+
+		rcode=ntohs(msghdr.bitfields)&DNS_RCODE_MASK;
+		if(rcode==DNS_RCODE_NAME) {
+			addr[n]=0;
+			continue;
+		}
+		if(rcode!=DNS_RCODE_OK)
+			continue;
+		addr[n]=0;
+
+		p=msg+sizeof(msghdr)-sizeof(msghdr.length);
+		end=msg+rd;
+		for(rrs=ntohs(msghdr.qdcount); rrs && p!=NULL; rrs--) {
+			if((p=dns_skip_name(p,end))!=NULL)
+				p+=sizeof(dns_query_t);
+		}
+		for(rrs=ntohs(msghdr.ancount); rrs && p!=NULL; rrs--) {
+			if((p=dns_skip_name(p,end))==NULL || p+sizeof(rr)>end)
+				break;
+			memcpy(&rr,p,sizeof(rr));
+			p+=sizeof(rr);
+			len=ntohs(rr.length);
+			if(p+len>end)
+				break;
+			if(ntohs(rr.type)==DNS_A && len==sizeof(DWORD)) {
+				memcpy(&addr[n],p,sizeof(DWORD));
+				if(ttl!=NULL)
+					ttl[n]=ntohl(rr.ttl);
+				break;
+			}
+			p+=len;	/* e.g. CNAME */
+		}
+	}
+
+	mail_close_socket(sock);
+	free(answered);
+	return(responses);
+}
+
 #ifdef MX_LOOKUP_TEST
 void main(int argc, char **argv)
 {
 	char		mx[128],mx2[128];
 	int			result;
 	DWORD		bindaddr=0;
+	DWORD		ttl;
 #ifdef _WIN32
 	WSADATA		WSAData;
 #endif
@@ -416,11 +691,12 @@ void main(int argc, char **argv)
 	if(argc > 3)
 		bindaddr=ntohl(inet_addr(argv[3]));
 
-	if((result=dns_getmx(argv[1],mx,mx2,bindaddr,inet_addr(argv[2]),FALSE,60))!=0) 
+	if((result=dns_getmx(argv[1],mx,mx2,bindaddr,inet_addr(argv[2]),FALSE,60,&ttl))!=0) 
 		printf("Error %d getting mx record\n",result);
 	else {
 		printf("MX1: %s\n",mx);
 		printf("MX2: %s\n",mx2);
+		printf("TTL: %lu\n",ttl);
 	}
 
 #ifdef _WIN32
@@ -37,6 +37,123 @@
 
 #include "sbbs.h"
 
+/****************************************************************************/
+/* Display file cache, shared by all nodes: the contents of recently		*/
+/* displayed files (menus, logon screens, etc.), re-read only when a file's	*/
+/* modification time or size changes. Entries being displayed are reference */
+/* counted, so a replaced entry is freed by the last node displaying it.	*/
+/****************************************************************************/
+#define DISPLAY_CACHE_FILES		64
+#define DISPLAY_CACHE_MAX_LEN	(128*1024)	/* Larger files aren't cached */
+
+typedef struct {
+	char	path[MAX_PATH+1];
+	time_t	mtime;
+	long	length;
+	time_t	loaded;
+	ulong	used;				/* For least-recently-used replacement */
+	int		refs;				/* Number of displays in progress (+1 if cached) */
+	char*	buf;				/* NULL-terminated file contents */
+} display_file_t;
+
+static display_file_t*	display_cache[DISPLAY_CACHE_FILES];
+static ulong			display_cache_used;
+static pthread_mutex_t	display_cache_mutex;
+static pthread_once_t	display_cache_once=PTHREAD_ONCE_INIT;
+
+/* Nodes start concurrently, so this is ran once by whichever displays first */
+static void display_cache_init(void)
+{
+	pthread_mutex_init(&display_cache_mutex,NULL);
+}
+
+/* Must be called with display_cache_mutex locked */
+static void display_cache_release(display_file_t* df)
+{
+	if(--df->refs<1)
+		free(df);
+}
+
+/* Returns a referenced entry or NULL if the file isn't (or can't be) cached */
+static display_file_t* display_cache_open(const char* path)
+{
+	int		i;
+	int		file;
+	long	length;
+	time_t	now;
+	struct stat st;
+	display_file_t* df=NULL;
+	display_file_t** slot=NULL;
+
+	if(stat(path,&st)!=0 || (st.st_mode&S_IFDIR))
+		return(NULL);
+	length=(long)st.st_size;
+	if(length>DISPLAY_CACHE_MAX_LEN)
+		return(NULL);
+
+	now=time(NULL);
+	pthread_once(&display_cache_once,display_cache_init);
+	pthread_mutex_lock(&display_cache_mutex);
+	for(i=0;i<DISPLAY_CACHE_FILES;i++) {
+		if(display_cache[i]!=NULL && strcmp(display_cache[i]->path,path)==0) {
+			slot=&display_cache[i];
+			break;
+		}
+		if(slot==NULL || display_cache[i]==NULL
+			|| (*slot!=NULL && display_cache[i]->used<(*slot)->used))
+			slot=&display_cache[i];
+	}
+	df=*slot;
+	/* A file modified in the second it was read may have changed since */
+	if(df!=NULL && strcmp(df->path,path)==0
+		&& df->mtime==st.st_mtime && df->length==length && df->loaded>df->mtime+1) {
+		df->used=++display_cache_used;
+		df->refs++;
+		pthread_mutex_unlock(&display_cache_mutex);
+		return(df);
+	}
+	if(df!=NULL) {	/* replace */
+		*slot=NULL;
+		display_cache_release(df);
+	}
+	pthread_mutex_unlock(&display_cache_mutex);
+
+	if((df=(display_file_t*)malloc(sizeof(display_file_t)+length+1))==NULL)
+		return(NULL);
+	df->buf=(char*)(df+1);
+	if((file=nopen(path,O_RDONLY|O_DENYNONE))==-1) {
+		free(df);
+		return(NULL);
+	}
+	if(lread(file,df->buf,length)!=length) {
+		close(file);
+		free(df);
+		return(NULL);
+	}
+	close(file);
+	df->buf[length]=0;
+	SAFECOPY(df->path,path);
+	df->mtime=st.st_mtime;
+	df->length=length;
+	df->loaded=now;
+	df->refs=2;		/* the cache's and the caller's */
+
+	pthread_mutex_lock(&display_cache_mutex);
+	df->used=++display_cache_used;
+	if(*slot!=NULL)	/* another node cached a file here meanwhile */
+		display_cache_release(*slot);
+	*slot=df;
+	pthread_mutex_unlock(&display_cache_mutex);
+	return(df);
+}
+
+static void display_cache_close(display_file_t* df)
+{
+	pthread_mutex_lock(&display_cache_mutex);
+	display_cache_release(df);
+	pthread_mutex_unlock(&display_cache_mutex);
+}
+
 /****************************************************************************/
 /* Prints a file remotely and locally, interpreting ^A sequences, checks    */
 /* for pauses, aborts and ANSI. 'str' is the path of the file to print      */
@@ -50,6 +167,7 @@ void sbbs_t::printfile(char *str, long mode)
 	BOOL wip=FALSE,rip=FALSE,html=FALSE;
 	long l,length,savcon=console;
 	FILE *stream;
+	display_file_t* df;
 
 	p=strrchr(str,'.');
 	if(p!=NULL) {
@@ -78,7 +196,11 @@ void sbbs_t::printfile(char *str, long mode)
 	if(!(mode&P_NOCRLF) && !tos && !wip && !rip && !html)
 		CRLF;
 
-	if((stream=fnopen(&file,str,O_RDONLY|O_DENYNONE))==NULL) {
+	if((df=display_cache_open(str))!=NULL) {
+		putmsg(df->buf,mode);
+		display_cache_close(df);
+	}
+	else if((stream=fnopen(&file,str,O_RDONLY|O_DENYNONE))==NULL) {
 		lprintf(LOG_NOTICE,"Node %d !Error %d (%s) opening: %s"
 			,cfg.node_num,errno,strerror(errno),str);
 		bputs(text[FileNotFound]);
@@ -86,27 +208,28 @@ void sbbs_t::printfile(char *str, long mode)
 		CRLF;
 		return; 
 	}
-
-	length=(long)filelength(file);
-	if(length<0) {
-		close(file);
-		errormsg(WHERE,ERR_CHK,str,length);
-		return;
-	}
-	if((buf=(char*)malloc(length+1L))==NULL) {
-		close(file);
-		errormsg(WHERE,ERR_ALLOC,str,length+1L);
-		return; 
-	}
-	l=lread(file,buf,length);
-	fclose(stream);
-	if(l!=length)
-		errormsg(WHERE,ERR_READ,str,length);
-	else {
-		buf[l]=0;
-		putmsg(buf,mode);
+	else {	/* too large to cache */
+		length=(long)filelength(file);
+		if(length<0) {
+			close(file);
+			errormsg(WHERE,ERR_CHK,str,length);
+			return;
+		}
+		if((buf=(char*)malloc(length+1L))==NULL) {
+			close(file);
+			errormsg(WHERE,ERR_ALLOC,str,length+1L);
+			return; 
+		}
+		l=lread(file,buf,length);
+		fclose(stream);
+		if(l!=length)
+			errormsg(WHERE,ERR_READ,str,length);
+		else {
+			buf[l]=0;
+			putmsg(buf,mode);
+		}
+		free(buf); 
 	}
-	free(buf); 
 
 	if((mode&P_NOABORT || wip || rip || html) && online==ON_REMOTE) {
 		SYNC;
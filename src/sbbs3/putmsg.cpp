@@ -60,12 +60,13 @@ char sbbs_t::putmsg(const char *buf, long mode)
 
 	attr_sp=0;	/* clear any saved attributes */
 	tmpatr=curatr;	/* was lclatr(-1) */
+	outcom_begin();
 	if(!(mode&P_SAVEATR))
 		attr(LIGHTGRAY);
 	if(mode&P_NOPAUSE)
 		sys_status|=SS_PAUSEOFF;
 	if(mode&P_HTML)
-		putcom("\x02\x02");
+		putcom_iac("\x02\x02");
 	if(mode&P_WORDWRAP) {
 		char *wrapped;
 		if((wrapped=::wordwrap((char*)buf, cols, 79, /* handle_quotes: */TRUE)) == NULL)
@@ -277,13 +278,14 @@ char sbbs_t::putmsg(const char *buf, long mode)
 		} 
 	}
 	if(mode&P_HTML)
-		putcom("\x02");
+		putcom_iac("\x02");
 	if(!(mode&P_SAVEATR)) {
 		console=orgcon;
 		attr(tmpatr); 
 	}
 
 	attr_sp=0;	/* clear any saved attributes */
+	outcom_end();
 
 	/* Handle defered pauses */
 	if(defered_pause) {
@@ -91,8 +91,7 @@ int sbbs_t::putnodedat(uint number, node_t* node)
 	number--;	/* make zero based */
 	lock(nodefile,(long)number*sizeof(node_t),sizeof(node_t));
 	for(attempts=0;attempts<10;attempts++) {
-		lseek(nodefile,(long)number*sizeof(node_t),SEEK_SET);
-		wr=write(nodefile,node,sizeof(node_t));
+		wr=writenodedat(&cfg,number+1,node,nodefile);
 		if(wr==sizeof(node_t))
 			break;
 		wrerr=errno;	/* save write error */
@@ -180,7 +180,7 @@ post_t * sbbs_t::loadposts(uint32_t *posts, uint subnum, ulong ptr, long mode, u
 	char name[128];
 	ushort aliascrc,namecrc,sysop;
 	int i,skip;
-	ulong l=0,total,alloc_len;
+	ulong l=0,n,total,alloc_len;
 	smbmsg_t msg;
 	idxrec_t idx;
 	post_t *post;
@@ -195,7 +195,12 @@ post_t * sbbs_t::loadposts(uint32_t *posts, uint subnum, ulong ptr, long mode, u
 		return(NULL); 
 	}
 
-	total=(long)filelength(fileno(smb.sid_fp))/sizeof(idxrec_t); /* total msgs in sub */
+	if((i=smb_loadidx(&smb))!=SMB_SUCCESS) {	/* cached for subsequent lookups too */
+		smb_unlocksmbhdr(&smb);
+		errormsg(WHERE,ERR_READ,smb.file,i,smb.last_error);
+		return(NULL);
+	}
+	total=smb.idx_cache_total; /* total msgs in sub */
 
 	if(!total) {			/* empty */
 		smb_unlocksmbhdr(&smb);
@@ -210,8 +215,6 @@ post_t * sbbs_t::loadposts(uint32_t *posts, uint subnum, ulong ptr, long mode, u
 	aliascrc=crc16(name,0);
 	sysop=crc16("sysop",0);
 
-	rewind(smb.sid_fp);
-
 	alloc_len=sizeof(post_t)*total;
 	#ifdef __OS2__
 		while(alloc_len%4096)
@@ -226,10 +229,9 @@ post_t * sbbs_t::loadposts(uint32_t *posts, uint subnum, ulong ptr, long mode, u
 	if(unvalidated_num)
 		*unvalidated_num=ULONG_MAX;
 
-	while(!feof(smb.sid_fp)) {
+	for(n=0;n<total;n++) {
 		skip=0;
-		if(smb_fread(&smb, &idx,sizeof(idx),smb.sid_fp) != sizeof(idx))
-			break;
+		idx=smb.idx_cache[n];
 
 		if(idx.number==0)	/* invalid message number, ignore */
 			continue;
@@ -371,6 +373,7 @@ int sbbs_t::scanposts(uint subnum, long mode, const char *find)
 	uint32_t u;
 	post_t	*post;
 	smbmsg_t	msg;
+	smbfts_t	fts;
 
 	find_buf[0]=0;
 	cursubnum=subnum;	/* for ARS */
@@ -496,6 +499,9 @@ int sbbs_t::scanposts(uint subnum, long mode, const char *find)
 		putnodedat(cfg.node_num,&thisnode); 
 	}
 	current_msg=&msg;	/* For MSG_* @-codes and bbs.msg_* property values */
+	memset(&fts,0,sizeof(fts));
+	if(mode&SCAN_FIND)
+		smb_fts_search(&smb,find,&fts);
 	while(online && !done) {
 
 		action=NODE_RMSG;
@@ -581,7 +587,10 @@ int sbbs_t::scanposts(uint subnum, long mode, const char *find)
 		if(domsg && !(sys_status&SS_ABORT)) {
 
 			if(do_find && mode&SCAN_FIND) { 			/* Find text in messages */
-				buf=smb_getmsgtxt(&smb,&msg,GETMSGTXT_ALL);
+				if(smb_fts_candidate(&fts,msg.hdr.number))
+					buf=smb_getmsgtxt(&smb,&msg,GETMSGTXT_ALL);
+				else
+					buf=NULL;	/* Can't contain the text, per the index */
 				if(!buf) {
 					if(smb.curmsg<smb.msgs-1) 
 						smb.curmsg++;
@@ -752,6 +761,7 @@ int sbbs_t::scanposts(uint subnum, long mode, const char *find)
 					smb_freemsgmem(&msg);
 				if(post)
 					free(post);
+				smb_fts_free(&fts);
 				smb_close(&smb);
 				smb_stack(&smb,SMB_STACK_POP);
 				current_msg=NULL;
@@ -860,6 +870,8 @@ int sbbs_t::scanposts(uint subnum, long mode, const char *find)
 					find=find_buf;
 					mode|=SCAN_FIND;
 					domsg=1;
+					smb_fts_free(&fts);
+					smb_fts_search(&smb,find,&fts);
 				}
 				break;
 			case 'I':   /* Sub-board information */
@@ -1185,6 +1197,7 @@ int sbbs_t::scanposts(uint subnum, long mode, const char *find)
 	if(!(org_mode&(SCAN_CONST|SCAN_TOYOU|SCAN_FIND))
 		&& !(subscan[subnum].cfg&SUB_CFG_NSCAN) && text[AddSubToNewScanQ][0] && yesno(text[AddSubToNewScanQ]))
 		subscan[subnum].cfg|=SUB_CFG_NSCAN;
+	smb_fts_free(&fts);
 	smb_close(&smb);
 	smb_stack(&smb,SMB_STACK_POP);
 	current_msg=NULL;
@@ -1244,9 +1257,13 @@ long sbbs_t::searchposts(uint subnum, post_t *post, long start, long posts
 	char	subj[128];
 	long	l,found=0;
 	smbmsg_t msg;
+	smbfts_t fts;
 
 	msg.total_hfields=0;
+	smb_fts_search(&smb,search,&fts);
 	for(l=start;l<posts && !msgabort();l++) {
+		if(!smb_fts_candidate(&fts,post[l].number))
+			continue;
 		msg.idx.offset=post[l].offset;
 		if(!loadmsg(&msg,post[l].number))
 			continue;
@@ -1283,6 +1300,7 @@ long sbbs_t::searchposts(uint subnum, post_t *post, long start, long posts
 		free(buf);
 		smb_freemsgmem(&msg); 
 	}
+	smb_fts_free(&fts);
 
 	return(found);
 }
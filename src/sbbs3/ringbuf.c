@@ -74,6 +74,39 @@
 	void *(*rb_memcpy)(void *, const void *, size_t);
 
 #endif
+
+/* Atomic access to the head and tail pointers, required for the			*/
+/* lock-free (RINGBUF_SINGLE_*) modes										*/
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7))
+	#define RINGBUF_ATOMIC
+	#define rb_load(ptr)			__atomic_load_n(&(ptr), __ATOMIC_SEQ_CST)
+	#define rb_store(ptr, val)		__atomic_store_n(&(ptr), (val), __ATOMIC_SEQ_CST)
+	#define rb_cas(ptr, cmp, val)	__sync_bool_compare_and_swap(&(ptr), (cmp), (val))
+#elif defined(_MSC_VER)
+	#define RINGBUF_ATOMIC
+	#define rb_load(ptr)			((BYTE*)InterlockedCompareExchangePointer((PVOID volatile*)&(ptr), NULL, NULL))
+	#define rb_store(ptr, val)		InterlockedExchangePointer((PVOID volatile*)&(ptr), (val))
+	#define rb_cas(ptr, cmp, val)	(InterlockedCompareExchangePointer((PVOID volatile*)&(ptr), (val), (cmp))==(cmp))
+#else	/* No atomics available: the mode is ignored (always mutex protected) */
+	#define rb_load(ptr)			(ptr)
+	#define rb_store(ptr, val)		((ptr)=(val))
+	#define rb_cas(ptr, cmp, val)	((ptr)=(val),TRUE)
+#endif
+
+#ifdef RINGBUF_ATOMIC
+	#define RINGBUF_LOCKFREE(rb)	((rb)->mode)
+#else
+	#define RINGBUF_LOCKFREE(rb)	0
+#endif
+
+#ifdef RINGBUF_MUTEX
+	#define rb_lock(rb, side)		if(!(RINGBUF_LOCKFREE(rb)&(side))) pthread_mutex_lock(&(rb)->mutex)
+	#define rb_unlock(rb, side)		if(!(RINGBUF_LOCKFREE(rb)&(side))) pthread_mutex_unlock(&(rb)->mutex)
+#else
+	#define rb_lock(rb, side)
+	#define rb_unlock(rb, side)
+#endif
+
 /****************************************************************************/
 /* Returns 0 on success, non-zero on failure								*/
 /****************************************************************************/
@@ -134,13 +167,55 @@ void RINGBUFCALL RingBufDispose( RingBuf* rb)
 	memset(rb,0,sizeof(RingBuf));
 }
 
-#define RINGBUF_FILL_LEVEL(rb)	(rb->pHead >= rb->pTail ? (rb->pHead - rb->pTail) \
-								: (rb->size - (rb->pTail - (rb->pHead + 1))))
+#define RINGBUF_LEVEL(rb, head, tail)	((head) >= (tail) ? (DWORD)((head) - (tail)) \
+								: (DWORD)((rb)->size - ((tail) - ((head) + 1))))
+#define RINGBUF_FILL_LEVEL(rb)	rb_fill_level(rb)
+
+static DWORD rb_fill_level( RingBuf* rb )
+{
+	BYTE*	head = rb_load(rb->pHead);
+	BYTE*	tail = rb_load(rb->pTail);
+
+	return RINGBUF_LEVEL(rb, head, tail);
+}
+
+/* Clear the "data waiting" signals after the consumer emptied the buffer	*/
+/* In the lock-free modes, the producer may have written (and signaled)		*/
+/* in the meantime, so re-check after resetting								*/
+static void rb_signal_read( RingBuf* rb )
+{
+#if defined(RINGBUF_SEM) || defined(RINGBUF_EVENT)
+	DWORD	fill = RINGBUF_FILL_LEVEL(rb);
+#endif
+
+#ifdef RINGBUF_SEM
+	if(fill == 0) {						/* empty */
+		sem_reset(&rb->sem);
+		if(RINGBUF_LOCKFREE(rb) && RINGBUF_FILL_LEVEL(rb))
+			sem_post(&rb->sem);
+	}
+	if(fill < rb->highwater_mark) {
+		sem_reset(&rb->highwater_sem);
+		if(RINGBUF_LOCKFREE(rb) && RINGBUF_FILL_LEVEL(rb) >= rb->highwater_mark)
+			sem_post(&rb->highwater_sem);
+	}
+#endif
+#ifdef RINGBUF_EVENT
+	if(rb->empty_event!=NULL && fill==0) {
+		SetEvent(rb->empty_event);
+		if(RINGBUF_LOCKFREE(rb) && RINGBUF_FILL_LEVEL(rb))
+			ResetEvent(rb->empty_event);
+	}
+#endif
+}
 
 DWORD RINGBUFCALL RingBufFull( RingBuf* rb )
 {
 	DWORD	retval;
 
+	if(RINGBUF_LOCKFREE(rb))
+		return RINGBUF_FILL_LEVEL(rb);
+
 #ifdef RINGBUF_MUTEX
 	pthread_mutex_lock(&rb->mutex);
 #endif
@@ -165,7 +240,11 @@ DWORD RINGBUFCALL RingBufFree( RingBuf* rb )
 
 DWORD RINGBUFCALL RingBufWrite( RingBuf* rb, const BYTE* src,  DWORD cnt )
 {
-	DWORD max, first, remain;
+	DWORD	max, first, remain;
+#if defined(RINGBUF_SEM) || defined(RINGBUF_EVENT)
+	DWORD	fill;
+#endif
+	BYTE*	head;
 
 	if(cnt==0)
 		return(cnt);
@@ -173,12 +252,12 @@ DWORD RINGBUFCALL RingBufWrite( RingBuf* rb, const BYTE* src,  DWORD cnt )
 	if(rb->pStart==NULL)
 		return(0);
 
-#ifdef RINGBUF_MUTEX
-	pthread_mutex_lock(&rb->mutex);
-#endif
+	rb_lock(rb, RINGBUF_SINGLE_PRODUCER);
+
+	head = rb_load(rb->pHead);
 
     /* allowed to write at pEnd */
-	max = rb->pEnd - rb->pHead + 1;
+	max = rb->pEnd - head + 1;
 
 	/*
 	 * we assume the caller has checked that there is enough room. For this reason
@@ -193,33 +272,49 @@ DWORD RINGBUFCALL RingBufWrite( RingBuf* rb, const BYTE* src,  DWORD cnt )
 		remain = cnt - first;
 	}
 
-	rb_memcpy( rb->pHead, src, first );
-	rb->pHead += first;
+	rb_memcpy( head, src, first );
+	head += first;
     src += first;
 
 	if(remain) {
 
-		rb->pHead = rb->pStart;
-		rb_memcpy(rb->pHead, src, remain);
-		rb->pHead += remain;
+		head = rb->pStart;
+		rb_memcpy(head, src, remain);
+		head += remain;
 	}
 
-    if(rb->pHead > rb->pEnd)
-    	rb->pHead = rb->pStart;
+	if(head > rb->pEnd) {
+		head = rb->pStart;
+	}
+
+	rb_store(rb->pHead, head);	/* publish the new data */
+
+#if defined(RINGBUF_SEM) || defined(RINGBUF_EVENT)
+	fill = RINGBUF_FILL_LEVEL(rb);
+#endif
 
+	/* Lock-free: only signal "data" when the buffer was empty (consumer	*/
+	/* waiting), but "highwater" after every write that leaves the level at	*/
+	/* or above the mark, since the consumer may have taken the last post	*/
+	/* without reading below the mark										*/
 #ifdef RINGBUF_SEM
-	sem_post(&rb->sem);
-	if(rb->highwater_mark!=0 && RINGBUF_FILL_LEVEL(rb)>=rb->highwater_mark)
+	if(!RINGBUF_LOCKFREE(rb) || fill <= cnt) {
+		sem_post(&rb->sem);
+		if(rb->notify!=NULL)
+			rb->notify(rb->notify_arg);
+	}
+	if(rb->highwater_mark!=0 && fill>=rb->highwater_mark) {
 		sem_post(&rb->highwater_sem);
+		if(rb->notify!=NULL)
+			rb->notify(rb->notify_arg);
+	}
 #endif
 #ifdef RINGBUF_EVENT
-	if(rb->empty_event!=NULL)
+	if(rb->empty_event!=NULL && (!RINGBUF_LOCKFREE(rb) || fill <= cnt))
 		ResetEvent(rb->empty_event);
 #endif
 
-#ifdef RINGBUF_MUTEX
-	pthread_mutex_unlock(&rb->mutex);
-#endif
+	rb_unlock(rb, RINGBUF_SINGLE_PRODUCER);
 
 	return(cnt);
 }
@@ -227,19 +322,20 @@ DWORD RINGBUFCALL RingBufWrite( RingBuf* rb, const BYTE* src,  DWORD cnt )
 /* Pass NULL dst to just foward pointer (after Peek) */
 DWORD RINGBUFCALL RingBufRead( RingBuf* rb, BYTE* dst,  DWORD cnt )
 {
-	DWORD max, first, remain, len;
+	DWORD	max, first, remain, len;
+	BYTE*	tail;
+	BYTE*	orig_tail;
 
-#ifdef RINGBUF_MUTEX
-	pthread_mutex_lock(&rb->mutex);
-#endif
+	rb_lock(rb, RINGBUF_SINGLE_CONSUMER);
 
-	len = RINGBUF_FILL_LEVEL(rb);
+	orig_tail = tail = rb_load(rb->pTail);
+	len = RINGBUF_LEVEL(rb, rb_load(rb->pHead), tail);
 
 	if( len < cnt )
         cnt = len;
 
 	/* allowed to read at pEnd */
-	max = rb->pEnd - rb->pTail + 1;
+	max = rb->pEnd - tail + 1;
 
 	if( max >= cnt ) {
 		first = cnt;
@@ -250,58 +346,55 @@ DWORD RINGBUFCALL RingBufRead( RingBuf* rb, BYTE* dst,  DWORD cnt )
 	}
 
     if(first && dst!=NULL) {
-		rb_memcpy( dst, rb->pTail, first );
+		rb_memcpy( dst, tail, first );
 		dst += first;
     }
-	rb->pTail += first;
+	tail += first;
 
 	if( remain ){
 
-		rb->pTail = rb->pStart;
+		tail = rb->pStart;
         if(dst!=NULL)
-			rb_memcpy( dst, rb->pTail, remain );
-		rb->pTail += remain;
+			rb_memcpy( dst, tail, remain );
+		tail += remain;
 	}
 
-    if(rb->pTail > rb->pEnd)
-		rb->pTail = rb->pStart;
+	if(tail > rb->pEnd) {
+		tail = rb->pStart;
+	}
 
-#ifdef RINGBUF_SEM		/* clear/signal semaphores, if appropriate */
-	if(RINGBUF_FILL_LEVEL(rb) == 0)		/* empty */
-		sem_reset(&rb->sem);
-	if(RINGBUF_FILL_LEVEL(rb) < rb->highwater_mark)
-		sem_reset(&rb->highwater_sem);
-#endif
+	if(RINGBUF_LOCKFREE(rb))
+		rb_cas(rb->pTail, orig_tail, tail);	/* fails if purged by RingBufReInit() */
+	else
+		rb_store(rb->pTail, tail);
 
-#ifdef RINGBUF_EVENT
-	if(rb->empty_event!=NULL && RINGBUF_FILL_LEVEL(rb)==0)
-		SetEvent(rb->empty_event);
-#endif
+	/* clear/signal semaphores, if appropriate */
+	rb_signal_read(rb);
 
-#ifdef RINGBUF_MUTEX
-	pthread_mutex_unlock(&rb->mutex);
-#endif
+	rb_unlock(rb, RINGBUF_SINGLE_CONSUMER);
 
 	return(cnt);
 }
 
 DWORD RINGBUFCALL RingBufPeek( RingBuf* rb, BYTE* dst,  DWORD cnt)
 {
-	DWORD max, first, remain, len;
+	DWORD	max, first, remain, len;
+	BYTE*	tail;
 
 	len = RingBufFull( rb );
 	if( len == 0 )
 		return(0);
 
-#ifdef RINGBUF_MUTEX
-	pthread_mutex_lock(&rb->mutex);
-#endif
+	rb_lock(rb, RINGBUF_SINGLE_CONSUMER);
+
+	tail = rb_load(rb->pTail);
+	len = RINGBUF_LEVEL(rb, rb_load(rb->pHead), tail);
 
 	if( len < cnt )
         cnt = len;
 
     /* allowed to read at pEnd */
-	max = rb->pEnd - rb->pTail + 1;
+	max = rb->pEnd - tail + 1;
 
 	if( max >= cnt ) {
 		first = cnt;
@@ -311,16 +404,14 @@ DWORD RINGBUFCALL RingBufPeek( RingBuf* rb, BYTE* dst,  DWORD cnt)
 		remain = cnt - first;
 	}
 
-	rb_memcpy( dst, rb->pTail, first );
+	rb_memcpy( dst, tail, first );
 	dst += first;
 
 	if(remain) {
 		rb_memcpy( dst, rb->pStart, remain );
 	}
 
-#ifdef RINGBUF_MUTEX
-	pthread_mutex_unlock(&rb->mutex);
-#endif
+	rb_unlock(rb, RINGBUF_SINGLE_CONSUMER);
 
 	return(cnt);
 }
@@ -328,6 +419,31 @@ DWORD RINGBUFCALL RingBufPeek( RingBuf* rb, BYTE* dst,  DWORD cnt)
 /* Reset head and tail pointers */
 void RINGBUFCALL RingBufReInit(RingBuf* rb)
 {
+	BYTE*	head;
+	BYTE*	tail;
+
+	if(RINGBUF_LOCKFREE(rb)) {
+		/* The head belongs to the producer, so purge by advancing the tail */
+		do {
+			tail = rb_load(rb->pTail);
+			head = rb_load(rb->pHead);
+		} while(tail != head && !rb_cas(rb->pTail, tail, head));
+#ifdef RINGBUF_SEM
+		sem_reset(&rb->sem);
+		sem_reset(&rb->highwater_sem);
+		if(RINGBUF_FILL_LEVEL(rb))		/* written since purged */
+			sem_post(&rb->sem);
+#endif
+#ifdef RINGBUF_EVENT
+		if(rb->empty_event!=NULL) {
+			SetEvent(rb->empty_event);
+			if(RINGBUF_FILL_LEVEL(rb))	/* written since purged */
+				ResetEvent(rb->empty_event);
+		}
+#endif
+		return;
+	}
+
 #ifdef RINGBUF_MUTEX
 	pthread_mutex_lock(&rb->mutex);
 #endif
@@ -336,6 +452,10 @@ void RINGBUFCALL RingBufReInit(RingBuf* rb)
 	sem_reset(&rb->sem);
 	sem_reset(&rb->highwater_sem);
 #endif
+#ifdef RINGBUF_EVENT
+	if(rb->empty_event!=NULL)
+		SetEvent(rb->empty_event);
+#endif
 #ifdef RINGBUF_MUTEX
 	pthread_mutex_unlock(&rb->mutex);
 #endif
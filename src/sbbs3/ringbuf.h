@@ -67,6 +67,15 @@
 #define RINGBUFCALL
 #endif
 
+/* Concurrency modes (RingBuf.mode), set before the buffer is shared		*/
+/* The head and tail pointers are accessed atomically in these modes and	*/
+/* the "single" side(s) never lock the mutex.  The semaphore is only		*/
+/* posted when the buffer goes from empty to non-empty (a consumer only		*/
+/* waits on an empty buffer)												*/
+#define RINGBUF_SINGLE_PRODUCER	(1<<0)	/* Only one thread ever writes		*/
+#define RINGBUF_SINGLE_CONSUMER	(1<<1)	/* Only one thread ever reads/peeks	*/
+#define RINGBUF_SPSC			(RINGBUF_SINGLE_PRODUCER|RINGBUF_SINGLE_CONSUMER)
+
 /************/
 /* Typedefs */
 /************/
@@ -78,10 +87,13 @@ typedef struct {
 	BYTE* 	pTail;			/* next byte to be consumed */
 	BYTE* 	pEnd; 			/* end of the buffer, used for wrap around */
     DWORD	size;
+	DWORD	mode;			/* RINGBUF_SINGLE_* flags (0=fully mutex protected) */
 #ifdef RINGBUF_SEM
 	sem_t	sem;			/* semaphore used to signal data waiting */
 	sem_t	highwater_sem;	/* semaphore used to signal highwater mark reached */
 	DWORD	highwater_mark;
+	void	(*notify)(void* arg);	/* optional, called (by the writer) after posting either semaphore */
+	void*	notify_arg;
 #endif
 #ifdef RINGBUF_EVENT
 	xpevent_t empty_event;
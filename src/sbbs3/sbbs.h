@@ -294,6 +294,20 @@ extern int	thread_suid_broken;			/* NPTL is no longer broken */
 
 /* Synchronet Node Instance class definition */
 #ifdef __cplusplus
+
+#define AR_CACHE_SIZE	256		/* ARS results cached per node (power of 2) */
+#define AR_CACHE_MAXLEN	64		/* Longer (compiled) ARS aren't cached */
+
+typedef struct {			/* Cached ARS evaluation result (see chk_ar.cpp) */
+	uchar			ar[AR_CACHE_MAXLEN];	/* Compiled ARS (the key) */
+	size_t			len;					/* 0 = unused */
+	client_t*		client;
+	bool			result;
+	bool			noaccess;	/* noaccess_str/val were set by the evaluation */
+	char*			noaccess_str;
+	long			noaccess_val;
+} ar_cache_t;
+
 class sbbs_t
 {
 
@@ -343,6 +357,19 @@ public:
 	void	spymsg(const char *msg);		// send message to active spies
 
 	int		putcom(const char *str, size_t len=0);  // Send string
+
+	/* Batched output: outcom() and putcom_iac() append to outcom_buf while */
+	/* outcom_batch is non-zero and outcom_flush() moves it to outbuf in	*/
+	/* as few RingBufWrite() calls as possible (node thread only)			*/
+	uchar	outcom_buf[OUTCOM_BUFSIZE];
+	size_t	outcom_buflen;
+	int		outcom_batch;		   // batched output nesting level
+	int		putcom_iac(const char *str, size_t len=0);	// Send string, escape Telnet IAC
+	int		outcom_flush(void);	   // Send batched output
+	void	outcom_begin(void) { outcom_batch++; }
+	void	outcom_end(void) { if(outcom_batch>0 && --outcom_batch==0) outcom_flush(); }
+	int		outcom_suspend(void) { int batch=outcom_batch; outcom_flush(); outcom_batch=0; return batch; }
+	void	outcom_resume(int batch) { outcom_flush(); outcom_batch=batch; }
 	void	hangup(void);		   // Hangup modem
 
 	uchar	telnet_local_option[0x100];
@@ -501,6 +528,10 @@ public:
 	char 	cid[LEN_CID+1]; /* Caller ID (IP Address) of current caller */
 	char 	*noaccess_str;	/* Why access was denied via ARS */
 	long 	noaccess_val;	/* Value of parameter not met in ARS */
+	ar_cache_t	ar_cache[AR_CACHE_SIZE];	/* Results of static ARS for useron */
+	user_t	ar_cache_user;	/* useron, when ar_cache was last valid */
+	long	ar_cache_status;	/* sys_status&SS_TMPSYSOP, when last valid */
+	bool	ar_dynamic;		/* ARS evaluated depends on more than useron */
 	int		errorlevel; 	/* Error level of external program */
 
 	csi_t	main_csi;		/* Main Command Shell Image */
@@ -776,6 +807,7 @@ public:
 	bool	chksyspass(void);
 	bool	chk_ar(const uchar * str, user_t* user, client_t* client); /* checks access requirements */
 	bool	ar_exp(const uchar ** ptrptr, user_t*, client_t*);
+	void	ar_cache_flush(void);
 	void	daily_maint(void);
 
 	/* upload.cpp */
@@ -843,6 +875,7 @@ public:
 
 	/* xtrn.cpp */
 	int		external(const char* cmdline, long mode, const char* startup_dir=NULL);
+	int		run_external(const char* cmdline, long mode, const char* startup_dir);
 
 	/* xtrn_sec.cpp */
 	int		xtrn_sec(void);					/* The external program section  */
@@ -1003,6 +1036,9 @@ extern "C" {
 	DLLEXPORT BOOL		DLLCALL putfileixb(scfg_t* cfg, file_t* f);
 	DLLEXPORT BOOL		DLLCALL getfiledat(scfg_t* cfg, file_t* f);
 	DLLEXPORT BOOL		DLLCALL putfiledat(scfg_t* cfg, file_t* f);
+	DLLEXPORT BOOL		DLLCALL loadfileidx(scfg_t* cfg, uint dirnum, fileidx_t* idx);
+	DLLEXPORT BOOL		DLLCALL getfileidx(scfg_t* cfg, fileidx_t* idx, file_t* f);
+	DLLEXPORT void		DLLCALL freefileidx(fileidx_t* idx);
 	DLLEXPORT void		DLLCALL putextdesc(scfg_t* cfg, uint dirnum, ulong datoffset, char *ext);
 	DLLEXPORT void		DLLCALL getextdesc(scfg_t* cfg, uint dirnum, ulong datoffset, char *ext);
 	DLLEXPORT char*		DLLCALL getfilepath(scfg_t* cfg, file_t* f, char* path);
@@ -1235,6 +1271,7 @@ extern "C" {
 													,char *name, SOCKET sock);
 	DLLEXPORT void		DLLCALL js_timeval(JSContext* cx, jsval val, struct timeval* tv);
 	DLLEXPORT SOCKET	DLLCALL js_socket(JSContext *cx, jsval val);
+	DLLEXPORT size_t	DLLCALL js_socket_pending(JSContext *cx, jsval val);
 
 	/* js_queue.c */
 	DLLEXPORT JSObject* DLLCALL js_CreateQueueClass(JSContext* cx, JSObject* parent);
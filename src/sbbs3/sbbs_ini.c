@@ -465,6 +465,10 @@ void sbbs_read_ini(
 			=iniGetShortInt(list,section,"LinesPerYield",10);
 		mail->max_recipients
 			=iniGetShortInt(list,section,"MaxRecipients",100);
+		mail->sendmail_threads
+			=iniGetShortInt(list,section,"SendMailThreads",4);
+		mail->max_msgs_per_conn
+			=iniGetShortInt(list,section,"MaxMsgsPerConnection",100);
 		mail->max_msg_size
 			=iniGetInteger(list,section,"MaxMsgSize",DEFAULT_MAX_MSG_SIZE);
 		mail->max_msgs_waiting
@@ -929,6 +933,10 @@ BOOL sbbs_write_ini(
 			break;
 		if(!iniSetShortInt(lp,section,"MaxRecipients",mail->max_recipients,&style))
 			break;
+		if(!iniSetShortInt(lp,section,"SendMailThreads",mail->sendmail_threads,&style))
+			break;
+		if(!iniSetShortInt(lp,section,"MaxMsgsPerConnection",mail->max_msgs_per_conn,&style))
+			break;
 		if(!iniSetInteger(lp,section,"MaxMsgSize",mail->max_msg_size,&style))
 			break;
 		if(!iniSetInteger(lp,section,"MaxMsgsWaiting",mail->max_msgs_waiting,&style))
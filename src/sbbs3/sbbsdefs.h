@@ -437,6 +437,7 @@ typedef enum {						/* Values for xtrn_t.event				*/
 #define KEY_BUFSIZE 1024	/* Size of keyboard input buffer				*/
 #define SAVE_LINES	 4		/* Maximum number of lines to save				*/
 #define LINE_BUFSIZE 512	/* Size of line output buffer					*/
+#define OUTCOM_BUFSIZE 1024	/* Size of batched (staged) output buffer		*/
 																			
 																			
 #define EDIT_TABSIZE 4		/* Tab size for internal message/line editor	*/
@@ -983,6 +984,17 @@ typedef struct {						/* File (transfers) Data */
 
 } file_t;
 
+typedef struct {						/* Directory file index (see filedat.c) */
+	uint	dir;						/* Directory loaded */
+	uchar*	ixb;						/* Contents of .IXB file */
+	long	length;						/* Length of .IXB file */
+	char*	dat;						/* Contents of .DAT file */
+	long	datlen;						/* Length of .DAT file */
+	ulong	slots;						/* Size of hash table (power of 2) */
+	long*	table;						/* .IXB offset+1 of each file, by name */
+
+} fileidx_t;
+
 typedef idxrec_t post_t;				/* defined in smbdefs.h */
 typedef idxrec_t mail_t;				/* defined in smbdefs.h */
 typedef fidoaddr_t faddr_t;				/* defined in smbdefs.h */
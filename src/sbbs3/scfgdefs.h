@@ -350,6 +350,7 @@ typedef struct
 {
 	DWORD			size;				/* sizeof(scfg_t) */
 	BOOL			prepped;			/* TRUE if prep_cfg() has been used */
+	DWORD			generation;			/* Different after each load_cfg() */
 
 	grp_t			**grp;				/* Each message group */
 	uint16_t		total_grps; 		/* Total number of groups */
@@ -61,6 +61,7 @@
 #include "sbbs_ini.h"
 #include "js_rtpool.h"
 #include "js_request.h"
+#include "js_cache.h"
 
 /* Constants */
 
@@ -1188,7 +1189,7 @@ static void js_service_thread(void* arg)
 
 	JS_ClearPendingException(js_cx);
 
-	js_script=JS_CompileFile(js_cx, js_glob, spath);
+	js_script=js_get_compiled_script(js_cx, js_glob, spath);
 
 	if(js_script==NULL) 
 		lprintf(LOG_ERR,"%04d !JavaScript FAILED to compile script (%s)",socket,spath);
@@ -1295,7 +1296,7 @@ static void js_static_service_thread(void* arg)
 
 		JS_SetOperationCallback(js_cx, js_OperationCallback);
 	
-		if((js_script=JS_CompileFile(js_cx, js_glob, spath))==NULL)  {
+		if((js_script=js_get_compiled_script(js_cx, js_glob, spath))==NULL)  {
 			lprintf(LOG_ERR,"%04d !JavaScript FAILED to compile script (%s)",service->socket,spath);
 			break;
 		}
@@ -1966,6 +1967,8 @@ void DLLCALL services_thread(void* arg)
 		/* Main Server Loop */
 		while(!terminated) {
 
+			js_cache_expire();	/* free compiled scripts that have gone unused */
+
 			if(active_clients()==0) {
 				if(!(startup->options&BBS_OPT_NO_RECYCLE)) {
 					if((p=semfile_list_check(&initialized,recycle_semfiles))!=NULL) {
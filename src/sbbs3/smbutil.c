@@ -114,6 +114,7 @@ char *usage=
 "       e[f] = import e-mail from text file f (or use stdin)\n"
 "       n[f] = import netmail from text file f (or use stdin)\n"
 "       h    = dump hash file\n"
+"       f    = create (or rebuild) full-text search index\n"
 "       s    = display msg base status\n"
 "       c    = change msg base status\n"
 "       d    = delete all msgs\n"
@@ -614,6 +615,53 @@ void dump_hashes(void)
 	smb_close_hash(&smb);
 }
 
+/****************************************************************************/
+/* Creates (or rebuilds) the full-text search index from the message base	*/
+/****************************************************************************/
+void index_text(void)
+{
+	int			i;
+	ulong		l=0;
+	smbmsg_t	msg;
+
+	if((i=smb_fts_create(&smb))!=SMB_SUCCESS) {
+		fprintf(errfp,"\n%s!smb_fts_create returned %d: %s\n"
+			,beep,i,smb.last_error);
+		return;
+	}
+	rewind(smb.sid_fp);
+	while(1) {
+		memset(&msg,0,sizeof(msg));
+		if(!fread(&msg.idx,1,sizeof(idxrec_t),smb.sid_fp))
+			break;
+		if(msg.idx.attr&MSG_DELETE)
+			continue;
+		i=smb_lockmsghdr(&smb,&msg);
+		if(i) {
+			fprintf(errfp,"\n%s!smb_lockmsghdr returned %d: %s\n"
+				,beep,i,smb.last_error);
+			break; 
+		}
+		i=smb_getmsghdr(&smb,&msg);
+		smb_unlockmsghdr(&smb,&msg);
+		if(i) {
+			fprintf(errfp,"\n%s!smb_getmsghdr returned %d: %s\n"
+				,beep,i,smb.last_error);
+			break; 
+		}
+		fprintf(statfp,"\r%"PRIu32"  ",msg.hdr.number);
+		i=smb_fts_addmsg(&smb,&msg);
+		smb_freemsgmem(&msg);
+		if(i) {
+			fprintf(errfp,"\n%s!smb_fts_addmsg returned %d: %s\n"
+				,beep,i,smb.last_error);
+			break; 
+		}
+		l++;
+	}
+	fprintf(statfp,"\r%lu messages indexed\n",l);
+}
+
 /****************************************************************************/
 /* Maintain message base - deletes messages older than max age (in days)	*/
 /* or messages that exceed maximum											*/
@@ -1631,6 +1679,7 @@ int main(int argc, char **argv)
 							break;
 						case 'P':
 						case 'D':
+						case 'F':
 							if((i=smb_lock(&smb))!=0) {
 								fprintf(errfp,"\n%s!smb_lock returned %d: %s\n"
 									,beep,i,smb.last_error);
@@ -1643,6 +1692,9 @@ int main(int argc, char **argv)
 								case 'D':
 									delmsgs();
 									break;
+								case 'F':
+									index_text();
+									break;
 							}
 							smb_unlock(&smb);
 							y=strlen(cmd)-1;
@@ -37,6 +37,7 @@
 
 #include "sbbs.h"
 #include "cmdshell.h"
+#include "xpmap.h"
 #ifndef USHRT_MAX
 	#define USHRT_MAX ((unsigned short)~0)
 #endif
@@ -47,6 +48,243 @@ char* nulstr="";
 
 #define VALID_CFG(cfg)	(cfg!=NULL && cfg->size==sizeof(scfg_t))
 
+/****************************************************************************/
+/* Process-wide index of user/name.dat, hashed by normalized name (case,	*/
+/* spaces, dots and underscores ignored), so that matchuser() need not read	*/
+/* and compare every name in the file. Kept current by putusername() and	*/
+/* reloaded when name.dat is modified (by size or time) by someone else.	*/
+/****************************************************************************/
+#define NAME_INDEX_HEADROOM		1024	/* new users before a reload is needed */
+
+static struct {
+	char	path[MAX_PATH+1];
+	time_t	mtime;
+	long	ntime;						/* nanoseconds part of mtime		*/
+	off_t	length;
+	uint	total;						/* names (user numbers) loaded		*/
+	uint	size;						/* names allocated					*/
+	uint	buckets;					/* power of 2						*/
+	uint*	bucket;						/* first user number per hash		*/
+	uint*	next;						/* next user number w/same hash		*/
+	char	(*name)[LEN_ALIAS+1];
+} name_index;
+
+#if defined(_THREAD_SAFE) || defined(_WIN32)
+static pthread_mutex_t	name_index_mutex;
+static pthread_once_t	name_index_once=PTHREAD_ONCE_INIT;
+
+static void name_index_init(void)
+{
+	pthread_mutex_init(&name_index_mutex,NULL);
+}
+
+static void name_index_lock(void)
+{
+	pthread_once(&name_index_once,name_index_init);
+	pthread_mutex_lock(&name_index_mutex);
+}
+#define name_index_unlock()		pthread_mutex_unlock(&name_index_mutex)
+#else
+#define name_index_lock()
+#define name_index_unlock()
+#endif
+
+/* Two writes of the same size within one second leave st_mtime unchanged */
+static long name_index_ntime(struct stat* st)
+{
+#if defined(__linux__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+	return(st->st_mtim.tv_nsec);
+#elif defined(__APPLE__)
+	return(st->st_mtimespec.tv_nsec);
+#else
+	return(0);
+#endif
+}
+
+/* Returns TRUE if the index was loaded from (or updated to) name.dat as it is now */
+static BOOL name_index_matches(struct stat* st)
+{
+	return(st->st_mtime==name_index.mtime
+		&& name_index_ntime(st)==name_index.ntime
+		&& st->st_size==name_index.length);
+}
+
+static ulong name_hash(const char* name)
+{
+	ulong	h=0;
+
+	for(;*name;name++) {
+		if(*name=='.' || *name=='_' || isspace((uchar)*name))
+			continue;
+		h=(h*31)+toupper((uchar)*name);
+	}
+	return(h);
+}
+
+static void name_index_free(void)
+{
+	FREE_AND_NULL(name_index.bucket);
+	FREE_AND_NULL(name_index.next);
+	FREE_AND_NULL(name_index.name);
+	name_index.path[0]=0;
+	name_index.total=0;
+	name_index.size=0;
+	name_index.buckets=0;
+}
+
+/* Links user 'number' into its hash chain, keeping chains in ascending order */
+static void name_index_link(uint number)
+{
+	uint*	n;
+
+	n=&name_index.bucket[name_hash(name_index.name[number-1])&(name_index.buckets-1)];
+	while(*n && *n<number)
+		n=&name_index.next[*n-1];
+	name_index.next[number-1]=*n;
+	*n=number;
+}
+
+static void name_index_unlink(uint number)
+{
+	uint*	n;
+
+	n=&name_index.bucket[name_hash(name_index.name[number-1])&(name_index.buckets-1)];
+	while(*n && *n!=number)
+		n=&name_index.next[*n-1];
+	if(*n)
+		*n=name_index.next[number-1];
+}
+
+static BOOL name_index_load(const char* path, struct stat* st)
+{
+	char*	buf;
+	int		file;
+	uint	c;
+	uint	n;
+
+	name_index_free();
+	if((file=nopen(path,O_RDONLY))==-1)
+		return(FALSE);
+	if(fstat(file,st)!=0) {
+		close(file);
+		return(FALSE);
+	}
+	name_index.total=(uint)(st->st_size/(LEN_ALIAS+2));
+	name_index.size=name_index.total+NAME_INDEX_HEADROOM;
+	for(name_index.buckets=NAME_INDEX_HEADROOM;name_index.buckets<name_index.size;)
+		name_index.buckets<<=1;
+	name_index.bucket=(uint*)calloc(name_index.buckets,sizeof(*name_index.bucket));
+	name_index.next=(uint*)calloc(name_index.size,sizeof(*name_index.next));
+	name_index.name=calloc(name_index.size,sizeof(*name_index.name));
+	buf=(char*)malloc(name_index.total*(LEN_ALIAS+2)+1);
+	if(name_index.bucket==NULL || name_index.next==NULL || name_index.name==NULL || buf==NULL
+		|| read(file,buf,name_index.total*(LEN_ALIAS+2))!=(int)(name_index.total*(LEN_ALIAS+2))) {
+		close(file);
+		FREE_AND_NULL(buf);
+		name_index_free();
+		return(FALSE);
+	}
+	close(file);
+	for(n=name_index.total;n>0;n--) {
+		for(c=0;c<LEN_ALIAS;c++) {
+			if(buf[((n-1)*(LEN_ALIAS+2))+c]==ETX)
+				break;
+			name_index.name[n-1][c]=buf[((n-1)*(LEN_ALIAS+2))+c];
+		}
+		name_index_link(n);
+	}
+	free(buf);
+	SAFECOPY(name_index.path,path);
+	name_index.mtime=st->st_mtime;
+	name_index.ntime=name_index_ntime(st);
+	name_index.length=st->st_size;
+	return(TRUE);
+}
+
+/* Call with name_index locked */
+static BOOL name_index_current(const char* path)
+{
+	struct stat st;
+
+	if(name_index.name!=NULL && strcmp(name_index.path,path)==0
+		&& stat(path,&st)==0 && name_index_matches(&st))
+		return(TRUE);
+	return(name_index_load(path,&st));
+}
+
+/* Called from putusername() after name.dat slot 'number' has been written */
+static void name_index_update(const char* path, struct stat* before, int file, uint number, const char* name)
+{
+	struct stat after;
+	uint	c;
+
+	name_index_lock();
+	if(name_index.name!=NULL && strcmp(name_index.path,path)==0) {
+		if(!name_index_matches(before)
+			|| number>name_index.size || fstat(file,&after)!=0
+			|| after.st_size!=(off_t)((number>name_index.total ? number : name_index.total)*(LEN_ALIAS+2)))
+			name_index_free();	/* changed elsewhere, truncated, or full: reload */
+		else {
+			while(name_index.total<number)	/* padded with blank (deleted) names */
+				name_index_link(++name_index.total);
+			name_index_unlink(number);
+			memset(name_index.name[number-1],0,LEN_ALIAS+1);
+			for(c=0;c<LEN_ALIAS && name[c] && name[c]!=ETX;c++)
+				name_index.name[number-1][c]=name[c];
+			name_index_link(number);
+			name_index.mtime=after.st_mtime;
+			name_index.ntime=name_index_ntime(&after);
+			name_index.length=after.st_size;
+		}
+	}
+	name_index_unlock();
+}
+
+/* The comparisons originally made by matchuser() against each name.dat entry */
+static BOOL username_matches(const char* dat, const char* name, const char* stripped_name)
+{
+	char*	p;
+	char	str[LEN_ALIAS+1];
+
+	if(!stricmp(dat,name)) 
+		return(TRUE);
+	/* convert dots to spaces */
+	strcpy(str,dat);
+	REPLACE_CHARS(str,'.',' ',p);
+	if(!stricmp(str,name)) 
+		return(TRUE);
+	/* convert spaces to dots */
+	strcpy(str,dat);
+	REPLACE_CHARS(str,' ','.',p);
+	if(!stricmp(str,name)) 
+		return(TRUE);
+	/* convert dots to underscores */
+	strcpy(str,dat);
+	REPLACE_CHARS(str,'.','_',p);
+	if(!stricmp(str,name)) 
+		return(TRUE);
+	/* convert underscores to dots */
+	strcpy(str,dat);
+	REPLACE_CHARS(str,'_','.',p);
+	if(!stricmp(str,name)) 
+		return(TRUE);
+	/* convert spaces to underscores */
+	strcpy(str,dat);
+	REPLACE_CHARS(str,' ','_',p);
+	if(!stricmp(str,name)) 
+		return(TRUE);
+	/* convert underscores to spaces */
+	strcpy(str,dat);
+	REPLACE_CHARS(str,'_',' ',p);
+	if(!stricmp(str,name)) 
+		return(TRUE);
+	/* strip spaces (from both) */
+	strip_space(dat,str);
+	if(!stricmp(str,stripped_name)) 
+		return(TRUE);
+	return(FALSE);
+}
+
 /****************************************************************************/
 /* Looks for a perfect match amoung all usernames (not deleted users)		*/
 /* Makes dots and underscores synomynous with spaces for comparisions		*/
@@ -55,10 +293,10 @@ char* nulstr="";
 uint DLLCALL matchuser(scfg_t* cfg, const char *name, BOOL sysop_alias)
 {
 	int		file,c;
-	char*	p;
 	char	dat[LEN_ALIAS+2];
-	char	str[256];
+	char	str[MAX_PATH+1];
 	char	tmp[256];
+	uint	n;
 	ulong	l,length;
 	FILE*	stream;
 
@@ -70,6 +308,20 @@ uint DLLCALL matchuser(scfg_t* cfg, const char *name, BOOL sysop_alias)
 		return(1);
 
 	SAFEPRINTF(str,"%suser/name.dat",cfg->data_dir);
+	SAFECOPY(tmp,name);
+	strip_space(tmp,tmp);
+
+	name_index_lock();
+	if(name_index_current(str)) {
+		n=name_index.bucket[name_hash(name)&(name_index.buckets-1)];
+		while(n && !username_matches(name_index.name[n-1],name,tmp))
+			n=name_index.next[n-1];
+		name_index_unlock();
+		return(n);
+	}
+	name_index_unlock();
+
+	/* Couldn't index name.dat (e.g. out of memory), so search it the slow way */
 	if((stream=fnopen(&file,str,O_RDONLY))==NULL)
 		return(0);
 	length=(long)filelength(file);
@@ -78,42 +330,7 @@ uint DLLCALL matchuser(scfg_t* cfg, const char *name, BOOL sysop_alias)
 		for(c=0;c<LEN_ALIAS;c++)
 			if(dat[c]==ETX) break;
 		dat[c]=0;
-		if(!stricmp(dat,name)) 
-			break;
-		/* convert dots to spaces */
-		strcpy(str,dat);
-		REPLACE_CHARS(str,'.',' ',p);
-		if(!stricmp(str,name)) 
-			break;
-		/* convert spaces to dots */
-		strcpy(str,dat);
-		REPLACE_CHARS(str,' ','.',p);
-		if(!stricmp(str,name)) 
-			break;
-		/* convert dots to underscores */
-		strcpy(str,dat);
-		REPLACE_CHARS(str,'.','_',p);
-		if(!stricmp(str,name)) 
-			break;
-		/* convert underscores to dots */
-		strcpy(str,dat);
-		REPLACE_CHARS(str,'_','.',p);
-		if(!stricmp(str,name)) 
-			break;
-		/* convert spaces to underscores */
-		strcpy(str,dat);
-		REPLACE_CHARS(str,' ','_',p);
-		if(!stricmp(str,name)) 
-			break;
-		/* convert underscores to spaces */
-		strcpy(str,dat);
-		REPLACE_CHARS(str,'_',' ',p);
-		if(!stricmp(str,name)) 
-			break;
-		/* strip spaces (from both) */
-		strip_space(dat,str);
-		strip_space(name,tmp);
-		if(!stricmp(str,tmp)) 
+		if(username_matches(dat,name,tmp))
 			break;
 	}
 	fclose(stream);
@@ -588,6 +805,8 @@ char* DLLCALL username(scfg_t* cfg, int usernumber, char *name)
 int DLLCALL putusername(scfg_t* cfg, int number, char *name)
 {
 	char str[256];
+	char path[MAX_PATH+1];
+	struct stat st;
 	int file;
 	int wr;
 	long length;
@@ -596,9 +815,11 @@ int DLLCALL putusername(scfg_t* cfg, int number, char *name)
 	if(!VALID_CFG(cfg) || name==NULL || number<1) 
 		return(-1);
 
-	SAFEPRINTF(str,"%suser/name.dat", cfg->data_dir);
-	if((file=nopen(str,O_RDWR|O_CREAT))==-1) 
+	SAFEPRINTF(path,"%suser/name.dat", cfg->data_dir);
+	if((file=nopen(path,O_RDWR|O_CREAT))==-1) 
 		return(errno); 
+	if(fstat(file,&st)!=0)
+		st.st_size=-1;	/* not what's indexed */
 	length=(long)filelength(file);
 
 	/* Truncate corrupted name.dat */
@@ -622,6 +843,8 @@ int DLLCALL putusername(scfg_t* cfg, int number, char *name)
 	putrec(str,0,LEN_ALIAS,name);
 	putrec(str,LEN_ALIAS,2,crlf);
 	wr=write(file,str,LEN_ALIAS+2);
+	if(wr==LEN_ALIAS+2)
+		name_index_update(path,&st,file,number,name);
 	close(file);
 
 	if(wr!=LEN_ALIAS+2)
@@ -669,6 +892,193 @@ uint DLLCALL getage(scfg_t* cfg, char *birth)
 	return(age);
 }
 
+/****************************************************************************/
+/* Process-wide read-only mapping of node.dab, so node records can be read	*/
+/* without opening, reading and closing the file each time. The file		*/
+/* remains the authority (and its record locks are still honored by the		*/
+/* writers); being a shared mapping, writes by other processes are seen.	*/
+/* The mapping is checked against the file (inode and size) at most once	*/
+/* per NODEDAB_CHECK_INTERVAL (or when a record beyond it is requested)		*/
+/* and remapped if node.dab was replaced or resized. Writes made in this	*/
+/* process wake anyone in waitnodedat().									*/
+/****************************************************************************/
+#define NODEDAB_POLL_INTERVAL	250		/* ms, for writes by other processes */
+#define NODEDAB_CHECK_INTERVAL	1000	/* ms, between stat()s of node.dab */
+
+static struct {
+	char				path[MAX_PATH+1];
+	struct xpmapping*	map;
+	ino_t				ino;				/* of the mapped file */
+	uint				nodes;				/* records mapped */
+	msclock_t			checked;			/* when last stat()ed */
+	uint32_t			changes;			/* in-process writes */
+} nodedab;
+
+#if defined(_THREAD_SAFE) || defined(_WIN32)
+static pthread_mutex_t	nodedab_mutex;
+static pthread_once_t	nodedab_once=PTHREAD_ONCE_INIT;
+
+static void nodedab_init(void)
+{
+	pthread_mutex_init(&nodedab_mutex,NULL);
+}
+
+static void nodedab_lock(void)
+{
+	pthread_once(&nodedab_once,nodedab_init);
+	pthread_mutex_lock(&nodedab_mutex);
+}
+#define nodedab_unlock()	pthread_mutex_unlock(&nodedab_mutex)
+#else
+#define nodedab_lock()
+#define nodedab_unlock()
+#endif
+
+#if defined(_THREAD_SAFE) && defined(__unix__)
+	#define NODEDAB_COND
+	static pthread_cond_t	nodedab_changed=PTHREAD_COND_INITIALIZER;
+#endif
+
+/* Returns a pointer to the (zero-based) node record in the mapping or NULL */
+/* Must be called with the nodedab lock held, the mapping may be replaced */
+static node_t* nodedab_record(scfg_t* cfg, uint number)
+{
+	char		path[MAX_PATH+1];
+	struct stat	st;
+
+	if(cfg->node_misc&NM_CLOSENODEDAB)	/* network file system: use the file */
+		return(NULL);
+	SAFEPRINTF(path,"%snode.dab",cfg->ctrl_dir);
+	if(nodedab.map!=NULL && number<nodedab.nodes && strcmp(path,nodedab.path)==0
+		&& msclock()-nodedab.checked < NODEDAB_CHECK_INTERVAL*MSCLOCKS_PER_SEC/1000)
+		return((node_t*)nodedab.map->addr+number);
+	if(stat(path,&st)!=0)
+		return(NULL);
+	nodedab.checked=msclock();
+	if(nodedab.map!=NULL && (st.st_ino!=nodedab.ino || (uint64_t)st.st_size!=(uint64_t)nodedab.map->size
+		|| strcmp(path,nodedab.path)!=0)) {
+		xpunmap(nodedab.map);
+		nodedab.map=NULL;
+	}
+	/* The nodes extend node.dab to sys_nodes records when they start */
+	if(nodedab.map==NULL) {
+		if(st.st_size<(off_t)(cfg->sys_nodes*sizeof(node_t))
+			|| (nodedab.map=xpmap(path,XPMAP_READ))==NULL)
+			return(NULL);
+		SAFECOPY(nodedab.path,path);
+		nodedab.ino=st.st_ino;
+		nodedab.nodes=(uint)(nodedab.map->size/sizeof(node_t));
+		if(nodedab.nodes>MAX_NODES)
+			nodedab.nodes=MAX_NODES;
+	}
+	if(number>=nodedab.nodes)
+		return(NULL);
+	return((node_t*)nodedab.map->addr+number);
+}
+
+/****************************************************************************/
+/* Reads node record 'number' (without locking) from the shared mapping.	*/
+/* Returns FALSE if not mapped, in which case the caller must read the file	*/
+/****************************************************************************/
+BOOL DLLCALL readnodedat(scfg_t* cfg, uint number, node_t* node)
+{
+	node_t*		rec;
+	node_t		chk;
+	int			count;
+
+	if(!VALID_CFG(cfg) || node==NULL || number<1 || number>cfg->sys_nodes)
+		return(FALSE);
+	number--;	/* make zero based */
+	for(count=0;count<LOOP_NODEDAB;count++) {
+		if(count)
+			YIELD();
+		nodedab_lock();
+		if((rec=nodedab_record(cfg,number))==NULL) {
+			nodedab_unlock();
+			return(FALSE);
+		}
+		memcpy(node,rec,sizeof(node_t));
+		memcpy(&chk,rec,sizeof(node_t));	/* being written by another process? */
+		nodedab_unlock();
+		if(memcmp(node,&chk,sizeof(node_t))==0)
+			return(TRUE);
+	}
+	return(FALSE);
+}
+
+/****************************************************************************/
+/* Writes node record 'number' to the open (and locked) node.dab 'file'		*/
+/* Returns the result of the write()										*/
+/****************************************************************************/
+int DLLCALL writenodedat(scfg_t* cfg, uint number, node_t* node, int file)
+{
+	int		wr;
+
+	if(!VALID_CFG(cfg) || node==NULL || number<1 || number>cfg->sys_nodes)
+		return(-1);
+	number--;	/* make zero based */
+	nodedab_lock();
+	lseek(file,(long)number*sizeof(node_t),SEEK_SET);
+	wr=write(file,node,sizeof(node_t));
+	nodedab.changes++;
+#ifdef NODEDAB_COND
+	pthread_cond_broadcast(&nodedab_changed);
+#endif
+	nodedab_unlock();
+	return(wr);
+}
+
+/****************************************************************************/
+/* Waits up to 'timeout' milliseconds for node record 'number' to differ	*/
+/* from 'node'. Returns TRUE (with 'node' updated) if it did.				*/
+/****************************************************************************/
+BOOL DLLCALL waitnodedat(scfg_t* cfg, uint number, node_t* node, ulong timeout)
+{
+	node_t		cur;
+	uint32_t	changes;
+	ulong		wait;
+	msclock_t	start=msclock();
+#ifdef NODEDAB_COND
+	struct timespec	ts;
+#endif
+
+	if(!VALID_CFG(cfg) || node==NULL)
+		return(FALSE);
+	for(;;) {
+		nodedab_lock();
+		changes=nodedab.changes;
+		nodedab_unlock();
+		if(getnodedat(cfg,number,&cur,NULL)!=0)
+			return(FALSE);
+		if(memcmp(&cur,node,sizeof(node_t))!=0) {
+			*node=cur;
+			return(TRUE);
+		}
+		wait=(ulong)((msclock()-start)*1000/MSCLOCKS_PER_SEC);
+		if(wait>=timeout)
+			return(FALSE);
+		wait=timeout-wait;
+		if(wait>NODEDAB_POLL_INTERVAL)
+			wait=NODEDAB_POLL_INTERVAL;
+#ifdef NODEDAB_COND
+		clock_gettime(CLOCK_REALTIME,&ts);
+		ts.tv_sec+=wait/1000;
+		ts.tv_nsec+=(wait%1000)*1000000;
+		if(ts.tv_nsec>=1000000000) {
+			ts.tv_sec++;
+			ts.tv_nsec-=1000000000;
+		}
+		nodedab_lock();
+		while(nodedab.changes==changes
+			&& pthread_cond_timedwait(&nodedab_changed,&nodedab_mutex,&ts)==0)
+			;
+		nodedab_unlock();
+#else
+		SLEEP(wait);
+#endif
+	}
+}
+
 /****************************************************************************/
 /* Reads the data for node number 'number' into the structure 'node'        */
 /* from node.dab															*/
@@ -688,6 +1098,8 @@ int DLLCALL getnodedat(scfg_t* cfg, uint number, node_t *node, int* fdp)
 		return(-1);
 
 	memset(node,0,sizeof(node_t));
+	if(fdp==NULL && readnodedat(cfg,number,node))
+		return(0);
 	SAFEPRINTF(str,"%snode.dab",cfg->ctrl_dir);
 	if((file=nopen(str,O_RDWR|O_DENYNONE))==-1)
 		return(errno); 
@@ -735,15 +1147,13 @@ int DLLCALL putnodedat(scfg_t* cfg, uint number, node_t* node, int file)
 		return(-1);
 	}
 
-	number--;	/* make zero based */
 	for(attempts=0;attempts<10;attempts++) {
-		lseek(file,(long)number*sizeof(node_t),SEEK_SET);
-		if((wr=write(file,node,sizeof(node_t)))==sizeof(node_t))
+		if((wr=writenodedat(cfg,number,node,file))==sizeof(node_t))
 			break;
 		wrerr=errno;	/* save write error */
 		mswait(100);
 	}
-	unlock(file,(long)number*sizeof(node_t),sizeof(node_t));
+	unlock(file,(long)(number-1)*sizeof(node_t),sizeof(node_t));
 	close(file);
 
 	if(wr!=sizeof(node_t))
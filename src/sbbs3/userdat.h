@@ -91,6 +91,9 @@ DLLEXPORT char*	DLLCALL username(scfg_t* cfg, int usernumber, char * str);
 DLLEXPORT char* DLLCALL usermailaddr(scfg_t* cfg, char* addr, const char* name);
 DLLEXPORT int	DLLCALL getnodedat(scfg_t* cfg, uint number, node_t *node, int* file);
 DLLEXPORT int	DLLCALL putnodedat(scfg_t* cfg, uint number, node_t *node, int file);
+DLLEXPORT BOOL	DLLCALL readnodedat(scfg_t* cfg, uint number, node_t *node);
+DLLEXPORT int	DLLCALL writenodedat(scfg_t* cfg, uint number, node_t *node, int file);
+DLLEXPORT BOOL	DLLCALL waitnodedat(scfg_t* cfg, uint number, node_t *node, ulong timeout);
 DLLEXPORT char* DLLCALL nodestatus(scfg_t* cfg, node_t* node, char* buf, size_t buflen);
 DLLEXPORT void	DLLCALL printnodedat(scfg_t* cfg, uint number, node_t* node);
 DLLEXPORT void	DLLCALL packchatpass(char *pass, node_t* node);
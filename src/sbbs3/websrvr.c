@@ -72,6 +72,7 @@
 #include "md5.h"
 #include "js_rtpool.h"
 #include "js_request.h"
+#include "js_cache.h"
 #include "xpmap.h"
 #include "xpprintf.h"
 
@@ -93,6 +94,7 @@ static const char*	unknown="<unknown>";
 #define MAX_REDIR_LOOPS			20		/* Max. times to follow internal redirects for a single request */
 #define MAX_POST_LEN			1048576	/* Max size of body for POSTS */
 #define	OUTBUF_LEN				20480	/* Size of output thread ring buffer */
+#define	SENDFILE_CHUNK			(256*1024)	/* Bytes of file sent per sendfilesocket() call */
 
 enum {
 	 CLEANUP_SSJS_TMP_FILE
@@ -128,6 +130,41 @@ static named_string_t** mime_types;
 static named_string_t** cgi_handlers;
 static named_string_t** xjs_handlers;
 
+/* Per-directory access control (access.ars and webctrl.ini) cache */
+#define DIR_ACCESS_CACHE_MAX_DIRS	1024	/* Max number of directories to hold in cache */
+#define DIR_ACCESS_STALE_TIMEOUT	5		/* Minimum seconds between calls to stat() */
+
+typedef struct {				/* webctrl.ini settings, NULL if not specified */
+	char*	ars;
+	char*	realm;
+	char*	digest_realm;
+	char*	error_dir;			/* prep_dir()'d */
+	char*	cgi_dir;			/* prep_dir()'d */
+	char*	auth_list;
+	BOOL	path_info_index;
+} webctrl_t;
+
+typedef struct {
+	BOOL	exists;
+	BOOL	readable;
+	time_t	mtime;				/* st_mtime from last stat() call */
+	off_t	size;				/* st_size from last stat() call */
+} ctrl_file_t;
+
+typedef struct {
+	char*		dir;			/* Physical path, with trailing slash */
+	time_t		laststat;		/* Time of last call to stat() */
+	time_t		lastused;
+	ctrl_file_t	access_ars;
+	char*		ars;			/* First line of access.ars, NULL if none */
+	ctrl_file_t	webctrl_ini;
+	webctrl_t	global;			/* webctrl.ini root section */
+	str_list_t	specs;			/* webctrl.ini section (filespec) names */
+	webctrl_t*	spec;			/* Per-filespec settings, parallel to specs */
+} dir_access_t;
+
+static link_list_t	dir_access_cache;
+
 /* Logging stuff */
 link_list_t	log_list;
 struct log_data {
@@ -1225,6 +1262,49 @@ static BOOL send_headers(http_session_t *session, const char *status, int chunke
 	return(send_file);
 }
 
+/*
+ * Sends (part of) a file directly from the file to the socket (using the
+ * kernel's sendfile() when available), bypassing the output ring buffer.
+ * The ring buffer must be drained first so that the headers are sent first.
+ * Only for non-chunked responses, returns -1 if the file could not be sent.
+ */
+static int sock_sendfile_direct(http_session_t *session,int file,unsigned long start,unsigned long remain)
+{
+	int		ret=0;
+	int		i;
+	int		sel;
+	off_t	offset=start;
+	fd_set	wr_set;
+	struct timeval tv;
+
+	drain_outbuf(session);
+	if(session->socket==INVALID_SOCKET)
+		return(-1);
+	/* Keep the output thread from sending while we are */
+	pthread_mutex_lock(&session->outbuf_write);
+	while(remain && session->socket!=INVALID_SOCKET) {
+		FD_ZERO(&wr_set);
+		FD_SET(session->socket,&wr_set);
+		tv.tv_sec=startup->max_inactivity;
+		tv.tv_usec=0;
+		if((sel=select(session->socket+1,NULL,&wr_set,NULL,&tv))!=1) {
+			if(sel==0)
+				lprintf(LOG_WARNING,"%04d Timeout selecting socket for write",session->socket);
+			ret=-1;
+			break;
+		}
+		if((i=sendfilesocket(session->socket,file,&offset,remain>SENDFILE_CHUNK ? SENDFILE_CHUNK : remain))<1) {
+			if(i<0)
+				ret=-1;
+			break;
+		}
+		ret+=i;
+		remain-=i;
+	}
+	pthread_mutex_unlock(&session->outbuf_write);
+	return(ret);
+}
+
 static int sock_sendfile(http_session_t *session,char *path,unsigned long start, unsigned long end)
 {
 	int		file;
@@ -1232,6 +1312,7 @@ static int sock_sendfile(http_session_t *session,char *path,unsigned long start,
 	int		i;
 	char	buf[2048];		/* Input buffer */
 	unsigned long		remain;
+	long	length;
 
 	if(startup->options&WEB_OPT_DEBUG_TX)
 		lprintf(LOG_DEBUG,"%04d Sending %s",session->socket,path);
@@ -1241,6 +1322,7 @@ static int sock_sendfile(http_session_t *session,char *path,unsigned long start,
 		if(start || end) {
 			if(lseek(file, start, SEEK_SET)==-1) {
 				lprintf(LOG_WARNING,"%04d !ERROR %d seeking to position %lu in %s",session->socket,ERROR_VALUE,start,path);
+				close(file);
 				return(0);
 			}
 			remain=end-start+1;
@@ -1248,9 +1330,22 @@ static int sock_sendfile(http_session_t *session,char *path,unsigned long start,
 		else {
 			remain=-1L;
 		}
+		if(!session->req.write_chunked && (length=filelength(file))>=0) {
+			if((unsigned long)length<start)
+				remain=0;
+			else if(remain>(unsigned long)length-start)
+				remain=length-start;
+			if((ret=sock_sendfile_direct(session,file,start,remain))<0) {
+				lprintf(LOG_WARNING,"%04d !ERROR %d sending %s",session->socket,ERROR_VALUE,path);
+				ret=0;
+			}
+			close(file);
+			return(ret);
+		}
 		while((i=read(file, buf, remain>sizeof(buf)?sizeof(buf):remain))>0) {
 			if(writebuf(session,buf,i)!=i) {
 				lprintf(LOG_WARNING,"%04d !ERROR sending %s",session->socket,path);
+				close(file);
 				return(0);
 			}
 			ret+=i;
@@ -2865,6 +2960,259 @@ static BOOL check_extra_path(http_session_t * session)
 	return(FALSE);
 }
 
+/****************************************************************************/
+/* Per-directory access control (access.ars and webctrl.ini) cache			*/
+/****************************************************************************/
+static void free_webctrl(webctrl_t* ctrl)
+{
+	FREE_AND_NULL(ctrl->ars);
+	FREE_AND_NULL(ctrl->realm);
+	FREE_AND_NULL(ctrl->digest_realm);
+	FREE_AND_NULL(ctrl->error_dir);
+	FREE_AND_NULL(ctrl->cgi_dir);
+	FREE_AND_NULL(ctrl->auth_list);
+	ctrl->path_info_index=FALSE;
+}
+
+static void get_webctrl(str_list_t ini, const char* section, webctrl_t* ctrl)
+{
+	char	value[INI_MAX_VALUE_LEN];
+
+	if(iniGetString(ini, section, "AccessRequirements", NULL, value)!=NULL)
+		ctrl->ars=strdup(value);
+	if(iniGetString(ini, section, "Realm", NULL, value)!=NULL)
+		ctrl->realm=strdup(value);
+	if(iniGetString(ini, section, "DigestRealm", NULL, value)!=NULL)
+		ctrl->digest_realm=strdup(value);
+	if(iniGetString(ini, section, "ErrorDirectory", NULL, value)!=NULL) {
+		prep_dir(root_dir, value, sizeof(value));
+		ctrl->error_dir=strdup(value);
+	}
+	if(iniGetString(ini, section, "CGIDirectory", NULL, value)!=NULL) {
+		prep_dir(root_dir, value, sizeof(value));
+		ctrl->cgi_dir=strdup(value);
+	}
+	if(iniGetString(ini, section, "Authentication", NULL, value)!=NULL)
+		ctrl->auth_list=strdup(value);
+	ctrl->path_info_index=iniGetBool(ini, section, "PathInfoIndex", FALSE);
+}
+
+/* Replaces the request's string with a copy of the (specified) webctrl.ini value */
+static void set_webctrl_str(char** dest, const char* src)
+{
+	if(src==NULL)
+		return;
+	FREE_AND_NULL(*dest);
+	/* FREE()d in close_request() */
+	*dest=strdup(src);
+}
+
+static void apply_webctrl(http_session_t* session, webctrl_t* ctrl, BOOL* recheck_dynamic)
+{
+	if(ctrl->ars!=NULL)
+		SAFECOPY(session->req.ars,ctrl->ars);
+	set_webctrl_str(&session->req.realm, ctrl->realm);
+	set_webctrl_str(&session->req.digest_realm, ctrl->digest_realm);
+	set_webctrl_str(&session->req.error_dir, ctrl->error_dir);
+	if(ctrl->cgi_dir!=NULL) {
+		set_webctrl_str(&session->req.cgi_dir, ctrl->cgi_dir);
+		*recheck_dynamic=TRUE;
+	}
+	set_webctrl_str(&session->req.auth_list, ctrl->auth_list);
+	session->req.path_info_index=ctrl->path_info_index;
+}
+
+static void free_dir_webctrl(dir_access_t* dir)
+{
+	size_t	i;
+
+	for(i=0; dir->specs!=NULL && dir->specs[i]!=NULL; i++)
+		free_webctrl(&dir->spec[i]);
+	FREE_AND_NULL(dir->spec);
+	dir->specs=iniFreeStringList(dir->specs);
+	free_webctrl(&dir->global);
+}
+
+static void free_dir_access(dir_access_t* dir)
+{
+	free_dir_webctrl(dir);
+	FREE_AND_NULL(dir->ars);
+	FREE_AND_NULL(dir->dir);
+	free(dir);
+}
+
+/* Returns TRUE if the file's existence, size, or time-stamp has changed */
+static BOOL ctrl_file_changed(const char* path, ctrl_file_t* cf)
+{
+	struct stat	sb;
+	BOOL		exists;
+
+	exists=(stat(path,&sb)==0);
+	if(exists==cf->exists
+		&& (!exists || (sb.st_mtime==cf->mtime && sb.st_size==cf->size)))
+		return(FALSE);
+	cf->exists=exists;
+	if(exists) {
+		cf->mtime=sb.st_mtime;
+		cf->size=sb.st_size;
+	}
+	return(TRUE);
+}
+
+/* (Re)reads the access.ars and webctrl.ini files of dir->dir, if changed */
+static void load_dir_access(dir_access_t* dir, time_t now)
+{
+	char		path[MAX_PATH+1];
+	char		ars[sizeof(((http_request_t*)NULL)->ars)];
+	size_t		i;
+	FILE*		file;
+	str_list_t	ini;
+
+	dir->laststat=now;
+
+	SAFEPRINTF(path,"%saccess.ars",dir->dir);
+	if(ctrl_file_changed(path,&dir->access_ars)) {
+		FREE_AND_NULL(dir->ars);
+		dir->access_ars.readable=FALSE;
+		if(dir->access_ars.exists && (file=fopen(path,"r"))!=NULL) {
+			dir->access_ars.readable=TRUE;
+			if(fgets(ars,sizeof(ars),file)!=NULL) {
+				truncsp(ars);
+				dir->ars=strdup(ars);
+			}
+			fclose(file);
+		}
+	}
+
+	SAFEPRINTF(path,"%swebctrl.ini",dir->dir);
+	if(ctrl_file_changed(path,&dir->webctrl_ini)) {
+		free_dir_webctrl(dir);
+		dir->webctrl_ini.readable=FALSE;
+		if(dir->webctrl_ini.exists && (file=fopen(path,"r"))!=NULL) {
+			dir->webctrl_ini.readable=TRUE;
+			ini=iniReadFile(file);
+			fclose(file);
+			get_webctrl(ini, ROOT_SECTION, &dir->global);
+			dir->specs=iniGetSectionList(ini, NULL);
+			i=strListCount(dir->specs);
+			if((dir->spec=(webctrl_t*)calloc(i+1,sizeof(webctrl_t)))==NULL)
+				dir->specs=iniFreeStringList(dir->specs);
+			for(i=0; dir->specs!=NULL && dir->specs[i]!=NULL; i++)
+				get_webctrl(ini, dir->specs[i], &dir->spec[i]);
+			iniFreeStringList(ini);
+		}
+	}
+}
+
+/* Returns the cached access controls for the directory (with trailing slash) */
+/* Must be called with dir_access_cache locked */
+static dir_access_t* get_dir_access(const char* path)
+{
+	time_t			now=time(NULL);
+	list_node_t*	node;
+	list_node_t*	oldest=NULL;
+	dir_access_t*	dir;
+
+	for(node=listFirstNode(&dir_access_cache); node!=NULL; node=listNextNode(node)) {
+		dir=(dir_access_t*)node->data;
+		if(strcmp(dir->dir,path)==0) {
+			if(now-dir->laststat >= DIR_ACCESS_STALE_TIMEOUT)
+				load_dir_access(dir, now);
+			dir->lastused=now;
+			return(dir);
+		}
+		if(oldest==NULL || dir->lastused < ((dir_access_t*)oldest->data)->lastused)
+			oldest=node;
+	}
+
+	if(oldest!=NULL && listCountNodes(&dir_access_cache) >= DIR_ACCESS_CACHE_MAX_DIRS) {
+		dir=(dir_access_t*)listRemoveNode(&dir_access_cache, oldest, /* free_data: */FALSE);
+		free_dir_access(dir);
+	}
+
+	if((dir=(dir_access_t*)calloc(1,sizeof(dir_access_t)))==NULL)
+		return(NULL);
+	if((dir->dir=strdup(path))==NULL) {
+		free_dir_access(dir);
+		return(NULL);
+	}
+	load_dir_access(dir, now);
+	dir->lastused=now;
+	if(listPushNode(&dir_access_cache, dir)==NULL) {
+		free_dir_access(dir);
+		return(NULL);
+	}
+	return(dir);
+}
+
+/* Results of apply_dir_access() */
+#define DIR_ACCESS_APPLIED		0
+#define DIR_ACCESS_FORBIDDEN	1	/* The request is for a control file */
+#define DIR_ACCESS_SYSOP_ONLY	2	/* A control file could not be read */
+
+/* Applies the (cached) access controls of curdir to the request			*/
+/* The cache is locked only for this directory's look-up (and re-read, if	*/
+/* stale) and while its settings are copied into the request				*/
+static int apply_dir_access(http_session_t* session, const char* curdir, const char* path
+	,const char* filename, BOOL* ars_found, BOOL* recheck_dynamic)
+{
+	char			str[MAX_PATH+1];
+	int				i;
+	int				result=DIR_ACCESS_APPLIED;
+	dir_access_t*	dir;
+
+	*ars_found=FALSE;
+	listLock(&dir_access_cache);
+	if((dir=get_dir_access(curdir))==NULL)
+		result=DIR_ACCESS_SYSOP_ONLY;
+	else {
+		if(dir->access_ars.exists) {
+			*ars_found=TRUE;
+			SAFEPRINTF(str,"%saccess.ars",curdir);
+			/* NEVER serve up an access.ars file */
+			if(!strcmp(path,str))
+				result=DIR_ACCESS_FORBIDDEN;
+			else if(!dir->access_ars.readable)
+				result=DIR_ACCESS_SYSOP_ONLY;
+			else if(dir->ars!=NULL)
+				SAFECOPY(session->req.ars,dir->ars);
+		}
+		if(result==DIR_ACCESS_APPLIED && dir->webctrl_ini.exists) {
+			SAFEPRINTF(str,"%swebctrl.ini",curdir);
+			/* NEVER serve up a webctrl.ini file */
+			if(!strcmp(path,str))
+				result=DIR_ACCESS_FORBIDDEN;
+			else if(!dir->webctrl_ini.readable)
+				result=DIR_ACCESS_SYSOP_ONLY;
+			else {
+				/* Globals */
+				apply_webctrl(session, &dir->global, recheck_dynamic);
+				/* Per-filespec (in the same order as when popped from the section list) */
+				for(i=(int)strListCount(dir->specs)-1; i>=0; i--) {
+					if(wildmatch(filename,dir->specs[i],TRUE))
+						apply_webctrl(session, &dir->spec[i], recheck_dynamic);
+				}
+				if(session->req.path_info_index)
+					*recheck_dynamic=TRUE;
+				/* Truncate at \r or \n */
+				truncsp(session->req.ars);
+			}
+		}
+	}
+	listUnlock(&dir_access_cache);
+	return(result);
+}
+
+static void free_dir_access_cache(void)
+{
+	dir_access_t*	dir;
+
+	while((dir=(dir_access_t*)listShiftNode(&dir_access_cache))!=NULL) {
+		free_dir_access(dir);
+	}
+	listFree(&dir_access_cache);
+}
+
 static BOOL check_request(http_session_t * session)
 {
 	char	path[MAX_PATH+1];
@@ -2873,13 +3221,11 @@ static BOOL check_request(http_session_t * session)
 	char	last_ch;
 	char*	last_slash;
 	char*	p;
-	FILE*	file;
 	int		i;
 	struct stat sb;
 	int		send404=0;
 	char	filename[MAX_PATH+1];
-	char	*spec;
-	str_list_t	specs;
+	BOOL	ars_found;
 	BOOL	recheck_dynamic=FALSE;
 
 	if(session->req.finished)
@@ -2955,120 +3301,19 @@ static BOOL check_request(http_session_t * session)
 		p=last_slash;
 		/* Terminate the path after the slash */
 		*(last_slash+1)=0;
-		sprintf(str,"%saccess.ars",curdir);
-		if(!stat(str,&sb)) {
-			/* NEVER serve up an access.ars file */
+		i=apply_dir_access(session, curdir, path, filename, &ars_found, &recheck_dynamic);
+		if(ars_found) {
 			lprintf(LOG_WARNING,"%04d !WARNING! access.ars support is depreciated and will be REMOVED very soon.",session->socket);
-			lprintf(LOG_WARNING,"%04d !WARNING! access.ars found at %s.",session->socket,str);
-			if(!strcmp(path,str)) {
-				send_error(session,"403 Forbidden");
-				return(FALSE);
-			}
-			/* Read access.ars file */
-			if((file=fopen(str,"r"))!=NULL) {
-				fgets(session->req.ars,sizeof(session->req.ars),file);
-				fclose(file);
-			}
-			else  {
-				/* If cannot open access.ars, only allow sysop access */
-				SAFECOPY(session->req.ars,"LEVEL 90");
-				break;
-			}
-			/* Truncate at \r or \n - can use last_slash since I'm done with it.*/
-			truncsp(session->req.ars);
+			lprintf(LOG_WARNING,"%04d !WARNING! access.ars found at %saccess.ars.",session->socket,curdir);
 		}
-		sprintf(str,"%swebctrl.ini",curdir);
-		if(!stat(str,&sb)) {
-			/* NEVER serve up a webctrl.ini file */
-			if(!strcmp(path,str)) {
-				send_error(session,"403 Forbidden");
-				return(FALSE);
-			}
-			/* Read webctrl.ini file */
-			if((file=fopen(str,"r"))!=NULL) {
-				/* FREE()d in this block */
-				specs=iniReadSectionList(file,NULL);
-				/* Read in globals */
-				if(iniReadString(file, NULL, "AccessRequirements", session->req.ars,str)==str)
-					SAFECOPY(session->req.ars,str);
-				if(iniReadString(file, NULL, "Realm", scfg.sys_name,str)==str) {
-					FREE_AND_NULL(session->req.realm);
-					/* FREE()d in close_request() */
-					session->req.realm=strdup(str);
-				}
-				if(iniReadString(file, NULL, "DigestRealm", scfg.sys_name,str)==str) {
-					FREE_AND_NULL(session->req.digest_realm);
-					/* FREE()d in close_request() */
-					session->req.digest_realm=strdup(str);
-				}
-				if(iniReadString(file, NULL, "ErrorDirectory", error_dir,str)==str) {
-					prep_dir(root_dir, str, sizeof(str));
-					FREE_AND_NULL(session->req.error_dir);
-					/* FREE()d in close_request() */
-					session->req.error_dir=strdup(str);
-				}
-				if(iniReadString(file, NULL, "CGIDirectory", cgi_dir,str)==str) {
-					prep_dir(root_dir, str, sizeof(str));
-					FREE_AND_NULL(session->req.cgi_dir);
-					/* FREE()d in close_request() */
-					session->req.cgi_dir=strdup(str);
-					recheck_dynamic=TRUE;
-				}
-				if(iniReadString(file, NULL, "Authentication", default_auth_list,str)==str) {
-					FREE_AND_NULL(session->req.auth_list);
-					/* FREE()d in close_request() */
-					session->req.auth_list=strdup(str);
-				}
-				session->req.path_info_index=iniReadBool(file, NULL, "PathInfoIndex", FALSE);
-				/* Read in per-filespec */
-				while((spec=strListPop(&specs))!=NULL) {
-					if(wildmatch(filename,spec,TRUE)) {
-						if(iniReadString(file, spec, "AccessRequirements", session->req.ars,str)==str)
-							SAFECOPY(session->req.ars,str);
-						if(iniReadString(file, spec, "Realm", scfg.sys_name,str)==str) {
-							FREE_AND_NULL(session->req.realm);
-							/* FREE()d in close_request() */
-							session->req.realm=strdup(str);
-						}
-						if(iniReadString(file, spec, "DigestRealm", scfg.sys_name,str)==str) {
-							FREE_AND_NULL(session->req.digest_realm);
-							/* FREE()d in close_request() */
-							session->req.digest_realm=strdup(str);
-						}
-						if(iniReadString(file, spec, "ErrorDirectory", error_dir,str)==str) {
-							FREE_AND_NULL(session->req.error_dir);
-							prep_dir(root_dir, str, sizeof(str));
-							/* FREE()d in close_request() */
-							session->req.error_dir=strdup(str);
-						}
-						if(iniReadString(file, spec, "CGIDirectory", cgi_dir,str)==str) {
-							FREE_AND_NULL(session->req.cgi_dir);
-							prep_dir(root_dir, str, sizeof(str));
-							/* FREE()d in close_request() */
-							session->req.cgi_dir=strdup(str);
-							recheck_dynamic=TRUE;
-						}
-						if(iniReadString(file, spec, "Authentication", default_auth_list,str)==str) {
-							FREE_AND_NULL(session->req.auth_list);
-							/* FREE()d in close_request() */
-							session->req.auth_list=strdup(str);
-						}
-						session->req.path_info_index=iniReadBool(file, spec, "PathInfoIndex", FALSE);
-					}
-					free(spec);
-				}
-				iniFreeStringList(specs);
-				fclose(file);
-				if(session->req.path_info_index)
-					recheck_dynamic=TRUE;
-			}
-			else  {
-				/* If cannot open webctrl.ars, only allow sysop access */
-				SAFECOPY(session->req.ars,"LEVEL 90");
-				break;
-			}
-			/* Truncate at \r or \n - can use last_slash since I'm done with it.*/
-			truncsp(session->req.ars);
+		if(i==DIR_ACCESS_FORBIDDEN) {
+			send_error(session,"403 Forbidden");
+			return(FALSE);
+		}
+		if(i==DIR_ACCESS_SYSOP_ONLY) {
+			/* If cannot read the access controls, only allow sysop access */
+			SAFECOPY(session->req.ars,"LEVEL 90");
+			break;
 		}
 		SAFECOPY(curdir,path);
 	}
@@ -4672,7 +4917,7 @@ static BOOL exec_ssjs(http_session_t* session, char* script)  {
 		session->js_callback.counter=0;
 
 		lprintf(LOG_DEBUG,"%04d JavaScript: Compiling script: %s",session->socket,script);
-		if((js_script=JS_CompileFile(session->js_cx, session->js_glob
+		if((js_script=js_get_compiled_script(session->js_cx, session->js_glob
 			,script))==NULL) {
 			lprintf(LOG_ERR,"%04d !JavaScript FAILED to compile script (%s)"
 				,session->socket,script);
@@ -5093,6 +5338,8 @@ void http_session_thread(void* arg)
 		session_threads--;
 		return;
 	}
+	/* Written only by this thread, read only by http_output_thread */
+	session.outbuf.mode=RINGBUF_SPSC;
 
 	/* Destroyed in this block (before all returns) */
 	sem_init(&session.output_thread_terminated,0,0);
@@ -5294,6 +5541,7 @@ static void cleanup(int code)
 	free_cfg(&scfg);
 
 	listFree(&log_list);
+	free_dir_access_cache();
 
 	mime_types=iniFreeNamedStringList(mime_types);
 
@@ -5708,6 +5956,7 @@ void DLLCALL web_server(void* arg)
 		status("Listening");
 
 		listInit(&log_list,/* flags */ LINK_LIST_MUTEX|LINK_LIST_SEMAPHORE);
+		listInit(&dir_access_cache,/* flags */ LINK_LIST_MUTEX);
 		if(startup->options&WEB_OPT_HTTP_LOGGING) {
 			/********************/
 			/* Start log thread */
@@ -5752,6 +6001,8 @@ void DLLCALL web_server(void* arg)
 
 		while(server_socket!=INVALID_SOCKET && !terminate_server) {
 
+			js_cache_expire();	/* free compiled scripts that have gone unused */
+
 			/* check for re-cycle/shutdown semaphores */
 			if(active_clients.value==0) {
 				if(!(startup->options&BBS_OPT_NO_RECYCLE)) {
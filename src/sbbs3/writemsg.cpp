@@ -1382,6 +1382,8 @@ void sbbs_t::editmsg(smbmsg_t *msg, uint subnum)
 	msg->hdr.length=(ushort)smb_getmsghdrlen(msg);
 	if((i=smb_putmsghdr(&smb,msg))!=SMB_SUCCESS)
 		errormsg(WHERE,ERR_WRITE,smb.file,i,smb.last_error);
+	else
+		smb_fts_addmsg(&smb,msg);	/* re-index the new text */
 }
 
 /****************************************************************************/
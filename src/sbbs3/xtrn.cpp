@@ -350,7 +350,7 @@ static void add_env_var(str_list_t* list, const char* var, const char* val)
 /****************************************************************************/
 /* Runs an external program 												*/
 /****************************************************************************/
-int sbbs_t::external(const char* cmdline, long mode, const char* startup_dir)
+int sbbs_t::run_external(const char* cmdline, long mode, const char* startup_dir)
 {
 	char	str[MAX_PATH+1];
 	char*	env_block=NULL;
@@ -1292,7 +1292,7 @@ static int forkpty(int *amaster, char *name, termios *termp, winsize *winp)
 }
 #endif /* NEED_FORKPTY */
 
-int sbbs_t::external(const char* cmdline, long mode, const char* startup_dir)
+int sbbs_t::run_external(const char* cmdline, long mode, const char* startup_dir)
 {
 	char	str[MAX_PATH+1];
 	char	fname[MAX_PATH+1];
@@ -2015,6 +2015,22 @@ int sbbs_t::external(const char* cmdline, long mode, const char* startup_dir)
 
 #endif	/* !WIN32 */
 
+/****************************************************************************/
+/* Runs an external program with batched output (see outcom_begin) sent		*/
+/* first and batching suspended, as the program's output goes straight to	*/
+/* the output buffer														*/
+/****************************************************************************/
+int sbbs_t::external(const char* cmdline, long mode, const char* startup_dir)
+{
+	int		batch;
+	int		result;
+
+	batch=outcom_suspend();
+	result=run_external(cmdline, mode, startup_dir);
+	outcom_resume(batch);
+	return(result);
+}
+
 const char* quoted_string(const char* str, char* buf, size_t maxlen)
 {
 	if(strchr(str,' ')==NULL)
@@ -38,6 +38,220 @@
 #include "smblib.h"
 #include "genwrap.h"
 
+/****************************************************************************/
+/* Self-packing message bases keep an in-memory list of the runs of unused	*/
+/* blocks in each allocation file (smb->sda_free and smb->sha_free), so		*/
+/* that allocating blocks for a new message doesn't require reading the		*/
+/* entire allocation file. The list is kept while the message base is open	*/
+/* and is re-read when the allocation file length or time changes (i.e.		*/
+/* another process has modified it). Blocks are always verified to still be	*/
+/* unused in the allocation file before they are allocated.					*/
+/****************************************************************************/
+static BOOL freelist_current(FILE* fp, smbfree_t* list)
+{
+	struct stat st;
+
+	return(list->extent!=NULL && fstat(fileno(fp),&st)==0
+		&& list->length==(long)st.st_size && list->time==st.st_mtime);
+}
+
+/* Record the allocation file length and time after updating it */
+static void freelist_stamp(FILE* fp, smbfree_t* list)
+{
+	struct stat st;
+
+	if(list->extent==NULL)
+		return;
+	if(fstat(fileno(fp),&st)!=0) {
+		FREE_AND_NULL(list->extent);
+		return;
+	}
+	list->length=(long)st.st_size;
+	list->time=st.st_mtime;
+}
+
+static BOOL freelist_grow(smbfree_t* list)
+{
+	smbextent_t*	extent;
+
+	if(list->extents<list->max_extents)
+		return(TRUE);
+	if((extent=(smbextent_t*)realloc(list->extent,sizeof(smbextent_t)*list->max_extents*2))==NULL) {
+		FREE_AND_NULL(list->extent);
+		return(FALSE);
+	}
+	list->extent=extent;
+	list->max_extents*=2;
+	return(TRUE);
+}
+
+/* Adds a run of unused blocks to the list, merging with adjacent runs */
+static void freelist_add(smbfree_t* list, ulong offset, ulong blocks)
+{
+	ulong	e,n,end=offset+blocks;
+
+	if(list->extent==NULL || !blocks)
+		return;
+	for(e=0;e<list->extents && list->extent[e].offset+list->extent[e].blocks<offset;e++)
+		;
+	/* Merge with any runs that overlap or are adjacent */
+	for(n=e;n<list->extents && list->extent[n].offset<=end;n++) {
+		if(list->extent[n].offset<offset)
+			offset=list->extent[n].offset;
+		if(list->extent[n].offset+list->extent[n].blocks>end)
+			end=list->extent[n].offset+list->extent[n].blocks;
+	}
+	if(n==e) {	/* new run */
+		if(!freelist_grow(list))
+			return;
+		memmove(&list->extent[e+1],&list->extent[e],sizeof(smbextent_t)*(list->extents-e));
+		list->extents++;
+	} else if(n>e+1) {
+		memmove(&list->extent[e+1],&list->extent[n],sizeof(smbextent_t)*(list->extents-n));
+		list->extents-=n-(e+1);
+	}
+	list->extent[e].offset=offset;
+	list->extent[e].blocks=end-offset;
+}
+
+/* Removes a run of (now used) blocks from the list */
+static void freelist_remove(smbfree_t* list, ulong offset, ulong blocks)
+{
+	ulong	e,end=offset+blocks;
+	ulong	run_end;
+
+	if(list->extent==NULL || !blocks)
+		return;
+	for(e=0;e<list->extents;) {
+		run_end=list->extent[e].offset+list->extent[e].blocks;
+		if(run_end<=offset) {
+			e++;
+			continue;
+		}
+		if(list->extent[e].offset>=end)
+			break;
+		if(list->extent[e].offset<offset) {
+			if(run_end>end) {	/* split */
+				if(!freelist_grow(list))
+					return;
+				memmove(&list->extent[e+1],&list->extent[e],sizeof(smbextent_t)*(list->extents-e));
+				list->extents++;
+				list->extent[e+1].offset=end;
+				list->extent[e+1].blocks=run_end-end;
+			}
+			list->extent[e].blocks=offset-list->extent[e].offset;
+			e++;
+		} else if(run_end>end) {
+			list->extent[e].blocks=run_end-end;
+			list->extent[e].offset=end;
+			break;
+		} else {
+			list->extents--;
+			memmove(&list->extent[e],&list->extent[e+1],sizeof(smbextent_t)*(list->extents-e));
+		}
+	}
+}
+
+/* Updates the list after blocks have been marked used or unused in the file */
+static void freelist_update(FILE* fp, smbfree_t* list, BOOL current, ulong offset, ulong blocks, BOOL used)
+{
+	if(!current || list->extent==NULL || offset>list->blocks) {
+		FREE_AND_NULL(list->extent);
+		return;
+	}
+	if(offset+blocks>list->blocks)
+		list->blocks=offset+blocks;
+	if(used)
+		freelist_remove(list,offset,blocks);
+	else
+		freelist_add(list,offset,blocks);
+	freelist_stamp(fp,list);
+}
+
+/* Reads the entire allocation file to create the list */
+static BOOL freelist_read(smb_t* smb, FILE* fp, smbfree_t* list, size_t entry_size)
+{
+	uchar	buf[4096];
+	size_t	i,j,len;
+	ulong	block=0;
+	ulong	run=0;
+
+	FREE_AND_NULL(list->extent);
+	list->extents=0;
+	list->max_extents=64;
+	if((list->extent=(smbextent_t*)malloc(sizeof(smbextent_t)*list->max_extents))==NULL)
+		return(FALSE);
+	rewind(fp);
+	while((len=smb_fread(smb,buf,sizeof(buf),fp))>=entry_size) {
+		for(i=0;i+entry_size<=len;i+=entry_size,block++) {
+			for(j=0;j<entry_size;j++)
+				if(buf[i+j])
+					break;
+			if(j==entry_size)	/* unused */
+				run++;
+			else if(run) {
+				freelist_add(list,block-run,run);
+				run=0;
+			}
+		}
+	}
+	if(run)
+		freelist_add(list,block-run,run);
+	clearerr(fp);
+	list->blocks=block;
+	freelist_stamp(fp,list);
+	return(list->extent!=NULL);
+}
+
+/* Returns TRUE if the blocks are (still) unused in the allocation file */
+static BOOL freelist_verify(smb_t* smb, FILE* fp, size_t entry_size, ulong offset, ulong blocks)
+{
+	uchar	buf[1024];
+	size_t	i,len;
+	ulong	bytes=blocks*entry_size;
+
+	if(fseek(fp,offset*entry_size,SEEK_SET))
+		return(FALSE);
+	while(bytes) {
+		len=bytes<sizeof(buf) ? bytes : sizeof(buf);
+		if(smb_fread(smb,buf,len,fp)!=len)
+			return(FALSE);
+		for(i=0;i<len;i++)
+			if(buf[i])
+				return(FALSE);
+		bytes-=len;
+	}
+	return(TRUE);
+}
+
+/* Returns the first block of the first run of enough unused blocks,		*/
+/* the end of file, or negative if the list could not be read				*/
+static long freelist_alloc(smb_t* smb, FILE* fp, smbfree_t* list, size_t entry_size, ulong blocks)
+{
+	int		retry;
+	ulong	e;
+	ulong	offset;
+
+	for(retry=0;retry<2;retry++) {
+		if(!freelist_current(fp,list) && !freelist_read(smb,fp,list,entry_size))
+			break;
+		for(e=0;e<list->extents;e++)
+			if(list->extent[e].blocks>=blocks)
+				break;
+		if(e>=list->extents)
+			offset=list->blocks;
+		else
+			offset=list->extent[e].offset;
+		if(offset>=list->blocks || freelist_verify(smb,fp,entry_size,offset,blocks)) {
+			clearerr(fp);
+			return((long)offset);
+		}
+		FREE_AND_NULL(list->extent);	/* Stale, re-read it */
+	}
+	clearerr(fp);
+	return(-1);
+}
+
 /****************************************************************************/
 /* Finds unused space in data file based on block allocation table and		*/
 /* marks space as used in allocation table.                                 */
@@ -51,6 +265,7 @@ long SMBCALL smb_allocdat(smb_t* smb, ulong length, uint16_t refs)
 {
     uint16_t  i;
 	ulong	j,l,blocks,offset=0L;
+	long	block;
 
 	if(smb->sda_fp==NULL) {
 		safe_snprintf(smb->last_error,sizeof(smb->last_error),"msgbase not open");
@@ -59,17 +274,21 @@ long SMBCALL smb_allocdat(smb_t* smb, ulong length, uint16_t refs)
 	blocks=smb_datblocks(length);
 	j=0;	/* j is consecutive unused block counter */
 	fflush(smb->sda_fp);
-	rewind(smb->sda_fp);
-	while(!feof(smb->sda_fp) && (long)offset>=0) {
-		if(smb_fread(smb,&i,sizeof(i),smb->sda_fp)!=sizeof(i))
-			break;
-		offset+=SDT_BLOCK_LEN;
-		if(!i) j++;
-		else   j=0;
-		if(j==blocks) {
-			offset-=(blocks*SDT_BLOCK_LEN);
-			break; 
-		} 
+	if((block=freelist_alloc(smb,smb->sda_fp,&smb->sda_free,sizeof(refs),blocks))>=0)
+		offset=block*SDT_BLOCK_LEN;
+	else {
+		rewind(smb->sda_fp);
+		while(!feof(smb->sda_fp) && (long)offset>=0) {
+			if(smb_fread(smb,&i,sizeof(i),smb->sda_fp)!=sizeof(i))
+				break;
+			offset+=SDT_BLOCK_LEN;
+			if(!i) j++;
+			else   j=0;
+			if(j==blocks) {
+				offset-=(blocks*SDT_BLOCK_LEN);
+				break; 
+			} 
+		}
 	}
 	if((long)offset<0) {
 		safe_snprintf(smb->last_error,sizeof(smb->last_error),"invalid data offset: %lu",offset);
@@ -81,6 +300,7 @@ long SMBCALL smb_allocdat(smb_t* smb, ulong length, uint16_t refs)
 	}
 	for(l=0;l<blocks;l++)
 		if(!fwrite(&refs,sizeof(refs),1,smb->sda_fp)) {
+			FREE_AND_NULL(smb->sda_free.extent);
 			safe_snprintf(smb->last_error,sizeof(smb->last_error)
 				,"%d '%s' writing allocation bytes at offset %ld"
 				,get_errno(),STRERROR(get_errno())
@@ -88,6 +308,8 @@ long SMBCALL smb_allocdat(smb_t* smb, ulong length, uint16_t refs)
 			return(SMB_ERR_WRITE);
 		}
 	fflush(smb->sda_fp);
+	freelist_update(smb->sda_fp,&smb->sda_free,/* current: */block>=0
+		,offset/SDT_BLOCK_LEN,blocks,/* used: */refs!=0);
 	return(offset);
 }
 
@@ -98,12 +320,14 @@ long SMBCALL smb_allocdat(smb_t* smb, ulong length, uint16_t refs)
 long SMBCALL smb_fallocdat(smb_t* smb, ulong length, uint16_t refs)
 {
 	ulong	l,blocks,offset;
+	BOOL	current;
 
 	if(smb->sda_fp==NULL) {
 		safe_snprintf(smb->last_error,sizeof(smb->last_error),"msgbase not open");
 		return(SMB_ERR_NOT_OPEN);
 	}
 	fflush(smb->sda_fp);
+	current=freelist_current(smb->sda_fp,&smb->sda_free);
 	clearerr(smb->sda_fp);
 	blocks=smb_datblocks(length);
 	if(fseek(smb->sda_fp,0L,SEEK_END)) {
@@ -119,6 +343,8 @@ long SMBCALL smb_fallocdat(smb_t* smb, ulong length, uint16_t refs)
 		if(!fwrite(&refs,sizeof(refs),1,smb->sda_fp))
 			break;
 	fflush(smb->sda_fp);
+	freelist_update(smb->sda_fp,&smb->sda_free,current && l==blocks
+		,offset/SDT_BLOCK_LEN,blocks,/* used: */refs!=0);
 	if(l<blocks) {
 		safe_snprintf(smb->last_error,sizeof(smb->last_error)
 			,"%d '%s' writing allocation bytes"
@@ -135,6 +361,7 @@ long SMBCALL smb_fallocdat(smb_t* smb, ulong length, uint16_t refs)
 int SMBCALL smb_freemsgdat(smb_t* smb, ulong offset, ulong length, uint16_t refs)
 {
 	BOOL	da_opened=FALSE;
+	BOOL	current;
 	int		retval=SMB_SUCCESS;
 	uint16_t	i;
 	ulong	l,blocks;
@@ -151,6 +378,8 @@ int SMBCALL smb_freemsgdat(smb_t* smb, ulong offset, ulong length, uint16_t refs
 		da_opened=TRUE;
 	}
 
+	fflush(smb->sda_fp);
+	current=freelist_current(smb->sda_fp,&smb->sda_free);
 	clearerr(smb->sda_fp);
 	for(l=0;l<blocks;l++) {
 		sda_offset=((offset/SDT_BLOCK_LEN)+l)*sizeof(i);
@@ -189,8 +418,14 @@ int SMBCALL smb_freemsgdat(smb_t* smb, ulong offset, ulong length, uint16_t refs
 			retval=SMB_ERR_WRITE; 
 			break;
 		}
+		if(i==0 && current)
+			freelist_add(&smb->sda_free,(offset/SDT_BLOCK_LEN)+l,1);
 	}
 	fflush(smb->sda_fp);
+	if(current && retval==SMB_SUCCESS)
+		freelist_stamp(smb->sda_fp,&smb->sda_free);
+	else
+		FREE_AND_NULL(smb->sda_free.extent);
 	if(da_opened)
 		smb_close_da(smb);
 	return(retval);
@@ -204,11 +439,15 @@ int SMBCALL smb_incdat(smb_t* smb, ulong offset, ulong length, uint16_t refs)
 {
 	uint16_t	i;
 	ulong	l,blocks;
+	BOOL	current;
 
 	if(smb->sda_fp==NULL) {
 		safe_snprintf(smb->last_error,sizeof(smb->last_error),"msgbase not open");
 		return(SMB_ERR_NOT_OPEN);
 	}
+	fflush(smb->sda_fp);
+	current=freelist_current(smb->sda_fp,&smb->sda_free);
+	smb->sda_free.length=-1;	/* Not current, unless updated below */
 	clearerr(smb->sda_fp);
 	blocks=smb_datblocks(length);
 	for(l=0;l<blocks;l++) {
@@ -234,7 +473,11 @@ int SMBCALL smb_incdat(smb_t* smb, ulong offset, ulong length, uint16_t refs)
 			return(SMB_ERR_WRITE); 
 		}
 	}
-	return fflush(smb->sda_fp); /* SMB_SUCCESS == 0 */
+	if(fflush(smb->sda_fp)!=0)
+		return(SMB_ERR_WRITE);
+	freelist_update(smb->sda_fp,&smb->sda_free,current
+		,offset/SDT_BLOCK_LEN,blocks,/* used: */refs!=0);
+	return(SMB_SUCCESS);
 }
 
 /****************************************************************************/
@@ -276,11 +519,15 @@ int SMBCALL smb_freemsghdr(smb_t* smb, ulong offset, ulong length)
 {
 	uchar	c=0;
 	ulong	l,blocks;
+	BOOL	current;
 
 	if(smb->sha_fp==NULL) {
 		safe_snprintf(smb->last_error,sizeof(smb->last_error),"msgbase not open");
 		return(SMB_ERR_NOT_OPEN);
 	}
+	fflush(smb->sha_fp);
+	current=freelist_current(smb->sha_fp,&smb->sha_free);
+	smb->sha_free.length=-1;	/* Not current, unless updated below */
 	clearerr(smb->sha_fp);
 	blocks=smb_hdrblocks(length);
 	if(fseek(smb->sha_fp,offset/SHD_BLOCK_LEN,SEEK_SET))
@@ -292,7 +539,11 @@ int SMBCALL smb_freemsghdr(smb_t* smb, ulong offset, ulong length)
 				,get_errno(),STRERROR(get_errno()));
 			return(SMB_ERR_WRITE);
 		}
-	return fflush(smb->sha_fp);	/* SMB_SUCCESS == 0 */
+	if(fflush(smb->sha_fp)!=0)
+		return(SMB_ERR_WRITE);
+	freelist_update(smb->sha_fp,&smb->sha_free,current
+		,offset/SHD_BLOCK_LEN,blocks,/* used: */FALSE);
+	return(SMB_SUCCESS);
 }
 
 /****************************************************************************/
@@ -343,6 +594,7 @@ long SMBCALL smb_allochdr(smb_t* smb, ulong length)
 {
 	uchar	c;
 	ulong	i,l,blocks,offset=0;
+	long	block;
 
 	if(smb->sha_fp==NULL) {
 		safe_snprintf(smb->last_error,sizeof(smb->last_error),"msgbase not open");
@@ -351,17 +603,21 @@ long SMBCALL smb_allochdr(smb_t* smb, ulong length)
 	blocks=smb_hdrblocks(length);
 	i=0;	/* i is consecutive unused block counter */
 	fflush(smb->sha_fp);
-	rewind(smb->sha_fp);
-	while(!feof(smb->sha_fp)) {
-		if(smb_fread(smb,&c,sizeof(c),smb->sha_fp)!=sizeof(c)) 
-			break;
-		offset+=SHD_BLOCK_LEN;
-		if(!c) i++;
-		else   i=0;
-		if(i==blocks) {
-			offset-=(blocks*SHD_BLOCK_LEN);
-			break; 
-		} 
+	if((block=freelist_alloc(smb,smb->sha_fp,&smb->sha_free,sizeof(c),blocks))>=0)
+		offset=block*SHD_BLOCK_LEN;
+	else {
+		rewind(smb->sha_fp);
+		while(!feof(smb->sha_fp)) {
+			if(smb_fread(smb,&c,sizeof(c),smb->sha_fp)!=sizeof(c)) 
+				break;
+			offset+=SHD_BLOCK_LEN;
+			if(!c) i++;
+			else   i=0;
+			if(i==blocks) {
+				offset-=(blocks*SHD_BLOCK_LEN);
+				break; 
+			} 
+		}
 	}
 	clearerr(smb->sha_fp);
 	if(fseek(smb->sha_fp,offset/SHD_BLOCK_LEN,SEEK_SET))
@@ -369,12 +625,15 @@ long SMBCALL smb_allochdr(smb_t* smb, ulong length)
 
 	for(l=0;l<blocks;l++)
 		if(fputc(1,smb->sha_fp)!=1) {
+			FREE_AND_NULL(smb->sha_free.extent);
 			safe_snprintf(smb->last_error,sizeof(smb->last_error)
 				,"%d '%s' writing allocation record"
 				,get_errno(),STRERROR(get_errno()));
 			return(SMB_ERR_WRITE);
 		}
 	fflush(smb->sha_fp);
+	freelist_update(smb->sha_fp,&smb->sha_free,/* current: */block>=0
+		,offset/SHD_BLOCK_LEN,blocks,/* used: */TRUE);
 	return(offset);
 }
 
@@ -386,6 +645,7 @@ long SMBCALL smb_fallochdr(smb_t* smb, ulong length)
 {
 	uchar	c=1;
 	ulong	l,blocks,offset;
+	BOOL	current;
 
 	if(smb->sha_fp==NULL) {
 		safe_snprintf(smb->last_error,sizeof(smb->last_error),"msgbase not open");
@@ -393,18 +653,22 @@ long SMBCALL smb_fallochdr(smb_t* smb, ulong length)
 	}
 	blocks=smb_hdrblocks(length);
 	fflush(smb->sha_fp);
+	current=freelist_current(smb->sha_fp,&smb->sha_free);
 	clearerr(smb->sha_fp);
 	if(fseek(smb->sha_fp,0L,SEEK_END))
 		return(SMB_ERR_SEEK);
 	offset=ftell(smb->sha_fp)*SHD_BLOCK_LEN;
 	for(l=0;l<blocks;l++)
 		if(!fwrite(&c,1,1,smb->sha_fp)) {
+			FREE_AND_NULL(smb->sha_free.extent);
 			safe_snprintf(smb->last_error,sizeof(smb->last_error)
 				,"%d '%s' writing allocation record"
 				,get_errno(),STRERROR(get_errno()));
 			return(SMB_ERR_WRITE);
 		}
 	fflush(smb->sha_fp);
+	freelist_update(smb->sha_fp,&smb->sha_free,current
+		,offset/SHD_BLOCK_LEN,blocks,/* used: */TRUE);
 	return(offset);
 }
 
@@ -56,6 +56,8 @@
 
 #define SMB_HEADER_ID	"SMB\x1a"		/* <S> <M> <B> <^Z> */
 #define SHD_HEADER_ID	"SHD\x1a"		/* <S> <H> <D> <^Z> */
+#define SCH_HEADER_ID	"SCH\x1a"		/* <S> <C> <H> <^Z> */
+#define HIX_HEADER_ID	"HIX\x1a"		/* <H> <I> <X> <^Z> */
 #define LEN_HEADER_ID	4
 
 #ifndef uchar
@@ -495,6 +497,60 @@ typedef struct _PACK {
 
 } hash_t;
 
+typedef struct _PACK {		/* Hash file index (.hix) header */
+
+	uchar		id[LEN_HEADER_ID];	/* HIX<^Z> */
+	uint32_t	slots;			/* Size of the hash table that follows (power of 2) */
+	uint32_t	total;			/* Number of used entries in hash table */
+	uint32_t	records;		/* Number of hash file (.hash) records indexed */
+	uint32_t	unindexed;		/* Number of those records without a CRC-32 */
+
+} hixhdr_t;
+
+typedef struct _PACK {		/* Hash file index hash table entry */
+
+	uint32_t	crc32;			/* hash_t.crc32 */
+	uchar		source;			/* hash_t.source */
+	uchar		reserved[3];
+	uint32_t	record;			/* Hash file record number + 1 (0 = unused entry) */
+
+} hixent_t;
+
+typedef struct _PACK {		/* Duplicate message text CRC history (.sch) header */
+
+	uchar		id[LEN_HEADER_ID];	/* SCH<^Z> */
+	uint32_t	max_crcs;		/* Capacity of the CRC list that follows */
+	uint32_t	slots;			/* Size of the hash table that follows (power of 2) */
+	uint32_t	head;			/* CRC list position of next CRC to add (or oldest) */
+	uint32_t	total;			/* Number of CRCs in list */
+
+} schhdr_t;
+
+typedef struct _PACK {		/* Duplicate message text CRC history hash table entry */
+
+	uint32_t	crc;
+	uint32_t	pos;			/* CRC list position + 1 (0 = unused entry) */
+
+} schent_t;
+
+#define SMB_FTS_BLOOM_BITS	4096	/* Bits per full-text search index record */
+
+typedef struct _PACK {		/* Full-text search index (.sft) record */
+
+	uint32_t	number;			/* Message number */
+	uchar		bloom[SMB_FTS_BLOOM_BITS/8];	/* Bloom filter of text trigrams */
+
+} ftsrec_t;
+
+typedef struct {			/* Full-text search index look-up result */
+
+	uint32_t	total;			/* Number of messages in the index */
+	uint32_t*	indexed;		/* Sorted numbers of messages in the index */
+	uint32_t	matches;		/* Number of messages that may contain the text */
+	uint32_t*	match;			/* Sorted numbers of those messages */
+
+} smbfts_t;
+
 typedef struct _PACK {		/* Message base header (fixed portion) */
 
     uchar		id[LEN_HEADER_ID];	/* SMB<^Z> */
@@ -627,6 +683,24 @@ typedef struct {				/* Message */
 
 } smbmsg_t;
 
+typedef struct {			/* Run of unused blocks in an allocation file */
+
+	ulong		offset;			/* First unused block */
+	ulong		blocks;			/* Number of consecutive unused blocks */
+
+} smbextent_t;
+
+typedef struct {			/* In-memory list of unused blocks in an allocation file */
+
+	smbextent_t*	extent;		/* Sorted by offset (NULL if not read) */
+	ulong		extents;		/* Number of runs in list */
+	ulong		max_extents;	/* Number of runs allocated */
+	ulong		blocks;			/* Total number of blocks in allocation file */
+	long		length;			/* Allocation file length and time when read/updated */
+	time_t		time;
+
+} smbfree_t;
+
 typedef struct {			/* Message base */
 
     char		file[128];      /* Path and base filename (no extension) */
@@ -641,6 +715,13 @@ typedef struct {			/* Message base */
 	smbstatus_t status; 	/* Status header record */
 	BOOL		locked;			/* SMB header is locked */
 	char		last_error[MAX_PATH*2];		/* Last error message */
+	idxrec_t*	idx_cache;		/* In-memory copy of index (see smb_loadidx) */
+	uint32_t	idx_cache_total;/* Number of records in idx_cache */
+	long		idx_cache_length;	/* Index file length and time when cached */
+	time_t		idx_cache_time;
+	long		idx_cache_ntime;	/* Nanoseconds of idx_cache_time (if known) */
+	smbfree_t	sda_free;		/* Unused data blocks (see smb_allocdat) */
+	smbfree_t	sha_free;		/* Unused header blocks (see smb_allochdr) */
 
 	/* Private member variables (not initialized by or used by smblib) */
 	uint32_t	subnum;			/* Sub-board number */
@@ -44,14 +44,290 @@
 #include "crc32.h"
 #include "genwrap.h"
 
+/****************************************************************************/
+/* The hash file index (.hix) is an open-addressing (linear probing) hash	*/
+/* table of the hash file (.hash) records, keyed by source and CRC-32, so	*/
+/* that finding a hash doesn't require reading the entire hash file.		*/
+/* The index is brought up-to-date (or rebuilt) whenever the hash file is	*/
+/* found to have more (or fewer) records than have been indexed.			*/
+/* The hash file must be open (and locked) when the index is accessed.		*/
+/****************************************************************************/
+#define HIX_MIN_SLOTS				1024
+#define HIX_ENTRY_OFFSET(slot)		(sizeof(hixhdr_t)+((slot)*sizeof(hixent_t)))
+
+static uint32_t hix_home(hixhdr_t* hdr, uchar source, uint32_t crc)
+{
+	crc^=source;
+	crc^=crc>>16;
+	crc*=0x45d9f3b;
+	crc^=crc>>16;
+	return(crc&(hdr->slots-1));
+}
+
+static BOOL hix_getent(int file, uint32_t slot, hixent_t* ent)
+{
+	return(lseek(file,HIX_ENTRY_OFFSET(slot),SEEK_SET)==(long)HIX_ENTRY_OFFSET(slot)
+		&& read(file,ent,sizeof(hixent_t))==sizeof(hixent_t));
+}
+
+static BOOL hix_putent(int file, uint32_t slot, hixent_t* ent)
+{
+	return(lseek(file,HIX_ENTRY_OFFSET(slot),SEEK_SET)==(long)HIX_ENTRY_OFFSET(slot)
+		&& write(file,ent,sizeof(hixent_t))==sizeof(hixent_t));
+}
+
+static BOOL hix_puthdr(int file, hixhdr_t* hdr)
+{
+	return(lseek(file,0,SEEK_SET)==0 && write(file,hdr,sizeof(hixhdr_t))==sizeof(hixhdr_t));
+}
+
+/* Returns FALSE if hash record is not to be indexed (i.e. no CRC-32) */
+static BOOL hix_indexable(hash_t* hash)
+{
+	return((hash->flags&SMB_HASH_CRC32)!=0);
+}
+
+/* Creates a new index of all the records in the hash file */
+static int hix_build(smb_t* smb, int file, hixhdr_t* hdr, uint32_t records)
+{
+	uint32_t	r;
+	uint32_t	slot;
+	hixent_t*	table;
+	hash_t		hash;
+
+	memset(hdr,0,sizeof(hixhdr_t));
+	memcpy(hdr->id,HIX_HEADER_ID,LEN_HEADER_ID);
+	for(hdr->slots=HIX_MIN_SLOTS;hdr->slots<records*4;hdr->slots<<=1)
+		;
+	if((table=(hixent_t*)calloc(hdr->slots,sizeof(hixent_t)))==NULL) {
+		safe_snprintf(smb->last_error,sizeof(smb->last_error)
+			,"malloc failure of %lu bytes",(ulong)(hdr->slots*sizeof(hixent_t)));
+		return(SMB_ERR_MEM);
+	}
+	fseek(smb->hash_fp,0,SEEK_SET);
+	for(r=0;r<records;r++) {
+		if(smb_fread(smb,&hash,sizeof(hash),smb->hash_fp)!=sizeof(hash))
+			break;
+		if(hash.flags==0)
+			continue;
+		if(!hix_indexable(&hash)) {
+			hdr->unindexed++;
+			continue;
+		}
+		for(slot=hix_home(hdr,hash.source,hash.crc32);table[slot].record;slot=(slot+1)&(hdr->slots-1))
+			;
+		table[slot].crc32=hash.crc32;
+		table[slot].source=hash.source;
+		table[slot].record=r+1;
+		hdr->total++;
+	}
+	hdr->records=r;
+
+	chsize(file,0);
+	if(!hix_puthdr(file,hdr)
+		|| write(file,table,hdr->slots*sizeof(hixent_t))!=(int)(hdr->slots*sizeof(hixent_t))) {
+		free(table);
+		chsize(file,0);
+		safe_snprintf(smb->last_error,sizeof(smb->last_error)
+			,"%d '%s' writing hash index"
+			,get_errno(),STRERROR(get_errno()));
+		return(SMB_ERR_WRITE);
+	}
+	free(table);
+	return(SMB_SUCCESS);
+}
+
+/* Adds the hash file records that have been appended since last indexed */
+static int hix_update(smb_t* smb, int file, hixhdr_t* hdr, BOOL rebuild)
+{
+	long		length;
+	uint32_t	records;
+	uint32_t	slot;
+	hixent_t	ent;
+	hash_t		hash;
+
+	length=filelength(fileno(smb->hash_fp));
+	if(length<0) {
+		safe_snprintf(smb->last_error,sizeof(smb->last_error)
+			,"invalid file length: %ld", length);
+		return(SMB_ERR_FILE_LEN);
+	}
+	records=length/sizeof(hash_t);
+
+	memset(hdr,0,sizeof(hixhdr_t));
+	if(!rebuild && (lseek(file,0,SEEK_SET)!=0 || read(file,hdr,sizeof(hixhdr_t))!=sizeof(hixhdr_t)))
+		rebuild=TRUE;
+	if(rebuild
+		|| memcmp(hdr->id,HIX_HEADER_ID,LEN_HEADER_ID)
+		|| hdr->slots<HIX_MIN_SLOTS || (hdr->slots&(hdr->slots-1))
+		|| hdr->records>records
+		|| filelength(file)!=(long)HIX_ENTRY_OFFSET(hdr->slots)
+		|| (hdr->total+(records-hdr->records))*2>hdr->slots)
+		return(hix_build(smb,file,hdr,records));
+
+	if(hdr->records==records)
+		return(SMB_SUCCESS);
+
+	fseek(smb->hash_fp,hdr->records*sizeof(hash_t),SEEK_SET);
+	for(;hdr->records<records;hdr->records++) {
+		if(smb_fread(smb,&hash,sizeof(hash),smb->hash_fp)!=sizeof(hash))
+			break;
+		if(hash.flags==0)
+			continue;
+		if(!hix_indexable(&hash)) {
+			hdr->unindexed++;
+			continue;
+		}
+		for(slot=hix_home(hdr,hash.source,hash.crc32);;slot=(slot+1)&(hdr->slots-1)) {
+			if(!hix_getent(file,slot,&ent))
+				return(hix_build(smb,file,hdr,records));
+			if(ent.record==0)
+				break;
+		}
+		memset(&ent,0,sizeof(ent));
+		ent.crc32=hash.crc32;
+		ent.source=hash.source;
+		ent.record=hdr->records+1;
+		if(!hix_putent(file,slot,&ent))
+			return(hix_build(smb,file,hdr,records));
+		hdr->total++;
+	}
+	if(!hix_puthdr(file,hdr)) {
+		chsize(file,0);
+		safe_snprintf(smb->last_error,sizeof(smb->last_error)
+			,"%d '%s' writing hash index header"
+			,get_errno(),STRERROR(get_errno()));
+		return(SMB_ERR_WRITE);
+	}
+	return(SMB_SUCCESS);
+}
+
+/* Opens the hash file index and brings it up-to-date, returns -1 on failure */
+static int hix_open(smb_t* smb, hixhdr_t* hdr, BOOL rebuild)
+{
+	char	path[MAX_PATH+1];
+	int		file;
+
+	SAFEPRINTF(path,"%s.hix",smb->file);
+	if((file=sopen(path,O_RDWR|O_CREAT|O_BINARY,SH_DENYNO,S_IREAD|S_IWRITE))==-1) {
+		safe_snprintf(smb->last_error,sizeof(smb->last_error)
+			,"%d '%s' opening %s"
+			,get_errno(),STRERROR(get_errno()),path);
+		return(-1);
+	}
+	if(hix_update(smb,file,hdr,rebuild)!=SMB_SUCCESS) {
+		close(file);
+		return(-1);
+	}
+	return(file);
+}
+
+/* Brings the hash file index up-to-date with the hash file (or rebuilds it)*/
+int SMBCALL smb_indexhashes(smb_t* smb, BOOL rebuild)
+{
+	int			file;
+	int			retval;
+	BOOL		opened=(smb->hash_fp==NULL);
+	hixhdr_t	hdr;
+
+	if((retval=smb_open_hash(smb))!=SMB_SUCCESS)
+		return(retval);
+
+	if((file=hix_open(smb,&hdr,rebuild))==-1)
+		retval=SMB_ERR_WRITE;
+	else
+		close(file);
+
+	if(opened)
+		smb_close_hash(smb);
+
+	return(retval);
+}
+
+static BOOL hash_matches(hash_t* compare, hash_t* hash)
+{
+	if(compare->source!=hash->source)
+		return(FALSE);	/* wrong source */
+	if(compare->length!=hash->length)
+		return(FALSE);	/* wrong source length */
+	if(compare->flags&SMB_HASH_MARKED)
+		return(FALSE);	/* already marked */
+	if((compare->flags&SMB_HASH_PROC_COMP_MASK)!=(hash->flags&SMB_HASH_PROC_COMP_MASK))
+		return(FALSE);	/* wrong pre-process flags */
+	if((compare->flags&hash->flags&SMB_HASH_MASK)==0)	
+		return(FALSE);	/* no matching hashes */
+	if((compare->flags&hash->flags&SMB_HASH_CRC16)
+		&& compare->crc16!=hash->crc16)
+		return(FALSE);	/* wrong crc-16 */
+	if((compare->flags&hash->flags&SMB_HASH_CRC32)
+		&& compare->crc32!=hash->crc32)
+		return(FALSE);	/* wrong crc-32 */
+	if((compare->flags&hash->flags&SMB_HASH_MD5)
+		&& memcmp(compare->md5,hash->md5,sizeof(hash->md5)))
+		return(FALSE);	/* wrong MD5 */
+
+	/* successful match! */
+	return(TRUE);
+}
+
+/* Finds hash records using the hash file index (instead of reading the	*/
+/* entire hash file), returns TRUE if any matching records were found		*/
+/* Of duplicate records, the first in the hash file matches (as in a scan)	*/
+static BOOL hix_findhash(smb_t* smb, int file, hixhdr_t* hdr, hash_t** compare
+						 ,hash_t* found_hash, long source_mask, BOOL mark)
+{
+	size_t		c;
+	uint32_t	slot;
+	uint32_t	record;
+	uint32_t	found_record=0;
+	hixent_t	ent;
+	hash_t		hash;
+	hash_t		first;
+
+	for(c=0;compare[c]!=NULL;c++) {
+		if((source_mask&(1<<compare[c]->source))==0)
+			continue;	/* not checking this source type */
+		record=0;
+		for(slot=hix_home(hdr,compare[c]->source,compare[c]->crc32);;slot=(slot+1)&(hdr->slots-1)) {
+			if(!hix_getent(file,slot,&ent) || ent.record==0)
+				break;
+			if(ent.crc32!=compare[c]->crc32 || ent.source!=compare[c]->source)
+				continue;
+			if(record && ent.record>record)
+				continue;	/* not the first matching record */
+			if(fseek(smb->hash_fp,(ent.record-1)*sizeof(hash_t),SEEK_SET)!=0
+				|| smb_fread(smb,&hash,sizeof(hash),smb->hash_fp)!=sizeof(hash))
+				continue;
+			if(hash.flags==0 || !hash_matches(compare[c],&hash))
+				continue;
+			record=ent.record;
+			memcpy(&first,&hash,sizeof(hash));
+		}
+		if(!record)
+			continue;
+		if(mark)
+			compare[c]->flags|=SMB_HASH_MARKED;
+		/* Report the same record a hash file scan would: the first, or when marking, the last */
+		if(!found_record
+			|| (mark && record>found_record) || (!mark && record<found_record)) {
+			found_record=record;
+			if(found_hash!=NULL)
+				memcpy(found_hash,&first,sizeof(first));
+		}
+	}
+	return(found_record!=0);
+}
+
 /* If return value is SMB_ERR_NOT_FOUND, hash file is left open */
 int SMBCALL smb_findhash(smb_t* smb, hash_t** compare, hash_t* found_hash, 
 						 long source_mask, BOOL mark)
 {
 	int		retval;
+	int		file;
 	BOOL	found=FALSE;
 	size_t	c,count;
 	hash_t	hash;
+	hixhdr_t hdr;
 
 	if(found_hash!=NULL)
 		memset(found_hash,0,sizeof(hash_t));
@@ -63,6 +339,24 @@ int SMBCALL smb_findhash(smb_t* smb, hash_t** compare, hash_t* found_hash,
 
 	if(count && source_mask!=SMB_HASH_SOURCE_NONE) {
 
+		/* Use the index if all the hashes being compared (and stored) have CRC-32s */
+		for(c=0;compare[c]!=NULL;c++)
+			if((source_mask&(1<<compare[c]->source)) && !hix_indexable(compare[c]))
+				break;
+		if(compare[c]==NULL && (file=hix_open(smb,&hdr,/* rebuild: */FALSE))!=-1) {
+			if(hdr.unindexed==0) {
+				found=hix_findhash(smb,file,&hdr,compare,found_hash,source_mask,mark);
+				close(file);
+				if(found) {
+					smb_close_hash(smb);
+					return(SMB_SUCCESS);
+				}
+				/* hash file left open */
+				return(SMB_ERR_NOT_FOUND);
+			}
+			close(file);
+		}
+
 		rewind(smb->hash_fp);
 		clearerr(smb->hash_fp);
 		while(!feof(smb->hash_fp)) {
@@ -75,31 +369,9 @@ int SMBCALL smb_findhash(smb_t* smb, hash_t** compare, hash_t* found_hash,
 			if((source_mask&(1<<hash.source))==0)	/* not checking this source type */
 				continue;
 
-			for(c=0;compare[c]!=NULL;c++) {
-
-				if(compare[c]->source!=hash.source)
-					continue;	/* wrong source */
-				if(compare[c]->length!=hash.length)
-					continue;	/* wrong source length */
-				if(compare[c]->flags&SMB_HASH_MARKED)
-					continue;	/* already marked */
-				if((compare[c]->flags&SMB_HASH_PROC_COMP_MASK)!=(hash.flags&SMB_HASH_PROC_COMP_MASK))
-					continue;	/* wrong pre-process flags */
-				if((compare[c]->flags&hash.flags&SMB_HASH_MASK)==0)	
-					continue;	/* no matching hashes */
-				if((compare[c]->flags&hash.flags&SMB_HASH_CRC16)
-					&& compare[c]->crc16!=hash.crc16)
-					continue;	/* wrong crc-16 */
-				if((compare[c]->flags&hash.flags&SMB_HASH_CRC32)
-					&& compare[c]->crc32!=hash.crc32)
-					continue;	/* wrong crc-32 */
-				if((compare[c]->flags&hash.flags&SMB_HASH_MD5)
-					&& memcmp(compare[c]->md5,hash.md5,sizeof(hash.md5)))
-					continue;	/* wrong MD5 */
-				
-				/* successful match! */
-				break;	/* can't match more than one, so stop comparing */
-			}
+			for(c=0;compare[c]!=NULL;c++)
+				if(hash_matches(compare[c],&hash))
+					break;	/* can't match more than one, so stop comparing */
 
 			if(compare[c]==NULL)
 				continue;	/* no match */
@@ -127,7 +399,9 @@ int SMBCALL smb_findhash(smb_t* smb, hash_t** compare, hash_t* found_hash,
 int SMBCALL smb_addhashes(smb_t* smb, hash_t** hashes, BOOL skip_marked)
 {
 	int		retval;
+	int		file;
 	size_t	h;
+	hixhdr_t hdr;
 
 	COUNT_LIST_ITEMS(hashes, h);
 	if(!h)	/* nothing to add */
@@ -151,6 +425,11 @@ int SMBCALL smb_addhashes(smb_t* smb, hash_t** hashes, BOOL skip_marked)
 		}
 	}
 
+	/* Index the new hash records */
+	fflush(smb->hash_fp);
+	if((file=hix_open(smb,&hdr,/* rebuild: */FALSE))!=-1)
+		close(file);
+
 	smb_close_hash(smb);
 
 	return(retval);
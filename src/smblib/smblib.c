@@ -87,6 +87,10 @@ int SMBCALL smb_open(smb_t* smb)
 		smb->retry_delay=250;	/* milliseconds */
 	smb->shd_fp=smb->sdt_fp=smb->sid_fp=NULL;
 	smb->sha_fp=smb->sda_fp=smb->hash_fp=NULL;
+	smb->idx_cache=NULL;
+	smb->idx_cache_total=0;
+	memset(&smb->sda_free,0,sizeof(smb->sda_free));
+	memset(&smb->sha_free,0,sizeof(smb->sha_free));
 	smb->last_error[0]=0;
 
 	/* Check for message-base lock semaphore file (under maintenance?) */
@@ -168,6 +172,9 @@ void SMBCALL smb_close(smb_t* smb)
 	smb_close_fp(&smb->sda_fp);
 	smb_close_fp(&smb->sha_fp);
 	smb_close_fp(&smb->hash_fp);
+	smb_freeidx(smb);
+	FREE_AND_NULL(smb->sda_free.extent);
+	FREE_AND_NULL(smb->sha_free.extent);
 }
 
 /****************************************************************************/
@@ -480,6 +487,97 @@ int SMBCALL smb_lockmsghdr(smb_t* smb, smbmsg_t* msg)
 	return(SMB_ERR_TIMEOUT);
 }
 
+/* Modification time (nanoseconds) of the index file, where available */
+static long smb_idx_ntime(struct stat* st)
+{
+#if defined(__linux__)
+	return(st->st_mtim.tv_nsec);
+#else
+	return(0);
+#endif
+}
+
+/* Returns TRUE if the cached index was read from the index file as it is now */
+static BOOL smb_idx_current(smb_t* smb, struct stat* st)
+{
+	return(smb->idx_cache!=NULL
+		&& smb->idx_cache_length==(long)st->st_size
+		&& smb->idx_cache_time==st->st_mtime
+		&& smb->idx_cache_ntime==smb_idx_ntime(st));
+}
+
+/****************************************************************************/
+/* Reads the entire index file into memory (smb->idx_cache) so subsequent	*/
+/* index lookups (smb_getmsgidx, smb_getfirstidx, smb_getlastidx) need not	*/
+/* read the file. The cache is re-read automatically when the index file's	*/
+/* length or modification time changes, and is freed by smb_close().		*/
+/* Index writes made through this smb_t update or invalidate the cache.	*/
+/****************************************************************************/
+int SMBCALL smb_loadidx(smb_t* smb)
+{
+	idxrec_t*	idx;
+	uint32_t	total;
+	struct stat	st;
+
+	if(smb->sid_fp==NULL) {
+		safe_snprintf(smb->last_error,sizeof(smb->last_error),"index not open");
+		return(SMB_ERR_NOT_OPEN);
+	}
+	if(fstat(fileno(smb->sid_fp),&st)!=0) {
+		safe_snprintf(smb->last_error,sizeof(smb->last_error)
+			,"%d '%s' getting index file status"
+			,get_errno(),STRERROR(get_errno()));
+		return(SMB_ERR_READ);
+	}
+	if(smb_idx_current(smb,&st))
+		return(SMB_SUCCESS);	/* still current */
+
+	total=(uint32_t)(st.st_size/sizeof(idxrec_t));
+	if((idx=(idxrec_t*)realloc(smb->idx_cache,(total ? total : 1)*sizeof(idxrec_t)))==NULL) {
+		smb_freeidx(smb);
+		safe_snprintf(smb->last_error,sizeof(smb->last_error)
+			,"error allocating %lu bytes of memory for index"
+			,(ulong)(total*sizeof(idxrec_t)));
+		return(SMB_ERR_MEM);
+	}
+	smb->idx_cache=idx;
+	clearerr(smb->sid_fp);
+	if(fseek(smb->sid_fp,0,SEEK_SET)) {
+		smb_freeidx(smb);
+		safe_snprintf(smb->last_error,sizeof(smb->last_error)
+			,"%d '%s' seeking to beginning of index file"
+			,get_errno(),STRERROR(get_errno()));
+		return(SMB_ERR_SEEK);
+	}
+	if(total && smb_fread(smb,idx,total*sizeof(idxrec_t),smb->sid_fp)!=total*sizeof(idxrec_t)) {
+		smb_freeidx(smb);
+		safe_snprintf(smb->last_error,sizeof(smb->last_error)
+			,"%d '%s' reading %lu index records"
+			,get_errno(),STRERROR(get_errno()),(ulong)total);
+		return(SMB_ERR_READ);
+	}
+	smb->idx_cache_total=total;
+	smb->idx_cache_length=(long)st.st_size;
+	smb->idx_cache_time=st.st_mtime;
+	smb->idx_cache_ntime=smb_idx_ntime(&st);
+	return(SMB_SUCCESS);
+}
+
+/****************************************************************************/
+/* Frees the in-memory copy of the index (if any), see smb_loadidx()		*/
+/****************************************************************************/
+void SMBCALL smb_freeidx(smb_t* smb)
+{
+	FREE_AND_NULL(smb->idx_cache);
+	smb->idx_cache_total=0;
+}
+
+/* Returns TRUE if the index has been cached (and is current) */
+static BOOL smb_cachedidx(smb_t* smb)
+{
+	return(smb->idx_cache!=NULL && smb_loadidx(smb)==SMB_SUCCESS);
+}
+
 /****************************************************************************/
 /* Fills msg->idx with message index based on msg->hdr.number				*/
 /* OR if msg->hdr.number is 0, based on msg->offset (record offset).		*/
@@ -525,6 +623,11 @@ int SMBCALL smb_getmsgidx(smb_t* smb, smbmsg_t* msg)
 				,msg->offset, byte_offset, length);
 			return(SMB_ERR_HDR_OFFSET);
 		}
+		if(smb_cachedidx(smb) && byte_offset/sizeof(idxrec_t)<smb->idx_cache_total) {
+			msg->offset=byte_offset/sizeof(idxrec_t);
+			msg->idx=smb->idx_cache[msg->offset];
+			return(SMB_SUCCESS);
+		}
 		if(fseek(smb->sid_fp,byte_offset,SEEK_SET)) {
 			safe_snprintf(smb->last_error,sizeof(smb->last_error)
 				,"%d '%s' seeking to offset %ld (byte %lu) in index file"
@@ -544,6 +647,27 @@ int SMBCALL smb_getmsgidx(smb_t* smb, smbmsg_t* msg)
 		return(SMB_SUCCESS); 
 	}
 
+	if(smb_cachedidx(smb)) {
+		total=smb->idx_cache_total;
+		bot=0;
+		top=total;
+		while(bot<top) {
+			l=bot+((top-bot)/2);
+			if(smb->idx_cache[l].number<msg->hdr.number)
+				bot=l+1;
+			else
+				top=l;
+		}
+		if(bot>=total || smb->idx_cache[bot].number!=msg->hdr.number) {
+			safe_snprintf(smb->last_error,sizeof(smb->last_error),"msg %lu not found"
+				,msg->hdr.number);
+			return(SMB_ERR_NOT_FOUND);
+		}
+		msg->idx=smb->idx_cache[bot];
+		msg->offset=bot;
+		return(SMB_SUCCESS);
+	}
+
 	bot=0;
 	top=total;
 	l=total/2; /* Start at middle index */
@@ -597,6 +721,10 @@ int SMBCALL smb_getfirstidx(smb_t* smb, idxrec_t *idx)
 		safe_snprintf(smb->last_error,sizeof(smb->last_error),"index not open");
 		return(SMB_ERR_NOT_OPEN);
 	}
+	if(smb_cachedidx(smb) && smb->idx_cache_total) {
+		*idx=smb->idx_cache[0];
+		return(SMB_SUCCESS);
+	}
 	clearerr(smb->sid_fp);
 	if(fseek(smb->sid_fp,0,SEEK_SET)) {
 		safe_snprintf(smb->last_error,sizeof(smb->last_error)
@@ -624,6 +752,10 @@ int SMBCALL smb_getlastidx(smb_t* smb, idxrec_t *idx)
 		safe_snprintf(smb->last_error,sizeof(smb->last_error),"index not open");
 		return(SMB_ERR_NOT_OPEN);
 	}
+	if(smb_cachedidx(smb) && smb->idx_cache_total) {
+		*idx=smb->idx_cache[smb->idx_cache_total-1];
+		return(SMB_SUCCESS);
+	}
 	clearerr(smb->sid_fp);
 	length=filelength(fileno(smb->sid_fp));
 	if(length<(long)sizeof(idxrec_t)) {
@@ -1323,19 +1455,172 @@ int SMBCALL smb_dfield(smbmsg_t* msg, ushort type, ulong length)
 }
 
 /****************************************************************************/
-/* Checks CRC history file for duplicate crc. If found, returns 1.			*/
-/* If no dupe, adds to CRC history and returns 0, or negative if error. 	*/
+/* The duplicate message text CRC history (.sch) file contains a header		*/
+/* (schhdr_t), a circular list of the last 'max_crcs' CRCs added (oldest	*/
+/* are replaced first) and an open-addressing (linear probing) hash table	*/
+/* of those CRCs, so that checking for and adding a CRC takes a constant	*/
+/* number of small reads and writes, regardless of the size of the history.	*/
+/* Older .sch files (just a list of CRCs) are converted when next written.	*/
+/****************************************************************************/
+#define SCH_LIST_OFFSET(hdr)		sizeof(schhdr_t)
+#define SCH_TABLE_OFFSET(hdr)		(sizeof(schhdr_t)+((hdr)->max_crcs*sizeof(uint32_t)))
+#define SCH_LENGTH(hdr)				(SCH_TABLE_OFFSET(hdr)+((hdr)->slots*sizeof(schent_t)))
+
+static uint32_t sch_home(schhdr_t* hdr, uint32_t crc)
+{
+	crc^=crc>>16;
+	crc*=0x45d9f3b;
+	crc^=crc>>16;
+	return(crc&(hdr->slots-1));
+}
+
+static BOOL sch_read(int file, ulong offset, void* buf, size_t len)
+{
+	return(lseek(file,offset,SEEK_SET)==(long)offset && read(file,buf,len)==(int)len);
+}
+
+static BOOL sch_write(int file, ulong offset, void* buf, size_t len)
+{
+	return(lseek(file,offset,SEEK_SET)==(long)offset && write(file,buf,len)==(int)len);
+}
+
+#define sch_getent(file, hdr, i, ent)	sch_read(file, SCH_TABLE_OFFSET(hdr)+((i)*sizeof(schent_t)), ent, sizeof(schent_t))
+#define sch_putent(file, hdr, i, ent)	sch_write(file, SCH_TABLE_OFFSET(hdr)+((i)*sizeof(schent_t)), ent, sizeof(schent_t))
+
+/* Removes the hash table entry in slot 'i', closing the gap (no tombstones) */
+static BOOL sch_delent(int file, schhdr_t* hdr, uint32_t i)
+{
+	uint32_t	j,k;
+	schent_t	ent;
+
+	for(j=(i+1)&(hdr->slots-1);;j=(j+1)&(hdr->slots-1)) {
+		if(!sch_getent(file,hdr,j,&ent))
+			return(FALSE);
+		if(ent.pos==0)
+			break;
+		k=sch_home(hdr,ent.crc);
+		/* Can the entry in slot j be moved back to slot i? */
+		if((j>i && (k<=i || k>j)) || (j<i && k<=i && k>j)) {
+			if(!sch_putent(file,hdr,i,&ent))
+				return(FALSE);
+			i=j;
+		}
+	}
+	memset(&ent,0,sizeof(ent));
+	return(sch_putent(file,hdr,i,&ent));
+}
+
+/* Converts an old format (or differently sized) .sch file into the current	*/
+/* format, sized for 'max_crcs', keeping the most recently added CRCs		*/
+static int sch_rebuild(smb_t* smb, int file, long length, schhdr_t* hdr)
+{
+	uchar*		buf;
+	uint32_t*	crcs;
+	uint32_t*	list;
+	schent_t*	table;
+	uint32_t	i,n,total,slot;
+	schhdr_t	old=*hdr;
+
+	if((buf=(uchar*)malloc(length+1))==NULL) {
+		safe_snprintf(smb->last_error,sizeof(smb->last_error)
+			,"malloc failure of %ld bytes",length+1);
+		return(SMB_ERR_MEM);
+	}
+	if(length && !sch_read(file,0,buf,length)) {
+		free(buf);
+		safe_snprintf(smb->last_error,sizeof(smb->last_error)
+			,"%d '%s' reading %ld bytes"
+			,get_errno(),STRERROR(get_errno()),length);
+		return(SMB_ERR_READ);
+	}
+	if(length>=(long)sizeof(schhdr_t) && memcmp(old.id,SCH_HEADER_ID,LEN_HEADER_ID)==0
+		&& old.head<old.max_crcs && old.total<=old.max_crcs
+		&& length>=(long)(SCH_LIST_OFFSET(&old)+(old.max_crcs*sizeof(uint32_t)))) {
+		/* Current format, different size: unwind the circular list (oldest first) */
+		list=(uint32_t*)(buf+SCH_LIST_OFFSET(&old));
+		total=old.total;
+		if((crcs=(uint32_t*)malloc((total+1)*sizeof(uint32_t)))==NULL) {
+			free(buf);
+			safe_snprintf(smb->last_error,sizeof(smb->last_error)
+				,"malloc failure of %lu bytes",(ulong)((total+1)*sizeof(uint32_t)));
+			return(SMB_ERR_MEM);
+		}
+		for(i=0;i<total;i++)
+			crcs[i]=list[(old.head+old.max_crcs-total+i)%old.max_crcs];
+		free(buf);
+		buf=(uchar*)crcs;
+	} else {
+		/* Old format: a list of CRCs, oldest first */
+		if(length%sizeof(uint32_t)) {
+			free(buf);
+			safe_snprintf(smb->last_error,sizeof(smb->last_error)
+				,"invalid file length: %ld", length);
+			return(SMB_ERR_FILE_LEN);
+		}
+		total=length/sizeof(uint32_t);
+		crcs=(uint32_t*)buf;
+	}
+
+	memset(hdr,0,sizeof(schhdr_t));
+	memcpy(hdr->id,SCH_HEADER_ID,LEN_HEADER_ID);
+	hdr->max_crcs=smb->status.max_crcs;
+	for(hdr->slots=64;hdr->slots<hdr->max_crcs*2;hdr->slots<<=1)
+		;
+	list=(uint32_t*)calloc(hdr->max_crcs,sizeof(uint32_t));
+	table=(schent_t*)calloc(hdr->slots,sizeof(schent_t));
+	if(list==NULL || table==NULL) {
+		free(buf);
+		FREE_AND_NULL(list);
+		FREE_AND_NULL(table);
+		safe_snprintf(smb->last_error,sizeof(smb->last_error)
+			,"malloc failure of %lu bytes",(ulong)SCH_LENGTH(hdr));
+		return(SMB_ERR_MEM);
+	}
+	n=(total>hdr->max_crcs) ? total-hdr->max_crcs : 0;
+	for(;n<total;n++) {
+		for(slot=sch_home(hdr,crcs[n]);table[slot].pos;slot=(slot+1)&(hdr->slots-1))
+			if(table[slot].crc==crcs[n])
+				break;
+		if(table[slot].pos)		/* duplicate */
+			continue;
+		list[hdr->head]=crcs[n];
+		table[slot].crc=crcs[n];
+		table[slot].pos=hdr->head+1;
+		hdr->head=(hdr->head+1)%hdr->max_crcs;
+		hdr->total++;
+	}
+	free(buf);
+
+	chsize(file,0);
+	i=sch_write(file,0,hdr,sizeof(schhdr_t))
+		&& sch_write(file,SCH_LIST_OFFSET(hdr),list,hdr->max_crcs*sizeof(uint32_t))
+		&& sch_write(file,SCH_TABLE_OFFSET(hdr),table,hdr->slots*sizeof(schent_t));
+	free(list);
+	free(table);
+	if(!i) {
+		safe_snprintf(smb->last_error,sizeof(smb->last_error)
+			,"%d '%s' writing %lu bytes"
+			,get_errno(),STRERROR(get_errno()),(ulong)SCH_LENGTH(hdr));
+		return(SMB_ERR_WRITE);
+	}
+	return(SMB_SUCCESS);
+}
+
+/****************************************************************************/
+/* If the crc is found in the duplicate message text CRC history, returns	*/
+/* SMB_DUPE_MSG, otherwise adds it (replacing the oldest, if full)			*/
 /****************************************************************************/
 int SMBCALL smb_addcrc(smb_t* smb, uint32_t crc)
 {
-	char	str[MAX_PATH+1];
-	int 	file;
-	int		wr;
-	long	length;
-	long	newlen;
-	ulong	l;
-	uint32_t *buf;
-	time_t	start=0;
+	char		str[MAX_PATH+1];
+	int 		file;
+	int			i;
+	long		length;
+	uint32_t	slot;
+	uint32_t	old;
+	schhdr_t	hdr;
+	schent_t	ent;
+	time_t		start=0;
 
 	if(!smb->status.max_crcs)
 		return(SMB_SUCCESS);
@@ -1363,59 +1648,79 @@ int SMBCALL smb_addcrc(smb_t* smb, uint32_t crc)
 	}
 
 	length=filelength(file);
-	if(length<0L || length%sizeof(uint32_t)) {
+	if(length<0L) {
 		close(file);
 		safe_snprintf(smb->last_error,sizeof(smb->last_error)
 			,"invalid file length: %ld", length);
 		return(SMB_ERR_FILE_LEN); 
 	}
 
-	if(length!=0) {
-		if((buf=(uint32_t*)malloc(length))==NULL) {
-			close(file);
-			safe_snprintf(smb->last_error,sizeof(smb->last_error)
-				,"malloc failure of %ld bytes"
-				,length);
-			return(SMB_ERR_MEM); 
-		}
-
-		if(read(file,buf,length)!=length) {
+	memset(&hdr,0,sizeof(hdr));
+	if(length>=(long)sizeof(hdr) && !sch_read(file,0,&hdr,sizeof(hdr))) {
+		close(file);
+		safe_snprintf(smb->last_error,sizeof(smb->last_error)
+			,"%d '%s' reading header"
+			,get_errno(),STRERROR(get_errno()));
+		return(SMB_ERR_READ);
+	}
+	if(memcmp(hdr.id,SCH_HEADER_ID,LEN_HEADER_ID) || hdr.max_crcs!=smb->status.max_crcs
+		|| hdr.head>=hdr.max_crcs || hdr.total>hdr.max_crcs
+		|| hdr.slots<hdr.max_crcs*2 || (hdr.slots&(hdr.slots-1)) || length!=(long)SCH_LENGTH(&hdr)) {
+		if((i=sch_rebuild(smb,file,length,&hdr))!=SMB_SUCCESS) {
 			close(file);
-			free(buf);
-			safe_snprintf(smb->last_error,sizeof(smb->last_error)
-				,"%d '%s' reading %ld bytes"
-				,get_errno(),STRERROR(get_errno()),length);
-			return(SMB_ERR_READ);
+			return(i);
 		}
+	}
 
-		for(l=0;l<length/sizeof(int32_t);l++)
-			if(crc==buf[l])
-				break;
-		if(l<length/sizeof(int32_t)) {					/* Dupe CRC found */
+	/* Look for the CRC (and an unused slot) */
+	for(slot=sch_home(&hdr,crc);;slot=(slot+1)&(hdr.slots-1)) {
+		if(!sch_getent(file,&hdr,slot,&ent))
+			break;
+		if(ent.pos==0)
+			break;
+		if(ent.crc==crc) {								/* Dupe CRC found */
 			close(file);
-			free(buf);
 			safe_snprintf(smb->last_error,sizeof(smb->last_error)
 				,"duplicate message text CRC detected");
 			return(SMB_DUPE_MSG);
-		} 
-
-		if(length>=(long)(smb->status.max_crcs*sizeof(int32_t))) {
-			newlen=(smb->status.max_crcs-1)*sizeof(int32_t);
-			chsize(file,0);	/* truncate it */
-			lseek(file,0L,SEEK_SET);
-			write(file,buf+(length-newlen),newlen); 
 		}
-		free(buf);
 	}
-	wr=write(file,&crc,sizeof(crc));	/* Write to the end */
-	close(file);
+	i=(ent.pos==0);
 
-	if(wr!=sizeof(crc)) {	
+	/* History full? Replace the oldest CRC */
+	if(i && hdr.total>=hdr.max_crcs) {
+		i=sch_read(file,SCH_LIST_OFFSET(&hdr)+(hdr.head*sizeof(uint32_t)),&old,sizeof(old));
+		for(slot=sch_home(&hdr,old);i;slot=(slot+1)&(hdr.slots-1)) {
+			if(!(i=sch_getent(file,&hdr,slot,&ent)) || ent.pos==0)
+				break;
+			if(ent.pos==hdr.head+1) {
+				i=sch_delent(file,&hdr,slot);
+				break;
+			}
+		}
+		hdr.total--;
+		/* Find the (possibly different) unused slot for the new CRC */
+		for(slot=sch_home(&hdr,crc);i;slot=(slot+1)&(hdr.slots-1))
+			if(!(i=sch_getent(file,&hdr,slot,&ent)) || ent.pos==0)
+				break;
+	}
+	if(i) {
+		ent.crc=crc;
+		ent.pos=hdr.head+1;
+		i=sch_write(file,SCH_LIST_OFFSET(&hdr)+(hdr.head*sizeof(uint32_t)),&crc,sizeof(crc))
+			&& sch_putent(file,&hdr,slot,&ent);
+		hdr.head=(hdr.head+1)%hdr.max_crcs;
+		hdr.total++;
+	}
+	if(!i || !sch_write(file,0,&hdr,sizeof(hdr))) {
+		chsize(file,0);	/* Inconsistent now, so start over */
+		close(file);
 		safe_snprintf(smb->last_error,sizeof(smb->last_error)
-			,"%d '%s' writing %u bytes"
-			,get_errno(),STRERROR(get_errno()),sizeof(crc));
+			,"%d '%s' updating %s"
+			,get_errno(),STRERROR(get_errno()),str);
 		return(SMB_ERR_WRITE);
 	}
+	close(file);
 
 	return(SMB_SUCCESS);
 }
@@ -1496,6 +1801,8 @@ int SMBCALL smb_addmsghdr(smb_t* smb, smbmsg_t* msg, int storage)
 		smb_putstatus(smb);
 	}
 	smb_unlocksmbhdr(smb);
+	if(i==SMB_SUCCESS)
+		smb_fts_addmsg(smb,msg);	/* failure here isn't fatal, just unindexed */
 	return(i);
 }
 
@@ -1576,7 +1883,11 @@ int SMBCALL smb_init_idx(smb_t* smb, smbmsg_t* msg)
 /****************************************************************************/
 int SMBCALL smb_putmsgidx(smb_t* smb, smbmsg_t* msg)
 {
+	int i;
 	long length;
+	BOOL cached=FALSE;
+	idxrec_t* idx;
+	struct stat st;
 
 	if(smb->sid_fp==NULL) {
 		safe_snprintf(smb->last_error,sizeof(smb->last_error),"index not open");
@@ -1584,6 +1895,8 @@ int SMBCALL smb_putmsgidx(smb_t* smb, smbmsg_t* msg)
 	}
 	clearerr(smb->sid_fp);
 	length = filelength(fileno(smb->sid_fp));
+	if(fstat(fileno(smb->sid_fp),&st)==0 && smb_idx_current(smb,&st))
+		cached=TRUE;
 	if(length < (long)(msg->offset*sizeof(idxrec_t))) {
 		safe_snprintf(smb->last_error,sizeof(smb->last_error)
 			,"invalid index offset: %ld, byte offset: %lu, length: %lu"
@@ -1603,7 +1916,26 @@ int SMBCALL smb_putmsgidx(smb_t* smb, smbmsg_t* msg)
 			,get_errno(),STRERROR(get_errno()));
 		return(SMB_ERR_WRITE);
 	}
-	return fflush(smb->sid_fp);	/* SMB_SUCCESS == 0 */
+	if((i=fflush(smb->sid_fp))!=0)
+		return(i);
+	if(smb->idx_cache!=NULL) {
+		/* Update (or append to) our cached copy, unless the index was modified elsewhere */
+		if(cached && (ulong)msg->offset==smb->idx_cache_total
+			&& (idx=(idxrec_t*)realloc(smb->idx_cache,(smb->idx_cache_total+1)*sizeof(idxrec_t)))!=NULL) {
+			smb->idx_cache=idx;
+			smb->idx_cache_total++;
+			length+=sizeof(idxrec_t);	/* appended (e.g. by smb_addmsg) */
+		}
+		if(cached && (ulong)msg->offset<smb->idx_cache_total
+			&& fstat(fileno(smb->sid_fp),&st)==0 && (long)st.st_size==length) {
+			smb->idx_cache[msg->offset]=msg->idx;
+			smb->idx_cache_length=length;
+			smb->idx_cache_time=st.st_mtime;
+			smb->idx_cache_ntime=smb_idx_ntime(&st);
+		} else
+			smb->idx_cache_length=-1;	/* re-read when next used */
+	}
+	return(SMB_SUCCESS);
 }
 
 /****************************************************************************/
@@ -1739,6 +2071,7 @@ int SMBCALL smb_create(smb_t* smb)
 	chsize(fileno(smb->sdt_fp),0L);
 	rewind(smb->sid_fp);
 	chsize(fileno(smb->sid_fp),0L);
+	smb_freeidx(smb);
 
 	SAFEPRINTF(str,"%s.sda",smb->file);
 	remove(str);						/* if it exists, delete it */
@@ -1748,6 +2081,11 @@ int SMBCALL smb_create(smb_t* smb)
 	remove(str);
 	SAFEPRINTF(str,"%s.hash",smb->file);
 	remove(str);
+	SAFEPRINTF(str,"%s.hix",smb->file);
+	remove(str);
+	SAFEPRINTF(str,"%s.sft",smb->file);
+	if(fexist(str))						/* keep the full-text index enabled */
+		smb_fts_create(smb);
 	smb_unlocksmbhdr(smb);
 	return(SMB_SUCCESS);
 }
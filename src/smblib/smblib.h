@@ -116,6 +116,8 @@ SMBEXPORT int 		SMBCALL smb_unlocksmbhdr(smb_t* smb);
 SMBEXPORT int 		SMBCALL smb_getmsgidx(smb_t* smb, smbmsg_t* msg);
 SMBEXPORT int 		SMBCALL smb_getfirstidx(smb_t* smb, idxrec_t *idx);
 SMBEXPORT int 		SMBCALL smb_getlastidx(smb_t* smb, idxrec_t *idx);
+SMBEXPORT int		SMBCALL smb_loadidx(smb_t* smb);
+SMBEXPORT void		SMBCALL smb_freeidx(smb_t* smb);
 SMBEXPORT ulong		SMBCALL smb_getmsghdrlen(smbmsg_t* msg);
 SMBEXPORT ulong		SMBCALL smb_getmsgdatlen(smbmsg_t* msg);
 SMBEXPORT ulong		SMBCALL smb_getmsgtxtlen(smbmsg_t* msg);
@@ -186,6 +188,7 @@ SMBEXPORT hash_t*	SMBCALL	smb_hashstr(ulong msgnum, uint32_t time, unsigned sour
 
 SMBEXPORT hash_t**	SMBCALL smb_msghashes(smbmsg_t* msg, const uchar* text, long source_mask);
 SMBEXPORT int		SMBCALL smb_addhashes(smb_t* smb, hash_t** hash_list, BOOL skip_marked);
+SMBEXPORT int		SMBCALL smb_indexhashes(smb_t* smb, BOOL rebuild);
 SMBEXPORT uint16_t	SMBCALL smb_name_crc(const char* name);
 SMBEXPORT uint16_t	SMBCALL smb_subject_crc(const char *subj);
 SMBEXPORT void		SMBCALL smb_freehashes(hash_t**);
@@ -230,6 +233,11 @@ SMBEXPORT void		SMBCALL smb_dump_msghdr(FILE* fp, smbmsg_t* msg);
 
 /* smbtxt.c */
 SMBEXPORT char*		SMBCALL smb_getmsgtxt(smb_t* smb, smbmsg_t* msg, ulong mode);
+SMBEXPORT int		SMBCALL smb_fts_create(smb_t* smb);
+SMBEXPORT int		SMBCALL smb_fts_addmsg(smb_t* smb, smbmsg_t* msg);
+SMBEXPORT int		SMBCALL smb_fts_search(smb_t* smb, const char* text, smbfts_t* fts);
+SMBEXPORT BOOL		SMBCALL smb_fts_candidate(smbfts_t* fts, ulong number);
+SMBEXPORT void		SMBCALL smb_fts_free(smbfts_t* fts);
 
 /* smbfile.c */
 SMBEXPORT int 		SMBCALL smb_feof(FILE* fp);
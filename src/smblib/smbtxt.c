@@ -38,6 +38,7 @@
 /* ANSI */
 #include <stdlib.h>	/* malloc/realloc/free */
 #include <string.h>	/* strlen */
+#include <ctype.h>	/* toupper */
 
 /* SMB-specific */
 #include "smblib.h"
@@ -160,3 +161,201 @@ void SMBCALL smb_freemsgtxt(char* buf)
 	if(buf!=NULL)
 		free(buf);
 }
+
+/****************************************************************************/
+/* The full-text search index (.sft) is an optional, append-only file with	*/
+/* one record (ftsrec_t) per message: a Bloom filter of every 3-character	*/
+/* sequence (trigram) in the upper-case, Ctrl-A stripped message text and	*/
+/* subject (as searched by the BBS). A message whose record is missing any	*/
+/* of the search string's trigrams cannot contain it and needn't be read.	*/
+/* Messages without a record are always searched, so the index may safely	*/
+/* lag behind (or be missing from) the message base. The index is only		*/
+/* maintained if it exists (see smb_fts_create).							*/
+/* When a message's text or subject is changed, another record is appended	*/
+/* for it (smb_fts_addmsg): a message is searched if any of its records		*/
+/* match, so older records can only cause unnecessary reads.				*/
+/****************************************************************************/
+#define FTS_HASH(a,b,c)	fts_hash(((uint32_t)(uchar)(a)<<16)|((uint32_t)(uchar)(b)<<8)|(uchar)(c))
+
+static uint32_t fts_hash(uint32_t trigram)
+{
+	uint32_t h=trigram*2654435761U;
+
+	return(((h>>16)^h)%SMB_FTS_BLOOM_BITS);
+}
+
+static void fts_addtext(ftsrec_t* rec, const char* text)
+{
+	size_t		i;
+	uint32_t	bit;
+
+	for(i=0;text[i] && text[i+1] && text[i+2];i++) {
+		bit=FTS_HASH(text[i],text[i+1],text[i+2]);
+		rec->bloom[bit/8]|=(1<<(bit%8));
+	}
+}
+
+/* Same result as strupr() followed by strip_ctrl() */
+static void fts_normalize(char* str)
+{
+	int	i,j;
+
+	strupr(str);
+	for(i=j=0;str[i];i++) {
+		if(str[i]=='\1') {	/* Ctrl-A */
+			i++;
+			if(str[i]==0 || toupper(str[i])=='Z')	/* EOF */
+				break;
+			if(str[i]=='<' && j)
+				j--;
+		}
+		else if((uchar)str[i]>=' ')
+			str[j++]=str[i];
+	}
+	str[j]=0;
+}
+
+static int fts_cmp(const void* v1, const void* v2)
+{
+	uint32_t n1=*(uint32_t*)v1;
+	uint32_t n2=*(uint32_t*)v2;
+
+	if(n1<n2)
+		return(-1);
+	return(n1>n2);
+}
+
+/****************************************************************************/
+/* Creates (or truncates) the full-text search index, enabling it			*/
+/****************************************************************************/
+int SMBCALL smb_fts_create(smb_t* smb)
+{
+	char	path[MAX_PATH+1];
+	int		file;
+
+	SAFEPRINTF(path,"%s.sft",smb->file);
+	if((file=sopen(path,O_WRONLY|O_CREAT|O_TRUNC|O_BINARY,SH_DENYNO,S_IREAD|S_IWRITE))==-1) {
+		safe_snprintf(smb->last_error,sizeof(smb->last_error)
+			,"%d '%s' creating %s"
+			,get_errno(),STRERROR(get_errno()),path);
+		return(SMB_ERR_OPEN);
+	}
+	close(file);
+	return(SMB_SUCCESS);
+}
+
+/****************************************************************************/
+/* Adds the text of a stored message to the full-text search index, if the	*/
+/* index exists (otherwise does nothing)									*/
+/****************************************************************************/
+int SMBCALL smb_fts_addmsg(smb_t* smb, smbmsg_t* msg)
+{
+	char		path[MAX_PATH+1];
+	char		subj[128];
+	char*		buf;
+	int			file;
+	int			retval=SMB_SUCCESS;
+	ftsrec_t	rec;
+
+	SAFEPRINTF(path,"%s.sft",smb->file);
+	if((file=sopen(path,O_WRONLY|O_APPEND|O_BINARY,SH_DENYNO))==-1)
+		return(SMB_SUCCESS);	/* not indexed */
+
+	memset(&rec,0,sizeof(rec));
+	rec.number=msg->hdr.number;
+	if((buf=smb_getmsgtxt(smb,msg,GETMSGTXT_ALL))!=NULL) {
+		fts_normalize(buf);
+		fts_addtext(&rec,buf);
+		free(buf);
+	}
+	if(msg->subj!=NULL) {
+		SAFECOPY(subj,msg->subj);
+		strupr(subj);
+		fts_addtext(&rec,subj);
+	}
+	if(write(file,&rec,sizeof(rec))!=sizeof(rec)) {
+		safe_snprintf(smb->last_error,sizeof(smb->last_error)
+			,"%d '%s' writing %s"
+			,get_errno(),STRERROR(get_errno()),path);
+		retval=SMB_ERR_WRITE;
+	}
+	close(file);
+	return(retval);
+}
+
+/****************************************************************************/
+/* Looks up the (upper-case) 'text' in the full-text search index			*/
+/* On success, use smb_fts_candidate() to determine if a message may		*/
+/* contain the text and smb_fts_free() when done							*/
+/* If there is no index, every message is a candidate						*/
+/****************************************************************************/
+int SMBCALL smb_fts_search(smb_t* smb, const char* text, smbfts_t* fts)
+{
+	char		path[MAX_PATH+1];
+	size_t		i;
+	uint32_t	max=0;
+	uint32_t*	np;
+	FILE*		fp;
+	ftsrec_t	query;
+	ftsrec_t	rec;
+
+	memset(fts,0,sizeof(smbfts_t));
+	SAFEPRINTF(path,"%s.sft",smb->file);
+	if((fp=fopen(path,"rb"))==NULL) {
+		safe_snprintf(smb->last_error,sizeof(smb->last_error)
+			,"%d '%s' opening %s"
+			,get_errno(),STRERROR(get_errno()),path);
+		return(SMB_ERR_OPEN);
+	}
+	setvbuf(fp,NULL,_IOFBF,256*sizeof(rec));
+
+	memset(&query,0,sizeof(query));
+	fts_addtext(&query,text);
+
+	while(fread(&rec,sizeof(rec),1,fp)==1) {
+		if(fts->total>=max) {
+			max=max ? max*2 : 1024;
+			if((np=(uint32_t*)realloc(fts->indexed,max*sizeof(uint32_t)))==NULL)
+				break;
+			fts->indexed=np;
+			if((np=(uint32_t*)realloc(fts->match,max*sizeof(uint32_t)))==NULL)
+				break;
+			fts->match=np;
+		}
+		fts->indexed[fts->total++]=rec.number;
+		for(i=0;i<sizeof(rec.bloom);i++)
+			if((query.bloom[i]&rec.bloom[i])!=query.bloom[i])
+				break;
+		if(i>=sizeof(rec.bloom))
+			fts->match[fts->matches++]=rec.number;
+	}
+	fclose(fp);
+
+	if(fts->total)
+		qsort(fts->indexed,fts->total,sizeof(uint32_t),fts_cmp);
+	if(fts->matches)
+		qsort(fts->match,fts->matches,sizeof(uint32_t),fts_cmp);
+	return(SMB_SUCCESS);
+}
+
+/****************************************************************************/
+/* Returns TRUE if the message may contain the text searched for			*/
+/****************************************************************************/
+BOOL SMBCALL smb_fts_candidate(smbfts_t* fts, ulong number)
+{
+	uint32_t	key=number;
+
+	if(fts->total==0
+		|| bsearch(&key,fts->indexed,fts->total,sizeof(uint32_t),fts_cmp)==NULL)
+		return(TRUE);	/* not indexed */
+	return(fts->matches
+		&& bsearch(&key,fts->match,fts->matches,sizeof(uint32_t),fts_cmp)!=NULL);
+}
+
+void SMBCALL smb_fts_free(smbfts_t* fts)
+{
+	FREE_AND_NULL(fts->indexed);
+	FREE_AND_NULL(fts->match);
+	fts->total=0;
+	fts->matches=0;
+}
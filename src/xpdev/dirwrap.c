@@ -530,6 +530,153 @@ BOOL DLLCALL fexist(const char *filespec)
 #endif
 }
 
+#if !defined(_WIN32)
+
+/****************************************************************************/
+/* Case-insensitive file name look-up cache for fexistcase(): the names of	*/
+/* the files in the most recently searched directories, re-read whenever a	*/
+/* directory's modification time changes (or is too recent to be trusted),	*/
+/* so that probing for a file that doesn't exist (in any case) costs one	*/
+/* stat() rather than a glob() of the entire directory.						*/
+/****************************************************************************/
+#define DIRCASE_CACHE_SIZE	32
+
+typedef struct {
+	BOOL	valid;
+	char	path[MAX_PATH+1];	/* Directory, as specified (may be blank) */
+	time_t	mtime;				/* Modification time of directory when read */
+	time_t	loaded;				/* Time directory was read */
+	ulong	used;				/* For least-recently-used replacement */
+	size_t	count;
+	char**	name;				/* File names, sorted case-insensitively */
+} dircase_t;
+
+static dircase_t	dircase_cache[DIRCASE_CACHE_SIZE];
+static ulong		dircase_used;
+#if defined(XPDEV_THREAD_SAFE)
+static pthread_mutex_t	dircase_mutex=PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static int dircase_compare(const void* arg1, const void* arg2)
+{
+	int	i;
+
+	if((i=stricmp(*(char**)arg1,*(char**)arg2))!=0)
+		return(i);
+	return(strcmp(*(char**)arg1,*(char**)arg2));
+}
+
+static int dircase_search(const void* key, const void* arg)
+{
+	return(stricmp((char*)key,*(char**)arg));
+}
+
+static void dircase_free(dircase_t* dc)
+{
+	size_t	i;
+
+	for(i=0;i<dc->count;i++)
+		free(dc->name[i]);
+	FREE_AND_NULL(dc->name);
+	dc->count=0;
+	dc->valid=FALSE;
+}
+
+static BOOL dircase_read(dircase_t* dc, const char* dir, time_t mtime)
+{
+	char	path[MAX_PATH+1];
+	char**	np;
+	size_t	max=0;
+	DIR*	dirp;
+	struct dirent* de;
+
+	dircase_free(dc);
+	if((dirp=opendir(*dir ? dir : "."))==NULL)
+		return(FALSE);
+	while((de=readdir(dirp))!=NULL) {
+#if defined(DT_DIR)
+		/* Only stat() the entries readdir() doesn't know the type of */
+		if(de->d_type==DT_DIR)
+			continue;
+		if(de->d_type==DT_UNKNOWN || de->d_type==DT_LNK)
+#endif
+		{
+			SAFEPRINTF2(path,"%s%s",dir,de->d_name);
+			if(isdir(path))
+				continue;
+		}
+		if(dc->count>=max) {
+			max=max ? max*2 : 64;
+			if((np=(char**)realloc(dc->name,max*sizeof(char*)))==NULL)
+				break;
+			dc->name=np;
+		}
+		if((dc->name[dc->count]=strdup(de->d_name))==NULL)
+			break;
+		dc->count++;
+	}
+	if(de!=NULL) {	/* out of memory */
+		closedir(dirp);
+		dircase_free(dc);
+		return(FALSE);
+	}
+	closedir(dirp);
+	if(dc->count)
+		qsort(dc->name,dc->count,sizeof(char*),dircase_compare);
+	SAFECOPY(dc->path,dir);
+	dc->mtime=mtime;
+	dc->loaded=time(NULL);
+	dc->valid=TRUE;
+	return(TRUE);
+}
+
+/* Returns 1 if found (and corrects the case of fname), 0 if not found,		*/
+/* or -1 if the directory could not be read								*/
+static int dircase_find(const char* dir, char* fname)
+{
+	int			i;
+	int			retval=0;
+	char**		np;
+	dircase_t*	dc=NULL;
+	struct stat	st;
+
+	if(stat(*dir ? dir : ".",&st)!=0)
+		return(0);
+
+#if defined(XPDEV_THREAD_SAFE)
+	pthread_mutex_lock(&dircase_mutex);
+#endif
+	for(i=0;i<DIRCASE_CACHE_SIZE;i++) {
+		if(dircase_cache[i].valid && strcmp(dircase_cache[i].path,dir)==0) {
+			dc=&dircase_cache[i];
+			break;
+		}
+		if(dc==NULL || dircase_cache[i].used<dc->used)
+			dc=&dircase_cache[i];	/* least-recently used */
+	}
+	/* A directory modified in the second it was read may have changed since */
+	if(!dc->valid || strcmp(dc->path,dir)!=0
+		|| dc->mtime!=st.st_mtime || dc->loaded<=dc->mtime+1) {
+		if(!dircase_read(dc,dir,st.st_mtime))
+			retval=-1;
+	}
+	if(retval==0) {
+		dc->used=++dircase_used;
+		if((np=(char**)bsearch(fname,dc->name,dc->count,sizeof(char*),dircase_search))!=NULL) {
+			while(np>dc->name && stricmp(fname,*(np-1))==0)
+				np--;	/* first match, as glob() would find */
+			strcpy(fname,*np);
+			retval=1;
+		}
+	}
+#if defined(XPDEV_THREAD_SAFE)
+	pthread_mutex_unlock(&dircase_mutex);
+#endif
+	return(retval);
+}
+
+#endif /* !_WIN32 */
+
 /****************************************************************************/
 /* Fixes upper/lowercase filename for Unix file systems						*/
 /****************************************************************************/
@@ -569,8 +716,18 @@ BOOL DLLCALL fexistcase(char *path)
 	if(path[0]==0)		/* work around glibc bug 574274 */
 		return FALSE;
 
-	if(!strchr(path,'*') && !strchr(path,'?') && fnameexist(path))
-		return(TRUE);
+	if(!strchr(path,'*') && !strchr(path,'?')) {
+		if(fnameexist(path))
+			return(TRUE);
+		p=getfname(path);
+		SAFECOPY(fname,p);
+		sprintf(globme,"%.*s",(int)(p-path),path);
+		if((i=dircase_find(globme,fname))>=0) {
+			if(i)
+				strcpy(p,fname);
+			return(i);
+		}
+	}
 
 	SAFECOPY(globme,path);
 	p=getfname(globme);
@@ -44,6 +44,9 @@
 #if defined(_WIN32)
  #include <malloc.h>	/* alloca() on Win32 */
 #endif
+#if defined(__linux__)
+ #include <sys/sendfile.h>	/* sendfile() */
+#endif
 
 #include "genwrap.h"	/* SLEEP */
 #include "gen_defs.h"	/* BOOL/LOG_WARNING */
@@ -191,6 +194,34 @@ int sendfilesocket(int sock, int file, off_t *offset, off_t count)
 	}
 	if(i==0)
 		return((int)count);
+#elif defined(__linux__)
+	{
+		off_t	pos=tell(file);
+		ssize_t	sent;
+
+		while(total<count) {
+			sent=sendfile(sock,file,&pos,(size_t)(count-total));
+			if(sent>0) {
+				total+=(int)sent;
+				continue;
+			}
+			if(sent==0)	/* EOF */
+				break;
+			if(errno==EAGAIN) {
+				SLEEP(1);
+				continue;
+			}
+			if(total==0 && (errno==EINVAL || errno==ENOSYS))
+				break;	/* Not supported for this file/socket, use read/send below */
+			return(-1);
+		}
+		if(total || count==0) {
+			lseek(file,pos,SEEK_SET);
+			if(offset!=NULL)
+				(*offset)+=total;
+			return(total);
+		}
+	}
 #endif
 
 	if(count<0) {
@@ -386,3 +417,71 @@ int nonblocking_connect(SOCKET sock, struct sockaddr* addr, size_t size, unsigne
 	}
 	return result;
 }
+
+/* Returns a pointer to (and *avail, the size of) the free space at the end of the buffer */
+/* Received data is appended there by the caller (then increment the len member) */
+char* sockbuf_space(sockbuf_t* b, size_t* avail)
+{
+	size_t	pending=sockbuf_pending(b);
+
+	if(b->pos) {
+		if(pending)
+			memmove(b->data,b->data+b->pos,pending);
+		b->pos=0;
+		b->len=pending;
+	}
+	*avail=sizeof(b->data)-b->len;
+	return(b->data+b->len);
+}
+
+/* Appends whatever is available (up to the free space) from sock to the buffer */
+/* Returns the result of recv() */
+int sockbuf_recv(sockbuf_t* b, SOCKET sock)
+{
+	int		rd;
+	size_t	avail;
+	char*	p;
+
+	p=sockbuf_space(b,&avail);
+	if(avail==0)
+		return(0);
+	rd=recv(sock,p,avail,0);
+	if(rd>0)
+		b->len+=rd;
+	return(rd);
+}
+
+/* Copies (and unless peek is TRUE, consumes) up to len bytes of previously received data */
+size_t sockbuf_read(sockbuf_t* b, void* buf, size_t len, BOOL peek)
+{
+	size_t	pending=sockbuf_pending(b);
+
+	if(len>pending)
+		len=pending;
+	memcpy(buf,b->data+b->pos,len);
+	if(!peek)
+		b->pos+=len;
+	return(len);
+}
+
+/* Moves received data, up to the next line-feed, to line+*linelen (up to maxlen total bytes) */
+/* Returns TRUE if the line-feed was found (and consumed, but not copied to line) */
+/* Returns FALSE if more data must be received or the line is full (*linelen==maxlen) */
+BOOL sockbuf_getline(sockbuf_t* b, char* line, size_t* linelen, size_t maxlen)
+{
+	char*	p=b->data+b->pos;
+	char*	lf;
+	size_t	len=sockbuf_pending(b);
+
+	if(len>maxlen-*linelen)
+		len=maxlen-*linelen;
+	if((lf=memchr(p,'\n',len))!=NULL)
+		len=lf-p;
+	memcpy(line+*linelen,p,len);
+	*linelen+=len;
+	b->pos+=len;
+	if(lf==NULL)
+		return(FALSE);
+	b->pos++;	/* skip the line-feed */
+	return(TRUE);
+}
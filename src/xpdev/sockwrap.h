@@ -178,6 +178,18 @@ static  int wsa_error;
 
 #endif	/* __unix__ */
 
+/* User-space receive buffer, for line-oriented (e.g. CRLF-terminated) protocols */
+#define SOCKBUF_SIZE	4096
+
+typedef struct {
+	size_t	pos;					/* Offset of next byte to be consumed */
+	size_t	len;					/* Offset past last byte received */
+	char	data[SOCKBUF_SIZE];
+} sockbuf_t;
+
+#define sockbuf_init(b)		((b)->pos=(b)->len=0)
+#define sockbuf_pending(b)	((b)->len-(b)->pos)	/* Bytes received but not yet consumed */
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -194,6 +206,11 @@ int 	retry_bind(SOCKET s, const struct sockaddr *addr, socklen_t addrlen
 				   ,int (*lprintf)(int level, const char *fmt, ...));
 int		nonblocking_connect(SOCKET, struct sockaddr*, size_t, unsigned timeout /* seconds */);
 
+char*	sockbuf_space(sockbuf_t*, size_t* avail);
+int		sockbuf_recv(sockbuf_t*, SOCKET);
+size_t	sockbuf_read(sockbuf_t*, void* buf, size_t len, BOOL peek);
+BOOL	sockbuf_getline(sockbuf_t*, char* line, size_t* linelen, size_t maxlen);
+
 #ifdef __cplusplus
 }
 #endif
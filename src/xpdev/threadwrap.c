@@ -187,6 +187,31 @@ int pthread_mutex_destroy(pthread_mutex_t* mutex)
 #endif
 }
 
+/* States of a pthread_once_t */
+#define ONCE_INIT_PENDING	0
+#define ONCE_INIT_RUNNING	1
+#define ONCE_INIT_DONE		2
+
+int pthread_once(pthread_once_t* once, void (*init_routine)(void))
+{
+#if defined(_WIN32)
+	if(InterlockedCompareExchange(once, ONCE_INIT_RUNNING, ONCE_INIT_PENDING)==ONCE_INIT_PENDING) {
+		init_routine();
+		InterlockedExchange(once, ONCE_INIT_DONE);
+	} else {
+		while(InterlockedCompareExchange(once, ONCE_INIT_DONE, ONCE_INIT_DONE)!=ONCE_INIT_DONE)
+			Sleep(1);
+	}
+#else
+	if(*once==ONCE_INIT_PENDING) {
+		*once=ONCE_INIT_RUNNING;
+		init_routine();
+		*once=ONCE_INIT_DONE;
+	}
+#endif
+	return 0;
+}
+
 #endif	/* POSIX thread mutexes */
 
 /************************************************************************/
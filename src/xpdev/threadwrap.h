@@ -121,6 +121,12 @@ int pthread_mutex_trylock(pthread_mutex_t*);
 int pthread_mutex_unlock(pthread_mutex_t*);
 int pthread_mutex_destroy(pthread_mutex_t*);
 
+/* One-time initialization (e.g. of a static mutex, which can't be		*/
+/* statically initialized when it's a Win32 Critical Section)			*/
+typedef long pthread_once_t;
+#define PTHREAD_ONCE_INIT	0
+int pthread_once(pthread_once_t*, void (*init_routine)(void));
+
 #define SetThreadName(c)
 
 #endif
@@ -59,7 +59,7 @@ struct xpmapping *xpmap(const char *filename, enum xpmap_type type)
 	switch(type) {
 		case XPMAP_READ:
 			oflags=O_RDONLY;
-			mflags=0;
+			mflags=MAP_SHARED;
 			mprot=PROT_READ;
 			break;
 		case XPMAP_WRITE: